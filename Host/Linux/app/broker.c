@@ -0,0 +1,445 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "broker.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BROKER_STACK_SIZE   4096
+#define BROKER_PRIORITY     4
+#define BROKER_WINDOW_SIZE  8192
+#define BROKER_RX_SIZE      2048
+#define BROKER_POLL_TICKS   (TX_TIMER_TICKS_PER_SECOND / 10)
+#define BROKER_SEND_TIMEOUT (5 * TX_TIMER_TICKS_PER_SECOND)
+
+// A disconnect that is not acknowledged in time is reset, the socket is closed either way before it is unaccepted
+#define BROKER_DISCONNECT_TIMEOUT TX_TIMER_TICKS_PER_SECOND
+
+// MQTT control packet types, upper nibble of the fixed header
+#define MQTT_CONNECT     1
+#define MQTT_CONNACK     2
+#define MQTT_PUBLISH     3
+#define MQTT_PUBACK      4
+#define MQTT_SUBSCRIBE   8
+#define MQTT_SUBACK      9
+#define MQTT_UNSUBSCRIBE 10
+#define MQTT_UNSUBACK    11
+#define MQTT_PINGREQ     12
+#define MQTT_PINGRESP    13
+#define MQTT_DISCONNECT  14
+
+// Internal request from broker_drop, kept apart from the scenario events
+#define BROKER_REQUEST_DROP 0x01
+
+static NX_IP* broker_ip;
+static NX_PACKET_POOL* broker_pool;
+static UINT broker_port;
+
+static TX_THREAD broker_thread;
+static ULONG broker_thread_stack[BROKER_STACK_SIZE / sizeof(ULONG)];
+static TX_EVENT_FLAGS_GROUP broker_events;
+static TX_EVENT_FLAGS_GROUP broker_requests;
+static TX_MUTEX broker_mutex;
+
+static NX_TCP_SOCKET broker_socket;
+static volatile bool broker_connected = false;
+
+static UCHAR broker_rx[BROKER_RX_SIZE];
+static ULONG broker_rx_length;
+
+static broker_stats_t broker_counters;
+
+static UINT broker_send(const UCHAR* data, UINT length)
+{
+    UINT status;
+    NX_PACKET* packet;
+
+    if (!broker_connected)
+    {
+        return NX_NOT_CONNECTED;
+    }
+
+    if ((status = nx_packet_allocate(broker_pool, &packet, NX_TCP_PACKET, BROKER_SEND_TIMEOUT)))
+    {
+        printf("Broker: no packet to send (0x%08x)\r\n", status);
+    }
+    else if ((status = nx_packet_data_append(packet, (VOID*)data, length, broker_pool, BROKER_SEND_TIMEOUT)) ||
+             (status = nx_tcp_socket_send(&broker_socket, packet, BROKER_SEND_TIMEOUT)))
+    {
+        printf("Broker: send failed (0x%08x)\r\n", status);
+        nx_packet_release(packet);
+    }
+
+    return status;
+}
+
+static VOID broker_record(ULONG event)
+{
+    tx_mutex_get(&broker_mutex, TX_WAIT_FOREVER);
+    switch (event)
+    {
+        case BROKER_EVENT_CONNECT:
+            broker_counters.connects++;
+            break;
+        case BROKER_EVENT_SUBSCRIBE:
+            broker_counters.subscribes++;
+            break;
+        case BROKER_EVENT_PUBLISH:
+            broker_counters.publishes++;
+            break;
+        case BROKER_EVENT_PING:
+            broker_counters.pings++;
+            break;
+        case BROKER_EVENT_DISCONNECT:
+            broker_counters.disconnects++;
+            break;
+    }
+    tx_mutex_put(&broker_mutex);
+
+    tx_event_flags_set(&broker_events, event, TX_OR);
+}
+
+static VOID broker_handle_publish(UCHAR flags, const UCHAR* body, ULONG length)
+{
+    UINT qos = (flags >> 1) & 0x03;
+    ULONG topic_length;
+    ULONG offset;
+
+    if (length < 2)
+    {
+        return;
+    }
+
+    topic_length = ((ULONG)body[0] << 8) | body[1];
+    offset       = 2 + topic_length + (qos ? 2 : 0);
+    if (offset > length)
+    {
+        return;
+    }
+
+    tx_mutex_get(&broker_mutex, TX_WAIT_FOREVER);
+    snprintf(broker_counters.last_topic, BROKER_TOPIC_SIZE, "%.*s", (int)topic_length, (const CHAR*)&body[2]);
+    snprintf(broker_counters.last_payload,
+        BROKER_PAYLOAD_SIZE,
+        "%.*s",
+        (int)(length - offset),
+        (const CHAR*)&body[offset]);
+    tx_mutex_put(&broker_mutex);
+
+    if (qos == 1)
+    {
+        const UCHAR puback[] = {MQTT_PUBACK << 4, 2, body[2 + topic_length], body[3 + topic_length]};
+        broker_send(puback, sizeof(puback));
+    }
+
+    broker_record(BROKER_EVENT_PUBLISH);
+}
+
+static VOID broker_handle_subscribe(const UCHAR* body, ULONG length)
+{
+    UCHAR suback[2 + 2 + 32];
+    UINT count = 0;
+    ULONG offset;
+
+    if (length < 2)
+    {
+        return;
+    }
+
+    // Grant every filter at the requested QoS, capped at 1
+    for (offset = 2; offset + 2 < length && count < 32; count++)
+    {
+        ULONG filter_length = ((ULONG)body[offset] << 8) | body[offset + 1];
+        UCHAR requested;
+
+        offset += 2 + filter_length;
+        if (offset >= length)
+        {
+            break;
+        }
+        requested         = body[offset++] & 0x03;
+        suback[4 + count] = requested > 1 ? 1 : requested;
+    }
+
+    suback[0] = MQTT_SUBACK << 4;
+    suback[1] = (UCHAR)(2 + count);
+    suback[2] = body[0];
+    suback[3] = body[1];
+    broker_send(suback, 4 + count);
+
+    broker_record(BROKER_EVENT_SUBSCRIBE);
+}
+
+// Handle every complete control packet in the receive buffer, returns false when the client is to be dropped
+static bool broker_process(void)
+{
+    while (broker_rx_length >= 2)
+    {
+        ULONG remaining  = 0;
+        ULONG multiplier = 1;
+        ULONG header     = 1;
+        UCHAR type       = broker_rx[0] >> 4;
+        UCHAR digit;
+
+        // Remaining length, up to 4 bytes of 7 bit digits
+        do
+        {
+            if (header >= broker_rx_length)
+            {
+                return true;
+            }
+            if (header > 4)
+            {
+                printf("Broker: malformed remaining length\r\n");
+                return false;
+            }
+            digit = broker_rx[header++];
+            remaining += (digit & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while (digit & 0x80);
+
+        if (header + remaining > BROKER_RX_SIZE)
+        {
+            printf("Broker: packet of %lu bytes is too large\r\n", (unsigned long)remaining);
+            return false;
+        }
+        if (header + remaining > broker_rx_length)
+        {
+            return true;
+        }
+
+        switch (type)
+        {
+            case MQTT_CONNECT:
+            {
+                const UCHAR connack[] = {MQTT_CONNACK << 4, 2, 0, 0};
+                broker_send(connack, sizeof(connack));
+                broker_record(BROKER_EVENT_CONNECT);
+                break;
+            }
+
+            case MQTT_PUBLISH:
+                broker_handle_publish(broker_rx[0] & 0x0F, &broker_rx[header], remaining);
+                break;
+
+            case MQTT_SUBSCRIBE:
+                broker_handle_subscribe(&broker_rx[header], remaining);
+                break;
+
+            case MQTT_UNSUBSCRIBE:
+                if (remaining >= 2)
+                {
+                    const UCHAR unsuback[] = {MQTT_UNSUBACK << 4, 2, broker_rx[header], broker_rx[header + 1]};
+                    broker_send(unsuback, sizeof(unsuback));
+                }
+                break;
+
+            case MQTT_PINGREQ:
+            {
+                const UCHAR pingresp[] = {MQTT_PINGRESP << 4, 0};
+                broker_send(pingresp, sizeof(pingresp));
+                broker_record(BROKER_EVENT_PING);
+                break;
+            }
+
+            case MQTT_DISCONNECT:
+                broker_record(BROKER_EVENT_DISCONNECT);
+                return false;
+
+            default:
+                // PUBACK for our QoS 0 publishes cannot happen, anything else is ignored
+                break;
+        }
+
+        broker_rx_length -= header + remaining;
+        memmove(broker_rx, &broker_rx[header + remaining], broker_rx_length);
+    }
+
+    return true;
+}
+
+static VOID broker_serve(void)
+{
+    UINT status;
+    NX_PACKET* packet;
+    ULONG requests;
+    ULONG copied;
+
+    broker_rx_length = 0;
+    broker_connected = true;
+
+    while (true)
+    {
+        if (tx_event_flags_get(&broker_requests, BROKER_REQUEST_DROP, TX_OR_CLEAR, &requests, TX_NO_WAIT) ==
+            TX_SUCCESS)
+        {
+            printf("Broker: dropping the client\r\n");
+            break;
+        }
+
+        status = nx_tcp_socket_receive(&broker_socket, &packet, BROKER_POLL_TICKS);
+        if (status == NX_NO_PACKET)
+        {
+            continue;
+        }
+        else if (status)
+        {
+            printf("Broker: client closed the connection (0x%08x)\r\n", status);
+            break;
+        }
+
+        // The extract stops at the end of the buffer without an error, a short copy is the overflow
+        status = nx_packet_data_extract_offset(
+            packet, 0, &broker_rx[broker_rx_length], BROKER_RX_SIZE - broker_rx_length, &copied);
+        if (status == NX_SUCCESS && copied < packet->nx_packet_length)
+        {
+            status = NX_OVERFLOW;
+        }
+        nx_packet_release(packet);
+        if (status)
+        {
+            printf("Broker: receive buffer overflow\r\n");
+            break;
+        }
+        broker_rx_length += copied;
+
+        if (!broker_process())
+        {
+            break;
+        }
+    }
+
+    broker_connected = false;
+}
+
+static VOID broker_thread_entry(ULONG parameter)
+{
+    UINT status;
+
+    while (true)
+    {
+        if ((status = nx_tcp_server_socket_accept(&broker_socket, NX_WAIT_FOREVER)))
+        {
+            printf("Broker: accept failed (0x%08x)\r\n", status);
+        }
+        else
+        {
+            broker_serve();
+            nx_tcp_socket_disconnect(&broker_socket, BROKER_DISCONNECT_TIMEOUT);
+        }
+
+        nx_tcp_server_socket_unaccept(&broker_socket);
+        if ((status = nx_tcp_server_socket_relisten(broker_ip, broker_port, &broker_socket)) &&
+            status != NX_CONNECTION_PENDING)
+        {
+            printf("Broker: relisten failed (0x%08x)\r\n", status);
+            return;
+        }
+    }
+}
+
+UINT broker_init(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, UINT port)
+{
+    UINT status;
+
+    broker_ip   = ip_ptr;
+    broker_pool = pool_ptr;
+    broker_port = port;
+    memset(&broker_counters, 0, sizeof(broker_counters));
+
+    if ((status = tx_event_flags_create(&broker_events, "Broker Events")))
+    {
+        printf("ERROR: Broker event flags (0x%08x)\r\n", status);
+    }
+    else if ((status = tx_event_flags_create(&broker_requests, "Broker Requests")))
+    {
+        printf("ERROR: Broker request flags (0x%08x)\r\n", status);
+    }
+    else if ((status = tx_mutex_create(&broker_mutex, "Broker", TX_NO_INHERIT)))
+    {
+        printf("ERROR: Broker mutex (0x%08x)\r\n", status);
+    }
+    else if ((status = nx_tcp_socket_create(ip_ptr,
+                  &broker_socket,
+                  "Broker",
+                  NX_IP_NORMAL,
+                  NX_FRAGMENT_OKAY,
+                  NX_IP_TIME_TO_LIVE,
+                  BROKER_WINDOW_SIZE,
+                  NX_NULL,
+                  NX_NULL)))
+    {
+        printf("ERROR: Broker socket (0x%08x)\r\n", status);
+    }
+    else if ((status = nx_tcp_server_socket_listen(ip_ptr, port, &broker_socket, 1, NX_NULL)))
+    {
+        printf("ERROR: Broker listen on port %u (0x%08x)\r\n", port, status);
+    }
+    else if ((status = tx_thread_create(&broker_thread,
+                  "Broker",
+                  broker_thread_entry,
+                  0,
+                  broker_thread_stack,
+                  BROKER_STACK_SIZE,
+                  BROKER_PRIORITY,
+                  BROKER_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: Broker thread (0x%08x)\r\n", status);
+    }
+
+    return status;
+}
+
+UINT broker_wait(ULONG events, ULONG wait_option)
+{
+    ULONG actual;
+
+    return tx_event_flags_get(&broker_events, events, TX_OR_CLEAR, &actual, wait_option);
+}
+
+UINT broker_publish(const CHAR* topic, const CHAR* payload)
+{
+    UCHAR message[4 + 2 + BROKER_TOPIC_SIZE + BROKER_PAYLOAD_SIZE];
+    UINT topic_length   = strlen(topic);
+    UINT payload_length = strlen(payload);
+    UINT remaining      = 2 + topic_length + payload_length;
+    UINT length         = 0;
+
+    if (topic_length >= BROKER_TOPIC_SIZE || payload_length >= BROKER_PAYLOAD_SIZE)
+    {
+        return NX_INVALID_PARAMETERS;
+    }
+
+    message[length++] = MQTT_PUBLISH << 4;
+    do
+    {
+        UCHAR digit = remaining % 128;
+        remaining /= 128;
+        message[length++] = digit | (remaining ? 0x80 : 0);
+    } while (remaining);
+
+    message[length++] = (UCHAR)(topic_length >> 8);
+    message[length++] = (UCHAR)topic_length;
+    memcpy(&message[length], topic, topic_length);
+    length += topic_length;
+    memcpy(&message[length], payload, payload_length);
+    length += payload_length;
+
+    return broker_send(message, length);
+}
+
+VOID broker_drop(void)
+{
+    tx_event_flags_set(&broker_requests, BROKER_REQUEST_DROP, TX_OR);
+}
+
+VOID broker_stats(broker_stats_t* stats)
+{
+    tx_mutex_get(&broker_mutex, TX_WAIT_FOREVER);
+    *stats = broker_counters;
+    tx_mutex_put(&broker_mutex);
+}
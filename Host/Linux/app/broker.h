@@ -0,0 +1,70 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _BROKER_H
+#define _BROKER_H
+
+#include "tx_api.h"
+#include "nx_api.h"
+
+// Events raised for each control packet the broker handles
+#define BROKER_EVENT_CONNECT    0x01
+#define BROKER_EVENT_SUBSCRIBE  0x02
+#define BROKER_EVENT_PUBLISH    0x04
+#define BROKER_EVENT_PING       0x08
+#define BROKER_EVENT_DISCONNECT 0x10
+
+#define BROKER_TOPIC_SIZE   64
+#define BROKER_PAYLOAD_SIZE 512
+
+typedef struct
+{
+    UINT connects;
+    UINT subscribes;
+    UINT publishes;
+    UINT pings;
+    UINT disconnects;
+    CHAR last_topic[BROKER_TOPIC_SIZE];
+    CHAR last_payload[BROKER_PAYLOAD_SIZE];
+} broker_stats_t;
+
+/**
+ * @brief Start a scripted MQTT 3.1.1 broker on the given IP instance
+ *
+ * Accepts one client at a time and answers CONNECT, SUBSCRIBE, PUBLISH (QoS 0 and 1), PINGREQ and DISCONNECT.
+ * Nothing is routed between clients, publishes are recorded for the scenarios.
+ *
+ * @param ip_ptr IP instance to listen on
+ * @param pool_ptr Pool for outgoing packets
+ * @param port TCP port to listen on
+ * @return TX_SUCCESS or an error code
+ */
+UINT broker_init(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, UINT port);
+
+/**
+ * @brief Wait for any of the given events, clearing the ones received
+ * @param events Mask of BROKER_EVENT_* values
+ * @param wait_option Ticks to wait
+ * @return TX_SUCCESS or TX_NO_EVENTS on timeout
+ */
+UINT broker_wait(ULONG events, ULONG wait_option);
+
+/**
+ * @brief Publish a QoS 0 message to the connected client
+ * @param topic Topic name
+ * @param payload Null terminated payload
+ * @return NX_SUCCESS or an error code
+ */
+UINT broker_publish(const CHAR* topic, const CHAR* payload);
+
+/**
+ * @brief Drop the connection to the client without a DISCONNECT
+ */
+VOID broker_drop(void);
+
+/**
+ * @brief Get a copy of the broker counters
+ */
+VOID broker_stats(broker_stats_t* stats);
+
+#endif // _BROKER_H
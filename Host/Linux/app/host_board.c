@@ -0,0 +1,215 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "host_board.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "azure_config.h"
+#include "config_manager.h"
+#include "config_schema.h"
+#include "dps_cache.h"
+#include "screen.h"
+#include "sensor.h"
+#include "sys_monitor.h"
+#include "watchdog.h"
+
+#define HOST_LED_PIN GPIO_PIN_13
+
+GPIO_TypeDef host_gpioc;
+
+static volatile bool host_reset = false;
+static device_config_t host_candidate;
+static UINT host_staged = 0;
+
+// DPS cache storage, RAM in place of the board's non volatile storage
+static UCHAR host_dps_cache[sizeof(dps_cache_record_t)];
+
+// Sensor values drift slowly with uptime so consecutive telemetry differs
+static float host_sensor_wave(float base, float span)
+{
+    ULONG phase = tx_time_get() % (60 * TX_TIMER_TICKS_PER_SECOND);
+    float ramp  = (float)phase / (float)(60 * TX_TIMER_TICKS_PER_SECOND);
+
+    return base + span * (ramp < 0.5f ? ramp : 1.0f - ramp);
+}
+
+hts221_data_t hts221_data_read(void)
+{
+    hts221_data_t data = {
+        .humidity_perc    = host_sensor_wave(40.0f, 10.0f),
+        .temperature_degC = host_sensor_wave(21.0f, 4.0f),
+    };
+
+    return data;
+}
+
+lps22hb_t lps22hb_data_read(void)
+{
+    lps22hb_t data = {
+        .pressure_hPa     = host_sensor_wave(1010.0f, 6.0f),
+        .temperature_degC = host_sensor_wave(21.0f, 4.0f),
+    };
+
+    return data;
+}
+
+lsm6dsl_data_t lsm6dsl_data_read(void)
+{
+    lsm6dsl_data_t data = {
+        .acceleration_mg   = {host_sensor_wave(-20.0f, 40.0f), host_sensor_wave(-20.0f, 40.0f), 1000.0f},
+        .angular_rate_mdps = {host_sensor_wave(-500.0f, 1000.0f), 0.0f, 0.0f},
+        .temperature_degC  = host_sensor_wave(21.0f, 4.0f),
+    };
+
+    return data;
+}
+
+lis2mdl_data_t lis2mdl_data_read(void)
+{
+    lis2mdl_data_t data = {
+        .magnetic_mG      = {host_sensor_wave(200.0f, 50.0f), -100.0f, 400.0f},
+        .temperature_degC = host_sensor_wave(21.0f, 4.0f),
+    };
+
+    return data;
+}
+
+void screen_print(char* str, LINE_NUM line)
+{
+    screen_printn(str, strlen(str), line);
+}
+
+void screen_printn(const char* str, unsigned int str_length, LINE_NUM line)
+{
+    printf("[screen %u] %.*s\r\n", (UINT)line / L1, (int)str_length, str);
+}
+
+UINT sys_monitor_format_json(CHAR* buffer, size_t size)
+{
+    int length = snprintf(buffer, size, "{\"up\":%lu}", (unsigned long)(tx_time_get() / TX_TIMER_TICKS_PER_SECOND));
+
+    return (length > 0 && (size_t)length < size) ? (UINT)length : 0;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState == GPIO_PIN_SET)
+    {
+        GPIOx->ODR |= GPIO_Pin;
+    }
+    else
+    {
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    }
+}
+
+void NVIC_SystemReset(void)
+{
+    printf("Host: system reset requested\r\n");
+    host_reset = true;
+
+    // Nothing after a reset may run, the scenario thread decides what happens next
+    tx_thread_suspend(tx_thread_identify());
+}
+
+// There is no IWDG on the host, deadlines are not enforced
+UINT watchdog_register(TX_THREAD* thread, ULONG deadline, watchdog_mode_t mode)
+{
+    return TX_SUCCESS;
+}
+
+VOID watchdog_checkin(void)
+{
+}
+
+VOID watchdog_deadline_set(ULONG deadline)
+{
+}
+
+// There is no flash on the host, configurations live for the process lifetime only
+config_result_t config_manager_stage(const device_config_t* config)
+{
+    memcpy(&host_candidate, config, sizeof(device_config_t));
+    host_staged++;
+
+    return CONFIG_OK;
+}
+
+void config_manager_commit(void)
+{
+}
+
+config_result_t config_manager_apply_update(
+    device_config_t* current, const char* content, size_t length, bool* restart_required)
+{
+    device_config_t update;
+
+    if (!current || !content || !restart_required)
+    {
+        return CONFIG_ERROR_INVALID;
+    }
+
+    memcpy(&update, current, sizeof(device_config_t));
+    if (config_schema_parse(&update, content, length) == 0 || !config_schema_validate(&update))
+    {
+        return CONFIG_ERROR_INVALID;
+    }
+
+    *restart_required = config_schema_requires_restart(current, &update);
+    if (*restart_required)
+    {
+        return config_manager_stage(&update);
+    }
+
+    memcpy(current, &update, sizeof(device_config_t));
+    printf("Runtime configuration updated\r\n");
+
+    return CONFIG_OK;
+}
+
+UINT dps_cache_storage_read(VOID* record, UINT length)
+{
+    if (length > sizeof(host_dps_cache))
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    memcpy(record, host_dps_cache, length);
+    return NX_SUCCESS;
+}
+
+UINT dps_cache_storage_write(const VOID* record, UINT length)
+{
+    if (length > sizeof(host_dps_cache))
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    memcpy(host_dps_cache, record, length);
+    return NX_SUCCESS;
+}
+
+bool host_led_state(void)
+{
+    return (host_gpioc.ODR & HOST_LED_PIN) != 0;
+}
+
+bool host_reset_requested(void)
+{
+    return host_reset;
+}
+
+UINT host_config_staged(void)
+{
+    return host_staged;
+}
+
+UCHAR* host_dps_cache_storage(UINT* size)
+{
+    *size = sizeof(host_dps_cache);
+    return host_dps_cache;
+}
@@ -0,0 +1,32 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _HOST_BOARD_H
+#define _HOST_BOARD_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+/**
+ * @brief Get the state of the user LED as last written by the application
+ */
+bool host_led_state(void);
+
+/**
+ * @brief Check whether the application asked for a system reset
+ */
+bool host_reset_requested(void);
+
+/**
+ * @brief Get the number of configurations staged for the next boot
+ */
+UINT host_config_staged(void);
+
+/**
+ * @brief Get the RAM standing in for the DPS cache storage, so scenarios can erase or corrupt it
+ * @param size Receives the size of the storage
+ */
+UCHAR* host_dps_cache_storage(UINT* size);
+
+#endif // _HOST_BOARD_H
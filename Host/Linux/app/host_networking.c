@@ -0,0 +1,152 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "networking.h"
+
+#include <stdio.h>
+
+#include "nx_api.h"
+#include "nx_secure_tls_api.h"
+#include "nxd_dns.h"
+
+#include "sntp_client.h"
+
+#define NETX_IP_STACK_SIZE  2048
+#define NETX_PACKET_COUNT   60
+#define NETX_PACKET_SIZE    1536
+#define NETX_POOL_SIZE      ((NETX_PACKET_SIZE + sizeof(NX_PACKET)) * NETX_PACKET_COUNT)
+#define NETX_ARP_CACHE_SIZE 512
+
+// Static address instead of DHCP, the primary interface carries no traffic
+#define NETX_IPV4_ADDRESS IP_ADDRESS(10, 0, 0, 2)
+#define NETX_IPV4_MASK    IP_ADDRESS(255, 255, 255, 0)
+
+// The DNS responder is on the same IP instance
+#define NETX_DNS_SERVER IP_ADDRESS(127, 0, 0, 1)
+
+static UCHAR netx_ip_stack[NETX_IP_STACK_SIZE];
+static UCHAR netx_ip_pool[NETX_POOL_SIZE];
+static UCHAR netx_arp_cache_area[NETX_ARP_CACHE_SIZE];
+
+NX_IP nx_ip;
+NX_PACKET_POOL nx_pool;
+NX_DNS nx_dns_client;
+
+UINT network_init(VOID (*ip_link_driver)(struct NX_IP_DRIVER_STRUCT*))
+{
+    UINT status;
+
+    // Initialize the NetX system.
+    nx_system_initialize();
+
+    // Create a packet pool.
+    if ((status = nx_packet_pool_create(&nx_pool, "NetX Packet Pool", NETX_PACKET_SIZE, netx_ip_pool, NETX_POOL_SIZE)))
+    {
+        printf("ERROR: nx_packet_pool_create (0x%08x)\r\n", status);
+    }
+
+    // Create an IP instance
+    else if ((status = nx_ip_create(&nx_ip,
+                  "NetX IP Instance 0",
+                  NETX_IPV4_ADDRESS,
+                  NETX_IPV4_MASK,
+                  &nx_pool,
+                  ip_link_driver,
+                  netx_ip_stack,
+                  NETX_IP_STACK_SIZE,
+                  1)))
+    {
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_ip_create (0x%08x)\r\n", status);
+    }
+
+    // Enable ARP and supply ARP cache memory
+    else if ((status = nx_arp_enable(&nx_ip, (VOID*)netx_arp_cache_area, NETX_ARP_CACHE_SIZE)))
+    {
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_arp_enable (0x%08x)\r\n", status);
+    }
+
+    // Enable TCP traffic
+    else if ((status = nx_tcp_enable(&nx_ip)))
+    {
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_tcp_enable (0x%08x)\r\n", status);
+    }
+
+    // Enable UDP traffic
+    else if ((status = nx_udp_enable(&nx_ip)))
+    {
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_udp_enable (0x%08x)\r\n", status);
+    }
+
+    // Enable ICMP traffic
+    else if ((status = nx_icmp_enable(&nx_ip)))
+    {
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_icmp_enable (0x%08x)\r\n", status);
+    }
+
+    // Create DNS
+    else if ((status = nx_dns_create(&nx_dns_client, &nx_ip, (UCHAR*)"DNS Client")))
+    {
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_dns_create (0x%08x)\r\n", status);
+    }
+
+    // Use the packet pool here
+#ifdef NX_DNS_CLIENT_USER_CREATE_PACKET_POOL
+    else if ((status = nx_dns_packet_pool_set(&nx_dns_client, nx_ip.nx_ip_default_packet_pool)))
+    {
+        nx_dns_delete(&nx_dns_client);
+        nx_ip_delete(&nx_ip);
+        nx_packet_pool_delete(&nx_pool);
+        printf("ERROR: nx_dns_packet_pool_set (0x%08x)\r\n", status);
+    }
+#endif
+
+    // Initialize the SNTP client
+    else if ((status = sntp_init()))
+    {
+        printf("ERROR: Failed to init the SNTP client (0x%08x)\r\n", status);
+    }
+
+    // Initialize TLS
+    else
+    {
+        nx_secure_tls_initialize();
+    }
+
+    return status;
+}
+
+UINT network_connect()
+{
+    UINT status;
+
+    printf("\r\nInitializing DNS client\r\n");
+
+    if ((status = nx_dns_server_remove_all(&nx_dns_client)))
+    {
+        printf("ERROR: nx_dns_server_remove_all (0x%08x)\r\n", status);
+    }
+
+    else if ((status = nx_dns_server_add(&nx_dns_client, NETX_DNS_SERVER)))
+    {
+        printf("ERROR: nx_dns_server_add (0x%08x)\r\n", status);
+    }
+
+    // Wait for an SNTP sync
+    else if ((status = sntp_sync()))
+    {
+        printf("ERROR: Failed to sync SNTP time (0x%08x)\r\n", status);
+    }
+
+    return status;
+}
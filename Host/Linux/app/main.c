@@ -0,0 +1,152 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tx_api.h"
+
+#include "boot_pipeline.h"
+#include "broker.h"
+#include "legacy/mqtt.h"
+#include "msg_pool.h"
+#include "networking.h"
+#include "nx_driver_host.h"
+#include "profiler.h"
+#include "responders.h"
+#include "scenarios.h"
+#include "sntp_client.h"
+
+#include "azure_config.h"
+#include "config_schema.h"
+
+#define MQTT_THREAD_STACK_SIZE 4096
+#define MQTT_THREAD_PRIORITY   4
+
+// The hostname goes through the DNS responder, which answers every name with the loopback address
+#define HOST_BROKER_HOSTNAME    "broker.host.test"
+#define HOST_BROKER_PORT        1883
+#define HOST_CLIENT_ID          "host-client"
+#define HOST_TELEMETRY_INTERVAL 1
+
+// Global configuration instance
+device_config_t g_device_config;
+
+static TX_THREAD mqtt_thread;
+static ULONG mqtt_thread_stack[MQTT_THREAD_STACK_SIZE / sizeof(ULONG)];
+
+static void init_device_configuration(void)
+{
+    config_schema_defaults(&g_device_config);
+
+    snprintf(g_device_config.mqtt_hostname, sizeof(g_device_config.mqtt_hostname), "%s", HOST_BROKER_HOSTNAME);
+    snprintf(g_device_config.mqtt_client_id, sizeof(g_device_config.mqtt_client_id), "%s", HOST_CLIENT_ID);
+    g_device_config.mqtt_port          = HOST_BROKER_PORT;
+    g_device_config.telemetry_interval = HOST_TELEMETRY_INTERVAL;
+
+    config_schema_print(&g_device_config);
+}
+
+static void mqtt_thread_entry(ULONG parameter)
+{
+    UINT status;
+
+    printf("Starting MQTT client thread\r\n\r\n");
+
+    // Sensors are synthetic and the configuration is fixed, only the network stages take time
+    boot_stage_end(BOOT_STAGE_SENSORS, TX_SUCCESS);
+    boot_stage_begin(BOOT_STAGE_CONFIG);
+    init_device_configuration();
+    boot_stage_end(BOOT_STAGE_CONFIG, TX_SUCCESS);
+
+    boot_stage_begin(BOOT_STAGE_SNTP);
+    status = network_connect();
+    boot_stage_end(BOOT_STAGE_SNTP, status);
+
+    if (status)
+    {
+        printf("ERROR: Failed to connect to network (0x%08x)\r\n", status);
+    }
+    else if ((status = azure_iot_mqtt_entry(&nx_ip, &nx_pool, &nx_dns_client, sntp_time_get)))
+    {
+        printf("ERROR: Failed to run MQTT client (0x%08x)\r\n", status);
+    }
+}
+
+void tx_application_define(void* first_unused_memory)
+{
+    UINT status;
+
+#ifdef PROFILER_ENABLE
+    prof_init();
+#endif
+
+    if ((status = boot_pipeline_init()))
+    {
+        printf("ERROR: Boot pipeline creation failed (0x%08x)\r\n", status);
+    }
+
+    // Shared message buffers for MQTT receive, telemetry and health reports
+    else if ((status = msg_pool_init()))
+    {
+        printf("ERROR: Message pool creation failed (0x%08x)\r\n", status);
+    }
+
+    // IP instance with a static address, everything runs over its loopback interface
+    else if ((status = network_init(nx_driver_host)))
+    {
+        printf("ERROR: Failed to initialize the network (0x%08x)\r\n", status);
+    }
+
+    // DNS and SNTP stand-ins for the servers a device talks to
+    else if ((status = responders_init(&nx_ip, &nx_pool)))
+    {
+        printf("ERROR: Failed to start the responders (0x%08x)\r\n", status);
+    }
+
+    // Scripted broker the scenarios observe
+    else if ((status = broker_init(&nx_ip, &nx_pool, HOST_BROKER_PORT)))
+    {
+        printf("ERROR: Failed to start the broker (0x%08x)\r\n", status);
+    }
+
+    // Create MQTT Client thread
+    else if ((status = tx_thread_create(&mqtt_thread,
+                  "MQTT Client",
+                  mqtt_thread_entry,
+                  0,
+                  mqtt_thread_stack,
+                  MQTT_THREAD_STACK_SIZE,
+                  MQTT_THREAD_PRIORITY,
+                  MQTT_THREAD_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: MQTT client thread creation failed (0x%08x)\r\n", status);
+    }
+
+    // Drives the client through the scenarios and exits with the result
+    else if ((status = scenario_start()))
+    {
+        printf("ERROR: Scenario thread creation failed (0x%08x)\r\n", status);
+    }
+
+    if (status)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (!scenario_parse(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Enter the ThreadX kernel, the scenario thread ends the process
+    tx_kernel_enter();
+
+    return EXIT_SUCCESS;
+}
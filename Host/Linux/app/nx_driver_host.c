@@ -0,0 +1,67 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "nx_driver_host.h"
+
+#define HOST_DRIVER_MTU 1500
+
+// Locally administered MAC so the address printed by diagnostics is recognisable
+#define HOST_DRIVER_MAC_MSW 0x0200
+#define HOST_DRIVER_MAC_LSW 0x00000001
+
+static ULONG host_driver_dropped = 0;
+
+VOID nx_driver_host(NX_IP_DRIVER* driver_req_ptr)
+{
+    NX_IP* ip_ptr               = driver_req_ptr->nx_ip_driver_ptr;
+    NX_INTERFACE* interface_ptr = driver_req_ptr->nx_ip_driver_interface;
+
+    driver_req_ptr->nx_ip_driver_status = NX_SUCCESS;
+
+    switch (driver_req_ptr->nx_ip_driver_command)
+    {
+        case NX_LINK_INTERFACE_ATTACH:
+            break;
+
+        case NX_LINK_INITIALIZE:
+            nx_ip_interface_mtu_set(ip_ptr, interface_ptr->nx_interface_index, HOST_DRIVER_MTU);
+            nx_ip_interface_physical_address_set(
+                ip_ptr, interface_ptr->nx_interface_index, HOST_DRIVER_MAC_MSW, HOST_DRIVER_MAC_LSW, NX_FALSE);
+            nx_ip_interface_address_mapping_configure(ip_ptr, interface_ptr->nx_interface_index, NX_TRUE);
+            break;
+
+        case NX_LINK_ENABLE:
+            interface_ptr->nx_interface_link_up = NX_TRUE;
+            break;
+
+        case NX_LINK_DISABLE:
+            interface_ptr->nx_interface_link_up = NX_FALSE;
+            break;
+
+        case NX_LINK_PACKET_SEND:
+        case NX_LINK_PACKET_BROADCAST:
+        case NX_LINK_ARP_SEND:
+        case NX_LINK_ARP_RESPONSE_SEND:
+        case NX_LINK_RARP_SEND:
+            // Nothing is attached to this interface
+            host_driver_dropped++;
+            nx_packet_transmit_release(driver_req_ptr->nx_ip_driver_packet);
+            break;
+
+        case NX_LINK_MULTICAST_JOIN:
+        case NX_LINK_MULTICAST_LEAVE:
+            break;
+
+        case NX_LINK_GET_STATUS:
+            *(driver_req_ptr->nx_ip_driver_return_ptr) = interface_ptr->nx_interface_link_up;
+            break;
+
+        case NX_LINK_GET_ERROR_COUNT:
+            *(driver_req_ptr->nx_ip_driver_return_ptr) = host_driver_dropped;
+            break;
+
+        default:
+            driver_req_ptr->nx_ip_driver_status = NX_UNHANDLED_COMMAND;
+            break;
+    }
+}
@@ -0,0 +1,19 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _NX_DRIVER_HOST_H
+#define _NX_DRIVER_HOST_H
+
+#include "nx_api.h"
+
+/**
+ * @brief Link driver for the primary interface of the host build
+ *
+ * The interface only gives NetX a configured address, frames sent on it are dropped. The broker, DNS and SNTP
+ * responders all listen on the same IP instance and are reached through the loopback interface.
+ *
+ * @param driver_req_ptr NetX driver request
+ */
+VOID nx_driver_host(NX_IP_DRIVER* driver_req_ptr);
+
+#endif // _NX_DRIVER_HOST_H
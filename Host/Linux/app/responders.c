@@ -0,0 +1,246 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "responders.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tx_api.h"
+
+#define RESPONDER_STACK_SIZE 4096
+#define RESPONDER_PRIORITY   4
+#define RESPONDER_QUEUE      4
+
+#define DNS_PORT         53
+#define DNS_HEADER_SIZE  12
+#define DNS_MESSAGE_SIZE 512
+#define DNS_TYPE_A       1
+#define DNS_CLASS_IN     1
+#define DNS_TTL          60
+
+#define SNTP_PORT         123
+#define SNTP_MESSAGE_SIZE 48
+#define SNTP_MODE_SERVER  4
+
+// Seconds between the NTP epoch (1/1/1900) and the Unix epoch (1/1/1970)
+#define NTP_TO_UNIX_EPOCH_SECS 2208988800UL
+
+static NX_PACKET_POOL* responder_pool;
+
+static NX_UDP_SOCKET dns_socket;
+static NX_UDP_SOCKET sntp_socket;
+
+static TX_THREAD dns_thread;
+static TX_THREAD sntp_thread;
+static ULONG dns_thread_stack[RESPONDER_STACK_SIZE / sizeof(ULONG)];
+static ULONG sntp_thread_stack[RESPONDER_STACK_SIZE / sizeof(ULONG)];
+
+static VOID put_u16(UCHAR* buffer, ULONG value)
+{
+    buffer[0] = (UCHAR)(value >> 8);
+    buffer[1] = (UCHAR)value;
+}
+
+static VOID put_u32(UCHAR* buffer, ULONG value)
+{
+    put_u16(buffer, value >> 16);
+    put_u16(buffer + 2, value);
+}
+
+static ULONG get_u16(const UCHAR* buffer)
+{
+    return ((ULONG)buffer[0] << 8) | buffer[1];
+}
+
+// Receive one datagram, returns its length and the sender or 0 on error
+static ULONG responder_receive(NX_UDP_SOCKET* socket, UCHAR* buffer, ULONG size, ULONG* address, UINT* port)
+{
+    NX_PACKET* packet;
+    ULONG length = 0;
+
+    if (nx_udp_socket_receive(socket, &packet, NX_WAIT_FOREVER))
+    {
+        return 0;
+    }
+
+    // A datagram that does not fit is dropped rather than answered from a truncated copy
+    if (nx_udp_source_extract(packet, address, port) ||
+        nx_packet_data_extract_offset(packet, 0, buffer, size, &length) || length < packet->nx_packet_length)
+    {
+        length = 0;
+    }
+    nx_packet_release(packet);
+
+    return length;
+}
+
+static VOID responder_send(NX_UDP_SOCKET* socket, const UCHAR* buffer, ULONG length, ULONG address, UINT port)
+{
+    UINT status;
+    NX_PACKET* packet;
+
+    if ((status = nx_packet_allocate(responder_pool, &packet, NX_UDP_PACKET, NX_NO_WAIT)))
+    {
+        printf("Responder: no packet to reply (0x%08x)\r\n", status);
+    }
+    else if ((status = nx_packet_data_append(packet, (VOID*)buffer, length, responder_pool, NX_NO_WAIT)) ||
+             (status = nx_udp_socket_send(socket, packet, address, port)))
+    {
+        printf("Responder: reply failed (0x%08x)\r\n", status);
+        nx_packet_release(packet);
+    }
+}
+
+static VOID dns_thread_entry(ULONG parameter)
+{
+    UCHAR message[DNS_MESSAGE_SIZE];
+    ULONG address;
+    UINT port;
+
+    while (true)
+    {
+        ULONG length = responder_receive(&dns_socket, message, DNS_MESSAGE_SIZE - 16, &address, &port);
+        ULONG offset = DNS_HEADER_SIZE;
+        bool answer;
+
+        // Only single question queries are answered
+        if (length < DNS_HEADER_SIZE || (message[2] & 0x80) || get_u16(&message[4]) != 1)
+        {
+            continue;
+        }
+
+        // Skip the question name, compression never appears in a query
+        while (offset < length && message[offset] != 0)
+        {
+            offset += message[offset] + 1;
+        }
+        offset += 1 + 4;
+        if (offset > length)
+        {
+            continue;
+        }
+
+        answer = get_u16(&message[offset - 4]) == DNS_TYPE_A && get_u16(&message[offset - 2]) == DNS_CLASS_IN;
+
+        // Response header: recursion desired copied, recursion available, no error
+        message[2] = 0x80 | (message[2] & 0x01);
+        message[3] = 0x80;
+        put_u16(&message[6], answer ? 1 : 0);
+        put_u16(&message[8], 0);
+        put_u16(&message[10], 0);
+
+        // Answers point back at the question name
+        if (answer)
+        {
+            put_u16(&message[offset], 0xC000 | DNS_HEADER_SIZE);
+            put_u16(&message[offset + 2], DNS_TYPE_A);
+            put_u16(&message[offset + 4], DNS_CLASS_IN);
+            put_u32(&message[offset + 6], DNS_TTL);
+            put_u16(&message[offset + 10], 4);
+            put_u32(&message[offset + 12], IP_ADDRESS(127, 0, 0, 1));
+            offset += 16;
+        }
+
+        responder_send(&dns_socket, message, offset, address, port);
+    }
+}
+
+static VOID sntp_thread_entry(ULONG parameter)
+{
+    UCHAR message[SNTP_MESSAGE_SIZE];
+    ULONG address;
+    UINT port;
+
+    while (true)
+    {
+        ULONG length = responder_receive(&sntp_socket, message, SNTP_MESSAGE_SIZE, &address, &port);
+        struct timespec now;
+        ULONG seconds;
+        ULONG fraction;
+
+        if (length < SNTP_MESSAGE_SIZE)
+        {
+            continue;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        seconds  = (ULONG)now.tv_sec + NTP_TO_UNIX_EPOCH_SECS;
+        fraction = (ULONG)(((unsigned long long)now.tv_nsec << 32) / 1000000000ULL);
+
+        // Originate timestamp is the client transmit timestamp
+        memmove(&message[24], &message[40], 8);
+
+        // No leap warning, the client version, server mode
+        message[0] = (message[0] & 0x38) | SNTP_MODE_SERVER;
+        message[1] = 1;
+        message[3] = 0xEC;
+        put_u32(&message[4], 0);
+        put_u32(&message[8], 0);
+        memcpy(&message[12], "LOCL", 4);
+
+        // Reference, receive and transmit timestamps are all the host clock
+        put_u32(&message[16], seconds);
+        put_u32(&message[20], fraction);
+        put_u32(&message[32], seconds);
+        put_u32(&message[36], fraction);
+        put_u32(&message[40], seconds);
+        put_u32(&message[44], fraction);
+
+        responder_send(&sntp_socket, message, SNTP_MESSAGE_SIZE, address, port);
+    }
+}
+
+static UINT responder_start(NX_IP* ip_ptr,
+    NX_UDP_SOCKET* socket,
+    CHAR* name,
+    UINT port,
+    TX_THREAD* thread,
+    VOID (*entry)(ULONG),
+    ULONG* stack)
+{
+    UINT status;
+
+    if ((status = nx_udp_socket_create(
+             ip_ptr, socket, name, NX_IP_NORMAL, NX_FRAGMENT_OKAY, NX_IP_TIME_TO_LIVE, RESPONDER_QUEUE)))
+    {
+        printf("ERROR: %s socket (0x%08x)\r\n", name, status);
+    }
+    else if ((status = nx_udp_socket_bind(socket, port, NX_NO_WAIT)))
+    {
+        printf("ERROR: %s bind to port %u (0x%08x)\r\n", name, port, status);
+    }
+    else if ((status = tx_thread_create(thread,
+                  name,
+                  entry,
+                  0,
+                  stack,
+                  RESPONDER_STACK_SIZE,
+                  RESPONDER_PRIORITY,
+                  RESPONDER_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: %s thread (0x%08x)\r\n", name, status);
+    }
+
+    return status;
+}
+
+UINT responders_init(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr)
+{
+    UINT status;
+
+    responder_pool = pool_ptr;
+
+    if ((status = responder_start(
+             ip_ptr, &dns_socket, "DNS Responder", DNS_PORT, &dns_thread, dns_thread_entry, dns_thread_stack)))
+    {
+        return status;
+    }
+
+    return responder_start(
+        ip_ptr, &sntp_socket, "SNTP Responder", SNTP_PORT, &sntp_thread, sntp_thread_entry, sntp_thread_stack);
+}
@@ -0,0 +1,21 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _RESPONDERS_H
+#define _RESPONDERS_H
+
+#include "nx_api.h"
+
+/**
+ * @brief Start the DNS and SNTP responders on the given IP instance
+ *
+ * The DNS responder answers every A query with 127.0.0.1 so any broker or time server hostname resolves to the
+ * loopback interface. The SNTP responder serves the host wall clock as a stratum 1 server.
+ *
+ * @param ip_ptr IP instance to bind to
+ * @param pool_ptr Pool for responses
+ * @return NX_SUCCESS or an error code
+ */
+UINT responders_init(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr);
+
+#endif // _RESPONDERS_H
@@ -0,0 +1,667 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "scenarios.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_config.h"
+#include "broker.h"
+#include "dps_cache.h"
+#include "host_board.h"
+#include "json_packet.h"
+#include "msg_pool.h"
+#include "profiler.h"
+#include "property_stage.h"
+
+#include "azure_iot_mqtt/azure_iot_mqtt.h"
+#include "nxd_mqtt_client.h"
+
+#define SCENARIO_STACK_SIZE 4096
+#define SCENARIO_PRIORITY   10
+
+#define SCENARIO_POLL_TICKS (TX_TIMER_TICKS_PER_SECOND / 10)
+
+// The legacy client subscribes to the command, LED, configuration and desired properties topics
+#define SCENARIO_SUBSCRIPTIONS 4
+
+// Publishes to look through for a command response, telemetry keeps flowing meanwhile
+#define SCENARIO_RESPONSE_PUBLISHES 20
+
+#define SCENARIO_MAX_SAMPLES 1024
+
+#define SCENARIO_STAGE_EVENT 0x01
+#define SCENARIO_STAGE_TICKS (TX_TIMER_TICKS_PER_SECOND / 10)
+
+typedef bool (*scenario_fn_t)(void);
+
+typedef struct
+{
+    const CHAR* name;
+    const CHAR* description;
+    scenario_fn_t run;
+} scenario_t;
+
+static TX_THREAD scenario_thread;
+static ULONG scenario_thread_stack[SCENARIO_STACK_SIZE / sizeof(ULONG)];
+
+static const CHAR* scenario_only = NULL;
+static UINT scenario_publish_count = 10;
+static ULONG scenario_timeout      = 30 * TX_TIMER_TICKS_PER_SECOND;
+
+static uint32_t publish_samples[SCENARIO_MAX_SAMPLES];
+static UINT publish_sample_count = 0;
+
+static TX_EVENT_FLAGS_GROUP stage_events;
+static property_stage_t stage;
+static UINT stage_failures;
+static AZURE_IOT_PROPERTY stage_sent[PROPERTY_STAGE_SIZE];
+static UINT stage_sent_count;
+
+// Subscriptions seen before the reconnect scenario dropped the client
+static UINT reconnect_subscribes;
+
+// Two AZURE_IOT_MQTT clients contending for the session, never connected
+static AZURE_IOT_MQTT session_clients[2];
+
+// Keep every publish duration, the probe itself only has a log2 histogram
+void prof_sample(prof_id_t id, uint32_t cycles)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (id != PROF_MQTT_PUBLISH)
+    {
+        return;
+    }
+
+    TX_DISABLE
+    if (publish_sample_count < SCENARIO_MAX_SAMPLES)
+    {
+        publish_samples[publish_sample_count++] = cycles;
+    }
+    TX_RESTORE
+}
+
+// Poll a condition until it holds or the scenario timeout expires
+static bool scenario_wait_for(bool (*condition)(void))
+{
+    ULONG deadline = tx_time_get() + scenario_timeout;
+
+    while (!condition())
+    {
+        if ((LONG)(tx_time_get() - deadline) >= 0)
+        {
+            return false;
+        }
+        tx_thread_sleep(SCENARIO_POLL_TICKS);
+    }
+
+    return true;
+}
+
+static bool subscriptions_done(void)
+{
+    broker_stats_t stats;
+
+    broker_stats(&stats);
+    return stats.subscribes >= SCENARIO_SUBSCRIPTIONS;
+}
+
+static bool resubscribed(void)
+{
+    broker_stats_t stats;
+
+    broker_stats(&stats);
+    return stats.subscribes >= reconnect_subscribes + SCENARIO_SUBSCRIPTIONS;
+}
+
+static bool led_on(void)
+{
+    return host_led_state();
+}
+
+static bool led_off(void)
+{
+    return !host_led_state();
+}
+
+static bool interval_updated(void)
+{
+    return g_device_config.telemetry_interval == 2;
+}
+
+static bool interval_desired(void)
+{
+    return g_device_config.telemetry_interval == 3;
+}
+
+static bool restart_requested(void)
+{
+    return host_reset_requested();
+}
+
+static bool scenario_connect(void)
+{
+    return broker_wait(BROKER_EVENT_CONNECT, scenario_timeout) == TX_SUCCESS;
+}
+
+static bool scenario_subscribe(void)
+{
+    return scenario_wait_for(subscriptions_done);
+}
+
+static bool scenario_led(void)
+{
+    // The client is not told about the subscriptions completing, wait for them before publishing
+    if (!scenario_wait_for(subscriptions_done))
+    {
+        return false;
+    }
+
+    return broker_publish(MQTT_LED_TOPIC, "ON") == NX_SUCCESS && scenario_wait_for(led_on) &&
+           broker_publish(MQTT_LED_TOPIC, "OFF") == NX_SUCCESS && scenario_wait_for(led_off);
+}
+
+// Wait for a publish on a topic whose payload contains the expected text
+static bool scenario_wait_publish(const CHAR* topic, const CHAR* expected)
+{
+    broker_stats_t stats;
+
+    for (UINT i = 0; i < SCENARIO_RESPONSE_PUBLISHES; i++)
+    {
+        if (broker_wait(BROKER_EVENT_PUBLISH, scenario_timeout) != TX_SUCCESS)
+        {
+            return false;
+        }
+
+        broker_stats(&stats);
+        if (strcmp(stats.last_topic, topic) == 0 && strstr(stats.last_payload, expected) != NULL)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool scenario_command(void)
+{
+    if (!scenario_wait_for(subscriptions_done))
+    {
+        return false;
+    }
+
+    // A declared command runs its handler, an unknown one is answered with 404
+    return broker_publish(MQTT_COMMAND_TOPIC, "{\"name\":\"setLedState\",\"payload\":true,\"id\":\"1\"}") ==
+               NX_SUCCESS &&
+           scenario_wait_for(led_on) && scenario_wait_publish(MQTT_RESPONSE_TOPIC, "\"status\":200") &&
+           broker_publish(MQTT_COMMAND_TOPIC, "{\"name\":\"reboot\",\"id\":\"2\"}") == NX_SUCCESS &&
+           scenario_wait_publish(MQTT_RESPONSE_TOPIC, "\"status\":404");
+}
+
+static bool scenario_property(void)
+{
+    if (!scenario_wait_for(subscriptions_done))
+    {
+        return false;
+    }
+
+    // A valid value is applied and acknowledged with 200, one out of range with 400
+    return broker_publish(MQTT_DESIRED_TOPIC, "{\"telemetryInterval\":3,\"$version\":2}") == NX_SUCCESS &&
+           scenario_wait_for(interval_desired) && scenario_wait_publish(MQTT_REPORTED_TOPIC, "\"ac\":200") &&
+           broker_publish(MQTT_DESIRED_TOPIC, "{\"telemetryInterval\":0,\"$version\":3}") == NX_SUCCESS &&
+           scenario_wait_publish(MQTT_REPORTED_TOPIC, "\"ac\":400");
+}
+
+static bool scenario_publish(void)
+{
+    broker_stats_t stats;
+    UINT start;
+
+    broker_stats(&stats);
+    start = stats.publishes;
+
+    while (stats.publishes - start < scenario_publish_count)
+    {
+        if (broker_wait(BROKER_EVENT_PUBLISH, scenario_timeout) != TX_SUCCESS)
+        {
+            printf("Scenario: %u of %u publishes received\r\n", stats.publishes - start, scenario_publish_count);
+            return false;
+        }
+        broker_stats(&stats);
+    }
+
+    printf("Scenario: last publish on %s: %s\r\n", stats.last_topic, stats.last_payload);
+    return true;
+}
+
+static bool scenario_reconnect(void)
+{
+    broker_stats_t stats;
+    UINT connects;
+
+    if (!scenario_wait_for(subscriptions_done))
+    {
+        return false;
+    }
+
+    broker_stats(&stats);
+    connects             = stats.connects;
+    reconnect_subscribes = stats.subscribes;
+
+    // Events from before the drop must not count towards the reconnect
+    broker_wait(BROKER_EVENT_CONNECT | BROKER_EVENT_PUBLISH, TX_NO_WAIT);
+    broker_drop();
+
+    // The client connects again on its own, subscribes with the clean session and carries on publishing
+    if (broker_wait(BROKER_EVENT_CONNECT, scenario_timeout) != TX_SUCCESS || !scenario_wait_for(resubscribed))
+    {
+        return false;
+    }
+
+    broker_wait(BROKER_EVENT_PUBLISH, TX_NO_WAIT);
+    broker_stats(&stats);
+
+    return stats.connects == connects + 1 && broker_wait(BROKER_EVENT_PUBLISH, scenario_timeout) == TX_SUCCESS;
+}
+
+static bool scenario_config(void)
+{
+    UINT staged = host_config_staged();
+
+    if (!scenario_wait_for(subscriptions_done))
+    {
+        return false;
+    }
+
+    // A runtime setting is applied in place, a connection setting is staged and restarts the device
+    return broker_publish(MQTT_CONFIG_TOPIC, "TELEMETRY_INTERVAL=2\n") == NX_SUCCESS &&
+           scenario_wait_for(interval_updated) &&
+           broker_publish(MQTT_CONFIG_TOPIC, "MQTT_PORT=1884\n") == NX_SUCCESS &&
+           scenario_wait_for(restart_requested) && host_config_staged() == staged + 1;
+}
+
+// Stands in for the PATCH, fails while stage_failures is set
+static UINT stage_flush(AZURE_IOT_PROPERTY* properties, UINT count, VOID* context)
+{
+    if (stage_failures > 0)
+    {
+        stage_failures--;
+        return NX_NO_PACKET;
+    }
+
+    memcpy(stage_sent, properties, count * sizeof(AZURE_IOT_PROPERTY));
+    stage_sent_count = count;
+
+    return NX_SUCCESS;
+}
+
+// Wait for the stage to ask for a flush, then run it
+static bool stage_flush_requested(UINT expected)
+{
+    ULONG events;
+
+    return tx_event_flags_get(&stage_events, SCENARIO_STAGE_EVENT, TX_OR_CLEAR, &events, scenario_timeout) ==
+               TX_SUCCESS &&
+           property_stage_flush(&stage) == expected;
+}
+
+static bool scenario_stage(void)
+{
+    AZURE_IOT_PROPERTY ack = {
+        .property_name = (CHAR*)"telemetryInterval",
+        .type          = AZURE_IOT_PROPERTY_WRITABLE_INT,
+        .value         = 3,
+        .http_status   = 200,
+        .version       = 2,
+    };
+    AZURE_IOT_PROPERTY report = {
+        .property_name = (CHAR*)"telemetryInterval",
+        .type          = AZURE_IOT_PROPERTY_INT,
+        .value         = 4,
+    };
+    bool passed;
+
+    if (tx_event_flags_create(&stage_events, "stage") ||
+        property_stage_create(&stage, &stage_events, SCENARIO_STAGE_EVENT, SCENARIO_STAGE_TICKS, stage_flush, NULL))
+    {
+        return false;
+    }
+
+    // The first flush fails and nothing new is staged, the stage asks for the retry on its own. The plain report
+    // goes out as the pending acknowledgement with the new value.
+    stage_failures = 1;
+
+    passed = property_stage_put(&stage, &ack) == NX_SUCCESS && property_stage_put(&stage, &report) == NX_SUCCESS &&
+             stage_flush_requested(NX_NO_PACKET) && stage.count == 1 && stage_flush_requested(NX_SUCCESS) &&
+             stage.count == 0 && stage.retries == 1 && stage_sent_count == 1 &&
+             stage_sent[0].type == AZURE_IOT_PROPERTY_WRITABLE_INT && stage_sent[0].value == 4 &&
+             stage_sent[0].version == 2 && stage_sent[0].http_status == 200;
+
+    property_stage_delete(&stage);
+    tx_event_flags_delete(&stage_events);
+
+    return passed;
+}
+
+static bool session_pools_idle(const msg_pool_stats_t* session, const msg_pool_stats_t* large)
+{
+    msg_pool_stats_t now;
+
+    msg_pool_stats(MSG_POOL_SESSION, &now);
+    if (now.in_use != session->in_use)
+    {
+        return false;
+    }
+
+    msg_pool_stats(MSG_POOL_LARGE, &now);
+    return now.in_use == large->in_use;
+}
+
+static bool scenario_session(void)
+{
+    AZURE_IOT_MQTT* first  = &session_clients[0];
+    AZURE_IOT_MQTT* second = &session_clients[1];
+    msg_pool_stats_t session;
+    msg_pool_stats_t large;
+    bool passed;
+
+    msg_pool_stats(MSG_POOL_SESSION, &session);
+    msg_pool_stats(MSG_POOL_LARGE, &large);
+
+    printf("AZURE_IOT_MQTT %lu of %lu bytes, session %lu of %lu bytes\r\n",
+        (unsigned long)sizeof(AZURE_IOT_MQTT),
+        (unsigned long)AZURE_IOT_MQTT_FOOTPRINT_MAX,
+        (unsigned long)sizeof(AZURE_IOT_MQTT_SESSION),
+        (unsigned long)msg_pool_size(MSG_POOL_SESSION));
+
+    // The build refuses to compile when either size is exceeded, checked again here against the pool as configured
+    passed = sizeof(AZURE_IOT_MQTT) <= AZURE_IOT_MQTT_FOOTPRINT_MAX &&
+             sizeof(AZURE_IOT_MQTT_SESSION) <= msg_pool_size(MSG_POOL_SESSION) && session.block_count == 1;
+
+    // A reconnect keeps its session, a second client is refused until the first releases it
+    passed = passed && azure_iot_mqtt_session_acquire(first) == NX_SUCCESS && first->session != NX_NULL &&
+             first->session->tls_packet_buffer != NX_NULL && azure_iot_mqtt_session_acquire(second) == NX_NO_MEMORY &&
+             second->session == NX_NULL;
+
+    azure_iot_mqtt_session_release(first);
+    passed = passed && first->session == NX_NULL && session_pools_idle(&session, &large) &&
+             azure_iot_mqtt_session_acquire(second) == NX_SUCCESS;
+
+    azure_iot_mqtt_session_release(second);
+
+    return passed && session_pools_idle(&session, &large);
+}
+
+static UINT dps_cache_read(const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE], CHAR* hostname, UINT hostname_size)
+{
+    CHAR device_id[DPS_CACHE_DEVICE_ID_SIZE];
+    UINT hostname_length;
+    UINT device_id_length;
+
+    return dps_cache_load(
+        fingerprint, hostname, hostname_size, &hostname_length, device_id, sizeof(device_id), &device_id_length);
+}
+
+static bool dps_cache_hit(
+    const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE], const CHAR* expected_hostname, const CHAR* expected_device_id)
+{
+    CHAR hostname[DPS_CACHE_HOSTNAME_SIZE];
+    CHAR device_id[DPS_CACHE_DEVICE_ID_SIZE];
+    UINT hostname_length;
+    UINT device_id_length;
+
+    return dps_cache_load(fingerprint,
+               hostname,
+               sizeof(hostname),
+               &hostname_length,
+               device_id,
+               sizeof(device_id),
+               &device_id_length) == NX_SUCCESS &&
+           hostname_length == strlen(expected_hostname) && strcmp(hostname, expected_hostname) == 0 &&
+           device_id_length == strlen(expected_device_id) && strcmp(device_id, expected_device_id) == 0;
+}
+
+static bool scenario_dps_cache(void)
+{
+    static const CHAR id_scope[]        = "0ne00000000";
+    static const CHAR registration_id[] = "host-device";
+    static const CHAR key[]             = "aG9zdC1rZXk=";
+    static const CHAR rotated_key[]     = "cm90YXRlZC1rZXk=";
+    static const CHAR hub[]             = "host-hub.azure-devices.net";
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE];
+    UCHAR rotated[DPS_CACHE_FINGERPRINT_SIZE];
+    CHAR hostname[DPS_CACHE_HOSTNAME_SIZE];
+    UCHAR* storage;
+    UINT size;
+    bool passed;
+
+    dps_cache_fingerprint(id_scope,
+        sizeof(id_scope) - 1,
+        registration_id,
+        sizeof(registration_id) - 1,
+        (const UCHAR*)key,
+        sizeof(key) - 1,
+        fingerprint);
+    dps_cache_fingerprint(id_scope,
+        sizeof(id_scope) - 1,
+        registration_id,
+        sizeof(registration_id) - 1,
+        (const UCHAR*)rotated_key,
+        sizeof(rotated_key) - 1,
+        rotated);
+
+    // Erased storage is a miss
+    storage = host_dps_cache_storage(&size);
+    memset(storage, 0xFF, size);
+    passed = dps_cache_read(fingerprint, hostname, sizeof(hostname)) == NX_NOT_FOUND;
+
+    // A stored assignment comes back only for the inputs it was provisioned with
+    passed = passed &&
+             dps_cache_store(fingerprint, hub, sizeof(hub) - 1, registration_id, sizeof(registration_id) - 1) ==
+                 NX_SUCCESS &&
+             dps_cache_hit(fingerprint, hub, registration_id) &&
+             dps_cache_read(rotated, hostname, sizeof(hostname)) == NX_NOT_FOUND &&
+             dps_cache_read(fingerprint, hostname, 4) == NX_SIZE_ERROR;
+
+    // Only a hub rejecting the device makes the assignment stale, an unreachable hub keeps it
+    passed = passed && !dps_cache_rejected(NX_DNS_QUERY_FAILED) && !dps_cache_rejected(NX_NOT_CONNECTED) &&
+             !dps_cache_rejected(NXD_MQTT_COMMUNICATION_FAILURE) &&
+             !dps_cache_rejected(NXD_MQTT_CONNECT_FAILURE) &&
+             dps_cache_rejected(NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD) &&
+             dps_cache_rejected(NXD_MQTT_ERROR_NOT_AUTHORIZED) && dps_cache_hit(fingerprint, hub, registration_id);
+
+    // A torn write inside the hostname reads as a miss
+    storage[offsetof(dps_cache_record_t, hostname) + 1] ^= 0x01;
+    passed = passed && dps_cache_read(fingerprint, hostname, sizeof(hostname)) == NX_NOT_FOUND;
+
+    // Invalidating after a rejection makes the next start provision again
+    passed = passed &&
+             dps_cache_store(fingerprint, hub, sizeof(hub) - 1, registration_id, sizeof(registration_id) - 1) ==
+                 NX_SUCCESS &&
+             dps_cache_invalidate() == NX_SUCCESS &&
+             dps_cache_read(fingerprint, hostname, sizeof(hostname)) == NX_NOT_FOUND;
+
+    return passed;
+}
+
+// Run in this order, the configuration scenario ends with the client parked in a reset
+static const scenario_t scenarios[] = {
+    {"connect", "CONNECT answered with CONNACK", scenario_connect},
+    {"subscribe", "Command, LED, configuration and desired properties topics subscribed", scenario_subscribe},
+    {"led", "LED follows ON/OFF on the LED topic", scenario_led},
+    {"command", "Declared command runs, unknown command answered with 404", scenario_command},
+    {"property", "Writable property applied and acknowledged, invalid value rejected", scenario_property},
+    {"publish", "Telemetry published and acknowledged", scenario_publish},
+    {"reconnect", "Dropped connection restored, topics subscribed again and telemetry resumed", scenario_reconnect},
+    {"stage", "Failed property flush retried, plain report keeps the pending acknowledgement", scenario_stage},
+    {"session", "AZURE_IOT_MQTT fits its footprint, session borrowed from the pools and returned", scenario_session},
+    {"dps_cache", "Cached DPS assignment kept across network failures, dropped on rejection", scenario_dps_cache},
+    {"config", "Runtime update applied, connection update restarts", scenario_config},
+};
+
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static int compare_samples(const void* a, const void* b)
+{
+    uint32_t left  = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+
+    return left < right ? -1 : left > right;
+}
+
+// Nearest rank percentile of the sorted samples, in microseconds
+static unsigned long sample_percentile(UINT percent)
+{
+    UINT rank = (percent * publish_sample_count + 99) / 100;
+
+    return publish_samples[rank ? rank - 1 : 0] / 1000UL;
+}
+
+static VOID scenario_latency_print(void)
+{
+    if (publish_sample_count == 0)
+    {
+        return;
+    }
+
+    qsort(publish_samples, publish_sample_count, sizeof(publish_samples[0]), compare_samples);
+
+    printf("\r\nPublish latency over %u samples (us): p50 %lu, p90 %lu, p99 %lu, max %lu\r\n",
+        publish_sample_count,
+        sample_percentile(50),
+        sample_percentile(90),
+        sample_percentile(99),
+        (unsigned long)(publish_samples[publish_sample_count - 1] / 1000UL));
+}
+
+// The telemetry documents are written into a packet that nxd_mqtt_client_publish copies once into the PUBLISH packet,
+// the number formatting also goes through a buffer
+static VOID scenario_copy_print(void)
+{
+    json_packet_stats_t stats;
+
+    json_packet_stats(&stats);
+    if (stats.documents == 0)
+    {
+        return;
+    }
+
+    printf("Telemetry JSON over %lu messages: %lu bytes per message, %lu staged in a buffer, %lu chained, %lu "
+           "failed\r\n",
+        (unsigned long)stats.documents,
+        (unsigned long)(stats.bytes / stats.documents),
+        (unsigned long)(stats.staged / stats.documents),
+        (unsigned long)stats.chained,
+        (unsigned long)stats.failures);
+}
+
+static VOID scenario_thread_entry(ULONG parameter)
+{
+    UINT failures = 0;
+    UINT run      = 0;
+
+    for (UINT i = 0; i < SCENARIO_COUNT; i++)
+    {
+        const scenario_t* scenario = &scenarios[i];
+        bool passed;
+
+        // The client session is shared, every scenario needs the connection first
+        if (scenario_only != NULL && i != 0 && strcmp(scenario_only, scenario->name) != 0)
+        {
+            continue;
+        }
+
+        printf("\r\nScenario %s: %s\r\n", scenario->name, scenario->description);
+        passed = scenario->run();
+        printf("Scenario %s: %s\r\n", scenario->name, passed ? "PASS" : "FAIL");
+
+        run++;
+        if (!passed)
+        {
+            failures++;
+            break;
+        }
+    }
+
+    scenario_latency_print();
+    scenario_copy_print();
+
+    printf("\r\n%u of %u scenarios passed\r\n", run - failures, run);
+    exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static VOID scenario_usage(const char* program)
+{
+    printf("Usage: %s [--scenario NAME] [--count N] [--timeout SECONDS]\r\n", program);
+    printf("  --scenario  Run only NAME after connecting, one of:");
+    for (UINT i = 0; i < SCENARIO_COUNT; i++)
+    {
+        printf(" %s", scenarios[i].name);
+    }
+    printf("\r\n  --count     Publishes to wait for in the publish scenario (default %u)\r\n", scenario_publish_count);
+    printf("  --timeout   Seconds to wait for each expected event (default %lu)\r\n",
+        scenario_timeout / TX_TIMER_TICKS_PER_SECOND);
+}
+
+bool scenario_parse(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--scenario") == 0 && value)
+        {
+            scenario_only = value;
+        }
+        else if (strcmp(argv[i], "--count") == 0 && value && atoi(value) > 0)
+        {
+            scenario_publish_count = (UINT)atoi(value);
+        }
+        else if (strcmp(argv[i], "--timeout") == 0 && value && atoi(value) > 0)
+        {
+            scenario_timeout = (ULONG)atoi(value) * TX_TIMER_TICKS_PER_SECOND;
+        }
+        else
+        {
+            scenario_usage(argv[0]);
+            return false;
+        }
+        i++;
+    }
+
+    if (scenario_only != NULL)
+    {
+        bool known = false;
+
+        for (UINT i = 0; i < SCENARIO_COUNT; i++)
+        {
+            known |= strcmp(scenario_only, scenarios[i].name) == 0;
+        }
+
+        if (!known)
+        {
+            scenario_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+UINT scenario_start(void)
+{
+    return tx_thread_create(&scenario_thread,
+        "Scenario",
+        scenario_thread_entry,
+        0,
+        scenario_thread_stack,
+        SCENARIO_STACK_SIZE,
+        SCENARIO_PRIORITY,
+        SCENARIO_PRIORITY,
+        TX_NO_TIME_SLICE,
+        TX_AUTO_START);
+}
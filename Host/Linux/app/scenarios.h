@@ -0,0 +1,24 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _SCENARIOS_H
+#define _SCENARIOS_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+/**
+ * @brief Parse the command line options selecting the scenarios
+ * @return false if the options are invalid, usage has been printed
+ */
+bool scenario_parse(int argc, char* argv[]);
+
+/**
+ * @brief Start the thread driving the selected scenarios against the client
+ *
+ * The process exits with 0 once every scenario passed, 1 if any failed.
+ */
+UINT scenario_start(void);
+
+#endif // _SCENARIOS_H
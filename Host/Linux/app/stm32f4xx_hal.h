@@ -0,0 +1,32 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _STM32F4XX_HAL_H
+#define _STM32F4XX_HAL_H
+
+#include <stdint.h>
+
+// Just enough of the STM32 HAL for the MXChip sources built on the host, see host_board.c
+
+typedef struct
+{
+    uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+
+extern GPIO_TypeDef host_gpioc;
+#define GPIOC (&host_gpioc)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+// Parks the calling thread and flags the reset for the running scenario
+void NVIC_SystemReset(void);
+
+#endif // _STM32F4XX_HAL_H
@@ -0,0 +1,1066 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc32.h"
+#include "dps_response.h"
+#include "heap.h"
+#include "json_packet.h"
+#include "nx_driver_poll.h"
+#include "watchdog_deadline.h"
+
+// Start offsets and lengths walked by the CRC cross-check, every alignment and every remainder of the slice-by-8 loop
+#define CHECK_CRC_OFFSETS 8
+#define CHECK_CRC_LENGTH  300
+
+// Buffer checksummed for the throughput print
+#define CHECK_CRC_BENCH_SIZE   (1024 * 1024)
+#define CHECK_CRC_BENCH_ROUNDS 16
+
+// Pool for the allocator checks, and the randomized alloc, free and realloc run over it
+#define CHECK_HEAP_SIZE   (32 * 1024)
+#define CHECK_HEAP_LIVE   64
+#define CHECK_HEAP_STEPS  200000
+#define CHECK_HEAP_LARGE  4096
+#define CHECK_HEAP_VERIFY 64
+#define CHECK_HEAP_FULL   1024
+
+// Supervisor period and deadlines in ticks, the clock is simulated and starts just short of wrapping
+#define CHECK_WATCHDOG_PERIOD    100
+#define CHECK_WATCHDOG_CHECKIN   300
+#define CHECK_WATCHDOG_SCHEDULED 500
+#define CHECK_WATCHDOG_START     (UINT32_MAX - 250)
+
+// Offload driver poll schedule in ticks with the driver defaults, the clock is simulated and starts just short of
+// wrapping
+#define CHECK_POLL_INTERVAL 100
+#define CHECK_POLL_FAST     2
+#define CHECK_POLL_COUNT    25
+#define CHECK_POLL_START    (UINT32_MAX - 150)
+#define CHECK_POLL_NEVER    UINT32_MAX
+
+// An idle hour at 100 ticks per second, the driver thread may wake once per full poll
+#define CHECK_POLL_HOUR        (3600 * CHECK_POLL_INTERVAL)
+#define CHECK_POLL_HOUR_BUDGET (3600 + 1)
+
+// Room for the largest recorded response, the DPS client borrows a message buffer for those
+#define CHECK_DPS_TOKENS 64
+
+// Packets for the JSON writer, small so escapes land on packet boundaries
+#define CHECK_JSON_PACKETS     32
+#define CHECK_JSON_PACKET_SIZE 7
+
+typedef bool (*check_fn_t)(void);
+
+typedef struct
+{
+    const char* name;
+    const char* description;
+    check_fn_t run;
+} check_t;
+
+typedef struct
+{
+    const char* text;
+    uint32_t crc;
+} crc_vector_t;
+
+// An allocation the heap checks expect to find intact, filled with its own pattern
+typedef struct
+{
+    uint8_t* ptr;
+    size_t size;
+    uint8_t pattern;
+} heap_live_t;
+
+static const char* check_only = NULL;
+
+static uint32_t random_state = 0x5EED;
+
+static heap_t check_heap;
+static uint64_t check_heap_memory[CHECK_HEAP_SIZE / sizeof(uint64_t)];
+static heap_live_t heap_live[CHECK_HEAP_LIVE];
+
+// Stand-ins for the supervised threads, only their addresses and run counts matter
+static uint32_t watchdog_worker_runs;
+static uint32_t watchdog_sensor_runs;
+static uint32_t watchdog_clock;
+static watchdog_deadlines_t watchdog_table;
+
+// Where a DPS response lands, sized like the AZURE_IOT_MQTT fields
+static char dps_hostname[128];
+static char dps_device_id[64];
+static char dps_operation_id[64];
+static jsmntok_t dps_tokens[CHECK_DPS_TOKENS];
+
+// Packets handed out by nx_packet_data_append, in order until the pool is empty
+struct NX_PACKET_POOL_STRUCT
+{
+    NX_PACKET packets[CHECK_JSON_PACKETS];
+    UCHAR data[CHECK_JSON_PACKETS][CHECK_JSON_PACKET_SIZE];
+    UINT used;
+};
+
+static NX_PACKET_POOL json_pool;
+
+// Set to let the simulated CRC unit take the word aligned bulk, counts the words it was handed
+static bool crc_unit_enabled;
+static size_t crc_unit_words;
+
+static uint32_t elapsed_us(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+// Fixed pseudo random fill, so a failure can be reproduced
+static void fill_random(uint8_t* buffer, size_t length, uint32_t seed)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        seed      = seed * 1103515245 + 12345;
+        buffer[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static uint32_t random_next(void)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+// One bit at a time straight from the polynomial, the reference the table driven code is held to
+static uint32_t crc_bitwise(uint32_t crc, const uint8_t* p, size_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *p++;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static uint32_t bit_reverse(uint32_t value)
+{
+    uint32_t reversed = 0;
+
+    for (int bit = 0; bit < 32; bit++)
+    {
+        reversed = (reversed << 1) | ((value >> bit) & 1);
+    }
+
+    return reversed;
+}
+
+// The STM32 CRC unit: non-reflected polynomial 0x04C11DB7 over whole words, DR' = f(DR ^ word)
+static uint32_t crc_unit_word(uint32_t reg, uint32_t word)
+{
+    reg ^= word;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        reg = (reg << 1) ^ (0x04C11DB7 & -(reg >> 31));
+    }
+
+    return reg;
+}
+
+// Fed the way crc32_hw.c feeds the unit, so the bit reversal and the fold of the running state are exercised
+bool crc32_hw_update(uint32_t* state, const uint32_t* words, size_t count)
+{
+    uint32_t reg;
+
+    if (!crc_unit_enabled)
+    {
+        return false;
+    }
+
+    reg = crc_unit_word(0xFFFFFFFF, bit_reverse(words[0]) ^ bit_reverse(*state) ^ 0xFFFFFFFF);
+    for (size_t i = 1; i < count; i++)
+    {
+        reg = crc_unit_word(reg, bit_reverse(words[i]));
+    }
+
+    *state = bit_reverse(reg);
+    crc_unit_words += count;
+
+    return true;
+}
+
+static bool crc_vectors(void)
+{
+    static const crc_vector_t vectors[] = {
+        {"", 0x00000000},
+        {"a", 0xE8B7BE43},
+        {"abc", 0x352441C2},
+        {"123456789", 0xCBF43926},
+        {"message digest", 0x20159D7F},
+        {"The quick brown fox jumps over the lazy dog", 0x414FA339},
+        {"12345678901234567890123456789012345678901234567890123456789012345678901234567890", 0x7CA94A72},
+    };
+    bool passed = true;
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        const crc_vector_t* vector = &vectors[i];
+        size_t length              = strlen(vector->text);
+        uint32_t crc               = crc32_compute(vector->text, length);
+
+        if (crc != vector->crc || crc32_update_sw(0, vector->text, length) != vector->crc ||
+            crc_bitwise(0, (const uint8_t*)vector->text, length) != vector->crc)
+        {
+            printf("\"%s\": 0x%08x, expected 0x%08x\r\n", vector->text, crc, vector->crc);
+            passed = false;
+        }
+    }
+
+    return passed;
+}
+
+// Every start offset and length against the bitwise reference, in one piece and fed in two
+static bool crc_cross_check(void)
+{
+    static uint8_t buffer[CHECK_CRC_OFFSETS + CHECK_CRC_LENGTH];
+
+    fill_random(buffer, sizeof(buffer), 0x5EED);
+
+    for (size_t offset = 0; offset < CHECK_CRC_OFFSETS; offset++)
+    {
+        for (size_t length = 0; length <= CHECK_CRC_LENGTH; length++)
+        {
+            const uint8_t* p  = buffer + offset;
+            uint32_t expected = crc_bitwise(0, p, length);
+            size_t split      = length / 3;
+
+            if (crc32_update_sw(0, p, length) != expected || crc32_update(0, p, length) != expected ||
+                crc32_update(crc32_update(0, p, split), p + split, length - split) != expected)
+            {
+                printf("Mismatch at offset %zu, length %zu\r\n", offset, length);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool check_crc_vectors(void)
+{
+    return crc_vectors();
+}
+
+static bool check_crc_slice(void)
+{
+    crc_unit_enabled = false;
+    return crc_cross_check();
+}
+
+static bool check_crc_unit(void)
+{
+    bool passed;
+
+    // The unit only takes the aligned bulk, the head and the tail still go through the tables
+    crc_unit_enabled = true;
+    crc_unit_words   = 0;
+    passed           = crc_vectors() && crc_cross_check() && crc_unit_words > 0;
+    crc_unit_enabled = false;
+
+    return passed;
+}
+
+static bool check_crc_bench(void)
+{
+    static uint8_t buffer[CHECK_CRC_BENCH_SIZE];
+    struct timespec start;
+    uint32_t sliced_us;
+    uint32_t bitwise_us;
+    uint32_t sliced  = 0;
+    uint32_t bitwise = 0;
+
+    fill_random(buffer, sizeof(buffer), 0xBE7C);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < CHECK_CRC_BENCH_ROUNDS; i++)
+    {
+        sliced = crc32_update_sw(sliced, buffer, sizeof(buffer));
+    }
+    sliced_us = elapsed_us(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < CHECK_CRC_BENCH_ROUNDS; i++)
+    {
+        bitwise = crc_bitwise(bitwise, buffer, sizeof(buffer));
+    }
+    bitwise_us = elapsed_us(&start);
+
+    printf("CRC32 over %d MB: slice-by-8 %u MB/s, bitwise %u MB/s\r\n",
+        CHECK_CRC_BENCH_ROUNDS,
+        (uint32_t)((uint64_t)CHECK_CRC_BENCH_ROUNDS * 1000000 / (sliced_us ? sliced_us : 1)),
+        (uint32_t)((uint64_t)CHECK_CRC_BENCH_ROUNDS * 1000000 / (bitwise_us ? bitwise_us : 1)));
+
+    return sliced == bitwise;
+}
+
+// Mostly small requests with the odd large one, so blocks are split off and merged back across several lists
+static size_t heap_random_size(void)
+{
+    return random_next() % 8 ? 1 + random_next() % 256 : 1 + random_next() % CHECK_HEAP_LARGE;
+}
+
+static bool heap_intact(const heap_live_t* live)
+{
+    for (size_t i = 0; i < live->size; i++)
+    {
+        if (live->ptr[i] != (uint8_t)(live->pattern + i))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void heap_fill(heap_live_t* live, uint8_t* ptr, size_t size)
+{
+    live->ptr     = ptr;
+    live->size    = size;
+    live->pattern = (uint8_t)random_next();
+    for (size_t i = 0; i < size; i++)
+    {
+        ptr[i] = (uint8_t)(live->pattern + i);
+    }
+}
+
+static bool heap_create(heap_stats_t* empty)
+{
+    memset(heap_live, 0, sizeof(heap_live));
+    if (heap_init(&check_heap, check_heap_memory, sizeof(check_heap_memory)) != 0 || heap_check(&check_heap) != 0)
+    {
+        return false;
+    }
+
+    heap_get_stats(&check_heap, empty);
+    return empty->used == 0 && empty->largest > 0 && empty->free > empty->largest;
+}
+
+// Everything handed back has to coalesce into the one block the pool started with
+static bool heap_drained(const heap_stats_t* empty)
+{
+    heap_stats_t stats;
+
+    for (int i = 0; i < CHECK_HEAP_LIVE; i++)
+    {
+        heap_free(&check_heap, heap_live[i].ptr);
+        heap_live[i].ptr = NULL;
+    }
+
+    heap_get_stats(&check_heap, &stats);
+    return heap_check(&check_heap) == 0 && stats.used == 0 && stats.free == empty->free &&
+           stats.largest == empty->largest;
+}
+
+static bool check_heap_random(void)
+{
+    heap_stats_t empty;
+    heap_stats_t stats;
+    uint32_t allocs   = 0;
+    uint32_t failures = 0;
+    uint32_t moves    = 0;
+
+    if (!heap_create(&empty))
+    {
+        return false;
+    }
+
+    for (int step = 0; step < CHECK_HEAP_STEPS; step++)
+    {
+        heap_live_t* live = &heap_live[random_next() % CHECK_HEAP_LIVE];
+        size_t size       = heap_random_size();
+        uint8_t* ptr;
+
+        if (live->ptr == NULL)
+        {
+            if ((ptr = heap_alloc(&check_heap, size)) == NULL)
+            {
+                failures++;
+                continue;
+            }
+
+            allocs++;
+            if (heap_usable_size(ptr) < size || ((uintptr_t)ptr & (HEAP_ALIGN - 1)))
+            {
+                printf("Step %d: allocation of %zu is too small or unaligned\r\n", step, size);
+                return false;
+            }
+            heap_fill(live, ptr, size);
+        }
+        else if (random_next() % 2)
+        {
+            if (!heap_intact(live))
+            {
+                printf("Step %d: allocation of %zu overwritten\r\n", step, live->size);
+                return false;
+            }
+            heap_free(&check_heap, live->ptr);
+            live->ptr = NULL;
+        }
+        else
+        {
+            // A realloc keeps the common prefix whether it grows, shrinks or moves the block
+            size_t kept = size < live->size ? size : live->size;
+
+            if ((ptr = heap_realloc(&check_heap, live->ptr, size)) == NULL)
+            {
+                failures++;
+                continue;
+            }
+
+            allocs += ptr != live->ptr;
+            moves += ptr != live->ptr;
+            live->ptr  = ptr;
+            live->size = kept;
+            if (!heap_intact(live) || heap_usable_size(ptr) < size)
+            {
+                printf("Step %d: realloc to %zu lost data\r\n", step, size);
+                return false;
+            }
+            heap_fill(live, ptr, size);
+        }
+
+        // The used, free and largest accounting has to hold after every operation
+        if (heap_check(&check_heap) != 0)
+        {
+            printf("Step %d: pool inconsistent\r\n", step);
+            return false;
+        }
+
+        if (step % CHECK_HEAP_VERIFY == 0)
+        {
+            for (int i = 0; i < CHECK_HEAP_LIVE; i++)
+            {
+                if (heap_live[i].ptr && !heap_intact(&heap_live[i]))
+                {
+                    printf("Step %d: allocation of %zu overwritten\r\n", step, heap_live[i].size);
+                    return false;
+                }
+            }
+        }
+    }
+
+    heap_get_stats(&check_heap, &stats);
+    printf("%d steps: %u allocations, %u moved by realloc, %u refused, peak %zu of %zu bytes\r\n",
+        CHECK_HEAP_STEPS,
+        allocs,
+        moves,
+        failures,
+        stats.peak,
+        empty.free);
+
+    return stats.allocs == allocs && stats.failures == failures && heap_drained(&empty);
+}
+
+// Filling the pool to the last byte leaves nothing free, and nothing is lost once it is handed back
+static bool check_heap_full(void)
+{
+    static uint8_t* blocks[CHECK_HEAP_FULL];
+    heap_stats_t empty;
+    heap_stats_t stats;
+    int large = 0;
+    int count = 0;
+
+    if (!heap_create(&empty))
+    {
+        return false;
+    }
+
+    // Requests are rounded up to the next size class, so the tail is taken in the smallest blocks that exactly fit
+    while (count < CHECK_HEAP_FULL && (blocks[count] = heap_alloc(&check_heap, CHECK_HEAP_LARGE)) != NULL)
+    {
+        large = ++count;
+    }
+    while (count < CHECK_HEAP_FULL && (blocks[count] = heap_alloc(&check_heap, 1)) != NULL)
+    {
+        count++;
+    }
+
+    heap_get_stats(&check_heap, &stats);
+    printf("%d blocks of %d and %d of 1 fill the pool, %zu used, %zu free\r\n",
+        large,
+        CHECK_HEAP_LARGE,
+        count - large,
+        stats.used,
+        stats.free);
+
+    if (count == CHECK_HEAP_FULL || heap_check(&check_heap) != 0 || stats.free != 0 || stats.largest != 0 ||
+        stats.used != empty.free)
+    {
+        return false;
+    }
+
+    while (count > 0)
+    {
+        heap_free(&check_heap, blocks[--count]);
+    }
+
+    return heap_drained(&empty);
+}
+
+static bool check_heap_resize(void)
+{
+    heap_stats_t empty;
+    heap_stats_t stats;
+    uint8_t* first;
+    uint8_t* second;
+    size_t used;
+
+    if (!heap_create(&empty) || (first = heap_alloc(&check_heap, 256)) == NULL ||
+        (second = heap_alloc(&check_heap, 256)) == NULL)
+    {
+        return false;
+    }
+
+    // Blocked by the allocation behind it, the block stays as it was
+    heap_get_stats(&check_heap, &stats);
+    used = stats.used;
+    if (heap_resize(&check_heap, first, 512) != NULL || heap_usable_size(first) != 256 || heap_check(&check_heap))
+    {
+        return false;
+    }
+
+    // Shrinking splits off a tail, growing takes it back and reaches into the free space behind the second block
+    if (heap_resize(&check_heap, first, 64) != first || heap_check(&check_heap) ||
+        heap_resize(&check_heap, first, 256) != first || heap_check(&check_heap) ||
+        heap_resize(&check_heap, second, 1024) != second || heap_check(&check_heap) ||
+        heap_resize(&check_heap, second, 256) != second || heap_check(&check_heap))
+    {
+        return false;
+    }
+
+    heap_get_stats(&check_heap, &stats);
+    heap_live[0].ptr = first;
+    heap_live[1].ptr = second;
+
+    return stats.used == used && heap_drained(&empty);
+}
+
+static uint32_t watchdog_run_count(const void* owner)
+{
+    return *(const uint32_t*)owner;
+}
+
+// One supervisor period on the simulated clock, true if the IWDG would be refreshed. The worker checks in and the
+// sensor thread is scheduled at the end of the period if asked to.
+static bool watchdog_period(bool worker, bool sensor, const void** late, uint32_t* overdue)
+{
+    const watchdog_deadline_t* client;
+
+    watchdog_clock += CHECK_WATCHDOG_PERIOD;
+    if (worker)
+    {
+        watchdog_deadline_checkin(&watchdog_table, &watchdog_worker_runs, watchdog_clock);
+    }
+    if (sensor)
+    {
+        watchdog_sensor_runs++;
+    }
+
+    client = watchdog_deadline_overdue(&watchdog_table, watchdog_clock, watchdog_run_count, overdue);
+    *late  = client ? client->owner : NULL;
+
+    return client == NULL;
+}
+
+static bool check_watchdog(void)
+{
+    const void* late;
+    uint32_t overdue;
+    bool passed = true;
+
+    memset(&watchdog_table, 0, sizeof(watchdog_table));
+    watchdog_clock = CHECK_WATCHDOG_START;
+
+    if (watchdog_deadline_register(
+            &watchdog_table, &watchdog_worker_runs, CHECK_WATCHDOG_CHECKIN, WATCHDOG_CHECKIN, watchdog_clock, 0) ||
+        watchdog_deadline_register(&watchdog_table,
+            &watchdog_sensor_runs,
+            CHECK_WATCHDOG_SCHEDULED,
+            WATCHDOG_SCHEDULED,
+            watchdog_clock,
+            watchdog_sensor_runs))
+    {
+        return false;
+    }
+
+    // In time across the clock wrapping
+    for (int i = 0; passed && i < 10; i++)
+    {
+        passed = watchdog_period(true, true, &late, &overdue) && overdue == 0;
+    }
+
+    // The worker stops checking in, the refresh goes on until its deadline has passed and then stops
+    for (int i = 0; passed && i < CHECK_WATCHDOG_CHECKIN / CHECK_WATCHDOG_PERIOD; i++)
+    {
+        passed = watchdog_period(false, true, &late, &overdue);
+    }
+    passed = passed && !watchdog_period(false, true, &late, &overdue) && late == &watchdog_worker_runs &&
+             overdue == CHECK_WATCHDOG_PERIOD;
+    passed = passed && !watchdog_period(false, true, &late, &overdue) && late == &watchdog_worker_runs &&
+             overdue == 2 * CHECK_WATCHDOG_PERIOD;
+
+    // A check-in restores it
+    passed = passed && watchdog_period(true, true, &late, &overdue) && late == NULL && overdue == 0;
+
+    // The sensor thread is never scheduled again, it is blamed once past its deadline even with the worker in time
+    for (int i = 0; passed && i < CHECK_WATCHDOG_SCHEDULED / CHECK_WATCHDOG_PERIOD; i++)
+    {
+        passed = watchdog_period(true, false, &late, &overdue);
+    }
+    passed = passed && !watchdog_period(true, false, &late, &overdue) && late == &watchdog_sensor_runs &&
+             overdue == CHECK_WATCHDOG_PERIOD;
+
+    // Being scheduled once is enough to restore the refresh
+    passed = passed && watchdog_period(true, true, &late, &overdue);
+
+    // Nothing is enforced while held, releasing the last hold gives every thread a fresh deadline
+    watchdog_deadline_hold(&watchdog_table);
+    watchdog_deadline_hold(&watchdog_table);
+    for (int i = 0; passed && i < 20; i++)
+    {
+        passed = watchdog_period(false, false, &late, &overdue);
+    }
+    watchdog_deadline_release(&watchdog_table, watchdog_clock);
+    passed = passed && watchdog_period(false, false, &late, &overdue);
+    watchdog_deadline_release(&watchdog_table, watchdog_clock);
+    for (int i = 0; passed && i < CHECK_WATCHDOG_CHECKIN / CHECK_WATCHDOG_PERIOD; i++)
+    {
+        passed = watchdog_period(false, true, &late, &overdue);
+    }
+    passed = passed && !watchdog_period(false, true, &late, &overdue) && late == &watchdog_worker_runs;
+
+    // A shorter deadline set at runtime applies from the next period
+    watchdog_deadline_update(&watchdog_table, &watchdog_worker_runs, CHECK_WATCHDOG_PERIOD, watchdog_clock);
+    passed = passed && watchdog_period(false, true, &late, &overdue);
+    passed = passed && !watchdog_period(false, true, &late, &overdue) && late == &watchdog_worker_runs;
+
+    // Registering again updates the entry, a full table refuses new threads
+    passed = passed &&
+             watchdog_deadline_register(
+                 &watchdog_table, &watchdog_worker_runs, CHECK_WATCHDOG_CHECKIN, WATCHDOG_CHECKIN, watchdog_clock, 0) ==
+                 0 &&
+             watchdog_table.count == 2 && watchdog_table.clients[0].deadline == CHECK_WATCHDOG_CHECKIN;
+    for (unsigned int i = watchdog_table.count; passed && i < WATCHDOG_MAX_THREADS; i++)
+    {
+        passed = watchdog_deadline_register(
+                     &watchdog_table, &heap_live[i], CHECK_WATCHDOG_CHECKIN, WATCHDOG_CHECKIN, watchdog_clock, 0) == 0;
+    }
+
+    return passed &&
+           watchdog_deadline_register(
+               &watchdog_table, &watchdog_clock, CHECK_WATCHDOG_CHECKIN, WATCHDOG_CHECKIN, watchdog_clock, 0) != 0;
+}
+
+// Runs the driver thread loop for one socket from CHECK_POLL_START for the given ticks. The socket sends at send_at
+// and its reply is ready from reply_at, both relative to the start. Returns the ticks from the reply being ready until
+// a poll picks it up, CHECK_POLL_NEVER if it never is, and the number of loops in wakeups. A schedule that stops the
+// clock ends the run after one loop per tick.
+static uint32_t driver_poll_run(uint32_t ticks, uint32_t send_at, uint32_t reply_at, uint32_t* wakeups)
+{
+    NX_DRIVER_POLL poll;
+    uint16_t fast_polls = 0;
+    uint32_t now        = 0;
+    bool woken          = false;
+    bool poll_all;
+    uint32_t wait;
+
+    *wakeups = 0;
+    nx_driver_poll_init(&poll, CHECK_POLL_INTERVAL, CHECK_POLL_FAST, CHECK_POLL_COUNT, CHECK_POLL_START);
+
+    while (now <= ticks && *wakeups <= ticks)
+    {
+        (*wakeups)++;
+        poll_all = nx_driver_poll_all(&poll, CHECK_POLL_START + now);
+
+        if (nx_driver_poll_socket(&poll, &fast_polls, woken, poll_all))
+        {
+            if (now >= reply_at)
+            {
+                return now - reply_at;
+            }
+            nx_driver_poll_done(&poll, &fast_polls, false);
+        }
+
+        // The send event ends the wait early, as tx_event_flags_get does
+        wait  = nx_driver_poll_wait(&poll, CHECK_POLL_START + now, fast_polls != 0);
+        woken = now < send_at && send_at <= now + wait;
+        now   = woken ? send_at : now + wait;
+    }
+
+    return CHECK_POLL_NEVER;
+}
+
+static bool check_driver_poll(void)
+{
+    NX_DRIVER_POLL poll;
+    uint16_t fast_polls = 1;
+    uint32_t worst      = 0;
+    uint32_t delay;
+    uint32_t wakeups;
+    bool passed;
+
+    // Idle, one loop per full poll across the clock wrapping
+    passed = driver_poll_run(10 * CHECK_POLL_INTERVAL, CHECK_POLL_NEVER, CHECK_POLL_NEVER, &wakeups) ==
+                 CHECK_POLL_NEVER &&
+             wakeups == 11;
+
+    // An idle hour stays within the wakeup budget, the fast schedule never runs without a send
+    delay = driver_poll_run(CHECK_POLL_HOUR, CHECK_POLL_NEVER, CHECK_POLL_NEVER, &wakeups);
+    printf("Idle hour: %u driver wakeups, budget %u\r\n", wakeups, CHECK_POLL_HOUR_BUDGET);
+    passed = passed && delay == CHECK_POLL_NEVER && wakeups <= CHECK_POLL_HOUR_BUDGET;
+
+    // A reply to a send is picked up within the fast interval while the socket has fast polls left
+    for (uint32_t reply = 0; passed && reply <= (CHECK_POLL_COUNT - 1) * CHECK_POLL_FAST; reply++)
+    {
+        delay  = driver_poll_run(10 * CHECK_POLL_INTERVAL, 130, 130 + reply, &wakeups);
+        passed = delay <= CHECK_POLL_FAST;
+        worst  = delay > worst ? delay : worst;
+    }
+    printf("Reply pickup after a send: worst %u ticks, fast interval %u\r\n", worst, CHECK_POLL_FAST);
+
+    // Once quiet the socket falls back to the full poll, costing one loop per fast poll and no more
+    passed = passed && driver_poll_run(10 * CHECK_POLL_INTERVAL, 130, CHECK_POLL_NEVER, &wakeups) == CHECK_POLL_NEVER &&
+             wakeups == 11 + CHECK_POLL_COUNT;
+
+    // Data arriving without a send waits for the next full poll
+    delay  = driver_poll_run(10 * CHECK_POLL_INTERVAL, CHECK_POLL_NEVER, 250, &wakeups);
+    passed = passed && delay == 50;
+
+    // Data keeps a socket on the fast schedule, a quiet poll uses one fast poll up
+    nx_driver_poll_init(&poll, CHECK_POLL_INTERVAL, CHECK_POLL_FAST, CHECK_POLL_COUNT, CHECK_POLL_START);
+    nx_driver_poll_done(&poll, &fast_polls, true);
+    passed = passed && fast_polls == CHECK_POLL_COUNT;
+    nx_driver_poll_done(&poll, &fast_polls, false);
+
+    return passed && fast_polls == CHECK_POLL_COUNT - 1;
+}
+
+// Appends like NetX does, filling the last packet of the chain and then chaining more from the pool
+UINT nx_packet_data_append(
+    NX_PACKET* packet_ptr, VOID* data_start, ULONG data_size, NX_PACKET_POOL* pool_ptr, ULONG wait_option)
+{
+    const UCHAR* data = data_start;
+    NX_PACKET* last   = packet_ptr;
+    ULONG room;
+
+    while (last->nx_packet_next != NX_NULL)
+    {
+        last = last->nx_packet_next;
+    }
+
+    while (data_size > 0)
+    {
+        if (last->nx_packet_append_ptr == last->nx_packet_data_end)
+        {
+            if (pool_ptr->used == CHECK_JSON_PACKETS)
+            {
+                return NX_NO_PACKET;
+            }
+
+            last->nx_packet_next = &pool_ptr->packets[pool_ptr->used];
+            last                 = last->nx_packet_next;
+            memset(last, 0, sizeof(*last));
+            last->nx_packet_prepend_ptr = pool_ptr->data[pool_ptr->used];
+            last->nx_packet_append_ptr  = last->nx_packet_prepend_ptr;
+            last->nx_packet_data_end    = last->nx_packet_prepend_ptr + CHECK_JSON_PACKET_SIZE;
+            pool_ptr->used++;
+        }
+
+        room = last->nx_packet_data_end - last->nx_packet_append_ptr;
+        room = room < data_size ? room : data_size;
+        memcpy(last->nx_packet_append_ptr, data, room);
+        last->nx_packet_append_ptr += room;
+        packet_ptr->nx_packet_length += room;
+        data += room;
+        data_size -= room;
+    }
+
+    return NX_SUCCESS;
+}
+
+// Start a document in an empty packet from a fresh pool
+static NX_PACKET* json_packet_start(json_packet_t* writer, size_t pool_size)
+{
+    NX_PACKET* packet;
+
+    memset(&json_pool, 0, sizeof(json_pool));
+    json_pool.used = CHECK_JSON_PACKETS - pool_size;
+
+    packet                        = &json_pool.packets[json_pool.used];
+    packet->nx_packet_prepend_ptr = json_pool.data[json_pool.used];
+    packet->nx_packet_append_ptr  = packet->nx_packet_prepend_ptr;
+    packet->nx_packet_data_end    = packet->nx_packet_prepend_ptr + CHECK_JSON_PACKET_SIZE;
+    json_pool.used++;
+
+    json_packet_init(writer, packet, &json_pool, 0);
+    return packet;
+}
+
+// Finish the document and compare the chain it was written into
+static bool json_packet_matches(json_packet_t* writer, NX_PACKET* packet, const char* expected)
+{
+    char document[CHECK_JSON_PACKETS * CHECK_JSON_PACKET_SIZE + 1];
+    size_t length = 0;
+    size_t used;
+
+    if (json_packet_end(writer) != NX_SUCCESS)
+    {
+        return false;
+    }
+
+    for (; packet != NX_NULL; packet = packet->nx_packet_next)
+    {
+        used = packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr;
+        memcpy(document + length, packet->nx_packet_prepend_ptr, used);
+        length += used;
+    }
+    document[length] = 0;
+
+    if (strcmp(document, expected) != 0)
+    {
+        printf("Got %s\r\nExpected %s\r\n", document, expected);
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_json_packet(void)
+{
+    static const char command[] = "{\"name\":\"blink\",\"id\":\"a\\\"b\\\\c\\u0001\"}";
+    json_packet_t writer;
+    jsmntok_t tokens[8];
+    jsmn_parser parser;
+    NX_PACKET* packet;
+    bool passed;
+
+    // Quotes, backslashes and control characters are escaped, UTF-8 and DEL pass through
+    packet = json_packet_start(&writer, CHECK_JSON_PACKETS);
+    json_packet_object_begin(&writer, NULL);
+    json_packet_string(&writer, "s", "a\"b\\c\n\r\t\b\f\x01\x1f \xc3\xa9\x7f");
+    json_packet_int(&writer, "n", -12);
+    json_packet_object_end(&writer);
+    passed = json_packet_matches(
+        &writer, packet, "{\"s\":\"a\\\"b\\\\c\\n\\r\\t\\b\\f\\u0001\\u001f \xc3\xa9\x7f\",\"n\":-12}");
+
+    // The id of a command goes back as the token text, without escaping it twice
+    jsmn_init(&parser);
+    passed = passed && jsmn_parse(&parser, command, sizeof(command) - 1, tokens, 8) == 5;
+    packet = json_packet_start(&writer, CHECK_JSON_PACKETS);
+    json_packet_object_begin(&writer, NULL);
+    json_packet_string_raw(&writer, "id", command + tokens[4].start, tokens[4].end - tokens[4].start);
+    json_packet_object_end(&writer);
+    passed = passed && json_packet_matches(&writer, packet, "{\"id\":\"a\\\"b\\\\c\\u0001\"}");
+
+    // Running out of packets is kept and reported at the end
+    json_packet_start(&writer, 2);
+    json_packet_object_begin(&writer, NULL);
+    json_packet_string(&writer, "s", "\n\n\n\n\n\n\n\n");
+    json_packet_object_end(&writer);
+
+    return passed && json_packet_end(&writer) == NX_NO_PACKET;
+}
+
+static dps_response_action_t dps_replay(const char* topic, const char* message, dps_response_t* response)
+{
+    response->hostname          = dps_hostname;
+    response->hostname_size     = sizeof(dps_hostname);
+    response->device_id         = dps_device_id;
+    response->device_id_size    = sizeof(dps_device_id);
+    response->operation_id      = dps_operation_id;
+    response->operation_id_size = sizeof(dps_operation_id);
+    response->retry_after       = 0;
+
+    return dps_response_process(topic, message, dps_tokens, CHECK_DPS_TOKENS, response);
+}
+
+// Responses recorded from a DPS registration, the operation id is carried from the first into the polls
+static bool check_dps_response(void)
+{
+    static const char assigning[] =
+        "{\"operationId\":\"4.d0a671905ea5b2c8.42d78160-4c78-479e-8be7-61d5e55dac0d\",\"status\":\"assigning\"}";
+    static const char polled[] =
+        "{\"operationId\":\"4.d0a671905ea5b2c8.42d78160-4c78-479e-8be7-61d5e55dac0d\",\"status\":\"assigning\","
+        "\"registrationState\":{\"registrationId\":\"host-device\",\"status\":\"assigning\"}}";
+    static const char assigned[] =
+        "{\"operationId\":\"4.d0a671905ea5b2c8.42d78160-4c78-479e-8be7-61d5e55dac0d\",\"status\":\"assigned\","
+        "\"registrationState\":{\"registrationId\":\"host-device\",\"assignedHub\":\"host-hub.azure-devices.net\","
+        "\"deviceId\":\"host-device\",\"status\":\"assigned\",\"substatus\":\"initialAssignment\"}}";
+    static const char failed[] =
+        "{\"operationId\":\"4.d0a671905ea5b2c8.42d78160-4c78-479e-8be7-61d5e55dac0d\",\"status\":\"failed\","
+        "\"registrationState\":{\"registrationId\":\"host-device\",\"status\":\"failed\",\"errorCode\":400207}}";
+    static const char operation_id[] = "4.d0a671905ea5b2c8.42d78160-4c78-479e-8be7-61d5e55dac0d";
+    dps_response_t response;
+    bool passed;
+
+    memset(dps_operation_id, 0, sizeof(dps_operation_id));
+    memset(dps_hostname, 0, sizeof(dps_hostname));
+
+    // Registration accepted, poll the operation after the interval DPS asked for
+    passed = dps_replay("$dps/registrations/res/202/?$rid=1&retry-after=3", assigning, &response) ==
+                 DPS_RESPONSE_RETRY &&
+             response.retry_after == 3 && strcmp(dps_operation_id, operation_id) == 0;
+
+    // Still assigning, no interval given, the default applies
+    passed = passed &&
+             dps_replay("$dps/registrations/res/202/?$rid=1", polled, &response) == DPS_RESPONSE_RETRY &&
+             response.retry_after == DPS_RESPONSE_RETRY_DEFAULT;
+
+    // Throttled, the same poll goes out again later and the operation is kept
+    passed = passed &&
+             dps_replay("$dps/registrations/res/429/?$rid=1&retry-after=5", "", &response) == DPS_RESPONSE_RETRY &&
+             response.retry_after == 5 && strcmp(dps_operation_id, operation_id) == 0;
+
+    // Intervals are bounded
+    passed = passed &&
+             dps_replay("$dps/registrations/res/202/?$rid=1&retry-after=0", assigning, &response) ==
+                 DPS_RESPONSE_RETRY &&
+             response.retry_after == 1 &&
+             dps_replay("$dps/registrations/res/503/?$rid=1&retry-after=900", "", &response) == DPS_RESPONSE_RETRY &&
+             response.retry_after == DPS_RESPONSE_RETRY_MAX;
+
+    // Assigned, the first status wins over the nested one
+    passed = passed && dps_replay("$dps/registrations/res/200/?$rid=1", assigned, &response) == DPS_RESPONSE_ASSIGNED &&
+             strcmp(dps_hostname, "host-hub.azure-devices.net") == 0 && strcmp(dps_device_id, "host-device") == 0;
+
+    // Final failures
+    passed = passed && dps_replay("$dps/registrations/res/200/?$rid=1", failed, &response) == DPS_RESPONSE_FAILED &&
+             dps_replay("$dps/registrations/res/401/?$rid=1", "{\"errorCode\":401002}", &response) ==
+                 DPS_RESPONSE_FAILED &&
+             dps_replay("$dps/registrations/res/200/?$rid=1", "{\"status\":", &response) == DPS_RESPONSE_FAILED &&
+             dps_replay("$dps/registrations/res/200/?$rid=1", "{\"operationId\":\"x\"}", &response) ==
+                 DPS_RESPONSE_FAILED &&
+             dps_replay("$dps/registrations/res/202/?$rid=1", "{\"status\":\"assigning\"}", &response) ==
+                 DPS_RESPONSE_FAILED;
+
+    // A body needing more tokens than the storage holds, and a hub name too long for the client
+    passed = passed &&
+             dps_response_process("$dps/registrations/res/200/?$rid=1", assigned, dps_tokens, 4, &response) ==
+                 DPS_RESPONSE_FAILED;
+    response.hostname_size = 8;
+    passed = passed &&
+             dps_response_process(
+                 "$dps/registrations/res/200/?$rid=1", assigned, dps_tokens, CHECK_DPS_TOKENS, &response) ==
+                 DPS_RESPONSE_FAILED;
+
+    // Only registration responses carry a status
+    return passed && dps_response_status("$dps/registrations/res/202/?$rid=1") == 202 &&
+           dps_response_status("$iothub/twin/res/200/?$rid=1") == 0;
+}
+
+static const check_t checks[] = {
+    {"crc_vectors", "CRC32 of the published check values", check_crc_vectors},
+    {"crc_slice", "Slice-by-8 matches the bitwise CRC at every alignment and length", check_crc_slice},
+    {"crc_unit", "Aligned bulk through the simulated CRC unit matches the bitwise CRC", check_crc_unit},
+    {"crc_bench", "Slice-by-8 and bitwise throughput over the same buffer", check_crc_bench},
+    {"heap_random", "Random alloc, free and realloc keep the pool and its statistics consistent", check_heap_random},
+    {"heap_full", "A full pool reports nothing free and coalesces back once emptied", check_heap_full},
+    {"heap_resize", "Resize in place splits and merges with the free neighbour", check_heap_resize},
+    {"watchdog", "A missed deadline stops the refresh and a check-in restores it", check_watchdog},
+    {"dps_response", "Recorded DPS responses assign, retry after the given interval or fail", check_dps_response},
+    {"driver_poll", "The offload driver polls a socket fast after a send and falls back once quiet", check_driver_poll},
+    {"json_packet", "String values are escaped into chained packets, command ids pass through raw", check_json_packet},
+};
+
+#define CHECK_COUNT (sizeof(checks) / sizeof(checks[0]))
+
+static void check_usage(const char* program)
+{
+    printf("Usage: %s [--check NAME]\r\n", program);
+    printf("  --check  Run only NAME, one of:");
+    for (size_t i = 0; i < CHECK_COUNT; i++)
+    {
+        printf(" %s", checks[i].name);
+    }
+    printf("\r\n");
+}
+
+static bool check_parse(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--check") == 0 && value)
+        {
+            check_only = value;
+        }
+        else
+        {
+            check_usage(argv[0]);
+            return false;
+        }
+        i++;
+    }
+
+    if (check_only != NULL)
+    {
+        bool known = false;
+
+        for (size_t i = 0; i < CHECK_COUNT; i++)
+        {
+            known |= strcmp(check_only, checks[i].name) == 0;
+        }
+
+        if (!known)
+        {
+            check_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int failures = 0;
+    int run      = 0;
+
+    if (!check_parse(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // The checks are independent, a failure does not stop the others
+    for (size_t i = 0; i < CHECK_COUNT; i++)
+    {
+        const check_t* check = &checks[i];
+        bool passed;
+
+        if (check_only != NULL && strcmp(check_only, check->name) != 0)
+        {
+            continue;
+        }
+
+        printf("\r\nCheck %s: %s\r\n", check->name, check->description);
+        passed = check->run();
+        printf("Check %s: %s\r\n", check->name, passed ? "PASS" : "FAIL");
+
+        run++;
+        failures += !passed;
+    }
+
+    printf("\r\n%d of %d checks passed\r\n", run - failures, run);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
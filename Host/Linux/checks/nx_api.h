@@ -0,0 +1,43 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _NX_API_H
+#define _NX_API_H
+
+#include <stddef.h>
+
+// Just enough of NetX Duo for json_packet.c, the checks own the packets and nx_packet_data_append, see main.c
+
+typedef char CHAR;
+typedef unsigned char UCHAR;
+typedef int INT;
+typedef unsigned int UINT;
+typedef unsigned long ULONG;
+typedef void VOID;
+
+#define NX_NULL               NULL
+#define NX_SUCCESS            0x00
+#define NX_NO_PACKET          0x01
+#define NX_OVERFLOW           0x03
+#define NX_INVALID_PARAMETERS 0x4D
+
+// The writer only takes the statistics lock on one thread here
+#define TX_INTERRUPT_SAVE_AREA
+#define TX_DISABLE
+#define TX_RESTORE
+
+typedef struct NX_PACKET_STRUCT
+{
+    struct NX_PACKET_STRUCT* nx_packet_next;
+    UCHAR* nx_packet_prepend_ptr;
+    UCHAR* nx_packet_append_ptr;
+    UCHAR* nx_packet_data_end;
+    ULONG nx_packet_length;
+} NX_PACKET;
+
+typedef struct NX_PACKET_POOL_STRUCT NX_PACKET_POOL;
+
+UINT nx_packet_data_append(
+    NX_PACKET* packet_ptr, VOID* data_start, ULONG data_size, NX_PACKET_POOL* pool_ptr, ULONG wait_option);
+
+#endif // _NX_API_H
@@ -0,0 +1,1026 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "es_wifi_sim.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "es_wifi.h"
+#include "es_wifi_io.h"
+
+#define SIM_NAK         0x15
+#define SIM_OK          "\r\nOK\r\n> "
+#define SIM_PROMPT      "\r\n> "
+#define SIM_BOOT_PROMPT "\x15\x15\r\n> "
+
+#define SIM_MAC_ADDRESS  "C4:7F:51:00:00:01"
+#define SIM_CPU_CLOCK    120000000
+#define SIM_PING_REPLY   1 // Round trip in milliseconds for a reachable address
+#define SIM_JOIN_RETRIES 5
+
+// One transaction carries a command and, for S3, the payload plus the padding byte
+#define SIM_TRANSACTION_SIZE (ES_WIFI_PAYLOAD_SIZE + 32)
+
+// The IO layer null terminates the response, keep it inside the caller's buffer
+#define SIM_RESPONSE_SIZE (ES_WIFI_DATA_SIZE - 2)
+
+#define SIM_COMMAND_CODES 64
+
+// Returned by a handler whose response continues with another command, it ends with the prompt instead of OK
+static const char sim_pending[] = "";
+
+typedef const char* (*sim_handler_t)(const char* arg, uint8_t* data, uint16_t length);
+
+typedef struct
+{
+    const char* code;
+    sim_handler_t handler;
+} sim_command_t;
+
+typedef struct
+{
+    const char* ssid;
+    const char* mac;
+    int rssi;
+    const char* security;
+    int channel;
+} sim_ap_t;
+
+typedef struct
+{
+    int type;
+    uint16_t local_port;
+    struct in_addr remote_addr;
+    uint16_t remote_port;
+    uint32_t recv_length;
+    uint32_t recv_timeout;
+    uint32_t backlog;
+    bool server;
+    int fd;        // Client connection, accepted connection or UDP socket
+    int listen_fd; // TCP server only
+} sim_socket_t;
+
+typedef struct
+{
+    bool booted;
+    bool joined;
+    char ssid[ES_WIFI_MAX_SSID_NAME_SIZE + 1];
+    char password[ES_WIFI_MAX_PSWD_NAME_SIZE + 1];
+    int security;
+    uint8_t active;
+    sim_socket_t sockets[ES_WIFI_SIM_SOCKETS];
+    struct in_addr ping_addr;
+    uint32_t ping_count;
+    uint32_t ping_interval;
+    int scan_next; // Next access point for MR while a scan is listed, -1 otherwise
+    bool accepted; // A connection was accepted since the last MR
+} sim_module_t;
+
+typedef struct
+{
+    char code[3];
+    uint32_t count;
+} sim_count_t;
+
+static const sim_ap_t sim_aps[] = {
+    {ES_WIFI_SIM_SSID, "C4:7F:51:01:02:03", -42, "WPA2 AES", 6},
+    {"host-guest", "C4:7F:51:01:02:04", -71, "Open", 11},
+};
+
+#define SIM_AP_COUNT (sizeof(sim_aps) / sizeof(sim_aps[0]))
+
+static sim_module_t module;
+
+static uint8_t transaction[SIM_TRANSACTION_SIZE];
+static uint16_t transaction_length;
+
+// The last S3 as it came over the bus, length prefix, payload and padding
+static uint8_t last_send[SIM_TRANSACTION_SIZE];
+static uint16_t last_send_length;
+
+static uint8_t response[SIM_RESPONSE_SIZE];
+static uint16_t response_length;
+
+static es_wifi_sim_fault_t armed_fault = ES_WIFI_SIM_FAULT_NONE;
+static char armed_command[16];
+
+static es_wifi_sim_stats_t stats;
+static sim_count_t counts[SIM_COMMAND_CODES];
+
+// Timeouts are skipped rather than waited for, the tick jumps ahead instead
+static uint32_t clock_skew;
+
+uint32_t HAL_GetTick(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000) + clock_skew;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+    struct timespec delay = {Delay / 1000, (Delay % 1000) * 1000000L};
+
+    nanosleep(&delay, NULL);
+}
+
+static void respond(const char* format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf((char*)response + response_length, sizeof(response) - response_length, format, args);
+    va_end(args);
+
+    if (length > 0)
+    {
+        response_length = MIN(response_length + length, sizeof(response) - 1);
+    }
+}
+
+static void respond_bytes(const uint8_t* data, uint16_t length)
+{
+    length = MIN(length, sizeof(response) - response_length);
+    memcpy(response + response_length, data, length);
+    response_length += length;
+}
+
+static const char* address_text(struct in_addr address, char* text)
+{
+    return inet_ntop(AF_INET, &address, text, INET_ADDRSTRLEN);
+}
+
+static bool address_parse(const char* text, struct in_addr* address)
+{
+    return text && inet_pton(AF_INET, text, address) == 1;
+}
+
+static void socket_close(sim_socket_t* sock)
+{
+    if (sock->fd >= 0)
+    {
+        close(sock->fd);
+        sock->fd = -1;
+    }
+
+    if (sock->listen_fd >= 0)
+    {
+        close(sock->listen_fd);
+        sock->listen_fd = -1;
+    }
+
+    sock->server = false;
+}
+
+static void sockets_close(void)
+{
+    for (int i = 0; i < ES_WIFI_SIM_SOCKETS; i++)
+    {
+        socket_close(&module.sockets[i]);
+    }
+}
+
+// Power on state, nothing survives a restart of the module
+static void module_reset(void)
+{
+    if (module.booted)
+    {
+        sockets_close();
+    }
+
+    memset(&module, 0, sizeof(module));
+    for (int i = 0; i < ES_WIFI_SIM_SOCKETS; i++)
+    {
+        module.sockets[i].fd           = -1;
+        module.sockets[i].listen_fd    = -1;
+        module.sockets[i].recv_length  = ES_WIFI_PAYLOAD_SIZE;
+        module.sockets[i].recv_timeout = 1;
+    }
+    module.scan_next = -1;
+    module.booted    = true;
+
+    transaction_length = 0;
+    response_length    = 0;
+    stats.resets++;
+}
+
+static void count_command(const char* command)
+{
+    for (int i = 0; i < SIM_COMMAND_CODES; i++)
+    {
+        if (counts[i].code[0] == 0)
+        {
+            strncpy(counts[i].code, command, 2);
+        }
+
+        if (strncmp(counts[i].code, command, 2) == 0)
+        {
+            counts[i].count++;
+            return;
+        }
+    }
+}
+
+static es_wifi_sim_fault_t fault_take(const char* command)
+{
+    es_wifi_sim_fault_t fault = armed_fault;
+
+    if (fault == ES_WIFI_SIM_FAULT_NONE || strncmp(command, armed_command, strlen(armed_command)) != 0)
+    {
+        return ES_WIFI_SIM_FAULT_NONE;
+    }
+
+    armed_fault = ES_WIFI_SIM_FAULT_NONE;
+    stats.faults++;
+
+    return fault;
+}
+
+static sim_socket_t* active_socket(void)
+{
+    return &module.sockets[module.active];
+}
+
+static void socket_accept(sim_socket_t* sock)
+{
+    struct sockaddr_in peer;
+    socklen_t peer_length = sizeof(peer);
+    int fd;
+
+    if (!sock->server || sock->listen_fd < 0 || sock->fd >= 0)
+    {
+        return;
+    }
+
+    if ((fd = accept(sock->listen_fd, (struct sockaddr*)&peer, &peer_length)) >= 0)
+    {
+        sock->fd          = fd;
+        sock->remote_addr = peer.sin_addr;
+        sock->remote_port = ntohs(peer.sin_port);
+        module.accepted   = true;
+    }
+}
+
+static int socket_open(sim_socket_t* sock, int type)
+{
+    struct sockaddr_in local = {0};
+    int reuse                = 1;
+    int fd;
+
+    if ((fd = socket(AF_INET, type, 0)) < 0)
+    {
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    local.sin_family      = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port        = htons(sock->local_port);
+    if (sock->local_port && bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static const char* sim_info(const char* arg, uint8_t* data, uint16_t length)
+{
+    respond("%s,%s,v3.5.2,V1.4.0.rc1,V8.2.1,%d,%s",
+        ES_WIFI_SIM_PRODUCT_ID,
+        ES_WIFI_SIM_FW_REV,
+        SIM_CPU_CLOCK,
+        ES_WIFI_SIM_PRODUCT_NAME);
+    return NULL;
+}
+
+static void scan_entry(int index)
+{
+    const sim_ap_t* ap = &sim_aps[index];
+
+    respond("#%03d,\"%s\",%s,%d,72.2,Infrastructure,%s,2.4GHz,%d",
+        index + 1,
+        ap->ssid,
+        ap->mac,
+        ap->rssi,
+        ap->security,
+        ap->channel);
+}
+
+// F0 lists every access point at once, F0=2 one per response with MR fetching the next
+static const char* sim_scan(const char* arg, uint8_t* data, uint16_t length)
+{
+    if (arg && strcmp(arg, "2") == 0)
+    {
+        module.scan_next = 0;
+        return sim_pending;
+    }
+
+    for (int i = 0; i < SIM_AP_COUNT; i++)
+    {
+        if (i)
+        {
+            respond("\r\n");
+        }
+        scan_entry(i);
+    }
+
+    return NULL;
+}
+
+static const char* sim_message_read(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock = active_socket();
+    char text[INET_ADDRSTRLEN];
+
+    if (module.scan_next >= 0)
+    {
+        return sim_pending;
+    }
+
+    socket_accept(sock);
+    if (module.accepted)
+    {
+        module.accepted = false;
+        respond("[SOMA]Accepted %s:%u[EOMA]", address_text(sock->remote_addr, text), sock->remote_port);
+    }
+    else
+    {
+        respond("[SOMA][EOMA]");
+    }
+
+    return NULL;
+}
+
+static const char* sim_ssid(const char* arg, uint8_t* data, uint16_t length)
+{
+    snprintf(module.ssid, sizeof(module.ssid), "%s", arg ? arg : "");
+    return NULL;
+}
+
+static const char* sim_password(const char* arg, uint8_t* data, uint16_t length)
+{
+    snprintf(module.password, sizeof(module.password), "%s", arg ? arg : "");
+    return NULL;
+}
+
+static const char* sim_security(const char* arg, uint8_t* data, uint16_t length)
+{
+    module.security = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_join(const char* arg, uint8_t* data, uint16_t length)
+{
+    if (strcmp(module.ssid, ES_WIFI_SIM_SSID) != 0 || strcmp(module.password, ES_WIFI_SIM_PASSWORD) != 0)
+    {
+        module.joined = false;
+        return "JOIN Failed";
+    }
+
+    module.joined = true;
+    respond("[JOIN   ] %s,%s,0,0", module.ssid, ES_WIFI_SIM_IP_ADDRESS);
+    return NULL;
+}
+
+static const char* sim_join_status(const char* arg, uint8_t* data, uint16_t length)
+{
+    respond("%d", module.joined);
+    return NULL;
+}
+
+static const char* sim_leave(const char* arg, uint8_t* data, uint16_t length)
+{
+    sockets_close();
+    module.joined = false;
+    return NULL;
+}
+
+static const char* sim_network_settings(const char* arg, uint8_t* data, uint16_t length)
+{
+    respond("%s,%s,%d,1,0,%s,255.0.0.0,%s,%s,0.0.0.0,%d,0",
+        module.ssid,
+        module.password,
+        module.security,
+        ES_WIFI_SIM_IP_ADDRESS,
+        ES_WIFI_SIM_IP_ADDRESS,
+        ES_WIFI_SIM_IP_ADDRESS,
+        SIM_JOIN_RETRIES);
+    return NULL;
+}
+
+static const char* sim_mac(const char* arg, uint8_t* data, uint16_t length)
+{
+    respond("%s", SIM_MAC_ADDRESS);
+    return NULL;
+}
+
+static const char* sim_accept_setting(const char* arg, uint8_t* data, uint16_t length)
+{
+    return NULL;
+}
+
+// The host resolver answers, names under .invalid fail without a lookup as RFC 6761 asks
+static const char* sim_dns(const char* arg, uint8_t* data, uint16_t length)
+{
+    static const char invalid[] = ".invalid";
+    struct addrinfo hints = {0};
+    struct addrinfo* result;
+    size_t name_length = arg ? strlen(arg) : 0;
+    char text[INET_ADDRSTRLEN];
+
+    if (!module.joined)
+    {
+        return "Not joined";
+    }
+
+    if (name_length == 0 || (name_length >= sizeof(invalid) - 1 &&
+                                strcmp(arg + name_length - (sizeof(invalid) - 1), invalid) == 0))
+    {
+        return "DNS Lookup Failed";
+    }
+
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(arg, NULL, &hints, &result) != 0)
+    {
+        return "DNS Lookup Failed";
+    }
+
+    respond("%s", address_text(((struct sockaddr_in*)result->ai_addr)->sin_addr, text));
+    freeaddrinfo(result);
+
+    return NULL;
+}
+
+static const char* sim_ping_target(const char* arg, uint8_t* data, uint16_t length)
+{
+    return address_parse(arg, &module.ping_addr) ? NULL : "Invalid address";
+}
+
+static const char* sim_ping_count(const char* arg, uint8_t* data, uint16_t length)
+{
+    module.ping_count = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_ping_interval(const char* arg, uint8_t* data, uint16_t length)
+{
+    module.ping_interval = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+// Only loopback addresses answer, raw ICMP would need privileges on the host
+static const char* sim_ping(const char* arg, uint8_t* data, uint16_t length)
+{
+    if (!module.joined)
+    {
+        return "Not joined";
+    }
+
+    clock_skew += module.ping_count * module.ping_interval;
+
+    if ((ntohl(module.ping_addr.s_addr) >> 24) != 127)
+    {
+        return "Ping timeout";
+    }
+
+    for (uint32_t i = 0; i < module.ping_count; i++)
+    {
+        respond("%s%u,%d", i ? "\r\n" : "", i, SIM_PING_REPLY);
+    }
+
+    return NULL;
+}
+
+static const char* sim_socket_select(const char* arg, uint8_t* data, uint16_t length)
+{
+    int number = arg ? atoi(arg) : -1;
+
+    if (number < 0 || number >= ES_WIFI_SIM_SOCKETS)
+    {
+        return "Invalid socket";
+    }
+
+    module.active = (uint8_t)number;
+    return NULL;
+}
+
+static const char* sim_protocol(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->type = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_local_port(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->local_port = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_remote_address(const char* arg, uint8_t* data, uint16_t length)
+{
+    return address_parse(arg, &active_socket()->remote_addr) ? NULL : "Invalid address";
+}
+
+static const char* sim_remote_port(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->remote_port = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_backlog(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->backlog = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+// 1 and 11 start listening, 10 closes the accepted connection and 0 stops the server
+static const char* sim_server(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock = active_socket();
+    int mode           = arg ? atoi(arg) : 0;
+
+    if (mode == 0)
+    {
+        socket_close(sock);
+        return NULL;
+    }
+
+    if (mode == 10)
+    {
+        if (sock->fd >= 0)
+        {
+            close(sock->fd);
+            sock->fd = -1;
+        }
+        return NULL;
+    }
+
+    if (!module.joined)
+    {
+        return "Not joined";
+    }
+
+    socket_close(sock);
+
+    if (sock->type == ES_WIFI_UDP_CONNECTION)
+    {
+        sock->fd = socket_open(sock, SOCK_DGRAM);
+    }
+    else if (sock->type == ES_WIFI_TCP_CONNECTION &&
+             (sock->listen_fd = socket_open(sock, SOCK_STREAM | SOCK_NONBLOCK)) >= 0 &&
+             listen(sock->listen_fd, sock->backlog ? sock->backlog : 1) < 0)
+    {
+        socket_close(sock);
+    }
+
+    if (sock->fd < 0 && sock->listen_fd < 0)
+    {
+        return "Server start failed";
+    }
+
+    sock->server = true;
+    return NULL;
+}
+
+static const char* sim_client(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock      = active_socket();
+    struct sockaddr_in peer = {0};
+    bool tcp                = sock->type == ES_WIFI_TCP_CONNECTION;
+
+    socket_close(sock);
+
+    if (!arg || atoi(arg) == 0)
+    {
+        return NULL;
+    }
+
+    if (!module.joined)
+    {
+        return "Not joined";
+    }
+
+    if (!tcp && sock->type != ES_WIFI_UDP_CONNECTION)
+    {
+        return "Protocol not simulated";
+    }
+
+    if ((sock->fd = socket_open(sock, tcp ? SOCK_STREAM : SOCK_DGRAM)) < 0)
+    {
+        return "Socket failed";
+    }
+
+    peer.sin_family = AF_INET;
+    peer.sin_addr   = sock->remote_addr;
+    peer.sin_port   = htons(sock->remote_port);
+    if (tcp && connect(sock->fd, (struct sockaddr*)&peer, sizeof(peer)) < 0)
+    {
+        socket_close(sock);
+        return "Connection failed";
+    }
+
+    return NULL;
+}
+
+static const char* sim_transport_settings(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock = active_socket();
+    char remote[INET_ADDRSTRLEN];
+    bool connected;
+
+    socket_accept(sock);
+    connected = sock->fd >= 0;
+
+    // A server with nothing accepted yet reports the unspecified address, the driver polls for that
+    respond("%d,%s,%u,%s,%u,%d,%d,%u,0,0",
+        sock->type,
+        connected ? ES_WIFI_SIM_IP_ADDRESS : "0.0.0.0",
+        sock->local_port,
+        connected ? address_text(sock->remote_addr, remote) : "0.0.0.0",
+        connected ? sock->remote_port : 0,
+        sock->server && sock->type == ES_WIFI_TCP_CONNECTION,
+        sock->server && sock->type == ES_WIFI_UDP_CONNECTION,
+        sock->backlog);
+
+    return NULL;
+}
+
+static const char* sim_send_timeout(const char* arg, uint8_t* data, uint16_t length)
+{
+    return NULL;
+}
+
+static const char* sim_send(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock      = active_socket();
+    struct sockaddr_in peer = {0};
+    int size                = arg ? atoi(arg) : -1;
+    ssize_t sent;
+
+    if (size < 0 || size > ES_WIFI_PAYLOAD_SIZE || size > length)
+    {
+        return "Invalid length";
+    }
+
+    socket_accept(sock);
+    if (sock->fd < 0)
+    {
+        return "Not connected";
+    }
+
+    if (sock->type == ES_WIFI_UDP_CONNECTION)
+    {
+        peer.sin_family = AF_INET;
+        peer.sin_addr   = sock->remote_addr;
+        peer.sin_port   = htons(sock->remote_port);
+        sent            = sendto(sock->fd, data, size, 0, (struct sockaddr*)&peer, sizeof(peer));
+    }
+    else
+    {
+        sent = send(sock->fd, data, size, MSG_NOSIGNAL);
+    }
+
+    if (sent < 0)
+    {
+        return "Send failed";
+    }
+
+    respond("%d", (int)sent);
+    return NULL;
+}
+
+static const char* sim_receive_length(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->recv_length = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_receive_timeout(const char* arg, uint8_t* data, uint16_t length)
+{
+    active_socket()->recv_timeout = arg ? atoi(arg) : 0;
+    return NULL;
+}
+
+static const char* sim_receive(const char* arg, uint8_t* data, uint16_t length)
+{
+    sim_socket_t* sock = active_socket();
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    struct sockaddr_in peer;
+    socklen_t peer_length = sizeof(peer);
+    struct pollfd readable;
+    ssize_t received;
+
+    socket_accept(sock);
+    if (sock->fd < 0)
+    {
+        return "Not connected";
+    }
+
+    readable.fd     = sock->fd;
+    readable.events = POLLIN;
+    if (poll(&readable, 1, sock->recv_timeout) <= 0)
+    {
+        return NULL;
+    }
+
+    received = recvfrom(
+        sock->fd, buffer, MIN(sock->recv_length, sizeof(buffer)), 0, (struct sockaddr*)&peer, &peer_length);
+    if (received < 0 || (received == 0 && sock->type != ES_WIFI_UDP_CONNECTION))
+    {
+        // The peer closed, the module drops the connection
+        close(sock->fd);
+        sock->fd = -1;
+        return "Connection closed";
+    }
+
+    if (sock->type == ES_WIFI_UDP_CONNECTION)
+    {
+        sock->remote_addr = peer.sin_addr;
+        sock->remote_port = ntohs(peer.sin_port);
+    }
+
+    respond_bytes(buffer, received);
+    return NULL;
+}
+
+static const sim_command_t sim_commands[] = {
+    {"I?", sim_info},
+    {"F0", sim_scan},
+    {"MR", sim_message_read},
+    {"C1", sim_ssid},
+    {"C2", sim_password},
+    {"C3", sim_security},
+    {"C0", sim_join},
+    {"CS", sim_join_status},
+    {"CD", sim_leave},
+    {"C?", sim_network_settings},
+    {"Z5", sim_mac},
+    {"Z0", sim_accept_setting},
+    {"Z1", sim_accept_setting},
+    {"Z4", sim_accept_setting},
+    {"ZN", sim_accept_setting},
+    {"D0", sim_dns},
+    {"T1", sim_ping_target},
+    {"T2", sim_ping_count},
+    {"T3", sim_ping_interval},
+    {"T0", sim_ping},
+    {"P0", sim_socket_select},
+    {"P1", sim_protocol},
+    {"P2", sim_local_port},
+    {"P3", sim_remote_address},
+    {"P4", sim_remote_port},
+    {"P5", sim_server},
+    {"P6", sim_client},
+    {"P7", sim_accept_setting},
+    {"P8", sim_backlog},
+    {"P9", sim_accept_setting},
+    {"PK", sim_accept_setting},
+    {"P?", sim_transport_settings},
+    {"S2", sim_send_timeout},
+    {"S3", sim_send},
+    {"R0", sim_receive},
+    {"R1", sim_receive_length},
+    {"R2", sim_receive_timeout},
+};
+
+#define SIM_COMMAND_COUNT (sizeof(sim_commands) / sizeof(sim_commands[0]))
+
+static const char* dispatch(const char* command, uint8_t* data, uint16_t length)
+{
+    const char* arg = strchr(command, '=');
+
+    for (int i = 0; i < SIM_COMMAND_COUNT; i++)
+    {
+        if (strncmp(command, sim_commands[i].code, 2) == 0)
+        {
+            return sim_commands[i].handler(arg ? arg + 1 : NULL, data, length);
+        }
+    }
+
+    return "Unknown command";
+}
+
+// Run the command collected in the transaction and leave its response to be clocked out
+static es_wifi_sim_fault_t execute(void)
+{
+    uint8_t* end = memchr(transaction, '\r', transaction_length);
+    const char* command = (const char*)transaction;
+    const char* result;
+    es_wifi_sim_fault_t fault;
+
+    response_length = 0;
+
+    if (end == NULL)
+    {
+        respond("\r\nERROR: Unterminated command" SIM_PROMPT);
+        return ES_WIFI_SIM_FAULT_NONE;
+    }
+
+    if (strncmp(command, "S3", 2) == 0)
+    {
+        memcpy(last_send, transaction, transaction_length);
+        last_send_length = transaction_length;
+    }
+    *end = 0;
+
+    count_command(command);
+    fault = fault_take(command);
+
+    if (fault == ES_WIFI_SIM_FAULT_ERROR)
+    {
+        respond("\r\nERROR: Injected" SIM_PROMPT);
+        return fault;
+    }
+
+    if (fault == ES_WIFI_SIM_FAULT_RESET || strcmp(command, "ZR") == 0)
+    {
+        module_reset();
+        respond(SIM_BOOT_PROMPT);
+        return fault;
+    }
+
+    if (fault == ES_WIFI_SIM_FAULT_STUFFING)
+    {
+        return fault;
+    }
+
+    // Anything after the carriage return is the S3 payload or the padding byte
+    respond("\r\n");
+    result = dispatch(command, end + 1, transaction + transaction_length - (end + 1));
+
+    if (result == NULL)
+    {
+        respond(SIM_OK);
+    }
+    else if (result == sim_pending)
+    {
+        if (module.scan_next >= 0 && module.scan_next < SIM_AP_COUNT)
+        {
+            scan_entry(module.scan_next++);
+            respond(SIM_PROMPT);
+        }
+        else
+        {
+            module.scan_next = -1;
+            respond(SIM_OK);
+        }
+    }
+    else
+    {
+        response_length = 0;
+        respond("\r\nERROR: %s" SIM_PROMPT, result);
+    }
+
+    return fault;
+}
+
+int8_t SPI_WIFI_Init(uint16_t mode)
+{
+    module_reset();
+    return 0;
+}
+
+int8_t SPI_WIFI_DeInit(void)
+{
+    sockets_close();
+    return 0;
+}
+
+int8_t SPI_WIFI_ResetModule(void)
+{
+    module_reset();
+    return 0;
+}
+
+// Gathers the transaction, an odd length is padded with '\n' as the SPI transport does
+int16_t SPI_WIFI_SendData(uint8_t* pdata, uint16_t len, uint32_t timeout)
+{
+    uint16_t padded = (len + 1) & ~1;
+
+    if (transaction_length + padded > sizeof(transaction))
+    {
+        transaction_length = 0;
+        return ES_WIFI_ERROR_SPI_FAILED;
+    }
+
+    memcpy(transaction + transaction_length, pdata, len);
+    if (len & 1)
+    {
+        transaction[transaction_length + len] = '\n';
+    }
+    transaction_length += padded;
+    stats.bytes_sent += len;
+
+    return len;
+}
+
+// Ends the transaction, the module runs the command and the response is read back
+int16_t SPI_WIFI_ReceiveData(uint8_t* pData, uint16_t len, uint32_t timeout)
+{
+    es_wifi_sim_fault_t fault = ES_WIFI_SIM_FAULT_NONE;
+    uint16_t length;
+
+    if (transaction_length == 0)
+    {
+        clock_skew += timeout;
+        return ES_WIFI_ERROR_WAITING_DRDY_FALLING;
+    }
+
+    fault              = execute();
+    transaction_length = 0;
+    stats.transactions++;
+
+    if (fault == ES_WIFI_SIM_FAULT_DROP_RESPONSE)
+    {
+        response_length = 0;
+        clock_skew += timeout;
+        return ES_WIFI_ERROR_WAITING_DRDY_FALLING;
+    }
+
+    if (fault == ES_WIFI_SIM_FAULT_STUFFING)
+    {
+        // The IO layer gives up after a buffer of filler and resets the module
+        module_reset();
+        return ES_WIFI_ERROR_STUFFING_FOREVER;
+    }
+
+    // The module pads an odd response with filler
+    if (response_length & 1)
+    {
+        response[response_length++] = SIM_NAK;
+    }
+
+    length = response_length;
+    if (len && length > ((len + 1) & ~1))
+    {
+        length = (len + 1) & ~1;
+    }
+
+    memcpy(pData, response, length);
+    stats.bytes_received += length;
+    response_length = 0;
+
+    return length;
+}
+
+void SPI_WIFI_Delay(uint32_t Delay)
+{
+    HAL_Delay(Delay);
+}
+
+void es_wifi_sim_fault(es_wifi_sim_fault_t fault, const char* command)
+{
+    armed_fault = fault;
+    snprintf(armed_command, sizeof(armed_command), "%s", command ? command : "");
+}
+
+uint32_t es_wifi_sim_count(const char* command)
+{
+    uint32_t count = 0;
+
+    for (int i = 0; i < SIM_COMMAND_CODES && counts[i].code[0]; i++)
+    {
+        if (strncmp(counts[i].code, command, 2) == 0)
+        {
+            count += counts[i].count;
+        }
+    }
+
+    return count;
+}
+
+uint16_t es_wifi_sim_last_send(uint8_t* data, uint16_t size)
+{
+    uint16_t length = MIN(last_send_length, size);
+
+    memcpy(data, last_send, length);
+    return length;
+}
+
+void es_wifi_sim_stats(es_wifi_sim_stats_t* result)
+{
+    *result = stats;
+}
+
+void es_wifi_sim_clear(void)
+{
+    memset(counts, 0, sizeof(counts));
+    memset(&stats, 0, sizeof(stats));
+    last_send_length = 0;
+}
@@ -0,0 +1,72 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _ES_WIFI_SIM_H
+#define _ES_WIFI_SIM_H
+
+#include <stdint.h>
+
+// The simulated module implements the SPI_WIFI_* functions of es_wifi_io.h, so wifi.c registers it with
+// ES_WIFI_RegisterBusIO in place of the SPI transport. Commands and responses use the module's framing, sockets are
+// backed by Linux sockets and reach the host through its own network stack.
+
+// The one access point that accepts a join, a second open network only shows up in scans
+#define ES_WIFI_SIM_SSID     "host-ap"
+#define ES_WIFI_SIM_PASSWORD "host-password"
+
+#define ES_WIFI_SIM_PRODUCT_ID   "ISM43362-M3G-L44-SPI"
+#define ES_WIFI_SIM_FW_REV       "C3.5.2.5.STM"
+#define ES_WIFI_SIM_PRODUCT_NAME "Inventek eS-WiFi"
+
+// The module reports the loopback address, the peers see connections coming from it
+#define ES_WIFI_SIM_IP_ADDRESS "127.0.0.1"
+
+#define ES_WIFI_SIM_SOCKETS 4
+
+typedef enum
+{
+    ES_WIFI_SIM_FAULT_NONE,
+    ES_WIFI_SIM_FAULT_DROP_RESPONSE, // The command runs but its response never comes, the receive times out
+    ES_WIFI_SIM_FAULT_ERROR,         // The command is refused with ERROR and has no effect
+    ES_WIFI_SIM_FAULT_RESET,         // The module restarts on the command and answers with the boot prompt
+    ES_WIFI_SIM_FAULT_STUFFING       // The module clocks out filler until the IO layer gives up and resets it
+} es_wifi_sim_fault_t;
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t resets;
+    uint32_t faults;
+    uint32_t bytes_sent;
+    uint32_t bytes_received;
+} es_wifi_sim_stats_t;
+
+/**
+ * @brief Arm a fault for the next command starting with the given prefix
+ * @param fault Fault to inject once, ES_WIFI_SIM_FAULT_NONE disarms
+ * @param command Command prefix such as "R0" or "S3", NULL for the next command
+ */
+void es_wifi_sim_fault(es_wifi_sim_fault_t fault, const char* command);
+
+/**
+ * @brief Number of commands with the given two character code, such as "P0", since the last es_wifi_sim_clear
+ */
+uint32_t es_wifi_sim_count(const char* command);
+
+/**
+ * @brief Copy the last S3 transaction as the module received it, from the length prefix through the padding
+ * @return Bytes copied, 0 when nothing was sent since the last es_wifi_sim_clear
+ */
+uint16_t es_wifi_sim_last_send(uint8_t* data, uint16_t size);
+
+/**
+ * @brief Get a copy of the module counters
+ */
+void es_wifi_sim_stats(es_wifi_sim_stats_t* stats);
+
+/**
+ * @brief Clear the command and module counters and the last send
+ */
+void es_wifi_sim_clear(void);
+
+#endif // _ES_WIFI_SIM_H
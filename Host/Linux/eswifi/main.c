@@ -0,0 +1,811 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "es_wifi_sim.h"
+#include "wifi.h"
+
+// Ports on the host loopback, the echo servers stand in for peers on the network
+#define CHECK_TCP_ECHO_PORT 47001
+#define CHECK_UDP_ECHO_PORT 47002
+#define CHECK_SERVER_PORT   47003
+#define CHECK_UDP_LOCAL     47004
+
+#define CHECK_TCP_SOCKET    0
+#define CHECK_UDP_SOCKET    1
+#define CHECK_SERVER_SOCKET 2
+
+// Milliseconds a receive waits for the echo
+#define CHECK_RECEIVE_TIMEOUT 1000
+
+#define CHECK_PING_COUNT 3
+
+// A 1 KB transfer in sends of a quarter each, the echo is read back after every send
+#define CHECK_COMMANDS_SIZE  1024
+#define CHECK_COMMANDS_CHUNK 256
+
+// Small echoes timed one by one, the 99th percentile round trip in microseconds stays well inside the receive timeout
+#define CHECK_LATENCY_COUNT 200
+#define CHECK_LATENCY_SIZE  32
+#define CHECK_LATENCY_BOUND 100000
+
+// A bulk transfer in full payloads, the AT framing may add at most a tenth to the bytes exchanged with the module
+#define CHECK_BULK_SIZE     (64 * 1024)
+#define CHECK_BULK_OVERHEAD 10
+
+// Chained sends, the raw S3 is the length prefix, at most a full payload and one padding byte
+#define CHECK_SEGMENTS_MAXIMUM 8
+#define CHECK_SEGMENTS_RAW     (ES_WIFI_PAYLOAD_SIZE + 16)
+
+typedef bool (*check_fn_t)(void);
+
+typedef struct
+{
+    const char* name;
+    const char* description;
+    check_fn_t run;
+} check_t;
+
+// wifi.c keeps the module handle global, the checks look at what the parsers filled in
+extern ES_WIFIObject_t EsWifiObj;
+
+static const char* check_only = NULL;
+
+static uint8_t loopback[4] = {127, 0, 0, 1};
+
+static int listen_socket(int type, uint16_t port)
+{
+    struct sockaddr_in local = {0};
+    int reuse                = 1;
+    int fd;
+
+    if ((fd = socket(AF_INET, type, 0)) < 0)
+    {
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    local.sin_family      = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port        = htons(port);
+    if (bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0 || (type == SOCK_STREAM && listen(fd, 4) < 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void* tcp_echo_entry(void* context)
+{
+    int server = (int)(intptr_t)context;
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    ssize_t length;
+    int fd;
+
+    while ((fd = accept(server, NULL, NULL)) >= 0)
+    {
+        while ((length = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        {
+            send(fd, buffer, length, MSG_NOSIGNAL);
+        }
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void* udp_echo_entry(void* context)
+{
+    int fd = (int)(intptr_t)context;
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    struct sockaddr_in peer;
+    socklen_t peer_length = sizeof(peer);
+    ssize_t length;
+
+    while ((length = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&peer, &peer_length)) >= 0)
+    {
+        sendto(fd, buffer, length, 0, (struct sockaddr*)&peer, peer_length);
+        peer_length = sizeof(peer);
+    }
+
+    return NULL;
+}
+
+static bool echo_start(void)
+{
+    pthread_t thread;
+    int tcp = listen_socket(SOCK_STREAM, CHECK_TCP_ECHO_PORT);
+    int udp = listen_socket(SOCK_DGRAM, CHECK_UDP_ECHO_PORT);
+
+    if (tcp < 0 || udp < 0)
+    {
+        printf("ERROR: Failed to start the echo servers\r\n");
+        return false;
+    }
+
+    return pthread_create(&thread, NULL, tcp_echo_entry, (void*)(intptr_t)tcp) == 0 &&
+           pthread_create(&thread, NULL, udp_echo_entry, (void*)(intptr_t)udp) == 0;
+}
+
+static bool join(void)
+{
+    return WIFI_Connect(ES_WIFI_SIM_SSID, ES_WIFI_SIM_PASSWORD, WIFI_ECN_WPA2_PSK) == WIFI_STATUS_OK;
+}
+
+// Send a message and expect it back within one receive, the echo arrives in a single segment on loopback
+static bool tcp_echo(const char* message)
+{
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    uint16_t length = strlen(message);
+    uint16_t sent;
+    uint16_t received;
+
+    return WIFI_SendData(CHECK_TCP_SOCKET, (uint8_t*)message, length, &sent, CHECK_RECEIVE_TIMEOUT) ==
+               WIFI_STATUS_OK &&
+           sent == length &&
+           WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT) ==
+               WIFI_STATUS_OK &&
+           received == length && memcmp(buffer, message, length) == 0;
+}
+
+// Send the bytes in chunks and read each echo back, the pattern shows a byte that was lost or moved
+static bool tcp_transfer(uint32_t total, uint16_t chunk)
+{
+    static uint8_t message[ES_WIFI_PAYLOAD_SIZE];
+    static uint8_t echo[ES_WIFI_PAYLOAD_SIZE];
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    uint16_t length;
+    uint16_t sent;
+    uint16_t received;
+
+    for (uint32_t offset = 0; offset < total; offset += length)
+    {
+        length = MIN(MIN(chunk, total - offset), sizeof(message));
+        for (uint16_t i = 0; i < length; i++)
+        {
+            message[i] = (uint8_t)((offset + i) * 7 + 1);
+        }
+
+        if (WIFI_SendData(CHECK_TCP_SOCKET, message, length, &sent, CHECK_RECEIVE_TIMEOUT) != WIFI_STATUS_OK ||
+            sent != length)
+        {
+            return false;
+        }
+
+        // Always ask for a full buffer, the echo may come back in more than one piece
+        for (uint16_t total_received = 0; total_received < length; total_received += received)
+        {
+            if (WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT) !=
+                    WIFI_STATUS_OK ||
+                received == 0 || total_received + received > length)
+            {
+                return false;
+            }
+            memcpy(echo + total_received, buffer, received);
+        }
+
+        if (memcmp(echo, message, length) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool tcp_open(void)
+{
+    return WIFI_OpenClientConnection(CHECK_TCP_SOCKET, WIFI_TCP_PROTOCOL, "echo", loopback, CHECK_TCP_ECHO_PORT, 0) ==
+           WIFI_STATUS_OK;
+}
+
+static bool check_init(void)
+{
+    char text[ES_WIFI_PRODUCT_NAME_SIZE + 1] = {0};
+
+    if (WIFI_Init() != WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    WIFI_GetModuleName(text);
+    printf("Module %s, firmware %s\r\n", text, (char*)EsWifiObj.FW_Rev);
+
+    return strcmp((char*)EsWifiObj.Product_ID, ES_WIFI_SIM_PRODUCT_ID) == 0 &&
+           strcmp((char*)EsWifiObj.FW_Rev, ES_WIFI_SIM_FW_REV) == 0 && strcmp(text, ES_WIFI_SIM_PRODUCT_NAME) == 0;
+}
+
+static bool check_join(void)
+{
+    uint8_t address[4];
+    uint8_t mask[4];
+    uint8_t mac[6];
+
+    // A wrong password is refused and leaves the module unjoined
+    if (WIFI_Connect(ES_WIFI_SIM_SSID, "wrong", WIFI_ECN_WPA2_PSK) == WIFI_STATUS_OK ||
+        WIFI_IsConnected() == WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    return join() && WIFI_IsConnected() == WIFI_STATUS_OK && WIFI_GetIP_Address(address) == WIFI_STATUS_OK &&
+           memcmp(address, loopback, 4) == 0 && WIFI_GetIP_Mask(mask) == WIFI_STATUS_OK && mask[0] == 255 &&
+           mask[1] == 0 && WIFI_GetMAC_Address(mac) == WIFI_STATUS_OK && mac[0] == 0xC4 && mac[5] == 0x01 &&
+           strcmp((char*)EsWifiObj.NetSettings.SSID, ES_WIFI_SIM_SSID) == 0;
+}
+
+static bool check_scan(void)
+{
+    WIFI_APs_t aps;
+
+    // The firmware revision selects the one access point per response listing
+    return WIFI_ListAccessPoints(&aps, WIFI_MAX_APS) == WIFI_STATUS_OK && aps.count == 2 &&
+           strcmp((char*)aps.ap[0].SSID, ES_WIFI_SIM_SSID) == 0 && aps.ap[0].RSSI == -42 &&
+           aps.ap[0].Channel == 6 && aps.ap[0].Ecn == WIFI_ECN_WPA2_PSK && aps.ap[0].MAC[5] == 0x03 &&
+           strcmp((char*)aps.ap[1].SSID, "host-guest") == 0 && aps.ap[1].Ecn == WIFI_ECN_OPEN &&
+           aps.ap[1].Channel == 11;
+}
+
+static bool check_dns(void)
+{
+    uint8_t address[4] = {0};
+
+    return WIFI_GetHostAddress("localhost", address) == WIFI_STATUS_OK && memcmp(address, loopback, 4) == 0 &&
+           WIFI_GetHostAddress("missing.invalid", address) != WIFI_STATUS_OK;
+}
+
+static bool check_ping(void)
+{
+    uint8_t unreachable[4] = {192, 0, 2, 1};
+    int32_t result[CHECK_PING_COUNT];
+
+    if (WIFI_Ping(loopback, CHECK_PING_COUNT, 100, result) != WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < CHECK_PING_COUNT; i++)
+    {
+        if (result[i] < 0)
+        {
+            return false;
+        }
+    }
+
+    return WIFI_Ping(unreachable, CHECK_PING_COUNT, 100, result) != WIFI_STATUS_OK;
+}
+
+static bool check_tcp(void)
+{
+    static const char head[] = "scatter";
+    static const char tail[] = "-gather";
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    ES_WIFI_Segment_t segments[2] = {{(uint8_t*)head, sizeof(head) - 1}, {(uint8_t*)tail, sizeof(tail) - 1}};
+    uint16_t sent;
+    uint16_t received;
+    bool passed;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // Odd lengths go through the padding on both sides of the transfer
+    passed = tcp_echo("hello world") && tcp_echo("even");
+
+    passed = passed && WIFI_SendDataSegments(CHECK_TCP_SOCKET, segments, 2, &sent, CHECK_RECEIVE_TIMEOUT) ==
+                           WIFI_STATUS_OK &&
+             sent == 14 &&
+             WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT) ==
+                 WIFI_STATUS_OK &&
+             received == 14 && memcmp(buffer, "scatter-gather", 14) == 0;
+
+    // Nothing is pending, the receive times out empty
+    passed = passed && WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, 10) == WIFI_STATUS_OK &&
+             received == 0;
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_udp(void)
+{
+    static const char message[] = "datagram";
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    uint8_t peer[4] = {0};
+    uint16_t port   = 0;
+    uint16_t sent;
+    uint16_t received;
+    bool passed;
+
+    if (WIFI_OpenClientConnection(
+            CHECK_UDP_SOCKET, WIFI_UDP_PROTOCOL, "echo", loopback, CHECK_UDP_ECHO_PORT, CHECK_UDP_LOCAL) !=
+        WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    passed = WIFI_SendDataTo(CHECK_UDP_SOCKET,
+                 (uint8_t*)message,
+                 sizeof(message) - 1,
+                 &sent,
+                 CHECK_RECEIVE_TIMEOUT,
+                 loopback,
+                 CHECK_UDP_ECHO_PORT) == WIFI_STATUS_OK &&
+             WIFI_ReceiveDataFrom(
+                 CHECK_UDP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT, peer, &port) ==
+                 WIFI_STATUS_OK &&
+             received == sizeof(message) - 1 && memcmp(buffer, message, received) == 0 &&
+             memcmp(peer, loopback, 4) == 0 && port == CHECK_UDP_ECHO_PORT;
+
+    return WIFI_CloseClientConnection(CHECK_UDP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_server(void)
+{
+    static const char request[] = "ping";
+    static const char reply[]   = "pong";
+    struct sockaddr_in address  = {0};
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    uint16_t length;
+    bool passed;
+    int fd;
+
+    if (WIFI_StartServer(CHECK_SERVER_SOCKET, WIFI_TCP_PROTOCOL, 1, "server", CHECK_SERVER_PORT) != WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    // Nobody connected yet
+    if (WIFI_WaitServerConnection(CHECK_SERVER_SOCKET, 200, NULL, NULL) != WIFI_STATUS_TIMEOUT)
+    {
+        return false;
+    }
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port        = htons(CHECK_SERVER_PORT);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0)
+    {
+        return false;
+    }
+
+    send(fd, request, sizeof(request) - 1, 0);
+
+    passed = WIFI_WaitServerConnection(CHECK_SERVER_SOCKET, 1000, NULL, NULL) == WIFI_STATUS_OK &&
+             WIFI_ReceiveData(CHECK_SERVER_SOCKET, buffer, sizeof(buffer), &length, CHECK_RECEIVE_TIMEOUT) ==
+                 WIFI_STATUS_OK &&
+             length == sizeof(request) - 1 && memcmp(buffer, request, length) == 0 &&
+             WIFI_SendData(CHECK_SERVER_SOCKET, (uint8_t*)reply, sizeof(reply) - 1, &length, CHECK_RECEIVE_TIMEOUT) ==
+                 WIFI_STATUS_OK &&
+             recv(fd, buffer, sizeof(buffer), 0) == sizeof(reply) - 1 && memcmp(buffer, reply, sizeof(reply) - 1) == 0;
+
+    // Closing the accepted connection is seen by the peer, the server keeps listening
+    passed = passed && WIFI_CloseServerConnection(CHECK_SERVER_SOCKET) == WIFI_STATUS_OK &&
+             recv(fd, buffer, sizeof(buffer), 0) == 0;
+
+    close(fd);
+    return WIFI_StopServer(CHECK_SERVER_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+// Send a chain of segments cut from a pattern with gaps between them, then compare what the module received and
+// read the echo back. An odd total is padded with one '\n' after the payload, a long chain is cut at a full payload.
+static bool segments_send(const uint16_t* lengths, uint8_t count)
+{
+    static uint8_t source[2 * ES_WIFI_PAYLOAD_SIZE];
+    static uint8_t expected[CHECK_SEGMENTS_RAW];
+    static uint8_t raw[CHECK_SEGMENTS_RAW];
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    ES_WIFI_Segment_t segments[CHECK_SEGMENTS_MAXIMUM];
+    uint32_t offset  = 0;
+    uint32_t payload = 0;
+    uint16_t header;
+    uint16_t length;
+    uint16_t sent;
+    uint16_t received;
+
+    for (uint32_t i = 0; i < sizeof(source); i++)
+    {
+        source[i] = (uint8_t)(i * 13 + 5);
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        segments[i].Data   = source + offset;
+        segments[i].Length = lengths[i];
+        offset += lengths[i] + 3;
+        payload += lengths[i];
+    }
+
+    payload = MIN(payload, ES_WIFI_PAYLOAD_SIZE);
+    header  = snprintf((char*)expected, sizeof(expected), "S3=%04u\r", (unsigned)payload);
+    length  = header;
+    for (uint8_t i = 0; i < count && length < header + payload; i++)
+    {
+        uint16_t take = MIN(lengths[i], header + payload - length);
+
+        memcpy(expected + length, segments[i].Data, take);
+        length += take;
+    }
+    if (length & 1)
+    {
+        expected[length++] = '\n';
+    }
+
+    if (WIFI_SendDataSegments(CHECK_TCP_SOCKET, segments, count, &sent, CHECK_RECEIVE_TIMEOUT) != WIFI_STATUS_OK ||
+        sent != payload || es_wifi_sim_last_send(raw, sizeof(raw)) != length || memcmp(raw, expected, length) != 0)
+    {
+        return false;
+    }
+
+    for (uint32_t total = 0; total < payload; total += received)
+    {
+        if (WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT) !=
+                WIFI_STATUS_OK ||
+            received == 0 || total + received > payload ||
+            memcmp(buffer, expected + header + total, received) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool check_segments(void)
+{
+    static const uint16_t odd_total[]  = {3, 1, 5, 0, 6, 2};
+    static const uint16_t even_total[] = {3, 5};
+    static const uint16_t clamped[]    = {701, 1, 700};
+    bool passed;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    es_wifi_sim_clear();
+    passed = segments_send(odd_total, 6) && segments_send(even_total, 2) && segments_send(clamped, 3);
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_cache(void)
+{
+    bool passed;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // The socket and its settings are selected once, later exchanges on the same socket skip them
+    es_wifi_sim_clear();
+    passed = tcp_echo("one") && tcp_echo("two") && tcp_echo("three");
+    printf("P0 %u, S2 %u, R1 %u, R2 %u for three exchanges\r\n",
+        es_wifi_sim_count("P0"),
+        es_wifi_sim_count("S2"),
+        es_wifi_sim_count("R1"),
+        es_wifi_sim_count("R2"));
+
+    passed = passed && es_wifi_sim_count("P0") == 0 && es_wifi_sim_count("S2") == 1 && es_wifi_sim_count("R1") == 1 &&
+             es_wifi_sim_count("R2") == 1;
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_commands(void)
+{
+    bool passed;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // Past the first exchange a transfer is only sends and receives, the socket and its settings stay selected
+    es_wifi_sim_clear();
+    passed = tcp_transfer(CHECK_COMMANDS_SIZE, CHECK_COMMANDS_CHUNK);
+    printf("P0 %u, S2 %u, S3 %u, R1 %u, R2 %u, R0 %u for 1 KB\r\n",
+        es_wifi_sim_count("P0"),
+        es_wifi_sim_count("S2"),
+        es_wifi_sim_count("S3"),
+        es_wifi_sim_count("R1"),
+        es_wifi_sim_count("R2"),
+        es_wifi_sim_count("R0"));
+
+    passed = passed && es_wifi_sim_count("P0") == 0 && es_wifi_sim_count("S2") == 1 &&
+             es_wifi_sim_count("S3") == CHECK_COMMANDS_SIZE / CHECK_COMMANDS_CHUNK && es_wifi_sim_count("R1") == 1 &&
+             es_wifi_sim_count("R2") == 1;
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static uint32_t elapsed_us(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+static int compare_us(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static bool check_latency(void)
+{
+    static uint32_t round_trip[CHECK_LATENCY_COUNT];
+    struct timespec start;
+    bool passed = true;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // Each round trip is a send and the receive that picks up its echo through the AT layer, as a reply to a small MQTT
+    // packet would be. The driver thread noticing the reply is not included, the driver_poll host check covers that.
+    for (int i = 0; i < CHECK_LATENCY_COUNT && passed; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        passed        = tcp_transfer(CHECK_LATENCY_SIZE, CHECK_LATENCY_SIZE);
+        round_trip[i] = elapsed_us(&start);
+    }
+
+    if (passed)
+    {
+        qsort(round_trip, CHECK_LATENCY_COUNT, sizeof(round_trip[0]), compare_us);
+        printf("Round trip of %d bytes in us: p50 %u, p90 %u, p99 %u, max %u\r\n",
+            CHECK_LATENCY_SIZE,
+            round_trip[CHECK_LATENCY_COUNT / 2],
+            round_trip[CHECK_LATENCY_COUNT * 90 / 100],
+            round_trip[CHECK_LATENCY_COUNT * 99 / 100],
+            round_trip[CHECK_LATENCY_COUNT - 1]);
+
+        passed = round_trip[CHECK_LATENCY_COUNT * 99 / 100] < CHECK_LATENCY_BOUND;
+    }
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_bulk(void)
+{
+    uint32_t sends   = (CHECK_BULK_SIZE + ES_WIFI_PAYLOAD_SIZE - 1) / ES_WIFI_PAYLOAD_SIZE;
+    uint32_t payload = 2 * CHECK_BULK_SIZE;
+    es_wifi_sim_stats_t stats;
+    uint32_t framed;
+    bool passed;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // The payload crosses the AT layer twice, out with S3 and back with R0. The simulated module stands in for the SPI
+    // transport, so only the AT framing and transaction count are measured, not a transfer rate.
+    es_wifi_sim_clear();
+    passed = tcp_transfer(CHECK_BULK_SIZE, ES_WIFI_PAYLOAD_SIZE);
+    es_wifi_sim_stats(&stats);
+
+    framed = stats.bytes_sent + stats.bytes_received;
+    printf("%u KB in %u sends, %u transactions, %u framed bytes for %u payload bytes\r\n",
+        CHECK_BULK_SIZE / 1024,
+        sends,
+        stats.transactions,
+        framed,
+        payload);
+
+    // One S3 and one R0 per send, S2, R1 and R2 once for the socket, and the odd extra R0 for a split echo
+    passed = passed && es_wifi_sim_count("S3") == sends && stats.transactions <= 2 * sends + sends / 8 + 3 &&
+             framed < payload + payload / CHECK_BULK_OVERHEAD;
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_drop(void)
+{
+    uint8_t buffer[ES_WIFI_PAYLOAD_SIZE];
+    uint16_t sent;
+    uint16_t received;
+    uint32_t start;
+    bool passed;
+
+    if (!tcp_open() || WIFI_SendData(CHECK_TCP_SOCKET, (uint8_t*)"late", 4, &sent, CHECK_RECEIVE_TIMEOUT) !=
+                           WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    // The R0 runs and consumes the echo, only its response is lost
+    es_wifi_sim_fault(ES_WIFI_SIM_FAULT_DROP_RESPONSE, "R0");
+    es_wifi_sim_clear();
+    start  = HAL_GetTick();
+    passed = WIFI_ReceiveData(CHECK_TCP_SOCKET, buffer, sizeof(buffer), &received, CHECK_RECEIVE_TIMEOUT) !=
+                 WIFI_STATUS_OK &&
+             HAL_GetTick() - start >= ES_WIFI_TIMEOUT;
+
+    // After the failed exchange nothing is assumed about the module, the socket is selected again
+    passed = passed && tcp_echo("after") && es_wifi_sim_count("P0") == 1;
+
+    return WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK && passed;
+}
+
+static bool check_error(void)
+{
+    es_wifi_sim_fault(ES_WIFI_SIM_FAULT_ERROR, "P6=1");
+    if (tcp_open())
+    {
+        return false;
+    }
+
+    return tcp_open() && tcp_echo("retry") && WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK;
+}
+
+static bool check_reset(void)
+{
+    uint16_t sent;
+
+    if (!tcp_open())
+    {
+        return false;
+    }
+
+    // The module restarts in the middle of a send, the connection and the join are gone
+    es_wifi_sim_fault(ES_WIFI_SIM_FAULT_RESET, "S3");
+    if (WIFI_SendData(CHECK_TCP_SOCKET, (uint8_t*)"lost", 4, &sent, CHECK_RECEIVE_TIMEOUT) == WIFI_STATUS_OK ||
+        WIFI_IsConnected() == WIFI_STATUS_OK || tcp_open())
+    {
+        return false;
+    }
+
+    // Rejoin and reconnect the way the board's network code recovers
+    return join() && tcp_open() && tcp_echo("recovered") &&
+           WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK;
+}
+
+static bool check_stuffing(void)
+{
+    // The IO layer resets a module that never stops clocking out filler, the command reports the crash
+    es_wifi_sim_fault(ES_WIFI_SIM_FAULT_STUFFING, "C?");
+    if (ES_WIFI_GetNetworkSettings(&EsWifiObj) != ES_WIFI_STATUS_MODULE_CRASH || WIFI_IsConnected() == WIFI_STATUS_OK)
+    {
+        return false;
+    }
+
+    return join() && tcp_open() && tcp_echo("restarted") &&
+           WIFI_CloseClientConnection(CHECK_TCP_SOCKET) == WIFI_STATUS_OK;
+}
+
+// Run in this order, everything after the join needs the module on the network
+static const check_t checks[] = {
+    {"init", "Module answers I? and its identity is parsed", check_init},
+    {"join", "Wrong password refused, join reports address, mask and MAC", check_join},
+    {"scan", "Access points listed one per response with MR", check_scan},
+    {"dns", "Names resolve through the host, .invalid fails", check_dns},
+    {"ping", "Loopback answers every ping, an unreachable address fails", check_ping},
+    {"tcp", "Echo over a TCP client socket, padded, gathered and empty receives", check_tcp},
+    {"udp", "Echo over a UDP socket reports the peer address and port", check_udp},
+    {"server", "Server socket accepts, exchanges data and closes the connection", check_server},
+    {"segments", "Chained sends arrive byte for byte after the S3 length, padded when odd", check_segments},
+    {"cache", "Repeated exchanges skip socket selection and settings", check_cache},
+    {"commands", "A 1 KB transfer sets the socket timeouts and receive length once", check_commands},
+    {"latency", "Small echoes come back well inside the receive timeout", check_latency},
+    {"bulk", "A 64 KB transfer in full payloads keeps the AT framing overhead small", check_bulk},
+    {"drop", "A dropped response times out and the socket is selected again", check_drop},
+    {"error", "A refused command fails and the retry succeeds", check_error},
+    {"reset", "A module reset mid-send is recovered by rejoining", check_reset},
+    {"stuffing", "A stuck module is reported as crashed and recovered", check_stuffing},
+};
+
+#define CHECK_COUNT (sizeof(checks) / sizeof(checks[0]))
+
+// Checks that every other one depends on
+#define CHECK_SETUP_COUNT 2
+
+static void check_usage(const char* program)
+{
+    printf("Usage: %s [--check NAME]\r\n", program);
+    printf("  --check  Run only NAME after init and join, one of:");
+    for (int i = CHECK_SETUP_COUNT; i < CHECK_COUNT; i++)
+    {
+        printf(" %s", checks[i].name);
+    }
+    printf("\r\n");
+}
+
+static bool check_parse(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--check") == 0 && value)
+        {
+            check_only = value;
+        }
+        else
+        {
+            check_usage(argv[0]);
+            return false;
+        }
+        i++;
+    }
+
+    if (check_only != NULL)
+    {
+        bool known = false;
+
+        for (int i = CHECK_SETUP_COUNT; i < CHECK_COUNT; i++)
+        {
+            known |= strcmp(check_only, checks[i].name) == 0;
+        }
+
+        if (!known)
+        {
+            check_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    es_wifi_sim_stats_t stats;
+    int failures = 0;
+    int run      = 0;
+
+    if (!check_parse(argc, argv) || !echo_start())
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < CHECK_COUNT; i++)
+    {
+        const check_t* check = &checks[i];
+        bool passed;
+
+        if (check_only != NULL && i >= CHECK_SETUP_COUNT && strcmp(check_only, check->name) != 0)
+        {
+            continue;
+        }
+
+        printf("\r\nCheck %s: %s\r\n", check->name, check->description);
+        passed = check->run();
+        printf("Check %s: %s\r\n", check->name, passed ? "PASS" : "FAIL");
+
+        run++;
+        if (!passed)
+        {
+            failures++;
+            break;
+        }
+    }
+
+    es_wifi_sim_stats(&stats);
+    printf("\r\nModule: %u transactions since the last clear, %u resets, %u faults injected\r\n",
+        stats.transactions,
+        stats.resets,
+        stats.faults);
+
+    printf("\r\n%d of %d checks passed\r\n", run - failures, run);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _STM32L4XX_HAL_H
+#define _STM32L4XX_HAL_H
+
+#include <stdint.h>
+
+// Just enough of the STM32 HAL for the Inventek sources built on the host, see es_wifi_sim.c
+
+typedef struct
+{
+    uint32_t unused;
+} SPI_HandleTypeDef;
+
+// Milliseconds on the host clock, plus the time skipped by simulated timeouts
+uint32_t HAL_GetTick(void);
+
+void HAL_Delay(uint32_t Delay);
+
+#endif // _STM32L4XX_HAL_H
@@ -0,0 +1,28 @@
+/**************************************************************************/
+/*                                                                        */
+/*       Copyright (c) Microsoft Corporation. All rights reserved.        */
+/*                                                                        */
+/*       This software is licensed under the Microsoft Software License   */
+/*       Terms for Microsoft Azure RTOS. Full text of the license can be  */
+/*       found in the LICENSE file at https://aka.ms/AzureRTOS_EULA       */
+/*       and in the root directory of this software.                      */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef NX_USER_H
+#define NX_USER_H
+
+#define NX_SECURE_ENABLE
+#define NX_ENABLE_EXTENDED_NOTIFY_SUPPORT
+#define NX_ENABLE_IP_PACKET_FILTER
+#define NX_DISABLE_IPV6
+#define NX_DNS_CLIENT_USER_CREATE_PACKET_POOL
+
+#define NXD_MQTT_CLOUD_ENABLE
+
+#define NX_SNTP_CLIENT_MIN_SERVER_STRATUM 3
+
+/* The SNTP responder owns port 123 on the loopback interface, move the client off it.  */
+#define NX_SNTP_CLIENT_UDP_PORT 1123
+
+#endif /* NX_USER_H */
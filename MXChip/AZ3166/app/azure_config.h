@@ -58,11 +58,18 @@ extern device_config_t g_device_config;
 // ----------------------------------------------------------------------------
 // MQTT Topics Configuration
 // ----------------------------------------------------------------------------
-#define MQTT_TELEMETRY_TOPIC  "mxchip/telemetry"      // Simple test topic for telemetry
-#define MQTT_COMMAND_TOPIC    "mxchip/command"        // Simple test topic for commands
-#define MQTT_LED_TOPIC        "mxchip/led"            // Simple test topic for LED control
+#define MQTT_TELEMETRY_TOPIC "mxchip/telemetry"           // Simple test topic for telemetry
+#define MQTT_COMMAND_TOPIC   "mxchip/command"             // Commands, {"name":...,"payload":...,"id":...}
+#define MQTT_RESPONSE_TOPIC  "mxchip/command/response"    // Command results, {"id":...,"status":...}
+#define MQTT_DESIRED_TOPIC   "mxchip/properties/desired"  // Writable properties, {"name":value,...,"$version":n}
+#define MQTT_REPORTED_TOPIC  "mxchip/properties/reported" // Acknowledgements, {"name":{"value":...,"ac":...,"av":n}}
+#define MQTT_LED_TOPIC       "mxchip/led"                 // Simple test topic for LED control
+#define MQTT_CONFIG_TOPIC    "mxchip/config"              // Remote configuration updates, KEY=value lines
+#define MQTT_HEALTH_TOPIC    "mxchip/health"              // System monitor report, stack and CPU usage per thread
+#define MQTT_PROFILE_TOPIC   "mxchip/profile"             // Profiler probes, cycle counts and histograms
 
 // Default telemetry interval in seconds
 #define DEFAULT_TELEMETRY_INTERVAL 10
+#define TELEMETRY_INTERVAL         (g_device_config.telemetry_interval)
 
 #endif // _AZURE_CONFIG_H
@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 
+#include "crc32.h"
 #include "sensor.h"
 #include "ssd1306.h"
 
@@ -74,6 +75,26 @@ void Init_Screen(void)
     ssd1306_Init();
 }
 
+static void CRC_Init(void)
+{
+    uint8_t pattern[203];
+
+    __HAL_RCC_CRC_CLK_ENABLE();
+
+    // Cross check the hardware backend against software, unaligned and with a tail so every path is used
+    for (size_t i = 0; i < sizeof(pattern); i++)
+    {
+        pattern[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    if (crc32_update(crc32_compute(pattern + 1, 97), pattern + 98, 105) !=
+        crc32_update_sw(0, pattern + 1, sizeof(pattern) - 1))
+    {
+        printf("WARNING: CRC unit self test failed, using software CRC\r\n");
+        __HAL_RCC_CRC_CLK_DISABLE();
+    }
+}
+
 void board_init(void)
 {
     /* Initialize STM32F412 HAL library.  */
@@ -85,6 +106,9 @@ void board_init(void)
     // Initialize console
     UART_Console_Init();
 
+    // Initialize CRC unit
+    CRC_Init();
+
     // Initialize timer
     TIM_Init();
 
@@ -0,0 +1,140 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "boot_pipeline.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BOOT_TICKS_TO_MS(ticks) ((ticks) * 1000 / TX_TIMER_TICKS_PER_SECOND)
+
+typedef struct
+{
+    ULONG begin_ticks;
+    ULONG end_ticks;
+    UINT status;
+    bool started;
+    bool done;
+} boot_stage_record_t;
+
+static const CHAR* const boot_stage_names[BOOT_STAGE_COUNT] = {
+    "sensors",
+    "config",
+    "console",
+    "wifi init",
+    "wifi join",
+    "dhcp",
+    "dns",
+    "sntp",
+    "broker resolve",
+    "mqtt connect",
+    "first publish",
+};
+
+static boot_stage_record_t boot_stages[BOOT_STAGE_COUNT];
+static TX_EVENT_FLAGS_GROUP boot_events;
+
+UINT boot_pipeline_init(void)
+{
+    memset(boot_stages, 0, sizeof(boot_stages));
+
+    return tx_event_flags_create(&boot_events, "Boot Pipeline");
+}
+
+VOID boot_stage_begin(boot_stage_t stage)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (stage >= BOOT_STAGE_COUNT)
+    {
+        return;
+    }
+
+    TX_DISABLE
+    if (!boot_stages[stage].started)
+    {
+        boot_stages[stage].begin_ticks = tx_time_get();
+        boot_stages[stage].started     = true;
+    }
+    TX_RESTORE
+}
+
+VOID boot_stage_end(boot_stage_t stage, UINT status)
+{
+    TX_INTERRUPT_SAVE_AREA
+    bool completed = false;
+
+    if (stage >= BOOT_STAGE_COUNT)
+    {
+        return;
+    }
+
+    TX_DISABLE
+    if (!boot_stages[stage].done)
+    {
+        boot_stages[stage].end_ticks = tx_time_get();
+        if (!boot_stages[stage].started)
+        {
+            boot_stages[stage].begin_ticks = boot_stages[stage].end_ticks;
+            boot_stages[stage].started     = true;
+        }
+        boot_stages[stage].status = status;
+        boot_stages[stage].done   = true;
+        completed                 = true;
+    }
+    TX_RESTORE
+
+    if (completed)
+    {
+        tx_event_flags_set(&boot_events, BOOT_STAGE_BIT(stage), TX_OR);
+    }
+}
+
+UINT boot_stage_wait(ULONG stage_mask, ULONG wait_option)
+{
+    UINT status;
+    ULONG events;
+
+    if ((status = tx_event_flags_get(&boot_events, stage_mask, TX_AND, &events, wait_option)))
+    {
+        return status;
+    }
+
+    for (UINT stage = 0; stage < BOOT_STAGE_COUNT; ++stage)
+    {
+        if ((stage_mask & BOOT_STAGE_BIT(stage)) && boot_stages[stage].status != TX_SUCCESS)
+        {
+            return boot_stages[stage].status;
+        }
+    }
+
+    return TX_SUCCESS;
+}
+
+VOID boot_pipeline_report(void)
+{
+    printf("\r\n=============================\r\n");
+    printf("Boot Timeline (ms since reset)\r\n");
+    printf("=============================\r\n");
+
+    for (UINT stage = 0; stage < BOOT_STAGE_COUNT; ++stage)
+    {
+        boot_stage_record_t* record = &boot_stages[stage];
+
+        if (!record->done)
+        {
+            printf("\t%-16s %s\r\n", boot_stage_names[stage], record->started ? "running" : "not run");
+            continue;
+        }
+
+        printf("\t%-16s %6lu -> %6lu (%5lu ms)%s\r\n",
+            boot_stage_names[stage],
+            (unsigned long)BOOT_TICKS_TO_MS(record->begin_ticks),
+            (unsigned long)BOOT_TICKS_TO_MS(record->end_ticks),
+            (unsigned long)BOOT_TICKS_TO_MS(record->end_ticks - record->begin_ticks),
+            record->status == TX_SUCCESS ? "" : " FAILED");
+    }
+
+    printf("=============================\r\n\r\n");
+}
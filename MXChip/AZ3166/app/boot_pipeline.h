@@ -0,0 +1,64 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _BOOT_PIPELINE_H
+#define _BOOT_PIPELINE_H
+
+#include "tx_api.h"
+
+// Boot stages, each one completes exactly once per boot
+typedef enum
+{
+    BOOT_STAGE_SENSORS = 0,     // Sensors configured and first samples available
+    BOOT_STAGE_CONFIG,          // Device configuration loaded
+    BOOT_STAGE_CONSOLE,         // Serial setup window
+    BOOT_STAGE_WIFI_INIT,       // Radio powered up, IP stack created
+    BOOT_STAGE_WIFI_JOIN,       // Associated with the access point
+    BOOT_STAGE_DHCP,            // IP address leased
+    BOOT_STAGE_DNS,             // DNS servers configured
+    BOOT_STAGE_SNTP,            // Wall clock synced
+    BOOT_STAGE_BROKER_RESOLVE,  // Broker address resolved
+    BOOT_STAGE_MQTT_CONNECT,    // MQTT CONNACK received
+    BOOT_STAGE_FIRST_PUBLISH,   // First telemetry message published
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+
+#define BOOT_STAGE_BIT(stage) (1UL << (stage))
+
+// Stages that must complete before the network can carry application traffic
+#define BOOT_NETWORK_READY (BOOT_STAGE_BIT(BOOT_STAGE_WIFI_JOIN) | BOOT_STAGE_BIT(BOOT_STAGE_DHCP) | BOOT_STAGE_BIT(BOOT_STAGE_DNS))
+
+/**
+ * @brief Initialize the boot pipeline, must be called from tx_application_define
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT boot_pipeline_init(void);
+
+/**
+ * @brief Mark the start of a boot stage. Ignored if the stage already completed.
+ * @param stage Boot stage
+ */
+VOID boot_stage_begin(boot_stage_t stage);
+
+/**
+ * @brief Mark the end of a boot stage and release any stage waiting on it.
+ *        Safe to call from timer context. Ignored if the stage already completed.
+ * @param stage Boot stage
+ * @param status Result of the stage, 0 on success
+ */
+VOID boot_stage_end(boot_stage_t stage, UINT status);
+
+/**
+ * @brief Block until all the stages in the mask have completed
+ * @param stage_mask Mask built with BOOT_STAGE_BIT
+ * @param wait_option ThreadX wait option
+ * @return TX_SUCCESS if all stages completed successfully, the first failing stage status otherwise
+ */
+UINT boot_stage_wait(ULONG stage_mask, ULONG wait_option);
+
+/**
+ * @brief Print the boot timeline report to the console
+ */
+VOID boot_pipeline_report(void);
+
+#endif // _BOOT_PIPELINE_H
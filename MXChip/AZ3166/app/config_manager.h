@@ -4,6 +4,7 @@
 #ifndef _CONFIG_MANAGER_H
 #define _CONFIG_MANAGER_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -143,4 +144,33 @@ config_result_t config_manager_delayed_flash_write(void);
  */
 config_result_t config_manager_load_from_persistent_storage(device_config_t* config);
 
+/**
+ * @brief Stage a configuration in the candidate slot, it is tried on the next boot
+ * @param config Pointer to configuration structure to stage
+ * @return CONFIG_OK on success, error code otherwise
+ */
+config_result_t config_manager_stage(const device_config_t* config);
+
+/**
+ * @brief Make the running candidate the active configuration, call once the broker has been reached
+ */
+void config_manager_commit(void);
+
+/**
+ * @brief Wait for a running candidate to be committed, or roll it back and reset once its trial expires
+ * @note Returns at once when no candidate is on trial. The trial timer only signals, this runs the rollback.
+ */
+void config_manager_trial_wait(void);
+
+/**
+ * @brief Apply a remote configuration update of KEY=value lines
+ * @param current Running configuration, updated in place when only runtime settings change
+ * @param content Update text
+ * @param length Length of the update text
+ * @param restart_required Set when the update was staged as a candidate and needs a restart to be tried
+ * @return CONFIG_OK on success, error code otherwise
+ */
+config_result_t config_manager_apply_update(
+    device_config_t* current, const char* content, size_t length, bool* restart_required);
+
 #endif // _CONFIG_MANAGER_H
@@ -0,0 +1,368 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "config_schema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_config.h"
+
+// Longest value text accepted from a file, remote push or the prompt
+#define CONFIG_VALUE_MAX_LEN 128
+
+// Key lookup slots, must be a power of two comfortably larger than the number of fields
+#define CONFIG_KEY_SLOTS 32
+
+#define CONFIG_STR_(x) #x
+#define CONFIG_STR(x)  CONFIG_STR_(x)
+
+#define CONFIG_STRING_FIELD(key, label, member, default_value, secret)                                       \
+    { key, label, CONFIG_FIELD_STRING, offsetof(device_config_t, member),                                     \
+        sizeof(((device_config_t*)0)->member), 0, 0, NULL, default_value, secret, false }
+#define CONFIG_UINT_FIELD(key, label, type, member, min, max, default_value, runtime)                         \
+    { key, label, type, offsetof(device_config_t, member),                                                    \
+        sizeof(((device_config_t*)0)->member), min, max, NULL, CONFIG_STR(default_value), false, runtime }
+#define CONFIG_ENUM_FIELD(key, label, member, names, default_value)                                           \
+    { key, label, CONFIG_FIELD_ENUM, offsetof(device_config_t, member),                                       \
+        sizeof(((device_config_t*)0)->member), 0, sizeof(names) / sizeof(names[0]) - 1, names, default_value, \
+        false, false }
+
+static const char* const wifi_mode_names[] = {"None", "WEP", "WPA_PSK_TKIP", "WPA2_PSK_AES"};
+
+// Device configuration schema, adding a setting only needs a member in device_config_t and a line here
+static const config_field_t config_fields[] = {
+    CONFIG_STRING_FIELD("WIFI_SSID", "WiFi SSID", wifi_ssid, WIFI_SSID_DEFAULT, false),
+    CONFIG_STRING_FIELD("WIFI_PASSWORD", "WiFi Password", wifi_password, WIFI_PASSWORD_DEFAULT, true),
+    CONFIG_ENUM_FIELD("WIFI_MODE", "WiFi Mode", wifi_mode, wifi_mode_names, "WPA2_PSK_AES"),
+    CONFIG_STRING_FIELD("MQTT_HOSTNAME", "MQTT Hostname", mqtt_hostname, MQTT_BROKER_HOSTNAME_DEFAULT, false),
+    CONFIG_UINT_FIELD("MQTT_PORT", "MQTT Port", CONFIG_FIELD_U16, mqtt_port, 1, 65535, MQTT_BROKER_PORT_DEFAULT,
+        false),
+    CONFIG_STRING_FIELD("MQTT_CLIENT_ID", "MQTT Client ID", mqtt_client_id, MQTT_CLIENT_ID_DEFAULT, false),
+    CONFIG_STRING_FIELD("MQTT_USERNAME", "MQTT Username", mqtt_username, MQTT_USERNAME_DEFAULT, false),
+    CONFIG_STRING_FIELD("MQTT_PASSWORD", "MQTT Password", mqtt_password, MQTT_PASSWORD_DEFAULT, true),
+    CONFIG_UINT_FIELD("TELEMETRY_INTERVAL", "Telemetry Interval (s)", CONFIG_FIELD_U32, telemetry_interval, 1,
+        86400, DEFAULT_TELEMETRY_INTERVAL, true),
+};
+
+#define CONFIG_FIELD_COUNT (sizeof(config_fields) / sizeof(config_fields[0]))
+
+// CONFIG_KEY_SLOTS too small for the schema when the array size goes negative
+typedef char config_key_slots_check[CONFIG_FIELD_COUNT * 2 <= CONFIG_KEY_SLOTS ? 1 : -1];
+
+// Perfect hash over the keys. The seed is searched once so that every key lands in its own slot,
+// a lookup is then one hash and one string compare regardless of the number of fields.
+static uint8_t config_key_slots[CONFIG_KEY_SLOTS];  // Field index + 1, 0 for an empty slot
+static uint32_t config_key_seed;
+static bool config_key_slots_ready;
+
+static uint32_t config_key_hash(const char* key, size_t key_len, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+
+    for (size_t i = 0; i < key_len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+
+    return (hash ^ (hash >> 16)) & (CONFIG_KEY_SLOTS - 1);
+}
+
+static void config_key_slots_build(void) {
+    for (uint32_t seed = 0; seed < 4096; seed++) {
+        bool collision = false;
+
+        memset(config_key_slots, 0, sizeof(config_key_slots));
+        for (size_t i = 0; i < CONFIG_FIELD_COUNT && !collision; i++) {
+            uint32_t slot = config_key_hash(config_fields[i].key, strlen(config_fields[i].key), seed);
+            if (config_key_slots[slot] != 0) {
+                collision = true;
+            } else {
+                config_key_slots[slot] = (uint8_t)(i + 1);
+            }
+        }
+
+        if (!collision) {
+            config_key_seed = seed;
+            config_key_slots_ready = true;
+            return;
+        }
+    }
+
+    // No seed found, config_schema_find falls back to a linear scan
+    memset(config_key_slots, 0, sizeof(config_key_slots));
+}
+
+const config_field_t* config_schema_fields(size_t* count) {
+    if (count) {
+        *count = CONFIG_FIELD_COUNT;
+    }
+    return config_fields;
+}
+
+const config_field_t* config_schema_find(const char* key, size_t key_len) {
+    if (!config_key_slots_ready) {
+        config_key_slots_build();
+    }
+
+    if (config_key_slots_ready) {
+        uint8_t index = config_key_slots[config_key_hash(key, key_len, config_key_seed)];
+        if (index != 0) {
+            const config_field_t* field = &config_fields[index - 1];
+            if (strncmp(field->key, key, key_len) == 0 && field->key[key_len] == '\0') {
+                return field;
+            }
+        }
+        return NULL;
+    }
+
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        if (strncmp(config_fields[i].key, key, key_len) == 0 && config_fields[i].key[key_len] == '\0') {
+            return &config_fields[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t field_get_uint(const device_config_t* config, const config_field_t* field) {
+    const uint8_t* member = (const uint8_t*)config + field->offset;
+
+    if (field->size == sizeof(uint16_t)) {
+        uint16_t value;
+        memcpy(&value, member, sizeof(value));
+        return value;
+    } else {
+        uint32_t value;
+        memcpy(&value, member, sizeof(value));
+        return value;
+    }
+}
+
+static void field_set_uint(device_config_t* config, const config_field_t* field, uint32_t value) {
+    uint8_t* member = (uint8_t*)config + field->offset;
+
+    if (field->size == sizeof(uint16_t)) {
+        uint16_t value16 = (uint16_t)value;
+        memcpy(member, &value16, sizeof(value16));
+    } else {
+        memcpy(member, &value, sizeof(value));
+    }
+}
+
+bool config_schema_set(device_config_t* config, const config_field_t* field, const char* value) {
+    char* end;
+    unsigned long number;
+
+    switch (field->type) {
+        case CONFIG_FIELD_STRING:
+            if (strlen(value) >= field->size) {
+                return false;
+            }
+            strncpy((char*)config + field->offset, value, field->size);
+            return true;
+
+        case CONFIG_FIELD_ENUM:
+            for (uint32_t i = 0; i <= field->max; i++) {
+                if (strcmp(value, field->names[i]) == 0) {
+                    field_set_uint(config, field, i);
+                    return true;
+                }
+            }
+            // Numeric values are accepted as well
+            // fall through
+
+        case CONFIG_FIELD_U16:
+        case CONFIG_FIELD_U32:
+            number = strtoul(value, &end, 10);
+            if (value[0] == '\0' || *end != '\0' || number < field->min || number > field->max) {
+                return false;
+            }
+            field_set_uint(config, field, (uint32_t)number);
+            return true;
+    }
+
+    return false;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int config_schema_parse(device_config_t* config, const char* content, size_t length) {
+    const char* ptr = content;
+    const char* content_end = content + length;
+    char value[CONFIG_VALUE_MAX_LEN];
+    int applied = 0;
+
+    while (ptr < content_end) {
+        const char* line_end = memchr(ptr, '\n', content_end - ptr);
+        const char* next;
+        const char* equals;
+        const char* key_end;
+        const char* value_start;
+        const char* value_end;
+
+        if (!line_end) {
+            line_end = content_end;
+        }
+        next = line_end < content_end ? line_end + 1 : line_end;
+
+        // Trim the line
+        while (ptr < line_end && is_space(*ptr)) {
+            ptr++;
+        }
+
+        // Skip empty lines, comments and lines without a key=value pair
+        equals = memchr(ptr, '=', line_end - ptr);
+        if (ptr == line_end || *ptr == '#' || !equals) {
+            ptr = next;
+            continue;
+        }
+
+        key_end = equals;
+        while (key_end > ptr && is_space(key_end[-1])) {
+            key_end--;
+        }
+
+        value_start = equals + 1;
+        while (value_start < line_end && is_space(*value_start)) {
+            value_start++;
+        }
+        value_end = line_end;
+        while (value_end > value_start && is_space(value_end[-1])) {
+            value_end--;
+        }
+
+        const config_field_t* field = config_schema_find(ptr, key_end - ptr);
+        if (field) {
+            size_t value_len = value_end - value_start;
+
+            if (value_len < sizeof(value)) {
+                memcpy(value, value_start, value_len);
+                value[value_len] = '\0';
+            }
+
+            if (value_len < sizeof(value) && config_schema_set(config, field, value)) {
+                applied++;
+            } else {
+                printf("Config: invalid value for %s\r\n", field->key);
+            }
+        }
+
+        ptr = next;
+    }
+
+    return applied;
+}
+
+void config_schema_defaults(device_config_t* config) {
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        config_schema_set(config, &config_fields[i], config_fields[i].default_value);
+    }
+}
+
+bool config_schema_validate(const device_config_t* config) {
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        const config_field_t* field = &config_fields[i];
+
+        if (field->type == CONFIG_FIELD_STRING) {
+            // Ensure null termination
+            if (strnlen((const char*)config + field->offset, field->size) >= field->size) {
+                return false;
+            }
+        } else {
+            uint32_t value = field_get_uint(config, field);
+            if (value < field->min || value > field->max) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool config_schema_requires_restart(const device_config_t* from, const device_config_t* to) {
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        const config_field_t* field = &config_fields[i];
+
+        if (!field->runtime &&
+            memcmp((const uint8_t*)from + field->offset, (const uint8_t*)to + field->offset, field->size) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void config_schema_format(
+    const device_config_t* config, const config_field_t* field, char* buffer, size_t size, bool mask_secrets) {
+    if (field->type == CONFIG_FIELD_STRING) {
+        const char* value = (const char*)config + field->offset;
+        if (mask_secrets && field->secret && value[0] != '\0') {
+            snprintf(buffer, size, "********");
+        } else {
+            snprintf(buffer, size, "%s", value);
+        }
+    } else if (field->type == CONFIG_FIELD_ENUM && field_get_uint(config, field) <= field->max) {
+        snprintf(buffer, size, "%s", field->names[field_get_uint(config, field)]);
+    } else {
+        snprintf(buffer, size, "%lu", (unsigned long)field_get_uint(config, field));
+    }
+}
+
+void config_schema_print(const device_config_t* config) {
+    char value[CONFIG_VALUE_MAX_LEN];
+
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        config_schema_format(config, &config_fields[i], value, sizeof(value), true);
+        printf("  %s: %s\r\n", config_fields[i].label, value);
+    }
+}
+
+size_t config_schema_serialize(const device_config_t* config, char* buffer, size_t size) {
+    char value[CONFIG_VALUE_MAX_LEN];
+    size_t length = 0;
+
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        int written;
+
+        config_schema_format(config, &config_fields[i], value, sizeof(value), false);
+        written = snprintf(buffer + length, size - length, "%s=%s\n", config_fields[i].key, value);
+        if (written < 0 || (size_t)written >= size - length) {
+            return 0;
+        }
+        length += written;
+    }
+
+    return length;
+}
+
+void config_schema_prompt(device_config_t* config) {
+    char current[CONFIG_VALUE_MAX_LEN];
+    char input[CONFIG_VALUE_MAX_LEN];
+
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        const config_field_t* field = &config_fields[i];
+
+        config_schema_format(config, field, current, sizeof(current), true);
+
+        while (true) {
+            printf("%s [%s]: ", field->label, current);
+            if (!fgets(input, sizeof(input), stdin)) {
+                break;
+            }
+            input[strcspn(input, "\r\n")] = 0;
+
+            // Keep the current value
+            if (input[0] == '\0') {
+                break;
+            }
+
+            if (config_schema_set(config, field, input)) {
+                break;
+            }
+            printf("\r\nInvalid value\r\n");
+        }
+        printf("\r\n");
+    }
+}
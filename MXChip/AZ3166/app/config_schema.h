@@ -0,0 +1,122 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _CONFIG_SCHEMA_H
+#define _CONFIG_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config_manager.h"
+
+// Field value types understood by the schema
+typedef enum {
+    CONFIG_FIELD_STRING,
+    CONFIG_FIELD_U16,
+    CONFIG_FIELD_U32,
+    CONFIG_FIELD_ENUM
+} config_field_type_t;
+
+// One entry of the device configuration schema
+typedef struct {
+    const char* key;                // Key used in device.conf and remote config
+    const char* label;              // Label shown at the serial prompt
+    config_field_type_t type;
+    uint16_t offset;                // Offset of the member in device_config_t
+    uint16_t size;                  // Size of the member in device_config_t
+    uint32_t min;                   // Numeric bounds, inclusive
+    uint32_t max;
+    const char* const* names;       // Enum value names, indexed by value
+    const char* default_value;      // Default, parsed like any other value
+    bool secret;                    // Masked when printed
+    bool runtime;                   // Applied without a restart when changed remotely
+} config_field_t;
+
+/**
+ * @brief Get the schema table
+ * @param count Receives the number of fields
+ * @return Pointer to the first field
+ */
+const config_field_t* config_schema_fields(size_t* count);
+
+/**
+ * @brief Look up a field by key
+ * @param key Key, not necessarily null terminated
+ * @param key_len Length of the key
+ * @return Field or NULL if the key is unknown
+ */
+const config_field_t* config_schema_find(const char* key, size_t key_len);
+
+/**
+ * @brief Parse and store a single value after checking its bounds
+ * @param config Configuration to update
+ * @param field Field to set
+ * @param value Null terminated value text
+ * @return true if the value was accepted
+ */
+bool config_schema_set(device_config_t* config, const config_field_t* field, const char* value);
+
+/**
+ * @brief Apply KEY=value lines, '#' starts a comment and unknown keys are ignored
+ * @param config Configuration to update
+ * @param content Text to parse
+ * @param length Length of the text
+ * @return Number of values applied
+ */
+int config_schema_parse(device_config_t* config, const char* content, size_t length);
+
+/**
+ * @brief Fill every field with its schema default
+ * @param config Configuration to populate
+ */
+void config_schema_defaults(device_config_t* config);
+
+/**
+ * @brief Check every field is terminated and within its bounds
+ * @param config Configuration to check
+ * @return true if all fields are valid
+ */
+bool config_schema_validate(const device_config_t* config);
+
+/**
+ * @brief Check whether moving between two configurations changes a setting that needs a restart
+ * @param from Running configuration
+ * @param to New configuration
+ * @return true if a field without the runtime flag differs
+ */
+bool config_schema_requires_restart(const device_config_t* from, const device_config_t* to);
+
+/**
+ * @brief Format a field value
+ * @param config Configuration to read
+ * @param field Field to format
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ * @param mask_secrets Replace secret values with asterisks
+ */
+void config_schema_format(
+    const device_config_t* config, const config_field_t* field, char* buffer, size_t size, bool mask_secrets);
+
+/**
+ * @brief Print the configuration to the console with secrets masked
+ * @param config Configuration to print
+ */
+void config_schema_print(const device_config_t* config);
+
+/**
+ * @brief Serialize the configuration as KEY=value lines, secrets included
+ * @param config Configuration to serialize
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ * @return Length written, or 0 if the buffer is too small
+ */
+size_t config_schema_serialize(const device_config_t* config, char* buffer, size_t size);
+
+/**
+ * @brief Prompt for every field on the serial console, an empty answer keeps the current value
+ * @param config Configuration to update
+ */
+void config_schema_prompt(device_config_t* config);
+
+#endif // _CONFIG_SCHEMA_H
@@ -4,6 +4,7 @@
 #include "stm32f4xx_hal.h"
 
 #include "board_init.h"
+#include "profiler.h"
 
 int __io_putchar(int ch);
 int __io_getchar(void);
@@ -49,10 +50,13 @@ int _read(int file, char* ptr, int len)
 int _write(int file, char* ptr, int len)
 {
     int DataIdx;
+    PROF_BEGIN(PROF_CONSOLE_WRITE);
 
     for (DataIdx = 0; DataIdx < len; DataIdx++)
     {
         __io_putchar(*ptr++);
     }
+
+    PROF_END(PROF_CONSOLE_WRITE);
     return len;
 }
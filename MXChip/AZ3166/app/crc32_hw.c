@@ -0,0 +1,46 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "crc32.h"
+
+#include "stm32f4xx_hal.h"
+#include "tx_api.h"
+
+// Words fed per critical section, bounds interrupt latency while keeping the single CRC unit shared
+#define CRC32_HW_CHUNK_WORDS 64
+
+// The STM32F4 CRC unit only implements the non-reflected polynomial and always resets to 0xFFFFFFFF.
+// The reflected IEEE result is obtained by bit reversing the input words and the result. As the unit
+// computes DR' = f(DR ^ word), a running state is carried into a fresh reset by folding it into the first word.
+bool crc32_hw_update(uint32_t* state, const uint32_t* words, size_t count)
+{
+    TX_INTERRUPT_SAVE_AREA
+    uint32_t reg = __RBIT(*state);
+
+    // Enabled by board_init once the unit has passed its self test
+    if ((RCC->AHB1ENR & RCC_AHB1ENR_CRCEN) == 0)
+    {
+        return false;
+    }
+
+    while (count > 0)
+    {
+        size_t chunk = count < CRC32_HW_CHUNK_WORDS ? count : CRC32_HW_CHUNK_WORDS;
+
+        TX_DISABLE
+        CRC->CR = CRC_CR_RESET;
+        CRC->DR = __RBIT(*words++) ^ reg ^ 0xFFFFFFFF;
+        for (size_t i = 1; i < chunk; i++)
+        {
+            CRC->DR = __RBIT(*words++);
+        }
+        reg = CRC->DR;
+        TX_RESTORE
+
+        count -= chunk;
+    }
+
+    *state = __RBIT(reg);
+
+    return true;
+}
@@ -5,26 +5,33 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "screen.h"
 #include "sensor.h"
 #include "stm32f4xx_hal.h"
 
+#include "boot_pipeline.h"
+#include "dispatch.h"
+#include "jsmn.h"
+#include "json_packet.h"
+#include "msg_pool.h"
+#include "profiler.h"
 #include "sntp_client.h"
+#include "sys_monitor.h"
+#include "watchdog.h"
 
 #include "azure_config.h"
-
-// Define packet pool payload size if not already defined
-#ifndef NX_PACKET_POOL_PAYLOAD_SIZE
-#define NX_PACKET_POOL_PAYLOAD_SIZE 1536
-#endif
+#include "config_manager.h"
 
 // MQTT client settings
 #define TELEMETRY_INTERVAL_PROPERTY "telemetryInterval"
 #define LED_STATE_PROPERTY          "ledState"
 
 #define TELEMETRY_INTERVAL_EVENT 1
+#define CONFIG_RESTART_EVENT     2
+#define MQTT_DISCONNECT_EVENT    4
 
 // MQTT client settings for custom broker
 #define MQTT_CLIENT_STACK_SIZE        4096
@@ -32,13 +39,48 @@
 #define MQTT_TIMEOUT                  (30 * TX_TIMER_TICKS_PER_SECOND)  // Increase timeout to 30 seconds
 #define MQTT_KEEP_ALIVE               120                               // Reduce keep-alive to be less aggressive
 #define MQTT_TELEMETRY_QOS            1
+#define MQTT_RECEIVE_BUFFER_WAIT      (5 * TX_TIMER_TICKS_PER_SECOND)
+
+// One attempt per telemetry interval once the broker has dropped the connection, well inside the watchdog margin
+#define MQTT_RECONNECT_TIMEOUT        (10 * TX_TIMER_TICKS_PER_SECOND)
+
+// Command and writable property messages, parsed in place
+#define MQTT_JSON_TOKENS              24
+#define MQTT_COMMAND_ID_SIZE          32
+#define MQTT_RESPONSE_QOS             0
+#define MQTT_RESPONSE_WAIT            (5 * TX_TIMER_TICKS_PER_SECOND)
+#define DISPLAY_TEXT_SIZE             20
+
+// Commands, desired properties and configuration updates are handled on the worker, never on the MQTT client thread
+#define MQTT_WORKER_STACK_SIZE        2048
+#define MQTT_WORKER_PRIORITY          3
+#define MQTT_WORKER_QUEUE_SIZE        MSG_POOL_MEDIUM_COUNT
+#define MQTT_WORK_COMMAND             0
+#define MQTT_WORK_PROPERTIES          1
+#define MQTT_WORK_CONFIG              2
+
+// Allowance on top of the telemetry interval for one cycle of sensor reads, display updates and publishes
+#define MQTT_WATCHDOG_MARGIN          (60 * TX_TIMER_TICKS_PER_SECOND)
+
+// A received message handed to the worker, which releases the buffer. Two ULONGs so it fits a ThreadX queue message.
+typedef struct
+{
+    msg_medium_t* message;
+    USHORT length;
+    USHORT topic;
+} mqtt_work_t;
+
+typedef char mqtt_work_size_check[sizeof(mqtt_work_t) == 2 * sizeof(ULONG) ? 1 : -1];
 
 // MQTT client instance
 static NXD_MQTT_CLIENT mqtt_client;
+static NX_PACKET_POOL* mqtt_packet_pool;
 static TX_EVENT_FLAGS_GROUP mqtt_events;
 
-// Default telemetry interval
-static const INT telemetry_interval = DEFAULT_TELEMETRY_INTERVAL;
+static TX_THREAD mqtt_worker_thread;
+static ULONG mqtt_worker_stack[MQTT_WORKER_STACK_SIZE / sizeof(ULONG)];
+static TX_QUEUE mqtt_work_queue;
+static ULONG mqtt_work_storage[MQTT_WORKER_QUEUE_SIZE * sizeof(mqtt_work_t) / sizeof(ULONG)];
 
 // Telemetry state tracking
 static UINT telemetry_state = 0;
@@ -46,297 +88,494 @@ static UINT telemetry_state = 0;
 // Forward declaration of LED control function
 static void set_led_state(bool level);
 
-// MQTT message callback function 
-static VOID mqtt_message_callback(NXD_MQTT_CLIENT *client_ptr, UINT number_of_messages)
+static UINT set_led_state_command(const dispatch_arg_t* arg, VOID* context);
+static UINT set_display_text_command(const dispatch_arg_t* arg, VOID* context);
+static UINT telemetry_interval_property(const dispatch_arg_t* arg, VOID* context);
+
+static const dispatch_entry_t mqtt_command_entries[] = {
+    {.name = "setLedState", .type = DISPATCH_ARG_BOOL, .handler = set_led_state_command},
+    {
+        .name    = "setDisplayText",
+        .type    = DISPATCH_ARG_STRING,
+        .max     = DISPLAY_TEXT_SIZE,
+        .handler = set_display_text_command,
+    },
+};
+
+static const dispatch_entry_t mqtt_property_entries[] = {
+    {
+        .name    = TELEMETRY_INTERVAL_PROPERTY,
+        .type    = DISPATCH_ARG_INT,
+        .min     = 1,
+        .max     = 86400,
+        .handler = telemetry_interval_property,
+    },
+};
+
+static dispatch_table_t mqtt_commands;
+static dispatch_table_t mqtt_properties;
+
+// Start a document in a packet from the client's pool, the json_packet writer appends to it
+static UINT mqtt_document_begin(json_packet_t* writer, ULONG wait_option)
 {
     UINT status;
-    UCHAR message_buffer[NX_PACKET_POOL_PAYLOAD_SIZE];
-    UINT message_length;
-    UCHAR topic_buffer[128];
-    UINT topic_length;
+    NX_PACKET* packet_ptr;
 
-    // Process all messages in the queue
-    while (number_of_messages > 0)
+    if ((status = nx_packet_allocate(mqtt_packet_pool, &packet_ptr, NX_RECEIVE_PACKET, wait_option)))
     {
-        number_of_messages--;
+        printf("FAIL: Unable to allocate a document packet (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
 
-        // Get the next message in the queue
-        status = nxd_mqtt_client_message_get(client_ptr, topic_buffer, sizeof(topic_buffer), &topic_length,
-                                            message_buffer, sizeof(message_buffer), &message_length);
-        if (status == NXD_MQTT_SUCCESS)
-        {
-            // Ensure null termination
-            topic_buffer[topic_length] = 0;
-            message_buffer[message_length] = 0;
+    json_packet_init(writer, packet_ptr, mqtt_packet_pool, wait_option);
 
-            printf("Received message: topic=%s, message=%s\r\n", topic_buffer, message_buffer);
+    return NXD_MQTT_SUCCESS;
+}
 
-            // Check if this is a LED control message
-            if (strncmp((CHAR*)topic_buffer, MQTT_LED_TOPIC, topic_length) == 0)
-            {
-                // Process LED command
-                if (strncmp((CHAR*)message_buffer, "ON", message_length) == 0)
-                {
-                    set_led_state(true);
-                }
-                else if (strncmp((CHAR*)message_buffer, "OFF", message_length) == 0)
-                {
-                    set_led_state(false);
-                }
-            }
+// Finish the document and publish it, nxd_mqtt_client_publish copies it into the PUBLISH packet and assigns the
+// packet identifier. The message is passed as one buffer, so the document has to fit the head packet.
+static UINT mqtt_document_publish(json_packet_t* writer, const CHAR* topic, UINT qos, UINT retain, ULONG wait_option)
+{
+    NX_PACKET* packet_ptr = writer->packet;
+    UINT status;
+
+    if ((status = json_packet_end(writer)) == NX_SUCCESS)
+    {
+        if (writer->start == NX_NULL || packet_ptr->nx_packet_next != NX_NULL)
+        {
+            status = NX_SIZE_ERROR;
         }
         else
         {
-            printf("Error getting MQTT message: 0x%08lx\r\n", (unsigned long)status);
-            break;
+            status = nxd_mqtt_client_publish(&mqtt_client,
+                (CHAR*)topic,
+                strlen(topic),
+                (CHAR*)writer->start,
+                writer->length,
+                retain,
+                qos,
+                wait_option);
         }
     }
+
+    nx_packet_release(packet_ptr);
+
+    return status;
 }
 
-// LED control function
-static void set_led_state(bool level)
+// Index of the token after token i and all of its children
+static INT json_token_skip(const jsmntok_t* tokens, INT count, INT i)
 {
-    if (level)
-    {
-        printf("LED is turned ON\r\n");
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_SET);
-    }
-    else
+    INT pending = 1;
+
+    while (pending > 0 && i < count)
     {
-        printf("LED is turned OFF\r\n");
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
+        pending += tokens[i].size - 1;
+        i++;
     }
+
+    return i;
 }
 
-// MQTT disconnect callback
-static VOID mqtt_disconnect_callback(NXD_MQTT_CLIENT *client_ptr)
+// Raw JSON text of a value, strings keep their quotes so they can be parsed against a schema
+static VOID json_token_text(const CHAR* json, const jsmntok_t* token, const CHAR** text, UINT* length)
 {
-    printf("MQTT client disconnected\r\n");
-    
-    // Set event flag for reconnection
+    INT quote = token->type == JSMN_STRING ? 1 : 0;
+
+    *text   = json + token->start - quote;
+    *length = token->end - token->start + 2 * quote;
+}
+
+static bool json_token_equals(const CHAR* json, const jsmntok_t* token, const CHAR* text)
+{
+    return (UINT)(token->end - token->start) == strlen(text) && strncmp(json + token->start, text, strlen(text)) == 0;
+}
+
+static UINT set_led_state_command(const dispatch_arg_t* arg, VOID* context)
+{
+    set_led_state(arg->boolean);
+    return DISPATCH_STATUS_OK;
+}
+
+static UINT set_display_text_command(const dispatch_arg_t* arg, VOID* context)
+{
+    screen_printn(arg->string, arg->string_length, L3);
+    return DISPATCH_STATUS_OK;
+}
+
+// Goes through the configuration manager so the new interval is validated and persisted like a config topic update
+static UINT telemetry_interval_property(const dispatch_arg_t* arg, VOID* context)
+{
+    CHAR update[32];
+    bool restart_required = false;
+    INT length            = snprintf(update, sizeof(update), "TELEMETRY_INTERVAL=%d\n", arg->integer);
+
+    if (config_manager_apply_update(&g_device_config, update, length, &restart_required) != CONFIG_OK)
+    {
+        return DISPATCH_STATUS_BAD_REQUEST;
+    }
+
+    // Wake the telemetry loop so the new interval starts now
     tx_event_flags_set(&mqtt_events, TELEMETRY_INTERVAL_EVENT, TX_OR);
+
+    return DISPATCH_STATUS_OK;
 }
 
-UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_ptr, ULONG (*sntp_time_function)(VOID))
+// Command envelope {"name":"...","component":"...","payload":...,"id":"..."}, answered on the response topic
+static VOID mqtt_command_process(const CHAR* message, UINT message_length)
 {
-    UINT status;
-    static UCHAR mqtt_client_stack[MQTT_CLIENT_STACK_SIZE];
-    
-    NXD_ADDRESS server_ip;
-    UINT server_port = MQTT_BROKER_PORT;
-    
-    // Reset telemetry state counter for this session
-    telemetry_state = 0;
-    
-    printf("\r\n=============================\r\n");
-    printf("MQTT Client Initialization\r\n");
-    printf("=============================\r\n");
-    
-    // Initialize event flags for MQTT events
-    if ((status = tx_event_flags_create(&mqtt_events, "MQTT Events")))
+    jsmn_parser parser;
+    jsmntok_t tokens[MQTT_JSON_TOKENS];
+    const jsmntok_t* name         = NULL;
+    const jsmntok_t* component    = NULL;
+    const jsmntok_t* payload      = NULL;
+    CHAR id[MQTT_COMMAND_ID_SIZE] = "";
+    const dispatch_entry_t* entry = NULL;
+    const CHAR* payload_text      = "";
+    UINT payload_length           = 0;
+    UINT command_status;
+    json_packet_t writer;
+    INT count;
+    INT i;
+
+    jsmn_init(&parser);
+    count = jsmn_parse(&parser, message, message_length, tokens, MQTT_JSON_TOKENS);
+
+    if (count > 0 && tokens[0].type == JSMN_OBJECT)
     {
-        printf("FAIL: Unable to create MQTT event flags (0x%08lx)\r\n", (unsigned long)status);
-        return status;
+        for (i = 1; i + 1 < count; i = json_token_skip(tokens, count, i + 1))
+        {
+            const jsmntok_t* value = &tokens[i + 1];
+
+            if (json_token_equals(message, &tokens[i], "name") && value->type == JSMN_STRING)
+            {
+                name = value;
+            }
+            else if (json_token_equals(message, &tokens[i], "component") && value->type == JSMN_STRING)
+            {
+                component = value;
+            }
+            else if (json_token_equals(message, &tokens[i], "payload"))
+            {
+                payload = value;
+            }
+            else if (json_token_equals(message, &tokens[i], "id") && value->type == JSMN_STRING &&
+                     value->end - value->start < MQTT_COMMAND_ID_SIZE)
+            {
+                // Kept as the escaped token text, the response writes it back unchanged
+                snprintf(id, sizeof(id), "%.*s", value->end - value->start, message + value->start);
+            }
+        }
     }
-    
-    printf("Initializing MQTT client to connect to broker: %s:%d\r\n", MQTT_BROKER_HOSTNAME, MQTT_BROKER_PORT);
-    printf("Using client ID: %s\r\n", MQTT_CLIENT_ID);
-    if (strlen(MQTT_USERNAME) > 0) {
-        printf("Using authentication with username: %s\r\n", MQTT_USERNAME);
-    } else {
-        printf("No authentication credentials configured\r\n");
+
+    if (name == NULL)
+    {
+        command_status = DISPATCH_STATUS_BAD_REQUEST;
     }
-    
-    // Create MQTT client instance
-    status = nxd_mqtt_client_create(&mqtt_client,
-                               "MQTT Client",
-                               MQTT_CLIENT_ID,
-                               strlen(MQTT_CLIENT_ID),
-                               ip_ptr,
-                               pool_ptr,
-                               mqtt_client_stack,
-                               MQTT_CLIENT_STACK_SIZE,
-                               MQTT_CLIENT_PRIORITY,
-                               NX_NULL,
-                               0);
-    
-    if (status != NXD_MQTT_SUCCESS)
+    else if ((entry = dispatch_find(&mqtt_commands,
+                  component ? message + component->start : NULL,
+                  component ? component->end - component->start : 0,
+                  message + name->start,
+                  name->end - name->start)) == NULL)
     {
-        printf("FAIL: Failed to create MQTT client (0x%08lx)\r\n", (unsigned long)status);
-        return status;
+        printf("Command %.*s is not declared for this device\r\n", name->end - name->start, message + name->start);
+        command_status = DISPATCH_STATUS_NOT_FOUND;
     }
-    printf("SUCCESS: MQTT client created\r\n");
-    
-    // Register callbacks
-    nxd_mqtt_client_receive_notify_set(&mqtt_client, mqtt_message_callback);
-    printf("Registered message callback\r\n");
-    
-    nxd_mqtt_client_disconnect_notify_set(&mqtt_client, mqtt_disconnect_callback);
-    printf("Registered disconnect callback\r\n");
-    
-    // Connect to the broker
-    printf("\r\nIP Address Resolution\r\n");
-    printf("-------------------\r\n");
-    printf("Checking if broker address is an IP or hostname: %s\r\n", MQTT_BROKER_HOSTNAME);
-    
-    // Variable to store IP components when parsing
-    UINT ip_0, ip_1, ip_2, ip_3;
-    
-    // Check if the hostname is an IP address (simple parsing for IPv4)
-    if (sscanf(MQTT_BROKER_HOSTNAME, "%u.%u.%u.%u", &ip_0, &ip_1, &ip_2, &ip_3) == 4)
+    else
     {
-        // It's an IP address, so convert directly
-        printf("Direct IP address detected: %s\r\n", MQTT_BROKER_HOSTNAME);
-        
-        // Ensure the IP components are valid (0-255)
-        if (ip_0 <= 255 && ip_1 <= 255 && ip_2 <= 255 && ip_3 <= 255)
+        if (payload != NULL)
         {
-            // For NetworkX, IP address is stored in host byte order
-            ULONG host_byte_order_ip = (ip_0 << 24) | (ip_1 << 16) | (ip_2 << 8) | ip_3;
-            server_ip.nxd_ip_address.v4 = host_byte_order_ip;
-            
-            printf("SUCCESS: Using direct IP: %u.%u.%u.%u (0x%08lx)\r\n", 
-                   ip_0, ip_1, ip_2, ip_3, (unsigned long)host_byte_order_ip);
+            json_token_text(message, payload, &payload_text, &payload_length);
         }
-        else
+        command_status = dispatch_run(entry, payload_text, payload_length);
+    }
+
+    if (mqtt_document_begin(&writer, MQTT_RESPONSE_WAIT) == NXD_MQTT_SUCCESS)
+    {
+        json_packet_object_begin(&writer, NULL);
+        json_packet_string_raw(&writer, "id", id, strlen(id));
+        json_packet_int(&writer, "status", command_status);
+        if (command_status == DISPATCH_STATUS_BAD_REQUEST)
         {
-            printf("FAIL: Invalid IP address format: %s\r\n", MQTT_BROKER_HOSTNAME);
-            return NX_DNS_QUERY_FAILED;
+            json_packet_string(&writer, "error", "invalid command");
+        }
+        else if (command_status == DISPATCH_STATUS_NOT_FOUND)
+        {
+            json_packet_string(&writer, "error", "unknown command");
+        }
+        json_packet_object_end(&writer);
+
+        if (mqtt_document_publish(&writer, MQTT_RESPONSE_TOPIC, MQTT_RESPONSE_QOS, NX_FALSE, MQTT_RESPONSE_WAIT) !=
+            NXD_MQTT_SUCCESS)
+        {
+            printf("FAIL: Failed to publish command response\r\n");
         }
     }
-    else
+}
+
+// Desired properties {"name":value,...,"$version":n}, each declared one is acknowledged on the reported topic
+static VOID mqtt_properties_process(const CHAR* message, UINT message_length)
+{
+    jsmn_parser parser;
+    jsmntok_t tokens[MQTT_JSON_TOKENS];
+    INT version  = 0;
+    bool started = false;
+    json_packet_t writer;
+    INT count;
+    INT i;
+
+    jsmn_init(&parser);
+    count = jsmn_parse(&parser, message, message_length, tokens, MQTT_JSON_TOKENS);
+
+    if (count <= 0 || tokens[0].type != JSMN_OBJECT)
     {
-    // It's a hostname, resolve via DNS
-        printf("Resolving hostname via DNS: %s\r\n", MQTT_BROKER_HOSTNAME);
-        
-        // Try multiple DNS resolutions with different timeouts
-        UINT retry;
-        UINT max_retries = 3;
-        ULONG timeouts[3] = {5 * NX_IP_PERIODIC_RATE, 10 * NX_IP_PERIODIC_RATE, 15 * NX_IP_PERIODIC_RATE};
-        
-        for (retry = 0; retry < max_retries; retry++) 
+        printf("Desired properties rejected, not a JSON object\r\n");
+        return;
+    }
+
+    for (i = 1; i + 1 < count; i = json_token_skip(tokens, count, i + 1))
+    {
+        if (json_token_equals(message, &tokens[i], "$version") && tokens[i + 1].type == JSMN_PRIMITIVE)
         {
-            printf("DNS resolution attempt %d of %d (timeout: %lu ticks)...\r\n", 
-                  retry + 1, max_retries, timeouts[retry]);
-                  
-            // Resolve hostname to IP address
-            status = nx_dns_host_by_name_get(dns_ptr, 
-                                          (UCHAR *)MQTT_BROKER_HOSTNAME, 
-                                          &server_ip.nxd_ip_address.v4, 
-                                          timeouts[retry]);
-            if (status == NX_SUCCESS) 
-            {
-                printf("DNS resolution successful on attempt %d!\r\n", retry + 1);
-                break;
-            }
-            
-            printf("DNS resolution attempt %d failed (0x%08lx)\r\n", retry + 1, (unsigned long)status);
-            
-            // Check specific DNS error codes
-            if (status == NX_DNS_QUERY_FAILED)
-            {
-                printf("  - DNS query failed - no DNS servers could resolve this hostname\r\n");
-            }
-            else if (status == NX_DNS_NO_SERVER)
+            version = atoi(message + tokens[i + 1].start);
+        }
+    }
+
+    for (i = 1; i + 1 < count; i = json_token_skip(tokens, count, i + 1))
+    {
+        const dispatch_entry_t* entry =
+            dispatch_find(&mqtt_properties, NULL, 0, message + tokens[i].start, tokens[i].end - tokens[i].start);
+        dispatch_arg_t arg;
+        const CHAR* value;
+        UINT value_length;
+        UINT status;
+
+        if (entry == NULL)
+        {
+            continue;
+        }
+
+        json_token_text(message, &tokens[i + 1], &value, &value_length);
+        if ((status = dispatch_parse(entry, value, value_length, &arg)) == DISPATCH_STATUS_OK)
+        {
+            status = entry->handler(&arg, entry->context);
+        }
+
+        // One acknowledgement document for the whole update, started with the first declared property
+        if (!started)
+        {
+            if (mqtt_document_begin(&writer, MQTT_RESPONSE_WAIT) != NXD_MQTT_SUCCESS)
             {
-                printf("  - No DNS servers are configured in the system\r\n");
+                return;
             }
-            else if (status == NX_DNS_TIMEOUT)
+            json_packet_object_begin(&writer, NULL);
+            started = true;
+        }
+
+        json_packet_object_begin(&writer, entry->name);
+        if (entry->type == DISPATCH_ARG_BOOL)
+        {
+            json_packet_bool(&writer, "value", arg.boolean);
+        }
+        else
+        {
+            json_packet_int(&writer, "value", arg.integer);
+        }
+        json_packet_int(&writer, "ac", status);
+        json_packet_int(&writer, "av", version);
+        json_packet_object_end(&writer);
+    }
+
+    if (!started)
+    {
+        return;
+    }
+
+    json_packet_object_end(&writer);
+
+    if (mqtt_document_publish(&writer, MQTT_REPORTED_TOPIC, MQTT_RESPONSE_QOS, NX_FALSE, MQTT_RESPONSE_WAIT) !=
+        NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to publish property acknowledgement\r\n");
+    }
+}
+
+// Configuration file update, the restart is left to the telemetry loop so the session is closed cleanly first
+static VOID mqtt_config_process(const CHAR* message, UINT message_length)
+{
+    bool restart_required = false;
+
+    if (config_manager_apply_update(&g_device_config, message, message_length, &restart_required) != CONFIG_OK)
+    {
+        printf("Configuration update rejected\r\n");
+    }
+    else if (restart_required)
+    {
+        tx_event_flags_set(&mqtt_events, CONFIG_RESTART_EVENT, TX_OR);
+    }
+}
+
+static VOID mqtt_worker_entry(ULONG parameter)
+{
+    mqtt_work_t work;
+
+    while (true)
+    {
+        if (tx_queue_receive(&mqtt_work_queue, &work, TX_WAIT_FOREVER))
+        {
+            continue;
+        }
+
+        if (work.topic == MQTT_WORK_COMMAND)
+        {
+            mqtt_command_process(work.message->data, work.length);
+        }
+        else if (work.topic == MQTT_WORK_PROPERTIES)
+        {
+            mqtt_properties_process(work.message->data, work.length);
+        }
+        else
+        {
+            mqtt_config_process(work.message->data, work.length);
+        }
+
+        msg_medium_release(work.message);
+    }
+}
+
+// Hand a message to the worker, the buffer belongs to the worker once this returns true
+static bool mqtt_work_submit(UINT topic, msg_medium_t* message, UINT message_length)
+{
+    mqtt_work_t work = {.message = message, .length = (USHORT)message_length, .topic = (USHORT)topic};
+
+    if (tx_queue_send(&mqtt_work_queue, &work, TX_NO_WAIT))
+    {
+        printf("ERROR: Worker busy, message dropped\r\n");
+        return false;
+    }
+
+    return true;
+}
+
+// MQTT message callback function 
+static VOID mqtt_message_callback(NXD_MQTT_CLIENT *client_ptr, UINT number_of_messages)
+{
+    UINT status;
+    msg_medium_t* message = NULL;
+    CHAR* message_buffer;
+    UINT message_length;
+    UCHAR topic_buffer[128];
+    UINT topic_length;
+
+    // Process all messages in the queue
+    while (number_of_messages > 0)
+    {
+        // Payloads come from the shared message pool rather than this thread's stack, a buffer handed to the worker
+        // is replaced for the next message
+        if (message == NULL && (message = msg_medium_acquire(MQTT_RECEIVE_BUFFER_WAIT)) == NULL)
+        {
+            printf("ERROR: No buffer for %u received messages\r\n", number_of_messages);
+            return;
+        }
+        message_buffer = message->data;
+
+        number_of_messages--;
+
+        // Get the next message in the queue
+        status = nxd_mqtt_client_message_get(client_ptr, topic_buffer, sizeof(topic_buffer) - 1, &topic_length,
+                                            (UCHAR*)message_buffer, sizeof(message->data) - 1, &message_length);
+        if (status == NXD_MQTT_SUCCESS)
+        {
+            // Ensure null termination
+            topic_buffer[topic_length] = 0;
+            message_buffer[message_length] = 0;
+
+            printf("Received message: topic=%s, message=%s\r\n", topic_buffer, message_buffer);
+
+            // Check if this is a LED control message
+            if (strncmp((CHAR*)topic_buffer, MQTT_LED_TOPIC, topic_length) == 0)
             {
-                printf("  - DNS query timed out - DNS servers may be unreachable\r\n");
+                // Process LED command
+                if (strncmp((CHAR*)message_buffer, "ON", message_length) == 0)
+                {
+                    set_led_state(true);
+                }
+                else if (strncmp((CHAR*)message_buffer, "OFF", message_length) == 0)
+                {
+                    set_led_state(false);
+                }
             }
-            
-            // Show available DNS servers
-            ULONG dns_server_address[5];
-            UINT dns_count = 0;
-            
-            printf("Checking DNS server configuration...\r\n");
-            if (nx_dns_server_get(dns_ptr, 0, &dns_server_address[0]) == NX_SUCCESS)
+
+            // Answered on the worker, publishing from this callback would block the MQTT client thread
+            else if (strncmp((CHAR*)topic_buffer, MQTT_COMMAND_TOPIC, topic_length) == 0)
             {
-                printf("  - Primary DNS: %u.%u.%u.%u\r\n",
-                      (UINT)((dns_server_address[0] >> 24) & 0xFF),
-                      (UINT)((dns_server_address[0] >> 16) & 0xFF),
-                      (UINT)((dns_server_address[0] >> 8) & 0xFF),
-                      (UINT)(dns_server_address[0] & 0xFF));
-                dns_count++;
+                if (mqtt_work_submit(MQTT_WORK_COMMAND, message, message_length))
+                {
+                    message = NULL;
+                }
             }
-            else
+
+            else if (strncmp((CHAR*)topic_buffer, MQTT_DESIRED_TOPIC, topic_length) == 0)
             {
-                printf("  - No primary DNS server configured\r\n");
+                if (mqtt_work_submit(MQTT_WORK_PROPERTIES, message, message_length))
+                {
+                    message = NULL;
+                }
             }
-            
-            // Try Google DNS directly if hostname resolution fails on final attempt
-            if (retry == max_retries - 1)
+
+            // Check if this is a configuration update, applied on the worker with the telemetry interval property
+            else if (strncmp((CHAR*)topic_buffer, MQTT_CONFIG_TOPIC, topic_length) == 0)
             {
-                printf("Trying fallback to local IP address...\r\n");
-                // Use the local IP we configured earlier
-                server_ip.nxd_ip_address.v4 = IP_ADDRESS(192, 168, 1, 100);
-                printf("Using fallback IP: 192.168.1.100\r\n");
-                status = NX_SUCCESS;
+                if (mqtt_work_submit(MQTT_WORK_CONFIG, message, message_length))
+                {
+                    message = NULL;
+                }
             }
         }
-        
-        printf("SUCCESS: Hostname resolved via DNS\r\n");
-    }
-    
-    // Set IP version
-    server_ip.nxd_ip_version = NX_IP_VERSION_V4;
-    
-    printf("SUCCESS: Resolved to IP: %u.%u.%u.%u\r\n", 
-           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF));
-    
-    // Set credentials if provided
-    printf("\r\nMQTT Authentication\r\n");
-    printf("-------------------\r\n");
-    if (strlen(MQTT_USERNAME) > 0)
-    {
-        printf("Setting MQTT credentials for user: %s\r\n", MQTT_USERNAME);
-        
-        status = nxd_mqtt_client_login_set(&mqtt_client, 
-                                          MQTT_USERNAME, 
-                                          strlen(MQTT_USERNAME),
-                                          MQTT_PASSWORD, 
-                                          strlen(MQTT_PASSWORD));
-        if (status != NXD_MQTT_SUCCESS)
+        else
         {
-            printf("FAIL: Failed to set MQTT login credentials (0x%02lx)\r\n", (unsigned long)status);
-            return status;
+            printf("Error getting MQTT message: 0x%08lx\r\n", (unsigned long)status);
+            break;
         }
-        printf("SUCCESS: MQTT credentials set\r\n");
+    }
+
+    msg_medium_release(message);
+}
+
+// LED control function
+static void set_led_state(bool level)
+{
+    if (level)
+    {
+        printf("LED is turned ON\r\n");
+        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_SET);
     }
     else
     {
-        printf("No authentication credentials provided, connecting anonymously\r\n");
+        printf("LED is turned OFF\r\n");
+        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
     }
+}
+
+// MQTT disconnect callback
+static VOID mqtt_disconnect_callback(NXD_MQTT_CLIENT *client_ptr)
+{
+    printf("MQTT client disconnected\r\n");
     
-    // Connect to broker
-    printf("\r\nMQTT Connection\r\n");
+    // Wake the telemetry loop to reconnect
+    tx_event_flags_set(&mqtt_events, MQTT_DISCONNECT_EVENT, TX_OR);
+}
+
+// Network diagnostics, only run once a connection attempt has failed so the common path is not delayed.
+// May switch the port if the broker is only reachable on a different one.
+static VOID mqtt_connection_diagnostics(NX_IP* ip_ptr, NXD_ADDRESS* server_ip, UINT* server_port)
+{
+    UINT status;
+
+    printf("\r\nConnection Diagnostics\r\n");
     printf("-------------------\r\n");
-    printf("Connecting to MQTT broker at %u.%u.%u.%u:%u\r\n",
-           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
-           (UINT)server_port);
-           
-    printf("Keep alive: %d seconds\r\n", MQTT_KEEP_ALIVE);
-    printf("Clean session: Yes\r\n");
-    
-    // Make sure IP version is set correctly
-    server_ip.nxd_ip_version = NX_IP_VERSION_V4;
-    
-    // Debug: Show IP address we're using
-    printf("Using IP address: 0x%08lx (%u.%u.%u.%u):%u\r\n", 
-           (unsigned long)server_ip.nxd_ip_address.v4,
-           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
-           server_port);
-             // Print network interface information
+
+    // Print network interface information
     printf("Checking network interface status...\r\n");
     CHAR *interface_name = NULL;  // Interface name (passing NULL as we don't need it)
     ULONG ip_address;
@@ -380,17 +619,18 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
         printf("No gateway configured\r\n");
     }
            
-    // Add more debug info for network diagnosis    printf("Attempting to verify basic network connectivity...\r\n");
+    // Add more debug info for network diagnosis
+    printf("Attempting to verify basic network connectivity...\r\n");
     NX_PACKET *ping_packet;
     
     // Try pinging the MQTT broker first
     printf("Pinging MQTT broker at %u.%u.%u.%u...\r\n",
-           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF));
+           (UINT)((server_ip->nxd_ip_address.v4 >> 24) & 0xFF),
+           (UINT)((server_ip->nxd_ip_address.v4 >> 16) & 0xFF),
+           (UINT)((server_ip->nxd_ip_address.v4 >> 8) & 0xFF),
+           (UINT)(server_ip->nxd_ip_address.v4 & 0xFF));
            
-    if (nx_icmp_ping(ip_ptr, server_ip.nxd_ip_address.v4, "ICMP Ping test", 
+    if (nx_icmp_ping(ip_ptr, server_ip->nxd_ip_address.v4, "ICMP Ping test", 
                     strlen("ICMP Ping test"), &ping_packet, 5 * NX_IP_PERIODIC_RATE) == NX_SUCCESS)
     {
         printf("ICMP ping to MQTT broker successful! Network connectivity confirmed.\r\n");
@@ -437,13 +677,13 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
             printf("Check WiFi settings, firewall, and network configuration.\r\n");
         }
     }
-         // Test TCP connectivity to MQTT broker before attempting MQTT connection
+    // Test TCP connectivity to MQTT broker before attempting MQTT connection
     printf("Testing direct TCP connection to broker %u.%u.%u.%u:%u...\r\n",
-           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
-           server_port);
+           (UINT)((server_ip->nxd_ip_address.v4 >> 24) & 0xFF),
+           (UINT)((server_ip->nxd_ip_address.v4 >> 16) & 0xFF),
+           (UINT)((server_ip->nxd_ip_address.v4 >> 8) & 0xFF),
+           (UINT)(server_ip->nxd_ip_address.v4 & 0xFF),
+           *server_port);
     
     NX_TCP_SOCKET test_socket;
     
@@ -487,7 +727,7 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
         else
         {
             // Try different ports common for MQTT
-            UINT test_ports[] = {server_port, 1883, 8883}; 
+            UINT test_ports[] = {*server_port, 1883, 8883}; 
             UINT port_idx;
             UINT connected = NX_FALSE;
             
@@ -495,14 +735,14 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
             {
                 // Attempt to connect TCP socket
                 printf("Attempting TCP connection to %u.%u.%u.%u:%u (test %d of %d)...\r\n",
-                       (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
-                       (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
-                       (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
-                       (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
+                       (UINT)((server_ip->nxd_ip_address.v4 >> 24) & 0xFF),
+                       (UINT)((server_ip->nxd_ip_address.v4 >> 16) & 0xFF),
+                       (UINT)((server_ip->nxd_ip_address.v4 >> 8) & 0xFF),
+                       (UINT)(server_ip->nxd_ip_address.v4 & 0xFF),
                        test_ports[port_idx], port_idx+1, 
                        (int)(sizeof(test_ports)/sizeof(test_ports[0])));
                    
-                status = nx_tcp_client_socket_connect(&test_socket, server_ip.nxd_ip_address.v4, 
+                status = nx_tcp_client_socket_connect(&test_socket, server_ip->nxd_ip_address.v4, 
                                                     test_ports[port_idx], 
                                                     10 * NX_IP_PERIODIC_RATE);
                                                     
@@ -511,11 +751,11 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
                     printf("SUCCESS: TCP connection established to broker on port %u!\r\n", 
                            test_ports[port_idx]);
                            
-                    if (test_ports[port_idx] != server_port)
+                    if (test_ports[port_idx] != *server_port)
                     {
                         printf("IMPORTANT: Switching to working port %u for MQTT connection\r\n", 
                                test_ports[port_idx]);
-                        server_port = test_ports[port_idx];
+                        *server_port = test_ports[port_idx];
                     }
                     
                     nx_tcp_socket_disconnect(&test_socket, 5 * NX_IP_PERIODIC_RATE);
@@ -538,17 +778,366 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
                 }
             }
             
-            if (!connected)
+            if (!connected)
+            {
+                printf("WARNING: Could not establish TCP connection to broker on any tested port\r\n");
+                printf("This suggests a network connectivity issue or firewall blocking\r\n");
+            }
+            
+            // Clean up
+            nx_tcp_client_socket_unbind(&test_socket);
+            nx_tcp_socket_delete(&test_socket);
+        }
+    }
+}
+
+// Subscribe to the command, LED, configuration and desired properties topics, only the command topic is required
+static UINT mqtt_subscribe_topics(void)
+{
+    UINT status;
+
+    // Subscribe to the command topic
+    printf("Subscribing to command topic: %s (QoS %d)\r\n", MQTT_COMMAND_TOPIC, MQTT_TELEMETRY_QOS);
+    status = nxd_mqtt_client_subscribe(&mqtt_client, 
+                                      MQTT_COMMAND_TOPIC, 
+                                      strlen(MQTT_COMMAND_TOPIC),
+                                      MQTT_TELEMETRY_QOS);
+                                      
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to subscribe to command topic (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+    printf("SUCCESS: Subscribed to command topic: %s\r\n", MQTT_COMMAND_TOPIC);
+    
+    // Subscribe to the LED topic
+    printf("Subscribing to LED control topic: %s (QoS %d)\r\n", MQTT_LED_TOPIC, MQTT_TELEMETRY_QOS);
+    status = nxd_mqtt_client_subscribe(&mqtt_client, 
+                                      MQTT_LED_TOPIC, 
+                                      strlen(MQTT_LED_TOPIC),
+                                      MQTT_TELEMETRY_QOS);
+                                      
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to subscribe to LED topic (0x%08lx)\r\n", (unsigned long)status);
+    }
+    else
+    {
+        printf("SUCCESS: Subscribed to LED control topic: %s\r\n", MQTT_LED_TOPIC);
+    }
+
+    // Subscribe to the configuration topic
+    printf("Subscribing to configuration topic: %s (QoS %d)\r\n", MQTT_CONFIG_TOPIC, MQTT_TELEMETRY_QOS);
+    status = nxd_mqtt_client_subscribe(&mqtt_client,
+                                      MQTT_CONFIG_TOPIC,
+                                      strlen(MQTT_CONFIG_TOPIC),
+                                      MQTT_TELEMETRY_QOS);
+
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to subscribe to configuration topic (0x%08lx)\r\n", (unsigned long)status);
+    }
+    else
+    {
+        printf("SUCCESS: Subscribed to configuration topic: %s\r\n", MQTT_CONFIG_TOPIC);
+    }
+    
+    // Subscribe to the desired properties topic
+    printf("Subscribing to desired properties topic: %s (QoS %d)\r\n", MQTT_DESIRED_TOPIC, MQTT_TELEMETRY_QOS);
+    status = nxd_mqtt_client_subscribe(&mqtt_client,
+                                      MQTT_DESIRED_TOPIC,
+                                      strlen(MQTT_DESIRED_TOPIC),
+                                      MQTT_TELEMETRY_QOS);
+
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to subscribe to desired properties topic (0x%08lx)\r\n", (unsigned long)status);
+    }
+    else
+    {
+        printf("SUCCESS: Subscribed to desired properties topic: %s\r\n", MQTT_DESIRED_TOPIC);
+    }
+
+    return NXD_MQTT_SUCCESS;
+}
+
+// Connect again after the broker dropped the connection, a clean session so the topics are subscribed again
+static UINT mqtt_reconnect(NXD_ADDRESS* server_ip, UINT server_port)
+{
+    UINT status;
+
+    printf("Reconnecting to MQTT broker\r\n");
+    if ((status = nxd_mqtt_client_connect(
+             &mqtt_client, server_ip, server_port, MQTT_KEEP_ALIVE, NX_TRUE, MQTT_RECONNECT_TIMEOUT)))
+    {
+        printf("FAIL: Failed to reconnect to MQTT broker (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+
+    if ((status = mqtt_subscribe_topics()))
+    {
+        nxd_mqtt_client_disconnect(&mqtt_client);
+        return status;
+    }
+
+    printf("SUCCESS: Reconnected to MQTT broker\r\n");
+    return NXD_MQTT_SUCCESS;
+}
+
+UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_ptr, ULONG (*sntp_time_function)(VOID))
+{
+    UINT status;
+    static UCHAR mqtt_client_stack[MQTT_CLIENT_STACK_SIZE];
+    
+    NXD_ADDRESS server_ip;
+    UINT server_port = MQTT_BROKER_PORT;
+    
+    // Reset telemetry state counter for this session
+    telemetry_state = 0;
+    mqtt_packet_pool = pool_ptr;
+    
+    printf("\r\n=============================\r\n");
+    printf("MQTT Client Initialization\r\n");
+    printf("=============================\r\n");
+    
+    // Initialize event flags for MQTT events
+    if ((status = tx_event_flags_create(&mqtt_events, "MQTT Events")))
+    {
+        printf("FAIL: Unable to create MQTT event flags (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+
+    if ((status = dispatch_table_init(&mqtt_commands,
+             mqtt_command_entries,
+             sizeof(mqtt_command_entries) / sizeof(mqtt_command_entries[0]))) ||
+        (status = dispatch_table_init(&mqtt_properties,
+             mqtt_property_entries,
+             sizeof(mqtt_property_entries) / sizeof(mqtt_property_entries[0]))))
+    {
+        printf("FAIL: Unable to index the command and property tables (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+
+    if ((status = tx_queue_create(&mqtt_work_queue,
+             "MQTT work",
+             sizeof(mqtt_work_t) / sizeof(ULONG),
+             mqtt_work_storage,
+             sizeof(mqtt_work_storage))) ||
+        (status = tx_thread_create(&mqtt_worker_thread,
+             "MQTT worker",
+             mqtt_worker_entry,
+             0,
+             mqtt_worker_stack,
+             MQTT_WORKER_STACK_SIZE,
+             MQTT_WORKER_PRIORITY,
+             MQTT_WORKER_PRIORITY,
+             TX_NO_TIME_SLICE,
+             TX_AUTO_START)))
+    {
+        printf("FAIL: Unable to start the MQTT worker (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+    
+    printf("Initializing MQTT client to connect to broker: %s:%d\r\n", MQTT_BROKER_HOSTNAME, MQTT_BROKER_PORT);
+    printf("Using client ID: %s\r\n", MQTT_CLIENT_ID);
+    if (strlen(MQTT_USERNAME) > 0) {
+        printf("Using authentication with username: %s\r\n", MQTT_USERNAME);
+    } else {
+        printf("No authentication credentials configured\r\n");
+    }
+    
+    // Create MQTT client instance
+    status = nxd_mqtt_client_create(&mqtt_client,
+                               "MQTT Client",
+                               MQTT_CLIENT_ID,
+                               strlen(MQTT_CLIENT_ID),
+                               ip_ptr,
+                               pool_ptr,
+                               mqtt_client_stack,
+                               MQTT_CLIENT_STACK_SIZE,
+                               MQTT_CLIENT_PRIORITY,
+                               NX_NULL,
+                               0);
+    
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        printf("FAIL: Failed to create MQTT client (0x%08lx)\r\n", (unsigned long)status);
+        return status;
+    }
+    printf("SUCCESS: MQTT client created\r\n");
+    
+    // Register callbacks
+    nxd_mqtt_client_receive_notify_set(&mqtt_client, mqtt_message_callback);
+    printf("Registered message callback\r\n");
+    
+    nxd_mqtt_client_disconnect_notify_set(&mqtt_client, mqtt_disconnect_callback);
+    printf("Registered disconnect callback\r\n");
+    
+    // Connect to the broker
+    boot_stage_begin(BOOT_STAGE_BROKER_RESOLVE);
+    printf("\r\nIP Address Resolution\r\n");
+    printf("-------------------\r\n");
+    printf("Checking if broker address is an IP or hostname: %s\r\n", MQTT_BROKER_HOSTNAME);
+    
+    // Variable to store IP components when parsing
+    UINT ip_0, ip_1, ip_2, ip_3;
+    
+    // Check if the hostname is an IP address (simple parsing for IPv4)
+    if (sscanf(MQTT_BROKER_HOSTNAME, "%u.%u.%u.%u", &ip_0, &ip_1, &ip_2, &ip_3) == 4)
+    {
+        // It's an IP address, so convert directly
+        printf("Direct IP address detected: %s\r\n", MQTT_BROKER_HOSTNAME);
+        
+        // Ensure the IP components are valid (0-255)
+        if (ip_0 <= 255 && ip_1 <= 255 && ip_2 <= 255 && ip_3 <= 255)
+        {
+            // For NetworkX, IP address is stored in host byte order
+            ULONG host_byte_order_ip = (ip_0 << 24) | (ip_1 << 16) | (ip_2 << 8) | ip_3;
+            server_ip.nxd_ip_address.v4 = host_byte_order_ip;
+            
+            printf("SUCCESS: Using direct IP: %u.%u.%u.%u (0x%08lx)\r\n", 
+                   ip_0, ip_1, ip_2, ip_3, (unsigned long)host_byte_order_ip);
+        }
+        else
+        {
+            printf("FAIL: Invalid IP address format: %s\r\n", MQTT_BROKER_HOSTNAME);
+            boot_stage_end(BOOT_STAGE_BROKER_RESOLVE, NX_DNS_QUERY_FAILED);
+            return NX_DNS_QUERY_FAILED;
+        }
+    }
+    else
+    {
+    // It's a hostname, resolve via DNS
+        printf("Resolving hostname via DNS: %s\r\n", MQTT_BROKER_HOSTNAME);
+        
+        // Try multiple DNS resolutions with different timeouts
+        UINT retry;
+        UINT max_retries = 3;
+        ULONG timeouts[3] = {5 * NX_IP_PERIODIC_RATE, 10 * NX_IP_PERIODIC_RATE, 15 * NX_IP_PERIODIC_RATE};
+        
+        for (retry = 0; retry < max_retries; retry++) 
+        {
+            printf("DNS resolution attempt %d of %d (timeout: %lu ticks)...\r\n", 
+                  retry + 1, max_retries, timeouts[retry]);
+                  
+            // Resolve hostname to IP address
+            status = nx_dns_host_by_name_get(dns_ptr, 
+                                          (UCHAR *)MQTT_BROKER_HOSTNAME, 
+                                          &server_ip.nxd_ip_address.v4, 
+                                          timeouts[retry]);
+            if (status == NX_SUCCESS) 
+            {
+                printf("DNS resolution successful on attempt %d!\r\n", retry + 1);
+                break;
+            }
+            
+            printf("DNS resolution attempt %d failed (0x%08lx)\r\n", retry + 1, (unsigned long)status);
+            
+            // Check specific DNS error codes
+            if (status == NX_DNS_QUERY_FAILED)
+            {
+                printf("  - DNS query failed - no DNS servers could resolve this hostname\r\n");
+            }
+            else if (status == NX_DNS_NO_SERVER)
+            {
+                printf("  - No DNS servers are configured in the system\r\n");
+            }
+            else if (status == NX_DNS_TIMEOUT)
+            {
+                printf("  - DNS query timed out - DNS servers may be unreachable\r\n");
+            }
+            
+            // Show available DNS servers
+            ULONG dns_server_address[5];
+            UINT dns_count = 0;
+            
+            printf("Checking DNS server configuration...\r\n");
+            if (nx_dns_server_get(dns_ptr, 0, &dns_server_address[0]) == NX_SUCCESS)
             {
-                printf("WARNING: Could not establish TCP connection to broker on any tested port\r\n");
-                printf("This suggests a network connectivity issue or firewall blocking\r\n");
+                printf("  - Primary DNS: %u.%u.%u.%u\r\n",
+                      (UINT)((dns_server_address[0] >> 24) & 0xFF),
+                      (UINT)((dns_server_address[0] >> 16) & 0xFF),
+                      (UINT)((dns_server_address[0] >> 8) & 0xFF),
+                      (UINT)(dns_server_address[0] & 0xFF));
+                dns_count++;
+            }
+            else
+            {
+                printf("  - No primary DNS server configured\r\n");
             }
             
-            // Clean up
-            nx_tcp_client_socket_unbind(&test_socket);
-            nx_tcp_socket_delete(&test_socket);
+            // Try Google DNS directly if hostname resolution fails on final attempt
+            if (retry == max_retries - 1)
+            {
+                printf("Trying fallback to local IP address...\r\n");
+                // Use the local IP we configured earlier
+                server_ip.nxd_ip_address.v4 = IP_ADDRESS(192, 168, 1, 100);
+                printf("Using fallback IP: 192.168.1.100\r\n");
+                status = NX_SUCCESS;
+            }
+        }
+        
+        printf("SUCCESS: Hostname resolved via DNS\r\n");
+    }
+    
+    // Set IP version
+    server_ip.nxd_ip_version = NX_IP_VERSION_V4;
+    
+    printf("SUCCESS: Resolved to IP: %u.%u.%u.%u\r\n", 
+           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
+           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF));
+    boot_stage_end(BOOT_STAGE_BROKER_RESOLVE, NX_SUCCESS);
+    
+    // Set credentials if provided
+    printf("\r\nMQTT Authentication\r\n");
+    printf("-------------------\r\n");
+    if (strlen(MQTT_USERNAME) > 0)
+    {
+        printf("Setting MQTT credentials for user: %s\r\n", MQTT_USERNAME);
+        
+        status = nxd_mqtt_client_login_set(&mqtt_client, 
+                                          MQTT_USERNAME, 
+                                          strlen(MQTT_USERNAME),
+                                          MQTT_PASSWORD, 
+                                          strlen(MQTT_PASSWORD));
+        if (status != NXD_MQTT_SUCCESS)
+        {
+            printf("FAIL: Failed to set MQTT login credentials (0x%02lx)\r\n", (unsigned long)status);
+            return status;
         }
+        printf("SUCCESS: MQTT credentials set\r\n");
+    }
+    else
+    {
+        printf("No authentication credentials provided, connecting anonymously\r\n");
     }
+    
+    // Connect to broker
+    printf("\r\nMQTT Connection\r\n");
+    printf("-------------------\r\n");
+    printf("Connecting to MQTT broker at %u.%u.%u.%u:%u\r\n",
+           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
+           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
+           (UINT)server_port);
+           
+    printf("Keep alive: %d seconds\r\n", MQTT_KEEP_ALIVE);
+    printf("Clean session: Yes\r\n");
+    
+    // Make sure IP version is set correctly
+    server_ip.nxd_ip_version = NX_IP_VERSION_V4;
+    
+    // Debug: Show IP address we're using
+    printf("Using IP address: 0x%08lx (%u.%u.%u.%u):%u\r\n", 
+           (unsigned long)server_ip.nxd_ip_address.v4,
+           (UINT)((server_ip.nxd_ip_address.v4 >> 24) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 16) & 0xFF),
+           (UINT)((server_ip.nxd_ip_address.v4 >> 8) & 0xFF),
+           (UINT)(server_ip.nxd_ip_address.v4 & 0xFF),
+           server_port);
     printf("Connecting to MQTT broker with timeout of %ld seconds...\r\n", (long)(MQTT_TIMEOUT/TX_TIMER_TICKS_PER_SECOND));
     
     // Try connecting multiple times with different configurations
@@ -560,6 +1149,7 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
                                10 * TX_TIMER_TICKS_PER_SECOND,
                                MQTT_TIMEOUT};
                                
+    boot_stage_begin(BOOT_STAGE_MQTT_CONNECT);
     while (connection_attempts < MAX_ATTEMPTS)
     {
         printf("Connection attempt %d - with %ld second timeout...\r\n", 
@@ -581,8 +1171,16 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
         }
         
         printf("Connection attempt %d failed (0x%08lx)\r\n", connection_attempts+1, (unsigned long)status);
+
+        // Only probe the network once the fast path has failed
+        if (connection_attempts == 0)
+        {
+            mqtt_connection_diagnostics(ip_ptr, &server_ip, &server_port);
+        }
+
         connection_attempts++;
     }
+    boot_stage_end(BOOT_STAGE_MQTT_CONNECT, status);
 
     if (status != NXD_MQTT_SUCCESS)
     {
@@ -648,286 +1246,218 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
     }
     
     printf("SUCCESS: Connected to MQTT broker\r\n");
+
+    // The broker is reachable, keep a configuration that is on trial
+    config_manager_commit();
     
     printf("\r\nMQTT Subscriptions\r\n");
     printf("-------------------\r\n");
     
-    // Subscribe to the command topic
-    printf("Subscribing to command topic: %s (QoS %d)\r\n", MQTT_COMMAND_TOPIC, MQTT_TELEMETRY_QOS);
-    status = nxd_mqtt_client_subscribe(&mqtt_client, 
-                                      MQTT_COMMAND_TOPIC, 
-                                      strlen(MQTT_COMMAND_TOPIC),
-                                      MQTT_TELEMETRY_QOS);
-                                      
-    if (status != NXD_MQTT_SUCCESS)
+    if ((status = mqtt_subscribe_topics()))
     {
-        printf("FAIL: Failed to subscribe to command topic (0x%08lx)\r\n", (unsigned long)status);
         return status;
     }
-    printf("SUCCESS: Subscribed to command topic: %s\r\n", MQTT_COMMAND_TOPIC);
-    
-    // Subscribe to the LED topic
-    printf("Subscribing to LED control topic: %s (QoS %d)\r\n", MQTT_LED_TOPIC, MQTT_TELEMETRY_QOS);
-    status = nxd_mqtt_client_subscribe(&mqtt_client, 
-                                      MQTT_LED_TOPIC, 
-                                      strlen(MQTT_LED_TOPIC),
-                                      MQTT_TELEMETRY_QOS);
-                                      
-    if (status != NXD_MQTT_SUCCESS)
-    {
-        printf("FAIL: Failed to subscribe to LED topic (0x%08lx)\r\n", (unsigned long)status);
-    }
-    else
-    {
-        printf("SUCCESS: Subscribed to LED control topic: %s\r\n", MQTT_LED_TOPIC);
-    }
-    
+
     // Initialize the LED (off)
     set_led_state(false);
     
     // Update screen
     printf("\r\nMQTT Telemetry\r\n");
     printf("-------------------\r\n");
-    printf("Starting MQTT telemetry loop - interval: %d seconds\r\n", telemetry_interval);
+    printf("Starting MQTT telemetry loop - interval: %lu seconds\r\n", (unsigned long)TELEMETRY_INTERVAL);
     printf("Publishing to topic: %s\r\n", MQTT_TELEMETRY_TOPIC);
     printf("Press button B to exit (not implemented yet)\r\n");
     
     screen_print("Custom MQTT", L0);
     screen_print(MQTT_BROKER_HOSTNAME, L1);
     
-    // Main telemetry loop
+    // Sensors are configured in board_init, make sure they have produced a first sample
+    boot_stage_wait(BOOT_STAGE_BIT(BOOT_STAGE_SENSORS), TX_WAIT_FOREVER);
+    boot_stage_begin(BOOT_STAGE_FIRST_PUBLISH);
+    bool first_publish_done = false;
+    bool connected          = true;
+
+    // Sensor reads, the display and the publishes all run on this thread, a hang in any of them stops check-ins
+    watchdog_register(
+        tx_thread_identify(), TELEMETRY_INTERVAL * NX_IP_PERIODIC_RATE + MQTT_WATCHDOG_MARGIN, WATCHDOG_CHECKIN);
+
+    // Main telemetry loop, publish straight away then wait out the interval
     while (true)
     {
-        // Wait for events or timeout for regular telemetry
-        ULONG events;
-        tx_event_flags_get(
-            &mqtt_events, TELEMETRY_INTERVAL_EVENT, TX_OR_CLEAR, &events, telemetry_interval * NX_IP_PERIODIC_RATE);
-            
-        // Declare message buffer once for all cases (increased size for device name)
-        CHAR mqtt_message_buffer[256];
-        UINT message_length;
-        
+        PROF_BEGIN(PROF_PUBLISH_CYCLE);
+
+        // Each reading is serialized into a packet and published from there
+        json_packet_t writer;
+        const CHAR* telemetry_name = NULL;
+        hts221_data_t hts221_data;
+        lps22hb_t lps22hb_data;
+        lsm6dsl_data_t lsm6dsl_data;
+        lis2mdl_data_t lis2mdl_data;
+
+        // The sensor is read and the packet taken first, so the JSON build probe only covers serialization
         switch (telemetry_state)
-        {            case 0:
-                // Send temperature data (using HTS221 for highest accuracy)
-                {
-                    hts221_data_t hts221_data = hts221_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int temp_int = (int)(hts221_data.temperature_degC * 100); // Convert to int (e.g., 23.45 -> 2345)
-                    int temp_whole = temp_int / 100;
-                    int temp_frac = temp_int % 100;
-                    
-                    printf("DEBUG: Temperature (HTS221) as int*100: %d (= %d.%02d°C)\r\n", temp_int, temp_whole, temp_frac);
-                    
-                    // Use integer formatting for JSON since floating point printf doesn't work
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"temperature\": %d.%02d}", MQTT_CLIENT_ID, temp_whole, temp_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing temperature (HTS221): %d.%02d°C\r\n", temp_whole, temp_frac);
-                    printf("Topic: %s\r\n", MQTT_TELEMETRY_TOPIC);
-                    printf("Message: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish temperature message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                    else
-                    {
-                        printf("SUCCESS: Temperature data (HTS221) published\r\n");
-                    }
-                }
-                break;            case 1:
-                // Send pressure data
-                {
-                    lps22hb_t lps22hb_data = lps22hb_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int pressure_int = (int)(lps22hb_data.pressure_hPa * 100); // Convert to int (e.g., 1013.25 -> 101325)
-                    int pressure_whole = pressure_int / 100;
-                    int pressure_frac = pressure_int % 100;
-                    
-                    printf("DEBUG: Pressure as int*100: %d (= %d.%02d hPa)\r\n", pressure_int, pressure_whole, pressure_frac);
-                    
-                    // Use integer formatting for JSON since floating point printf doesn't work
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"pressure\": %d.%02d}", MQTT_CLIENT_ID, pressure_whole, pressure_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish pressure message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                }
-                break;            case 2:
-                // Send humidity data
-                {
-                    hts221_data_t hts221_data = hts221_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int humidity_int = (int)(hts221_data.humidity_perc * 100); // Convert to int (e.g., 45.67 -> 4567)
-                    int humidity_whole = humidity_int / 100;
-                    int humidity_frac = humidity_int % 100;
-                    
-                    // Use integer formatting for JSON since floating point printf doesn't work
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"humidity\": %d.%02d}", MQTT_CLIENT_ID, humidity_whole, humidity_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish humidity message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                    else
-                    {
-                        printf("SUCCESS: Humidity data published\r\n");
-                    }
-                }
-                break;            case 3:
-                // Send acceleration data
-                {
-                    lsm6dsl_data_t lsm6dsl_data = lsm6dsl_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int accel_int = (int)(lsm6dsl_data.acceleration_mg[0] * 100); // Convert to int (e.g., 9.81 -> 981)
-                    int accel_whole = accel_int / 100;
-                    int accel_frac = abs(accel_int % 100); // Use abs() for negative values
-                    
-                    // Use integer formatting for JSON since floating point printf doesn't work
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"acceleration\": %s%d.%02d}", 
-                            MQTT_CLIENT_ID, (accel_int < 0) ? "-" : "", abs(accel_whole), accel_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish acceleration message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                    else
-                    {
-                        printf("SUCCESS: Acceleration data published\r\n");
-                    }
-                }
-                break;            case 4:
-                // Send magnetic field data
-                {
-                    lis2mdl_data_t lis2mdl_data = lis2mdl_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int magnetic_int = (int)(lis2mdl_data.magnetic_mG[0] * 100); // Convert to int
-                    int magnetic_whole = magnetic_int / 100;
-                    int magnetic_frac = abs(magnetic_int % 100); // Use abs() for negative values
-                    
-                    // Use integer formatting for JSON since floating point printf doesn't work
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"magnetic\": %s%d.%02d}", 
-                            MQTT_CLIENT_ID, (magnetic_int < 0) ? "-" : "", abs(magnetic_whole), magnetic_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish magnetic field message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                    else
-                    {
-                        printf("SUCCESS: Magnetic field data published\r\n");
-                    }                }
+        {
+            case 0: // Temperature, using HTS221 for highest accuracy
+            case 2: // Humidity
+                hts221_data = hts221_data_read();
                 break;
-            
-            case 5:
-                // Send gyroscope data
-                {
-                    lsm6dsl_data_t lsm6dsl_data = lsm6dsl_data_read();
-                    
-                    // Convert float to integers for printf (since floating point printf is disabled)
-                    int gyro_x_int = (int)(lsm6dsl_data.angular_rate_mdps[0] * 100); // Convert to int
-                    int gyro_x_whole = gyro_x_int / 100;
-                    int gyro_x_frac = abs(gyro_x_int % 100); // Use abs() for negative values
-                    
-                    int gyro_y_int = (int)(lsm6dsl_data.angular_rate_mdps[1] * 100);
-                    int gyro_y_whole = gyro_y_int / 100;
-                    int gyro_y_frac = abs(gyro_y_int % 100);
-                    
-                    int gyro_z_int = (int)(lsm6dsl_data.angular_rate_mdps[2] * 100);
-                    int gyro_z_whole = gyro_z_int / 100;
-                    int gyro_z_frac = abs(gyro_z_int % 100);
-                    
-                    // Use integer formatting for JSON with all three axes
-                    sprintf(mqtt_message_buffer, "{\"device\": \"%s\", \"gyroscope\": {\"x\": %s%d.%02d, \"y\": %s%d.%02d, \"z\": %s%d.%02d}}", 
-                            MQTT_CLIENT_ID,
-                            (gyro_x_int < 0) ? "-" : "", abs(gyro_x_whole), gyro_x_frac,
-                            (gyro_y_int < 0) ? "-" : "", abs(gyro_y_whole), gyro_y_frac,
-                            (gyro_z_int < 0) ? "-" : "", abs(gyro_z_whole), gyro_z_frac);
-                    message_length = strlen(mqtt_message_buffer);
-                    printf("Publishing: %s\r\n", mqtt_message_buffer);
-                
-                    status = nxd_mqtt_client_publish(&mqtt_client, 
-                                                   MQTT_TELEMETRY_TOPIC,
-                                                   strlen(MQTT_TELEMETRY_TOPIC),
-                                                   (CHAR*)mqtt_message_buffer,
-                                                   message_length,
-                                                   NX_TRUE,
-                                                   MQTT_TELEMETRY_QOS,
-                                                   NX_WAIT_FOREVER);
-                                                   
-                    if (status != NXD_MQTT_SUCCESS)
-                    {
-                        printf("FAIL: Failed to publish gyroscope message (0x%08lx)\r\n", (unsigned long)status);
-                    }
-                    else
-                    {
-                        printf("SUCCESS: Gyroscope data published\r\n");
-                    }
-                }
+
+            case 1: // Pressure
+                lps22hb_data = lps22hb_data_read();
+                break;
+
+            case 3: // Acceleration
+            case 5: // Gyroscope
+                lsm6dsl_data = lsm6dsl_data_read();
+                break;
+
+            case 4: // Magnetic field
+                lis2mdl_data = lis2mdl_data_read();
                 break;
         }
+
+        if ((status = mqtt_document_begin(&writer, NX_WAIT_FOREVER)) == NXD_MQTT_SUCCESS)
+        {
+            PROF_BEGIN(PROF_JSON_BUILD);
+            json_packet_object_begin(&writer, NULL);
+            json_packet_string(&writer, "device", MQTT_CLIENT_ID);
+
+            // Values are passed as hundredths since floating point printf is disabled
+            switch (telemetry_state)
+            {
+                case 0:
+                    json_packet_fixed(&writer, "temperature", (int)(hts221_data.temperature_degC * 100));
+                    telemetry_name = "Temperature";
+                    break;
+
+                case 1:
+                    json_packet_fixed(&writer, "pressure", (int)(lps22hb_data.pressure_hPa * 100));
+                    telemetry_name = "Pressure";
+                    break;
+
+                case 2:
+                    json_packet_fixed(&writer, "humidity", (int)(hts221_data.humidity_perc * 100));
+                    telemetry_name = "Humidity";
+                    break;
+
+                case 3:
+                    json_packet_fixed(&writer, "acceleration", (int)(lsm6dsl_data.acceleration_mg[0] * 100));
+                    telemetry_name = "Acceleration";
+                    break;
+
+                case 4:
+                    json_packet_fixed(&writer, "magnetic", (int)(lis2mdl_data.magnetic_mG[0] * 100));
+                    telemetry_name = "Magnetic field";
+                    break;
+
+                case 5:
+                    // All three axes
+                    json_packet_object_begin(&writer, "gyroscope");
+                    json_packet_fixed(&writer, "x", (int)(lsm6dsl_data.angular_rate_mdps[0] * 100));
+                    json_packet_fixed(&writer, "y", (int)(lsm6dsl_data.angular_rate_mdps[1] * 100));
+                    json_packet_fixed(&writer, "z", (int)(lsm6dsl_data.angular_rate_mdps[2] * 100));
+                    json_packet_object_end(&writer);
+                    telemetry_name = "Gyroscope";
+                    break;
+            }
+
+            json_packet_object_end(&writer);
+            PROF_END(PROF_JSON_BUILD);
+        }
+
+        if (status == NXD_MQTT_SUCCESS)
+        {
+            PROF_BEGIN(PROF_MQTT_PUBLISH);
+            status = mqtt_document_publish(&writer, MQTT_TELEMETRY_TOPIC, MQTT_TELEMETRY_QOS, NX_TRUE, NX_WAIT_FOREVER);
+            PROF_END(PROF_MQTT_PUBLISH);
+
+            if (status != NXD_MQTT_SUCCESS)
+            {
+                printf("FAIL: Failed to publish %s message (0x%08lx)\r\n", telemetry_name, (unsigned long)status);
+            }
+            else
+            {
+                printf("SUCCESS: %s data published\r\n", telemetry_name);
+            }
+        }
         
+        if (!first_publish_done && status == NXD_MQTT_SUCCESS)
+        {
+            first_publish_done = true;
+            boot_stage_end(BOOT_STAGE_FIRST_PUBLISH, status);
+            boot_pipeline_report();
+        }
+
         // Move to the next telemetry type (now 6 states: 0-5)
         telemetry_state = (telemetry_state + 1) % 6;
+
+        // Publish a health report once per full telemetry cycle
+        if (telemetry_state == 0)
+        {
+            msg_medium_t* health_buffer = msg_medium_acquire(TX_WAIT_FOREVER);
+            UINT health_length          = sys_monitor_format_json(health_buffer->data, sizeof(health_buffer->data));
+
+            if (health_length > 0 &&
+                nxd_mqtt_client_publish(&mqtt_client,
+                    MQTT_HEALTH_TOPIC,
+                    strlen(MQTT_HEALTH_TOPIC),
+                    health_buffer->data,
+                    health_length,
+                    NX_FALSE,
+                    0,
+                    NX_WAIT_FOREVER) != NXD_MQTT_SUCCESS)
+            {
+                printf("FAIL: Failed to publish health report\r\n");
+            }
+
+            msg_medium_release(health_buffer);
+
+#ifdef PROFILER_ENABLE
+            msg_medium_t* profile_buffer = msg_medium_acquire(TX_WAIT_FOREVER);
+            UINT profile_length          = prof_format_json(profile_buffer->data, sizeof(profile_buffer->data));
+
+            if (profile_length > 0 &&
+                nxd_mqtt_client_publish(&mqtt_client,
+                    MQTT_PROFILE_TOPIC,
+                    strlen(MQTT_PROFILE_TOPIC),
+                    profile_buffer->data,
+                    profile_length,
+                    NX_FALSE,
+                    0,
+                    NX_WAIT_FOREVER) != NXD_MQTT_SUCCESS)
+            {
+                printf("FAIL: Failed to publish profile report\r\n");
+            }
+
+            msg_medium_release(profile_buffer);
+#endif
+        }
+
+        PROF_END(PROF_PUBLISH_CYCLE);
+
+        // Cycle complete, the interval may have changed since the last one
+        watchdog_deadline_set(TELEMETRY_INTERVAL * NX_IP_PERIODIC_RATE + MQTT_WATCHDOG_MARGIN);
+
+        // Wait for events or timeout for regular telemetry, the interval can change at runtime
+        ULONG events = 0;
+        tx_event_flags_get(&mqtt_events,
+            TELEMETRY_INTERVAL_EVENT | CONFIG_RESTART_EVENT | MQTT_DISCONNECT_EVENT,
+            TX_OR_CLEAR,
+            &events,
+            TELEMETRY_INTERVAL * NX_IP_PERIODIC_RATE);
+
+        if (events & CONFIG_RESTART_EVENT)
+        {
+            printf("Restarting to try the new configuration\r\n");
+            nxd_mqtt_client_disconnect(&mqtt_client);
+            NVIC_SystemReset();
+        }
+
+        // A failed attempt is retried after the next cycle rather than straight away
+        if ((events & MQTT_DISCONNECT_EVENT) || !connected)
+        {
+            connected = mqtt_reconnect(&server_ip, server_port) == NXD_MQTT_SUCCESS;
+        }
     }
 
     // Clean up (this will never execute in the current implementation)
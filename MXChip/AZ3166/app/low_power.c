@@ -0,0 +1,329 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "low_power.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "stm32f4xx_hal.h"
+
+// Tickless idle, driven by the ThreadX low power utility (TX_LOW_POWER in tx_user.h).
+// When the scheduler goes idle it reports the ticks until the next timer expiry, the SysTick is stopped and
+// the RTC wakeup timer, clocked from the LSE, is armed for that expiry. Any other enabled interrupt also ends
+// the sleep. On wake the time spent asleep is read back from the RTC and tx_time is advanced by it.
+// STOP is only entered while nothing holds low_power_stop_inhibit(). Wi-Fi holds it from its init onwards, so on
+// this board STOP only runs before the radio is brought up and the idle path is otherwise SLEEP (WFI).
+
+// RTC prescalers giving a 4096 Hz sub-second counter and a 1 Hz calendar from the 32768 Hz LSE
+#define LOW_POWER_RTC_PREDIV_A 7
+#define LOW_POWER_RTC_PREDIV_S 4095
+#define LOW_POWER_RTC_HZ       (LOW_POWER_RTC_PREDIV_S + 1)
+#define LOW_POWER_RTC_DAY      (86400UL * LOW_POWER_RTC_HZ)
+
+// The wakeup timer runs from RTCCLK/16, its 16-bit reload gives sleeps of up to 32 s
+#define LOW_POWER_WUT_HZ    (32768 / 16)
+#define LOW_POWER_MAX_TICKS ((0xFFFFUL * TX_TIMER_TICKS_PER_SECOND) / LOW_POWER_WUT_HZ)
+
+// Shorter sleeps are not worth stopping the tick for
+#define LOW_POWER_MIN_TICKS 2
+
+// Bound on the polling loops during initialization
+#define LOW_POWER_INIT_TIMEOUT 1000000
+
+// Bound on the wait for the wakeup timer to become writable on the idle path, with interrupts disabled. The flag
+// follows clearing WUTE within two RTCCLK cycles (61 us), this allows several times that at the full core clock.
+#define LOW_POWER_WUTWF_TIMEOUT 10000
+
+#define LOW_POWER_EXTI_RTC_WAKEUP EXTI_IMR_MR22
+
+typedef enum
+{
+    LOW_POWER_MODE_NONE,
+    LOW_POWER_MODE_SLEEP,
+    LOW_POWER_MODE_STOP
+} low_power_mode_t;
+
+static bool low_power_ready;
+static UINT low_power_inhibit_count;
+static low_power_mode_t low_power_mode;
+
+static ULONG low_power_wake_ticks;
+static ULONG low_power_expected_ticks;
+static ULONG low_power_start;
+static ULONG low_power_residual; // Left over time in 1/(LOW_POWER_RTC_HZ) tick units
+
+static low_power_stats_t low_power_counters;
+
+static bool wait_for(volatile uint32_t* reg, uint32_t mask, UINT timeout)
+{
+    for (UINT i = 0; i < timeout; i++)
+    {
+        if (*reg & mask)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static VOID rtc_unlock(void)
+{
+    RTC->WPR = 0xCA;
+    RTC->WPR = 0x53;
+}
+
+static VOID rtc_lock(void)
+{
+    RTC->WPR = 0xFF;
+}
+
+// Time of day in 1/LOW_POWER_RTC_HZ second units
+static ULONG rtc_now(void)
+{
+    uint32_t ssr;
+    uint32_t tr;
+    ULONG seconds;
+
+    // The shadow registers are bypassed, so read the sub-seconds twice to catch a rollover
+    do
+    {
+        ssr = RTC->SSR;
+        tr  = RTC->TR;
+    } while (ssr != RTC->SSR);
+
+    seconds = (((tr & RTC_TR_HT) >> RTC_TR_HT_Pos) * 10 + ((tr & RTC_TR_HU) >> RTC_TR_HU_Pos)) * 3600 +
+              (((tr & RTC_TR_MNT) >> RTC_TR_MNT_Pos) * 10 + ((tr & RTC_TR_MNU) >> RTC_TR_MNU_Pos)) * 60 +
+              (((tr & RTC_TR_ST) >> RTC_TR_ST_Pos) * 10 + ((tr & RTC_TR_SU) >> RTC_TR_SU_Pos));
+
+    return seconds * LOW_POWER_RTC_HZ + (LOW_POWER_RTC_PREDIV_S - (ssr & RTC_SSR_SS));
+}
+
+static VOID wakeup_timer_disable(void)
+{
+    rtc_unlock();
+    RTC->CR &= ~RTC_CR_WUTE;
+    rtc_lock();
+}
+
+// Restart the HSE and PLL after STOP mode, which wakes on the HSI. The PLL configuration is retained.
+static VOID clock_restore(void)
+{
+    RCC->CR |= RCC_CR_HSEON;
+    while ((RCC->CR & RCC_CR_HSERDY) == 0)
+    {
+    }
+
+    RCC->CR |= RCC_CR_PLLON;
+    while ((RCC->CR & RCC_CR_PLLRDY) == 0)
+    {
+    }
+
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+    {
+    }
+}
+
+UINT low_power_init(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    PWR->CR |= PWR_CR_DBP;
+
+    // The LSE is started by SystemClock_Config, changing the RTC clock source needs a backup domain reset
+    if ((RCC->BDCR & RCC_BDCR_RTCSEL) != RCC_BDCR_RTCSEL_0)
+    {
+        RCC->BDCR |= RCC_BDCR_BDRST;
+        RCC->BDCR &= ~RCC_BDCR_BDRST;
+        RCC->BDCR |= RCC_BDCR_LSEON;
+    }
+
+    if (!wait_for(&RCC->BDCR, RCC_BDCR_LSERDY, LOW_POWER_INIT_TIMEOUT))
+    {
+        printf("ERROR: LSE not ready, tickless idle disabled\r\n");
+        return TX_NOT_AVAILABLE;
+    }
+
+    RCC->BDCR |= RCC_BDCR_RTCSEL_0 | RCC_BDCR_RTCEN;
+
+    rtc_unlock();
+
+    RTC->ISR |= RTC_ISR_INIT;
+    if (!wait_for(&RTC->ISR, RTC_ISR_INITF, LOW_POWER_INIT_TIMEOUT))
+    {
+        rtc_lock();
+        printf("ERROR: RTC init mode not entered, tickless idle disabled\r\n");
+        return TX_NOT_AVAILABLE;
+    }
+
+    // The synchronous prescaler has to be written before the asynchronous one
+    RTC->PRER = LOW_POWER_RTC_PREDIV_S;
+    RTC->PRER |= LOW_POWER_RTC_PREDIV_A << RTC_PRER_PREDIV_A_Pos;
+    RTC->CR |= RTC_CR_BYPSHAD;
+    RTC->ISR &= ~RTC_ISR_INIT;
+
+    RTC->CR &= ~RTC_CR_WUTE;
+    if (!wait_for(&RTC->ISR, RTC_ISR_WUTWF, LOW_POWER_INIT_TIMEOUT))
+    {
+        rtc_lock();
+        printf("ERROR: RTC wakeup timer not writable, tickless idle disabled\r\n");
+        return TX_NOT_AVAILABLE;
+    }
+
+    // RTCCLK/16 and interrupt on expiry
+    RTC->CR = (RTC->CR & ~RTC_CR_WUCKSEL) | RTC_CR_WUTIE;
+
+    rtc_lock();
+
+    // The wakeup event reaches the NVIC through EXTI line 22, which also brings the system out of STOP
+    EXTI->IMR |= LOW_POWER_EXTI_RTC_WAKEUP;
+    EXTI->RTSR |= LOW_POWER_EXTI_RTC_WAKEUP;
+    HAL_NVIC_SetPriority(RTC_WKUP_IRQn, 0xF, 0);
+    HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+
+    low_power_ready = true;
+
+    return TX_SUCCESS;
+}
+
+VOID low_power_stop_inhibit(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    low_power_inhibit_count++;
+    TX_RESTORE
+}
+
+VOID low_power_stop_allow(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    if (low_power_inhibit_count > 0)
+    {
+        low_power_inhibit_count--;
+    }
+    TX_RESTORE
+}
+
+VOID low_power_stats(low_power_stats_t* stats)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *stats        = low_power_counters;
+    stats->uptime = tx_time_get();
+    TX_RESTORE
+}
+
+// ThreadX low power hooks, called from the idle loop of the scheduler with interrupts disabled
+
+VOID low_power_timer_setup(ULONG ticks)
+{
+    low_power_wake_ticks = ticks;
+}
+
+VOID low_power_enter(void)
+{
+    // Without an active timer, still wake up now and then so the time can be measured
+    ULONG ticks = low_power_wake_ticks ? low_power_wake_ticks : LOW_POWER_MAX_TICKS;
+
+    low_power_wake_ticks = 0;
+    low_power_mode       = LOW_POWER_MODE_NONE;
+
+    // Keep the tick and just wait for the next interrupt
+    if (!low_power_ready || ticks < LOW_POWER_MIN_TICKS)
+    {
+        return;
+    }
+
+    if (ticks > LOW_POWER_MAX_TICKS)
+    {
+        ticks = LOW_POWER_MAX_TICKS;
+    }
+
+    rtc_unlock();
+    RTC->CR &= ~RTC_CR_WUTE;
+    if (!wait_for(&RTC->ISR, RTC_ISR_WUTWF, LOW_POWER_WUTWF_TIMEOUT))
+    {
+        // The wakeup timer cannot be armed, keep the tick and just wait for the next interrupt
+        rtc_lock();
+        low_power_counters.wut_timeouts++;
+        return;
+    }
+    RTC->WUTR = (ticks * LOW_POWER_WUT_HZ) / TX_TIMER_TICKS_PER_SECOND - 1;
+    RTC->ISR &= ~RTC_ISR_WUTF;
+    EXTI->PR = LOW_POWER_EXTI_RTC_WAKEUP;
+    RTC->CR |= RTC_CR_WUTE;
+    rtc_lock();
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+    low_power_expected_ticks = ticks;
+    low_power_start          = rtc_now();
+
+    if (low_power_inhibit_count == 0)
+    {
+        // STOP with the regulator in low power mode
+        PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPDS;
+        SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+        low_power_mode = LOW_POWER_MODE_STOP;
+        low_power_counters.stop_count++;
+    }
+    else
+    {
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        low_power_mode = LOW_POWER_MODE_SLEEP;
+        low_power_counters.sleep_count++;
+    }
+}
+
+VOID low_power_exit(void)
+{
+    // Runs before the interrupt that caused the wake is serviced, so its handler sees the full clock
+    if (low_power_mode == LOW_POWER_MODE_STOP)
+    {
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        clock_restore();
+    }
+}
+
+ULONG low_power_timer_adjust(void)
+{
+    ULONG elapsed;
+    ULONG ticks;
+
+    if (low_power_mode == LOW_POWER_MODE_NONE)
+    {
+        return 0;
+    }
+
+    elapsed = (rtc_now() + LOW_POWER_RTC_DAY - low_power_start) % LOW_POWER_RTC_DAY;
+
+    wakeup_timer_disable();
+
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+    // Carry the part of a tick that was not accounted for into the next sleep
+    low_power_residual += elapsed * TX_TIMER_TICKS_PER_SECOND;
+    ticks = low_power_residual / LOW_POWER_RTC_HZ;
+    low_power_residual %= LOW_POWER_RTC_HZ;
+
+    if (ticks < low_power_expected_ticks)
+    {
+        low_power_counters.early_wakes++;
+    }
+    low_power_counters.idle_ticks += ticks;
+    low_power_mode = LOW_POWER_MODE_NONE;
+
+    return ticks;
+}
+
+void RTC_WKUP_IRQHandler(void)
+{
+    RTC->ISR &= ~RTC_ISR_WUTF;
+    EXTI->PR = LOW_POWER_EXTI_RTC_WAKEUP;
+}
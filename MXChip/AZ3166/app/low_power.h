@@ -0,0 +1,43 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _LOW_POWER_H
+#define _LOW_POWER_H
+
+#include "tx_api.h"
+
+// Idle statistics since boot
+typedef struct
+{
+    ULONG idle_ticks;   // Ticks spent asleep with the tick stopped
+    ULONG uptime;       // tx_time_get() when the snapshot was taken
+    ULONG sleep_count;  // Tickless sleeps in SLEEP mode, each one ends in a wake
+    ULONG stop_count;   // Tickless sleeps in STOP mode
+    ULONG early_wakes;  // Sleeps ended by an interrupt before the programmed expiry
+    ULONG wut_timeouts; // Idle periods left ticking because the wakeup timer did not become writable
+} low_power_stats_t;
+
+/**
+ * @brief Start the RTC wakeup timer used to pace tickless idle, must be called before the kernel starts
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT low_power_init(void);
+
+/**
+ * @brief Keep the system out of STOP mode, for peripherals that must stay clocked to raise their interrupt
+ * @note Calls nest, SLEEP mode is still used so any enabled interrupt wakes the system
+ */
+VOID low_power_stop_inhibit(void);
+
+/**
+ * @brief Release one low_power_stop_inhibit
+ */
+VOID low_power_stop_allow(void);
+
+/**
+ * @brief Get the idle statistics
+ * @param stats Receives the statistics
+ */
+VOID low_power_stats(low_power_stats_t* stats);
+
+#endif // _LOW_POWER_H
@@ -2,16 +2,23 @@
    Licensed under the MIT License. */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "tx_api.h"
 
 #include "board_init.h"
+#include "boot_pipeline.h"
 #include "cmsis_utils.h"
+#include "low_power.h"
+#include "msg_pool.h"
+#include "profiler.h"
 #include "screen.h"
+#include "sys_monitor.h"
 #include "ssd1306.h"
 #include "ssd1306_fonts.h"
 #include "sensor.h"
 #include "sntp_client.h"
+#include "watchdog.h"
 #include "wwd_networking.h"
 
 #include "legacy/mqtt.h"
@@ -19,6 +26,7 @@
 
 #include "azure_config.h"
 #include "config_manager.h"
+#include "config_schema.h"
 
 // Global configuration instance
 device_config_t g_device_config;
@@ -33,6 +41,11 @@ static void display_device_info(void);
 static void cycle_display_info(void);
 static void cycle_telemetry_info(void);
 
+#define SETUP_WINDOW_MS 10000
+
+// The slowest sensor (HTS221) is configured for 1 Hz, give it time to latch a first sample
+#define SENSOR_SETTLE_TICKS (TX_TIMER_TICKS_PER_SECOND * 3 / 2)
+
 static void init_device_configuration(void)
 {
     printf("Initializing device configuration...\r\n");
@@ -41,80 +54,20 @@ static void init_device_configuration(void)
     if (config_manager_check_reset_button()) {
         // Button was held, perform factory reset
         config_manager_factory_reset();
-        // Function will reset the device, so we won't reach here
-        return;
     }
     
-    // Try to load configuration from flash
-    if (config_manager_load(&g_device_config) == CONFIG_OK)
-    {
-        printf("Configuration loaded from flash:\r\n");
-        printf("  WiFi SSID: %s\r\n", g_device_config.wifi_ssid);
-        printf("  MQTT Broker: %s:%u\r\n", g_device_config.mqtt_hostname, (unsigned int)g_device_config.mqtt_port);
-        printf("  MQTT Client ID: %s\r\n", g_device_config.mqtt_client_id);
-        
-        // Ask if user wants to reconfigure
-        printf("\r\nPress any key within 10 seconds to enter setup mode...\r\n");
-        if (config_manager_wait_for_user_input(10000)) {
-            printf("Entering setup mode...\r\n");
-            if (config_manager_prompt_and_store(&g_device_config) == CONFIG_OK) {
-                printf("Configuration updated and will be used for this session\r\n");
-            }
-        } else {
-            printf("Timeout - using existing configuration\r\n");
-        }
-    }
-    else
+    // Try to load configuration from flash, this falls back to defaults
+    if (config_manager_load(&g_device_config) != CONFIG_OK)
     {
-        printf("No valid configuration found in flash\r\n");
-        
-        // Ask if user wants to configure or use defaults
-        printf("Press any key within 10 seconds to enter setup mode, or defaults will be used...\r\n");
-        if (config_manager_wait_for_user_input(10000)) {
-            printf("Entering setup mode...\r\n");
-            if (config_manager_prompt_and_store(&g_device_config) == CONFIG_OK) {
-                printf("Configuration received and will be used for this session\r\n");
-            } else {
-                printf("Setup failed, using defaults\r\n");
-                config_manager_get_defaults(&g_device_config);
-            }
-        } else {
-            printf("Timeout - using default configuration\r\n");
-            config_manager_get_defaults(&g_device_config);
-        }
+        printf("No valid configuration found, using defaults\r\n");
+        config_manager_get_defaults(&g_device_config);
     }
+
+    // The network thread is waiting on this to start joining
+    boot_stage_end(BOOT_STAGE_CONFIG, TX_SUCCESS);
     
     printf("Active configuration:\r\n");
-    printf("  WiFi SSID: ");
-    printf(g_device_config.wifi_ssid);
-    printf("\r\n");
-    
-    printf("  WiFi Mode: ");
-    if (g_device_config.wifi_mode == 0) printf("None");
-    else if (g_device_config.wifi_mode == 1) printf("WEP");
-    else if (g_device_config.wifi_mode == 2) printf("WPA_PSK_TKIP");
-    else if (g_device_config.wifi_mode == 3) printf("WPA2_PSK_AES");
-    else printf("Unknown");
-    printf("\r\n");
-    
-    printf("  MQTT Broker: ");
-    printf(g_device_config.mqtt_hostname);
-    printf(":");
-    if (g_device_config.mqtt_port == 1883) printf("1883");
-    else if (g_device_config.mqtt_port == 8883) printf("8883");
-    else printf("custom-port");
-    printf("\r\n");
-    
-    printf("  MQTT Client ID: ");
-    printf(g_device_config.mqtt_client_id);
-    printf("\r\n");
-    
-    printf("  Telemetry Interval: ");
-    if (g_device_config.telemetry_interval == 30) printf("30");
-    else if (g_device_config.telemetry_interval == 60) printf("60");
-    else if (g_device_config.telemetry_interval == 10) printf("10");
-    else printf("custom");
-    printf(" seconds\r\n");
+    config_schema_print(&g_device_config);
     printf("\r\n");
 
     // Display device info on OLED screen
@@ -124,34 +77,132 @@ static void init_device_configuration(void)
 #define MQTT_THREAD_STACK_SIZE 4096
 #define MQTT_THREAD_PRIORITY   4
 
+// Wi-Fi init, join, DHCP, DNS and SNTP used to run on the MQTT thread, keep its stack until a boot measures less
+#define NETWORK_THREAD_STACK_SIZE 4096
+#define NETWORK_THREAD_PRIORITY   4
+
+// The NetX IP thread runs at least once per second for its periodic timers
+#define NETX_IP_WATCHDOG_DEADLINE (10 * TX_TIMER_TICKS_PER_SECOND)
+
+#define CONSOLE_THREAD_STACK_SIZE 2048
+#define CONSOLE_THREAD_PRIORITY   10
+
 TX_THREAD mqtt_thread;
 ULONG mqtt_thread_stack[MQTT_THREAD_STACK_SIZE / sizeof(ULONG)];
 
-static void mqtt_thread_entry(ULONG parameter)
+static TX_THREAD network_thread;
+static ULONG network_thread_stack[NETWORK_THREAD_STACK_SIZE / sizeof(ULONG)];
+
+static TX_THREAD console_thread;
+static ULONG console_thread_stack[CONSOLE_THREAD_STACK_SIZE / sizeof(ULONG)];
+
+static TX_TIMER sensor_settle_timer;
+
+static void sensor_settle_expired(ULONG parameter)
 {
-    UINT status;
+    boot_stage_end(BOOT_STAGE_SENSORS, TX_SUCCESS);
+}
 
-    printf("Starting MQTT client thread\r\n\r\n");
-    
-    // Initialize configuration manager and load/prompt for configuration
-    init_device_configuration();
-    
-    // Wait for sensors to stabilize after board initialization
-    printf("Waiting for sensors to initialize...\r\n");
-    tx_thread_sleep(3 * TX_TIMER_TICKS_PER_SECOND); // Wait 3 seconds
-    printf("Sensors should be ready now\r\n");
+// Release anyone waiting on the network if it could not be brought up
+static void network_stages_fail(UINT status)
+{
+    boot_stage_end(BOOT_STAGE_WIFI_JOIN, status);
+    boot_stage_end(BOOT_STAGE_DHCP, status);
+    boot_stage_end(BOOT_STAGE_DNS, status);
+}
 
-    // Initialize the network with configuration from persistent storage
-    printf("Connecting to WiFi: %s\r\n", WIFI_SSID);
-    if ((status = wwd_network_init(WIFI_SSID, WIFI_PASSWORD, WIFI_MODE)))
+// Brings the radio up while the configuration is loading, then joins, leases and syncs the clock
+static void network_thread_entry(ULONG parameter)
+{
+    UINT status;
+
+    if ((status = wwd_network_init()))
     {
         printf("ERROR: Failed to initialize the network (0x%08lx)\r\n", (unsigned long)status);
+        network_stages_fail(status);
+        return;
     }
-    
+
+    // The IP thread cannot check in itself, it is supervised through its scheduling instead
+    if ((status = watchdog_register(&nx_ip.nx_ip_thread, NETX_IP_WATCHDOG_DEADLINE, WATCHDOG_SCHEDULED)))
+    {
+        printf("ERROR: Failed to supervise the IP thread (0x%08lx)\r\n", (unsigned long)status);
+    }
+
+    boot_stage_wait(BOOT_STAGE_BIT(BOOT_STAGE_CONFIG), TX_WAIT_FOREVER);
+
     // Connect to WiFi and get IP address via DHCP
-    else if ((status = wwd_network_connect()))
+    printf("Connecting to WiFi: %s\r\n", WIFI_SSID);
+    if ((status = wwd_network_connect(WIFI_SSID, WIFI_PASSWORD, WIFI_MODE)))
     {
         printf("ERROR: Failed to connect to network (0x%08lx)\r\n", (unsigned long)status);
+        network_stages_fail(status);
+        return;
+    }
+
+    // The clock is only needed for timestamps, so sync it alongside the broker connection
+    boot_stage_begin(BOOT_STAGE_SNTP);
+    status = sntp_sync();
+    boot_stage_end(BOOT_STAGE_SNTP, status);
+    if (status)
+    {
+        printf("ERROR: Failed to sync SNTP time (0x%08lx)\r\n", (unsigned long)status);
+    }
+}
+
+// Offers the serial setup window without holding up the rest of the boot
+static void console_thread_entry(ULONG parameter)
+{
+    static device_config_t new_config;
+    config_result_t status;
+
+    boot_stage_wait(BOOT_STAGE_BIT(BOOT_STAGE_CONFIG), TX_WAIT_FOREVER);
+
+    boot_stage_begin(BOOT_STAGE_CONSOLE);
+    printf("Press any key within %d seconds to enter setup mode...\r\n", SETUP_WINDOW_MS / 1000);
+    if (!config_manager_wait_for_user_input(SETUP_WINDOW_MS))
+    {
+        boot_stage_end(BOOT_STAGE_CONSOLE, TX_SUCCESS);
+
+        // Nothing else runs here, roll back a candidate that does not reach the broker in time
+        config_manager_trial_wait();
+        return;
+    }
+
+    printf("Entering setup mode...\r\n");
+    memcpy(&new_config, &g_device_config, sizeof(device_config_t));
+
+    // The prompt polls the UART, the threads it holds up must not be taken for hung
+    watchdog_hold();
+    status = config_manager_prompt_and_store(&new_config);
+    watchdog_release();
+
+    if (status == CONFIG_OK)
+    {
+        // The network may already be up with the old settings, restart so the new ones apply cleanly
+        printf("Configuration updated, restarting to apply...\r\n");
+        tx_thread_sleep(TX_TIMER_TICKS_PER_SECOND / 10);
+        NVIC_SystemReset();
+    }
+
+    boot_stage_end(BOOT_STAGE_CONSOLE, TX_SUCCESS);
+    config_manager_trial_wait();
+}
+
+static void mqtt_thread_entry(ULONG parameter)
+{
+    UINT status;
+
+    printf("Starting MQTT client thread\r\n\r\n");
+    
+    // Initialize configuration manager and load configuration
+    boot_stage_begin(BOOT_STAGE_CONFIG);
+    init_device_configuration();
+
+    // Wait for the network thread to bring the link up
+    if ((status = boot_stage_wait(BOOT_NETWORK_READY, TX_WAIT_FOREVER)))
+    {
+        printf("ERROR: Network is not available (0x%08lx)\r\n", (unsigned long)status);
     }
 
 #ifdef ENABLE_LEGACY_MQTT
@@ -193,23 +244,104 @@ void try_load_persistent_config_after_wifi(void) {
 
 void tx_application_define(void* first_unused_memory)
 {
+    UINT status;
+
     systick_interval_set(TX_TIMER_TICKS_PER_SECOND);
 
+#ifdef PROFILER_ENABLE
+    prof_init();
+#endif
+
+    if ((status = boot_pipeline_init()))
+    {
+        printf("ERROR: Boot pipeline creation failed (0x%08x)\r\n", status);
+    }
+
+    // Shared message buffers for MQTT receive, telemetry and health reports
+    else if ((status = msg_pool_init()))
+    {
+        printf("ERROR: Message pool creation failed (0x%08x)\r\n", status);
+    }
+
+    // Configuration slots and the candidate trial timer
+    else if ((status = config_manager_init()))
+    {
+        printf("ERROR: Configuration manager initialization failed (0x%08x)\r\n", status);
+    }
+
+    // Stack high-water marks and per-thread CPU usage
+    else if ((status = sys_monitor_init()))
+    {
+        printf("ERROR: System monitor creation failed (0x%08x)\r\n", status);
+    }
+
+    // Report the last reset cause and start the IWDG supervisor
+    else if ((status = watchdog_init()))
+    {
+        printf("ERROR: Watchdog initialization failed (0x%08x)\r\n", status);
+    }
+
+    // Tickless idle, the tick is stopped while every thread is blocked
+    else if ((status = low_power_init()))
+    {
+        printf("ERROR: Low power initialization failed (0x%08x)\r\n", status);
+    }
+
+    // Sensors were configured in board_init, release readers once they have produced a sample
+    else if ((status = tx_timer_create(&sensor_settle_timer,
+                  "Sensor Settle",
+                  sensor_settle_expired,
+                  0,
+                  SENSOR_SETTLE_TICKS,
+                  0,
+                  TX_AUTO_ACTIVATE)))
+    {
+        printf("ERROR: Sensor settle timer creation failed (0x%08x)\r\n", status);
+    }
+
+    // Create network thread
+    else if ((status = tx_thread_create(&network_thread,
+                  "Network Thread",
+                  network_thread_entry,
+                  0,
+                  network_thread_stack,
+                  NETWORK_THREAD_STACK_SIZE,
+                  NETWORK_THREAD_PRIORITY,
+                  NETWORK_THREAD_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: Network thread creation failed (0x%08x)\r\n", status);
+    }
+
     // Create MQTT thread
-    UINT status = tx_thread_create(&mqtt_thread,
-        "MQTT Thread",
-        mqtt_thread_entry,
-        0,
-        mqtt_thread_stack,
-        MQTT_THREAD_STACK_SIZE,
-        MQTT_THREAD_PRIORITY,
-        MQTT_THREAD_PRIORITY,
-        TX_NO_TIME_SLICE,
-        TX_AUTO_START);
-
-    if (status != TX_SUCCESS)
+    else if ((status = tx_thread_create(&mqtt_thread,
+                  "MQTT Thread",
+                  mqtt_thread_entry,
+                  0,
+                  mqtt_thread_stack,
+                  MQTT_THREAD_STACK_SIZE,
+                  MQTT_THREAD_PRIORITY,
+                  MQTT_THREAD_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: MQTT thread creation failed (0x%08x)\r\n", status);
+    }
+
+    // Create console thread
+    else if ((status = tx_thread_create(&console_thread,
+                  "Console Thread",
+                  console_thread_entry,
+                  0,
+                  console_thread_stack,
+                  CONSOLE_THREAD_STACK_SIZE,
+                  CONSOLE_THREAD_PRIORITY,
+                  CONSOLE_THREAD_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
     {
-        printf("ERROR: MQTT thread creation failed\r\n");
+        printf("ERROR: Console thread creation failed (0x%08x)\r\n", status);
     }
 }
 
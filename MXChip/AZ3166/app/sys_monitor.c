@@ -0,0 +1,365 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "sys_monitor.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+#include "tx_thread.h"
+
+#include "heap.h"
+#include "low_power.h"
+#include "msg_pool.h"
+#include "profiler.h"
+#include "watchdog.h"
+
+#define SYS_MONITOR_STACK_SIZE 1024
+#define SYS_MONITOR_PRIORITY   15
+
+// The 32-bit cycle counter wraps every ~44 s at 96 MHz, so sample well inside that
+#define SYS_MONITOR_PERIOD (10 * TX_TIMER_TICKS_PER_SECOND)
+
+// Lowest priority supervised thread, it misses its deadline when anything above it spins
+#define SYS_MONITOR_WATCHDOG_DEADLINE (3 * SYS_MONITOR_PERIOD)
+
+// Print the table to the console every this many samples
+#define SYS_MONITOR_PRINT_SAMPLES 6
+
+// Warn once a thread has used more than this share of its stack
+#define SYS_MONITOR_STACK_WARN_PERCENT 90
+
+static TX_THREAD sys_monitor_thread;
+static ULONG sys_monitor_thread_stack[SYS_MONITOR_STACK_SIZE / sizeof(ULONG)];
+static TX_MUTEX sys_monitor_mutex;
+
+static sys_monitor_thread_t sys_monitor_threads[SYS_MONITOR_MAX_THREADS];
+static UINT sys_monitor_thread_count;
+static UINT sys_monitor_idle_permille;
+
+// Previous sample, used to turn the running totals into per-period shares
+static TX_THREAD* sample_threads[SYS_MONITOR_MAX_THREADS];
+static unsigned long long sample_cycles[SYS_MONITOR_MAX_THREADS];
+static ULONG sample_total_cycles;
+
+// Scheduler hooks, called by the port with interrupts disabled on every context switch (TX_EXECUTION_PROFILE_ENABLE).
+// Interrupt time is charged to the interrupted thread.
+VOID _tx_execution_initialize(VOID)
+{
+}
+
+VOID _tx_execution_thread_enter(VOID)
+{
+    TX_THREAD* thread = _tx_thread_current_ptr;
+
+    if (thread)
+    {
+        thread->tx_thread_execution_start = DWT->CYCCNT;
+    }
+}
+
+VOID _tx_execution_thread_exit(VOID)
+{
+    TX_THREAD* thread = _tx_thread_current_ptr;
+
+    if (thread)
+    {
+        thread->tx_thread_execution_cycles += DWT->CYCCNT - thread->tx_thread_execution_start;
+    }
+}
+
+VOID _tx_execution_isr_enter(VOID)
+{
+}
+
+VOID _tx_execution_isr_exit(VOID)
+{
+}
+
+static ULONG stack_high_water(TX_THREAD* thread)
+{
+    ULONG* ptr = (ULONG*)thread->tx_thread_stack_start;
+    ULONG* end = (ULONG*)thread->tx_thread_stack_end;
+
+    // The stack grows down, so count the fill pattern left untouched at the bottom
+    while (ptr < end && *ptr == TX_STACK_FILL)
+    {
+        ptr++;
+    }
+
+    return thread->tx_thread_stack_size - (ULONG)((UCHAR*)ptr - (UCHAR*)thread->tx_thread_stack_start);
+}
+
+static VOID stack_error_notify(TX_THREAD* thread)
+{
+    printf("ERROR: Stack overflow in thread '%s'\r\n", thread->tx_thread_name);
+}
+
+static VOID sys_monitor_sample(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+    TX_THREAD* threads[SYS_MONITOR_MAX_THREADS];
+    unsigned long long cycles[SYS_MONITOR_MAX_THREADS];
+    TX_THREAD* thread;
+    ULONG total_cycles;
+    ULONG period_cycles;
+    ULONG busy_permille = 0;
+    UINT count = 0;
+
+    // Copy the thread list and counters in one go so the shares add up
+    TX_DISABLE
+    total_cycles = DWT->CYCCNT;
+    thread       = _tx_thread_created_ptr;
+    for (ULONG i = 0; i < _tx_thread_created_count && count < SYS_MONITOR_MAX_THREADS; i++)
+    {
+        threads[count] = thread;
+        cycles[count]  = thread->tx_thread_execution_cycles;
+        if (thread == _tx_thread_current_ptr)
+        {
+            cycles[count] += total_cycles - thread->tx_thread_execution_start;
+        }
+        count++;
+        thread = thread->tx_thread_created_next;
+    }
+    TX_RESTORE
+
+    period_cycles       = total_cycles - sample_total_cycles;
+    sample_total_cycles = total_cycles;
+
+    tx_mutex_get(&sys_monitor_mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < count; i++)
+    {
+        sys_monitor_thread_t* entry = &sys_monitor_threads[i];
+        unsigned long long previous = 0;
+
+        // Threads may have been created or deleted since the last sample
+        for (UINT j = 0; j < SYS_MONITOR_MAX_THREADS; j++)
+        {
+            if (sample_threads[j] == threads[i])
+            {
+                previous = sample_cycles[j];
+                break;
+            }
+        }
+
+        entry->name         = threads[i]->tx_thread_name;
+        entry->stack_size   = threads[i]->tx_thread_stack_size;
+        entry->stack_used   = stack_high_water(threads[i]);
+        entry->cpu_permille = period_cycles ? (UINT)(((cycles[i] - previous) * 1000) / period_cycles) : 0;
+        busy_permille += entry->cpu_permille;
+
+        if (entry->stack_used * 100 >= entry->stack_size * SYS_MONITOR_STACK_WARN_PERCENT)
+        {
+            printf("WARNING: Thread '%s' has used %lu of %lu stack bytes\r\n",
+                entry->name,
+                (unsigned long)entry->stack_used,
+                (unsigned long)entry->stack_size);
+        }
+    }
+
+    sys_monitor_thread_count  = count;
+    sys_monitor_idle_permille = busy_permille < 1000 ? 1000 - busy_permille : 0;
+
+    tx_mutex_put(&sys_monitor_mutex);
+
+    memset(sample_threads, 0, sizeof(sample_threads));
+    memcpy(sample_threads, threads, count * sizeof(threads[0]));
+    memcpy(sample_cycles, cycles, count * sizeof(cycles[0]));
+}
+
+static VOID sys_monitor_thread_entry(ULONG parameter)
+{
+    UINT samples = 0;
+
+    watchdog_register(&sys_monitor_thread, SYS_MONITOR_WATCHDOG_DEADLINE, WATCHDOG_CHECKIN);
+
+    while (true)
+    {
+        tx_thread_sleep(SYS_MONITOR_PERIOD);
+        sys_monitor_sample();
+        watchdog_checkin();
+
+        if (++samples % SYS_MONITOR_PRINT_SAMPLES == 0)
+        {
+            sys_monitor_print();
+#ifdef PROFILER_ENABLE
+            prof_print();
+#endif
+        }
+    }
+}
+
+UINT sys_monitor_init(void)
+{
+    UINT status;
+
+    // Start the cycle counter used for the execution profile
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if ((status = tx_mutex_create(&sys_monitor_mutex, "System Monitor", TX_NO_INHERIT)))
+    {
+        printf("ERROR: System monitor mutex creation failed (0x%08x)\r\n", status);
+    }
+
+    else if ((status = tx_thread_stack_error_notify(stack_error_notify)))
+    {
+        printf("ERROR: Stack error notify registration failed (0x%08x)\r\n", status);
+    }
+
+    else if ((status = tx_thread_create(&sys_monitor_thread,
+                  "System Monitor",
+                  sys_monitor_thread_entry,
+                  0,
+                  sys_monitor_thread_stack,
+                  SYS_MONITOR_STACK_SIZE,
+                  SYS_MONITOR_PRIORITY,
+                  SYS_MONITOR_PRIORITY,
+                  TX_NO_TIME_SLICE,
+                  TX_AUTO_START)))
+    {
+        printf("ERROR: System monitor thread creation failed (0x%08x)\r\n", status);
+    }
+
+    return status;
+}
+
+// Share of the uptime spent asleep with the tick stopped, in tenths of a percent
+static UINT low_power_residency(const low_power_stats_t* stats)
+{
+    return stats->uptime ? (UINT)(((unsigned long long)stats->idle_ticks * 1000) / stats->uptime) : 0;
+}
+
+VOID sys_monitor_print(void)
+{
+    heap_stats_t heap;
+    low_power_stats_t power;
+    watchdog_report_t reset;
+    UINT residency;
+
+    heap_system_stats(&heap);
+    low_power_stats(&power);
+    watchdog_last_reset(&reset);
+    residency = low_power_residency(&power);
+
+    tx_mutex_get(&sys_monitor_mutex, TX_WAIT_FOREVER);
+
+    printf("\r\n%-20s %12s %6s\r\n", "Thread", "Stack", "CPU");
+    for (UINT i = 0; i < sys_monitor_thread_count; i++)
+    {
+        sys_monitor_thread_t* entry = &sys_monitor_threads[i];
+        printf("%-20.20s %5lu/%-6lu %3u.%u%%\r\n",
+            entry->name,
+            (unsigned long)entry->stack_used,
+            (unsigned long)entry->stack_size,
+            entry->cpu_permille / 10,
+            entry->cpu_permille % 10);
+    }
+    printf("%-20s %12s %3u.%u%%\r\n", "idle", "", sys_monitor_idle_permille / 10, sys_monitor_idle_permille % 10);
+
+    tx_mutex_put(&sys_monitor_mutex);
+
+    printf("Heap: %lu used, %lu peak, %lu free, %lu largest block, %lu failed allocations\r\n",
+        (unsigned long)heap.used,
+        (unsigned long)heap.peak,
+        (unsigned long)heap.free,
+        (unsigned long)heap.largest,
+        (unsigned long)heap.failures);
+
+    printf("Low power: %u.%u%% tickless, %lu sleeps, %lu stops, %lu early wakes, %lu wakeup timer timeouts\r\n",
+        residency / 10,
+        residency % 10,
+        (unsigned long)power.sleep_count,
+        (unsigned long)power.stop_count,
+        (unsigned long)power.early_wakes,
+        (unsigned long)power.wut_timeouts);
+
+    printf("Last reset: %s%s%s, %lu watchdog resets\r\n",
+        watchdog_reset_name(reset.cause),
+        reset.missed[0] ? " by " : "",
+        reset.missed,
+        (unsigned long)reset.watchdog_resets);
+
+    for (UINT i = 0; i < MSG_POOL_CLASS_COUNT; i++)
+    {
+        msg_pool_stats_t pool;
+
+        msg_pool_stats((msg_pool_class_t)i, &pool);
+        if (pool.block_count == 0)
+        {
+            continue;
+        }
+
+        printf("Message pool %lu: %lu/%lu in use, %lu peak, %lu failed acquires\r\n",
+            (unsigned long)pool.block_size,
+            (unsigned long)pool.in_use,
+            (unsigned long)pool.block_count,
+            (unsigned long)pool.peak,
+            (unsigned long)pool.failures);
+    }
+    printf("\r\n");
+}
+
+UINT sys_monitor_format_json(CHAR* buffer, size_t size)
+{
+    heap_stats_t heap;
+    low_power_stats_t power;
+    watchdog_report_t reset;
+    size_t length;
+    int written;
+
+    heap_system_stats(&heap);
+    low_power_stats(&power);
+    watchdog_last_reset(&reset);
+
+    tx_mutex_get(&sys_monitor_mutex, TX_WAIT_FOREVER);
+
+    // Compact keys: n=name, s=stack used, z=stack size, c=cpu in tenths of a percent
+    written = snprintf(buffer, size, "{\"idle\":%u,\"threads\":[", sys_monitor_idle_permille);
+    length  = written > 0 ? (size_t)written : size;
+
+    for (UINT i = 0; i < sys_monitor_thread_count && length < size; i++)
+    {
+        sys_monitor_thread_t* entry = &sys_monitor_threads[i];
+        written                     = snprintf(buffer + length,
+            size - length,
+            "%s{\"n\":\"%s\",\"s\":%lu,\"z\":%lu,\"c\":%u}",
+            i ? "," : "",
+            entry->name,
+            (unsigned long)entry->stack_used,
+            (unsigned long)entry->stack_size,
+            entry->cpu_permille);
+        length += written > 0 ? (size_t)written : size;
+    }
+
+    if (length < size)
+    {
+        // Heap: u=used, p=peak, l=largest free block, f=failed allocations
+        // Low power: r=tickless residency in tenths of a percent, s=sleeps, t=stops, e=early wakes
+        // Reset: c=last cause, m=thread that missed its watchdog deadline, w=watchdog resets since power on
+        written = snprintf(buffer + length,
+            size - length,
+            "],\"heap\":{\"u\":%lu,\"p\":%lu,\"l\":%lu,\"f\":%lu},\"lp\":{\"r\":%u,\"s\":%lu,\"t\":%lu,\"e\":%lu},"
+            "\"rst\":{\"c\":\"%s\",\"m\":\"%s\",\"w\":%lu}}",
+            (unsigned long)heap.used,
+            (unsigned long)heap.peak,
+            (unsigned long)heap.largest,
+            (unsigned long)heap.failures,
+            low_power_residency(&power),
+            (unsigned long)power.sleep_count,
+            (unsigned long)power.stop_count,
+            (unsigned long)power.early_wakes,
+            watchdog_reset_name(reset.cause),
+            reset.missed,
+            (unsigned long)reset.watchdog_resets);
+        length += written > 0 ? (size_t)written : size;
+    }
+
+    tx_mutex_put(&sys_monitor_mutex);
+
+    return length < size ? (UINT)length : 0;
+}
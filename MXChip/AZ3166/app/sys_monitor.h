@@ -0,0 +1,41 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _SYS_MONITOR_H
+#define _SYS_MONITOR_H
+
+#include <stddef.h>
+
+#include "tx_api.h"
+
+#define SYS_MONITOR_MAX_THREADS 16
+
+// Snapshot of one thread taken by the monitor
+typedef struct
+{
+    const CHAR* name;
+    ULONG stack_size;
+    ULONG stack_used;  // High-water mark in bytes
+    UINT cpu_permille; // Share of the cycles over the last sample period
+} sys_monitor_thread_t;
+
+/**
+ * @brief Start the cycle counter and the monitor thread, must be called from tx_application_define
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT sys_monitor_init(void);
+
+/**
+ * @brief Print the latest snapshot to the console
+ */
+VOID sys_monitor_print(void);
+
+/**
+ * @brief Format the latest snapshot as a compact JSON health report
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ * @return Length written, or 0 if the buffer is too small
+ */
+UINT sys_monitor_format_json(CHAR* buffer, size_t size);
+
+#endif // _SYS_MONITOR_H
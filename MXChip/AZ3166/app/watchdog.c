@@ -0,0 +1,328 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "watchdog.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "crc32.h"
+
+// The IWDG is only refreshed while every supervised thread is within its deadline. Once one misses, its name is
+// written to a .noinit record and refreshing stops, so the IWDG resets the device and the next boot reports it.
+// A thread that checks in again before the IWDG expires restores the refresh and the record is cleared.
+// The supervisor runs above the application threads so a polling loop cannot starve it, starvation is caught by
+// supervising a low priority thread instead.
+
+#define WATCHDOG_STACK_SIZE 1024
+#define WATCHDOG_PRIORITY   1
+#define WATCHDOG_PERIOD     (1 * TX_TIMER_TICKS_PER_SECOND)
+
+// LSI (~32 kHz) / 64 gives 2 ms per count, 4000 counts is about 8 s. Also bounds tickless sleeps, the IWDG keeps
+// running in STOP mode and the supervisor wakes once per period to refresh it.
+#define WATCHDOG_IWDG_PRESCALER 4
+#define WATCHDOG_IWDG_RELOAD    4000
+
+#define WATCHDOG_IWDG_KEY_REFRESH 0xAAAA
+#define WATCHDOG_IWDG_KEY_ACCESS  0x5555
+#define WATCHDOG_IWDG_KEY_START   0xCCCC
+
+// Bound on the polling loop waiting for the prescaler and reload to be taken
+#define WATCHDOG_INIT_TIMEOUT 1000000
+
+#define WATCHDOG_RECORD_MAGIC 0x57444F47
+
+typedef struct
+{
+    uint32_t magic;
+    watchdog_report_t report;
+    uint32_t crc32;
+} watchdog_record_t;
+
+static const CHAR* const watchdog_reset_names[WATCHDOG_RESET_COUNT] = {
+    [WATCHDOG_RESET_POWER_ON]  = "power on",
+    [WATCHDOG_RESET_PIN]       = "reset pin",
+    [WATCHDOG_RESET_BROWN_OUT] = "brown out",
+    [WATCHDOG_RESET_SOFTWARE]  = "software",
+    [WATCHDOG_RESET_IWDG]      = "iwdg",
+    [WATCHDOG_RESET_WWDG]      = "wwdg",
+    [WATCHDOG_RESET_LOW_POWER] = "low power",
+};
+
+static watchdog_record_t watchdog_record __attribute__((section(".noinit")));
+
+// Copy taken at boot, the record is rewritten once a thread misses
+static watchdog_report_t watchdog_boot_report;
+
+static watchdog_deadlines_t watchdog_deadlines;
+
+static TX_THREAD watchdog_thread;
+static ULONG watchdog_thread_stack[WATCHDOG_STACK_SIZE / sizeof(ULONG)];
+
+static uint32_t watchdog_record_crc32(void)
+{
+    return crc32_compute(&watchdog_record, offsetof(watchdog_record_t, crc32));
+}
+
+static VOID watchdog_record_write(void)
+{
+    watchdog_record.magic = WATCHDOG_RECORD_MAGIC;
+    watchdog_record.crc32 = watchdog_record_crc32();
+}
+
+// The pin flag is set by every reset as the pin is driven low internally, so it is checked last
+static watchdog_reset_t watchdog_reset_read(void)
+{
+    uint32_t flags = RCC->CSR;
+    watchdog_reset_t cause;
+
+    if (flags & RCC_CSR_IWDGRSTF)
+    {
+        cause = WATCHDOG_RESET_IWDG;
+    }
+    else if (flags & RCC_CSR_WWDGRSTF)
+    {
+        cause = WATCHDOG_RESET_WWDG;
+    }
+    else if (flags & RCC_CSR_LPWRRSTF)
+    {
+        cause = WATCHDOG_RESET_LOW_POWER;
+    }
+    else if (flags & RCC_CSR_SFTRSTF)
+    {
+        cause = WATCHDOG_RESET_SOFTWARE;
+    }
+    else if (flags & RCC_CSR_PORRSTF)
+    {
+        cause = WATCHDOG_RESET_POWER_ON;
+    }
+    else if (flags & RCC_CSR_BORRSTF)
+    {
+        cause = WATCHDOG_RESET_BROWN_OUT;
+    }
+    else
+    {
+        cause = WATCHDOG_RESET_PIN;
+    }
+
+    // Clear the flags so the next reset is reported on its own
+    RCC->CSR |= RCC_CSR_RMVF;
+
+    return cause;
+}
+
+static bool watchdog_iwdg_start(void)
+{
+    // Stop the counter while the core is halted by a debugger
+    DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+
+    IWDG->KR  = WATCHDOG_IWDG_KEY_START;
+    IWDG->KR  = WATCHDOG_IWDG_KEY_ACCESS;
+    IWDG->PR  = WATCHDOG_IWDG_PRESCALER;
+    IWDG->RLR = WATCHDOG_IWDG_RELOAD;
+
+    for (UINT i = 0; i < WATCHDOG_INIT_TIMEOUT; i++)
+    {
+        if ((IWDG->SR & (IWDG_SR_PVU | IWDG_SR_RVU)) == 0)
+        {
+            IWDG->KR = WATCHDOG_IWDG_KEY_REFRESH;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t watchdog_run_count(const void* owner)
+{
+    return ((const TX_THREAD*)owner)->tx_thread_run_count;
+}
+
+// Returns the thread furthest past its deadline, or NULL if all are in time
+static TX_THREAD* watchdog_overdue(ULONG now, ULONG* overdue)
+{
+    TX_INTERRUPT_SAVE_AREA
+    const watchdog_deadline_t* late;
+    uint32_t ticks;
+
+    TX_DISABLE
+    late = watchdog_deadline_overdue(&watchdog_deadlines, now, watchdog_run_count, &ticks);
+    TX_RESTORE
+
+    *overdue = ticks;
+    return late ? (TX_THREAD*)late->owner : NULL;
+}
+
+static VOID watchdog_thread_entry(ULONG parameter)
+{
+    TX_THREAD* late;
+    TX_THREAD* reported = NULL;
+    ULONG overdue;
+    ULONG now;
+
+    while (true)
+    {
+        now = tx_time_get();
+        if ((late = watchdog_overdue(now, &overdue)) == NULL)
+        {
+            // Back in time before the IWDG expired, nothing is left to blame a later reset on
+            if (reported != NULL)
+            {
+                printf("Watchdog: %s is back within its deadline\r\n", reported->tx_thread_name);
+                memset(watchdog_record.report.missed, 0, sizeof(watchdog_record.report.missed));
+                watchdog_record.report.overdue_ms = 0;
+                watchdog_record_write();
+                reported = NULL;
+            }
+
+            IWDG->KR = WATCHDOG_IWDG_KEY_REFRESH;
+        }
+
+        // Hold off the refresh and keep the record on the latest thread that is late
+        else
+        {
+            watchdog_record.report.cause      = WATCHDOG_RESET_IWDG;
+            watchdog_record.report.overdue_ms = overdue * 1000 / TX_TIMER_TICKS_PER_SECOND;
+            watchdog_record.report.uptime_s   = now / TX_TIMER_TICKS_PER_SECOND;
+            snprintf(watchdog_record.report.missed, WATCHDOG_NAME_SIZE, "%s", late->tx_thread_name);
+            watchdog_record_write();
+
+            if (late != reported)
+            {
+                printf("ERROR: %s missed its watchdog deadline by %lu ms, refresh stopped\r\n",
+                    late->tx_thread_name,
+                    (unsigned long)watchdog_record.report.overdue_ms);
+                reported = late;
+            }
+        }
+
+        tx_thread_sleep(WATCHDOG_PERIOD);
+    }
+}
+
+UINT watchdog_init(void)
+{
+    UINT status;
+    watchdog_reset_t cause = watchdog_reset_read();
+    bool valid = watchdog_record.magic == WATCHDOG_RECORD_MAGIC && watchdog_record.crc32 == watchdog_record_crc32();
+
+    // RAM content is random after power loss, keep the watchdog count only across resets that preserve it
+    if (!valid || cause == WATCHDOG_RESET_POWER_ON || cause == WATCHDOG_RESET_BROWN_OUT)
+    {
+        memset(&watchdog_record.report, 0, sizeof(watchdog_record.report));
+    }
+
+    // A missed thread is only meaningful if the IWDG actually fired
+    if (cause == WATCHDOG_RESET_IWDG)
+    {
+        watchdog_record.report.watchdog_resets++;
+    }
+    else
+    {
+        memset(watchdog_record.report.missed, 0, sizeof(watchdog_record.report.missed));
+        watchdog_record.report.overdue_ms = 0;
+        watchdog_record.report.uptime_s   = 0;
+    }
+    watchdog_record.report.cause = cause;
+
+    memcpy(&watchdog_boot_report, &watchdog_record.report, sizeof(watchdog_boot_report));
+
+    // Start clean for this boot, only the count is carried forward
+    memset(watchdog_record.report.missed, 0, sizeof(watchdog_record.report.missed));
+    watchdog_record_write();
+
+    printf("Reset cause: %s", watchdog_reset_name(cause));
+    if (cause == WATCHDOG_RESET_IWDG)
+    {
+        printf(", %s after %lu s (%lu ms late), %lu watchdog resets",
+            watchdog_boot_report.missed[0] ? watchdog_boot_report.missed : "supervisor starved",
+            (unsigned long)watchdog_boot_report.uptime_s,
+            (unsigned long)watchdog_boot_report.overdue_ms,
+            (unsigned long)watchdog_boot_report.watchdog_resets);
+    }
+    printf("\r\n");
+
+    if ((status = tx_thread_create(&watchdog_thread,
+             "Watchdog",
+             watchdog_thread_entry,
+             0,
+             watchdog_thread_stack,
+             WATCHDOG_STACK_SIZE,
+             WATCHDOG_PRIORITY,
+             WATCHDOG_PRIORITY,
+             TX_NO_TIME_SLICE,
+             TX_AUTO_START)))
+    {
+        printf("ERROR: Watchdog thread creation failed (0x%08x)\r\n", status);
+    }
+
+    else if (!watchdog_iwdg_start())
+    {
+        printf("ERROR: IWDG did not take its configuration\r\n");
+        status = TX_NOT_AVAILABLE;
+    }
+
+    return status;
+}
+
+UINT watchdog_register(TX_THREAD* thread, ULONG deadline, watchdog_mode_t mode)
+{
+    TX_INTERRUPT_SAVE_AREA
+    int result;
+
+    TX_DISABLE
+    result = watchdog_deadline_register(
+        &watchdog_deadlines, thread, deadline, mode, tx_time_get(), thread->tx_thread_run_count);
+    TX_RESTORE
+
+    return result ? TX_NO_INSTANCE : TX_SUCCESS;
+}
+
+VOID watchdog_checkin(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    watchdog_deadline_checkin(&watchdog_deadlines, tx_thread_identify(), tx_time_get());
+    TX_RESTORE
+}
+
+VOID watchdog_deadline_set(ULONG deadline)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    watchdog_deadline_update(&watchdog_deadlines, tx_thread_identify(), deadline, tx_time_get());
+    TX_RESTORE
+}
+
+VOID watchdog_hold(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    watchdog_deadline_hold(&watchdog_deadlines);
+    TX_RESTORE
+}
+
+VOID watchdog_release(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    watchdog_deadline_release(&watchdog_deadlines, tx_time_get());
+    TX_RESTORE
+}
+
+VOID watchdog_last_reset(watchdog_report_t* report)
+{
+    memcpy(report, &watchdog_boot_report, sizeof(watchdog_boot_report));
+}
+
+const CHAR* watchdog_reset_name(watchdog_reset_t cause)
+{
+    return cause < WATCHDOG_RESET_COUNT ? watchdog_reset_names[cause] : "unknown";
+}
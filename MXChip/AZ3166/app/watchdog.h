@@ -0,0 +1,86 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "watchdog_deadline.h"
+
+#define WATCHDOG_NAME_SIZE 20
+
+// What reset the device last, from the RCC reset flags
+typedef enum
+{
+    WATCHDOG_RESET_POWER_ON = 0,
+    WATCHDOG_RESET_PIN,
+    WATCHDOG_RESET_BROWN_OUT,
+    WATCHDOG_RESET_SOFTWARE,
+    WATCHDOG_RESET_IWDG,
+    WATCHDOG_RESET_WWDG,
+    WATCHDOG_RESET_LOW_POWER,
+    WATCHDOG_RESET_COUNT
+} watchdog_reset_t;
+
+// Survives the watchdog reset, valid when the magic and CRC match
+typedef struct
+{
+    watchdog_reset_t cause;
+    ULONG watchdog_resets;           // Watchdog resets since power on
+    CHAR missed[WATCHDOG_NAME_SIZE]; // Thread that missed its deadline, empty if the supervisor never ran
+    ULONG overdue_ms;                // How late the thread was when the supervisor stopped refreshing
+    ULONG uptime_s;                  // Uptime at that point
+} watchdog_report_t;
+
+/**
+ * @brief Read the reset cause, start the IWDG and the supervisor thread, must be called before the kernel starts
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT watchdog_init(void);
+
+/**
+ * @brief Add a thread to the supervision
+ * @param thread Thread to supervise
+ * @param deadline Ticks allowed between check-ins, or between two runs for WATCHDOG_SCHEDULED
+ * @param mode How the thread proves it is alive
+ * @return TX_SUCCESS on success, TX_NO_INSTANCE if the table is full
+ * @note Registering a supervised thread again updates its deadline and mode
+ */
+UINT watchdog_register(TX_THREAD* thread, ULONG deadline, watchdog_mode_t mode);
+
+/**
+ * @brief Check in the calling thread, no effect if it is not supervised
+ */
+VOID watchdog_checkin(void);
+
+/**
+ * @brief Check in the calling thread and change its deadline, for loops whose period changes at runtime
+ * @param deadline Ticks allowed until the next check-in
+ */
+VOID watchdog_deadline_set(ULONG deadline);
+
+/**
+ * @brief Stop enforcing deadlines while the serial setup prompt polls the UART, calls nest
+ */
+VOID watchdog_hold(void);
+
+/**
+ * @brief Release one watchdog_hold, every supervised thread gets a fresh deadline
+ */
+VOID watchdog_release(void);
+
+/**
+ * @brief Get the reset cause and, after a watchdog reset, the thread that caused it
+ * @param report Receives the report
+ */
+VOID watchdog_last_reset(watchdog_report_t* report);
+
+/**
+ * @brief Get a short name for a reset cause
+ */
+const CHAR* watchdog_reset_name(watchdog_reset_t cause);
+
+#endif // _WATCHDOG_H
@@ -0,0 +1,115 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "watchdog_deadline.h"
+
+#include <stddef.h>
+
+static watchdog_deadline_t* watchdog_deadline_find(watchdog_deadlines_t* table, const void* owner)
+{
+    for (unsigned int i = 0; i < table->count; i++)
+    {
+        if (table->clients[i].owner == owner)
+        {
+            return &table->clients[i];
+        }
+    }
+
+    return NULL;
+}
+
+int watchdog_deadline_register(watchdog_deadlines_t* table,
+    const void* owner,
+    uint32_t deadline,
+    watchdog_mode_t mode,
+    uint32_t now,
+    uint32_t run_count)
+{
+    watchdog_deadline_t* client;
+
+    if ((client = watchdog_deadline_find(table, owner)) == NULL)
+    {
+        if (table->count == WATCHDOG_MAX_THREADS)
+        {
+            return -1;
+        }
+
+        client        = &table->clients[table->count++];
+        client->owner = owner;
+    }
+
+    client->mode      = mode;
+    client->deadline  = deadline;
+    client->last_seen = now;
+    client->run_count = run_count;
+
+    return 0;
+}
+
+void watchdog_deadline_checkin(watchdog_deadlines_t* table, const void* owner, uint32_t now)
+{
+    watchdog_deadline_t* client = watchdog_deadline_find(table, owner);
+
+    if (client != NULL)
+    {
+        client->last_seen = now;
+    }
+}
+
+void watchdog_deadline_update(watchdog_deadlines_t* table, const void* owner, uint32_t deadline, uint32_t now)
+{
+    watchdog_deadline_t* client = watchdog_deadline_find(table, owner);
+
+    if (client != NULL)
+    {
+        client->deadline  = deadline;
+        client->last_seen = now;
+    }
+}
+
+void watchdog_deadline_hold(watchdog_deadlines_t* table)
+{
+    table->hold++;
+}
+
+void watchdog_deadline_release(watchdog_deadlines_t* table, uint32_t now)
+{
+    if (table->hold && --table->hold == 0)
+    {
+        for (unsigned int i = 0; i < table->count; i++)
+        {
+            table->clients[i].last_seen = now;
+        }
+    }
+}
+
+const watchdog_deadline_t* watchdog_deadline_overdue(
+    watchdog_deadlines_t* table, uint32_t now, uint32_t (*run_count)(const void* owner), uint32_t* overdue)
+{
+    watchdog_deadline_t* late = NULL;
+
+    *overdue = 0;
+
+    for (unsigned int i = 0; i < table->count; i++)
+    {
+        watchdog_deadline_t* client = &table->clients[i];
+        uint32_t runs               = client->mode == WATCHDOG_SCHEDULED ? run_count(client->owner) : 0;
+        uint32_t elapsed;
+
+        // While held every deadline restarts, a scheduled owner is alive whenever it has run since the last look
+        if (table->hold || (client->mode == WATCHDOG_SCHEDULED && runs != client->run_count))
+        {
+            client->run_count = runs;
+            client->last_seen = now;
+        }
+
+        elapsed = now - client->last_seen;
+        if (elapsed > client->deadline && elapsed - client->deadline > *overdue)
+        {
+            *overdue = elapsed - client->deadline;
+            late     = client;
+        }
+    }
+
+    return late;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _WATCHDOG_DEADLINE_H
+#define _WATCHDOG_DEADLINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-thread deadline bookkeeping behind the watchdog supervisor. It has no ThreadX or IWDG dependency, times are
+// ticks compared with wrap-around, and callers serialize access to a table themselves.
+
+#define WATCHDOG_MAX_THREADS 8
+
+// How a thread proves it is alive
+typedef enum
+{
+    WATCHDOG_CHECKIN,  // The thread calls watchdog_checkin within its deadline
+    WATCHDOG_SCHEDULED // The thread has been scheduled within its deadline, for threads we cannot modify
+} watchdog_mode_t;
+
+typedef struct
+{
+    const void* owner; // Supervised thread, only compared
+    watchdog_mode_t mode;
+    uint32_t deadline;
+    uint32_t last_seen;
+    uint32_t run_count;
+} watchdog_deadline_t;
+
+typedef struct
+{
+    watchdog_deadline_t clients[WATCHDOG_MAX_THREADS];
+    unsigned int count;
+    unsigned int hold;
+} watchdog_deadlines_t;
+
+/**
+ * @brief Add an owner to the table, or update its deadline and mode if it is already there
+ * @param run_count Current run count of the owner, used by WATCHDOG_SCHEDULED
+ * @return 0 on success, -1 if the table is full
+ */
+int watchdog_deadline_register(watchdog_deadlines_t* table,
+    const void* owner,
+    uint32_t deadline,
+    watchdog_mode_t mode,
+    uint32_t now,
+    uint32_t run_count);
+
+/**
+ * @brief Restart the deadline of an owner, no effect if it is not in the table
+ */
+void watchdog_deadline_checkin(watchdog_deadlines_t* table, const void* owner, uint32_t now);
+
+/**
+ * @brief Change the deadline of an owner and restart it, no effect if it is not in the table
+ */
+void watchdog_deadline_update(watchdog_deadlines_t* table, const void* owner, uint32_t deadline, uint32_t now);
+
+/**
+ * @brief Stop enforcing deadlines, calls nest
+ */
+void watchdog_deadline_hold(watchdog_deadlines_t* table);
+
+/**
+ * @brief Release one hold, every owner gets a fresh deadline once the last one is released
+ */
+void watchdog_deadline_release(watchdog_deadlines_t* table, uint32_t now);
+
+/**
+ * @brief Decide whether the watchdog may be refreshed
+ * @param run_count Returns the current run count of an owner, used by WATCHDOG_SCHEDULED
+ * @param overdue Receives how many ticks the latest owner is past its deadline, 0 if all are in time
+ * @return The owner furthest past its deadline, NULL if every owner is in time and the refresh may go ahead
+ */
+const watchdog_deadline_t* watchdog_deadline_overdue(
+    watchdog_deadlines_t* table, uint32_t now, uint32_t (*run_count)(const void* owner), uint32_t* overdue);
+
+#endif // _WATCHDOG_DEADLINE_H
@@ -10,9 +10,13 @@
 
 #include "wiced_sdk.h"
 
+#include "boot_pipeline.h"
+#include "low_power.h"
 #include "sntp_client.h"
 #include "config_manager.h"
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #define NETX_IP_STACK_SIZE   2048
 #define NETX_TX_PACKET_COUNT 16
@@ -35,8 +39,8 @@ static UCHAR netx_tx_pool_stack[NETX_TX_POOL_SIZE];
 static UCHAR netx_rx_pool_stack[NETX_RX_POOL_SIZE];
 static UCHAR netx_arp_cache_area[NETX_ARP_CACHE_SIZE];
 
-static CHAR* netx_ssid;
-static CHAR* netx_password;
+static CHAR netx_ssid[CONFIG_SSID_MAX_LEN];
+static CHAR netx_password[CONFIG_PASSWORD_MAX_LEN];
 static wiced_security_t netx_mode;
 
 static NX_DHCP nx_dhcp_client;
@@ -62,12 +66,6 @@ static UINT wifi_init()
 
     printf("\r\nInitializing WiFi\r\n");
 
-    if (netx_ssid[0] == 0)
-    {
-        printf("ERROR: wifi_ssid is empty\r\n");
-        return NX_NOT_SUCCESSFUL;
-    }
-
     // Set pools for wifi
     if (wwd_buffer_init(nx_pool) != WWD_SUCCESS)
     {
@@ -82,6 +80,10 @@ static UINT wifi_init()
         return NX_NOT_SUCCESSFUL;
     }
 
+    // The SDIO bus and the WLAN interrupt need the system clocks, keep out of STOP while the radio is on. The radio
+    // stays on and is not put in power save, so this is never released and idle time after boot is spent in SLEEP.
+    low_power_stop_inhibit();
+
     wwd_wifi_get_mac_address(&mac, WWD_STA_INTERFACE);
     printf("\tMAC address: %02X:%02X:%02X:%02X:%02X:%02X\r\n",
         mac.octet[0],
@@ -196,29 +198,28 @@ static UINT dns_connect()
     return NX_SUCCESS;
 }
 
-UINT wwd_network_init(CHAR* ssid, CHAR* password, WiFi_Mode mode)
+static wiced_security_t wifi_security_get(WiFi_Mode mode)
 {
-    UINT status;
-
-    // Stash WiFi credentials
-    netx_ssid     = ssid;
-    netx_password = password;
-
     switch (mode)
     {
         case None:
-            netx_mode = WICED_SECURITY_OPEN;
-            break;
+            return WICED_SECURITY_OPEN;
         case WEP:
-            netx_mode = WICED_SECURITY_WEP_SHARED;
-            break;
+            return WICED_SECURITY_WEP_SHARED;
         case WPA_PSK_TKIP:
-            netx_mode = WICED_SECURITY_WPA_TKIP_PSK;
-            break;
+            return WICED_SECURITY_WPA_TKIP_PSK;
         case WPA2_PSK_AES:
-            netx_mode = WICED_SECURITY_WPA2_AES_PSK;
-            break;
+        default:
+            return WICED_SECURITY_WPA2_AES_PSK;
     }
+}
+
+// Power up the radio and create the IP stack. Needs no credentials, so it runs while the configuration is loaded.
+UINT wwd_network_init(void)
+{
+    UINT status;
+
+    boot_stage_begin(BOOT_STAGE_WIFI_INIT);
 
     // Initialize the NetX system.
     nx_system_initialize();
@@ -357,19 +358,39 @@ UINT wwd_network_init(CHAR* ssid, CHAR* password, WiFi_Mode mode)
         nx_secure_tls_initialize();
     }
 
+    boot_stage_end(BOOT_STAGE_WIFI_INIT, status);
+
     return status;
 }
 
-UINT wwd_network_connect()
+UINT wwd_network_connect(CHAR* ssid, CHAR* password, WiFi_Mode mode)
 {
     UINT status;
     int32_t wifiConnectCounter = 1;
     wiced_ssid_t wiced_ssid    = {0};
     wwd_result_t join_result;
+    wiced_security_t security = wifi_security_get(mode);
+    bool credentials_changed;
 
-    // Check if Wifi is already connected
-    if (wwd_wifi_is_ready_to_transceive(WWD_STA_INTERFACE) != WWD_SUCCESS)
+    if (ssid[0] == 0)
     {
+        printf("ERROR: wifi_ssid is empty\r\n");
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    credentials_changed = strncmp(netx_ssid, ssid, sizeof(netx_ssid)) != 0 ||
+                          strncmp(netx_password, password, sizeof(netx_password)) != 0 || netx_mode != security;
+
+    // Stash WiFi credentials
+    strncpy(netx_ssid, ssid, sizeof(netx_ssid) - 1);
+    strncpy(netx_password, password, sizeof(netx_password) - 1);
+    netx_mode = security;
+
+    // Check if Wifi is already connected to this network
+    if (credentials_changed || wwd_wifi_is_ready_to_transceive(WWD_STA_INTERFACE) != WWD_SUCCESS)
+    {
+        boot_stage_begin(BOOT_STAGE_WIFI_JOIN);
+
         printf("\r\nConnecting WiFi\r\n");
 
         // Halt any existing connection attempts
@@ -383,7 +404,7 @@ UINT wwd_network_connect()
         // Connect to the specified SSID
         printf("\tConnecting to SSID '%s' with mode %d\r\n", netx_ssid, netx_mode);
         printf("\tPlease wait while WiFi attempts to connect...\r\n");
-        do
+        while (true)
         {
             printf("\tAttempt %u...\r\n", (unsigned int)wifiConnectCounter++);
 
@@ -393,10 +414,17 @@ UINT wwd_network_connect()
                 &wiced_ssid, netx_mode, (uint8_t*)netx_password, strlen(netx_password), NULL, WWD_STA_INTERFACE);
             tx_mutex_put(&(nx_ip.nx_ip_protection));
 
+            if (join_result == WWD_SUCCESS)
+            {
+                break;
+            }
+
+            // Only back off between failed attempts
             tx_thread_sleep(5 * TX_TIMER_TICKS_PER_SECOND);
-        } while (join_result != WWD_SUCCESS);
+        }
 
         printf("SUCCESS: WiFi connected\r\n");
+        boot_stage_end(BOOT_STAGE_WIFI_JOIN, NX_SUCCESS);
         
         // Perform delayed flash write now that WiFi is stable
         config_result_t result = config_manager_delayed_flash_write();
@@ -405,28 +433,30 @@ UINT wwd_network_connect()
         } else {
             printf("Warning: Could not save config to persistent storage\r\n");
         }
-        
-        // Wait a moment for WiFi to stabilize before starting DHCP
-        tx_thread_sleep(2 * TX_TIMER_TICKS_PER_SECOND);
+    }
+    else
+    {
+        boot_stage_end(BOOT_STAGE_WIFI_JOIN, NX_SUCCESS);
     }
 
-    // Fetch IP details
-    if ((status = dhcp_connect()))
+    // Fetch IP details, nx_ip_status_check already waits for the link so no settle delay is needed
+    boot_stage_begin(BOOT_STAGE_DHCP);
+    status = dhcp_connect();
+    boot_stage_end(BOOT_STAGE_DHCP, status);
+    if (status)
     {
         printf("ERROR: dhcp_connect\r\n");
+        return status;
     }
 
     // Create DNS
-    else if ((status = dns_connect()))
+    boot_stage_begin(BOOT_STAGE_DNS);
+    status = dns_connect();
+    boot_stage_end(BOOT_STAGE_DNS, status);
+    if (status)
     {
         printf("ERROR: dns_connect\r\n");
     }
 
-    // Wait for an SNTP sync
-    else if ((status = sntp_sync()))
-    {
-        printf("ERROR: Failed to sync SNTP time (0x%08x)\r\n", status);
-    }
-
     return status;
 }
@@ -56,6 +56,7 @@
 #include "stm32f4xx_hal.h"
 #include "hts221_reg.h"
 #include "sensor.h"
+#include "profiler.h"
 
 extern I2C_HandleTypeDef I2cHandle;
 extern UART_HandleTypeDef UartHandle;
@@ -156,6 +157,7 @@ Sensor_StatusTypeDef hts221_config(void)
 hts221_data_t hts221_data_read(void)
 {
   hts221_data_t reading = {0};
+  PROF_BEGIN(PROF_SENSOR_HTS221);
 
   /* Read samples in polling mode */
 
@@ -182,6 +184,7 @@ hts221_data_t hts221_data_read(void)
     hts221_temperature_raw_get(&dev_ctx, data_raw_temperature.u8bit);
     reading.temperature_degC = linear_interpolation(&lin_temp, data_raw_temperature.i16bit);
     
+  PROF_END(PROF_SENSOR_HTS221);
   return reading;
 }
 
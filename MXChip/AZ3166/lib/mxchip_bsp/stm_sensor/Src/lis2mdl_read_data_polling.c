@@ -54,6 +54,7 @@
 #include "stm32f4xx_hal.h"
 #include "lis2mdl_reg.h"
 #include "sensor.h"
+#include "profiler.h"
 
 
 extern I2C_HandleTypeDef I2cHandle;
@@ -144,6 +145,7 @@ Sensor_StatusTypeDef lis2mdl_config(void)
 lis2mdl_data_t lis2mdl_data_read(void)
  {
    lis2mdl_data_t reading = {0};
+    PROF_BEGIN(PROF_SENSOR_LIS2MDL);
     uint8_t reg = 0;
     uint32_t timeout = 5000; // Reset timeout for each read, increase timeout value
 
@@ -165,6 +167,7 @@ lis2mdl_data_t lis2mdl_data_read(void)
       lis2mdl_temperature_raw_get(&dev_ctx, data_raw_temperature.u8bit);
       reading.temperature_degC = lis2mdl_from_lsb_to_celsius(data_raw_temperature.i16bit);
     
+    PROF_END(PROF_SENSOR_LIS2MDL);
     return reading;
   
 }
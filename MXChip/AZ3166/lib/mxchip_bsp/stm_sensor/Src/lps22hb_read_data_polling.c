@@ -56,6 +56,7 @@
 #include "lps22hb_reg.h"
 
 #include "sensor.h"
+#include "profiler.h"
 
 extern I2C_HandleTypeDef I2cHandle;
 extern UART_HandleTypeDef UartHandle;
@@ -139,6 +140,7 @@ Sensor_StatusTypeDef lps22hb_config(void)
 lps22hb_t lps22hb_data_read(void)
 {
   lps22hb_t reading = {0};
+    PROF_BEGIN(PROF_SENSOR_LPS22HB);
     uint8_t reg = 0;
     uint32_t timeout = 1000; // Reasonable timeout
     
@@ -158,6 +160,7 @@ lps22hb_t lps22hb_data_read(void)
         // Return some test data to see if the issue is sensor communication or formatting
         reading.temperature_degC = 25.5f;
         reading.pressure_hPa = 1013.25f;
+        PROF_END(PROF_SENSOR_LPS22HB);
         return reading;
     }
     
@@ -169,6 +172,7 @@ lps22hb_t lps22hb_data_read(void)
     lps22hb_temperature_raw_get(&dev_ctx, data_raw_temperature.u8bit);
     reading.temperature_degC = lps22hb_from_lsb_to_degc(data_raw_temperature.i16bit);
 
+    PROF_END(PROF_SENSOR_LPS22HB);
     return reading;
 }
 
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "sensor.h"
+#include "profiler.h"
 
 #include "stm32f4xx_hal.h"
 extern I2C_HandleTypeDef I2cHandle;
@@ -157,6 +158,7 @@ Sensor_StatusTypeDef lsm6dsl_config(void)
 lsm6dsl_data_t lsm6dsl_data_read(void)
 {
 lsm6dsl_data_t reading= {0};
+    PROF_BEGIN(PROF_SENSOR_LSM6DSL);
     /*
      * Read output only if new value is available
      */
@@ -188,6 +190,7 @@ lsm6dsl_data_t reading= {0};
       lsm6dsl_temperature_raw_get(&dev_ctx, data_raw_temperature.u8bit);
       reading.temperature_degC = lsm6dsl_from_lsb_to_celsius( data_raw_temperature.i16bit );
 
+   PROF_END(PROF_SENSOR_LSM6DSL);
    return reading;
 
 }
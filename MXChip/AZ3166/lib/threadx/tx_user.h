@@ -53,6 +53,30 @@
 
 #define TX_ENABLE_FPU_SUPPORT
 
+/* Per-thread execution time, measured with the DWT cycle counter by the scheduler hooks in sys_monitor.c.  */
+#define TX_EXECUTION_PROFILE_ENABLE
+#define TX_THREAD_USER_EXTENSION                    \
+    unsigned long long tx_thread_execution_cycles;  \
+    unsigned long tx_thread_execution_start;
+
+/* Tickless idle through the ThreadX low power utility, the hooks are implemented in low_power.c on top of
+   the RTC wakeup timer.  */
+#define TX_LOW_POWER
+#define TX_LOW_POWER_TICKLESS
+#define TX_ENABLE_WFI
+
+#ifndef __ASSEMBLER__
+void low_power_timer_setup(unsigned long ticks);
+void low_power_enter(void);
+void low_power_exit(void);
+unsigned long low_power_timer_adjust(void);
+#endif
+
+#define TX_LOW_POWER_TIMER_SETUP(ticks)     low_power_timer_setup(ticks)
+#define TX_LOW_POWER_USER_ENTER             low_power_enter()
+#define TX_LOW_POWER_USER_EXIT              low_power_exit()
+#define TX_LOW_POWER_USER_TIMER_ADJUST      low_power_timer_adjust()
+
 /* Define various build options for the ThreadX port.  The application should either make changes
    here by commenting or un-commenting the conditional compilation defined OR supply the defines 
    though the compiler's equivalent of the -D option.  
@@ -130,9 +154,7 @@
    define is negated, thereby forcing the stack fill which is necessary for the stack checking
    logic.  */
 
-/*
 #define TX_ENABLE_STACK_CHECKING
-*/
 
 /* Determine if preemption-threshold should be disabled. By default, preemption-threshold is 
    enabled. If the application does not use preemption-threshold, it may be disabled to reduce
@@ -23,6 +23,7 @@ UART_HandleTypeDef UartHandle;
 
 // Expose functions from STMCubeMX generation
 extern SPI_HandleTypeDef hspi;
+extern DMA_HandleTypeDef hdma_spi_tx;
 extern RNG_HandleTypeDef hrng;
 
 void SystemClock_Config(void);
@@ -121,3 +122,9 @@ void SPI3_IRQHandler(void)
 {
     HAL_SPI_IRQHandler(&hspi);
 }
+
+// WiFi SPI DMA interrupt handle, sends only
+void DMA2_Channel2_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_spi_tx);
+}
@@ -55,6 +55,14 @@
 #define NET_DEFAULT_NOBLOCKING_WRITE_TIMEOUT  1
 #define NET_DEFAULT_NOBLOCKING_READ_TIMEOUT   1
 
+/* ES_WIFIObject_t CacheValid bits. S2, R1 and R2 apply to the socket selected with P0,
+ * so they are only tracked for the active socket. */
+#define ES_WIFI_CACHE_SOCKET          0x01
+#define ES_WIFI_CACHE_SEND_TIMEOUT    0x02
+#define ES_WIFI_CACHE_RECV_LENGTH     0x04
+#define ES_WIFI_CACHE_RECV_TIMEOUT    0x08
+#define ES_WIFI_CACHE_SOCKET_SETTINGS (ES_WIFI_CACHE_SEND_TIMEOUT | ES_WIFI_CACHE_RECV_LENGTH | ES_WIFI_CACHE_RECV_TIMEOUT)
+
 #ifdef DEBUG_ENABLED
 #define DEBUG  printf("%s:%d :",__FILE__,__LINE__);printf
 #else
@@ -744,81 +752,145 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, ui
       }
       else if(strstr((char *)pdata, AT_ERROR_STRING))
       {
+        Obj->CacheValid = 0;
         UNLOCK_WIFI();
         return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
       }
     }
     if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER )
     {
+      Obj->CacheValid = 0;
       UNLOCK_WIFI();
       return ES_WIFI_STATUS_MODULE_CRASH;
     }
   }
+  /* the module state is unknown after a failed exchange */
+  Obj->CacheValid = 0;
   UNLOCK_WIFI();
   return ES_WIFI_STATUS_IO_ERROR;
 }
 
 /**
-  * @brief  Execute AT command with data.
+  * @brief  Execute AT command with data gathered from several buffers.
   * @param  Obj: pointer to module handle
   * @param  cmd: pointer to command string
-  * @param  pcmd_data: pointer to binary data
-  * @param  len: binary data length
+  * @param  segments: buffers holding the binary data
+  * @param  count: number of segments
+  * @param  len: binary data length, the segments past it are not sent
   * @param  pdata: pointer to returned data
   * @retval Operation Status.
   */
-
-static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pcmd_data, uint16_t len, uint8_t *pdata)
+static ES_WIFI_Status_t AT_RequestSendSegments(ES_WIFIObject_t *Obj, uint8_t* cmd, ES_WIFI_Segment_t *segments, uint8_t count, uint16_t len, uint8_t *pdata)
 {
-  int16_t send_len = 0;
   int16_t recv_len = 0;
   uint16_t cmd_len = 0;
   uint16_t n ;
+  uint16_t even;
+  uint8_t *data;
+  uint8_t pair[2];
+  uint8_t carry = 0;
+  uint8_t i;
 
   LOCK_WIFI();
   cmd_len = strlen((char*)cmd);
 
   /* can send only even number of byte on first send */
-  if (cmd_len & 1) return ES_WIFI_STATUS_ERROR;
+  if (cmd_len & 1)
+  {
+    UNLOCK_WIFI();
+    return ES_WIFI_STATUS_ERROR;
+  }
   n=Obj->fops.IO_Send(cmd, cmd_len, Obj->Timeout);
-  if (n == cmd_len)
+  if (n != cmd_len)
   {
-    send_len = Obj->fops.IO_Send(pcmd_data, len, Obj->Timeout);
-    if (send_len == len)
+    UNLOCK_WIFI();
+    return ES_WIFI_STATUS_IO_ERROR;
+  }
+
+  /* SPI moves 16-bit words, a segment ending on an odd byte pairs it with the next segment */
+  for (i = 0; (i < count) && (len > 0); i++)
+  {
+    data = segments[i].Data;
+    n = MIN(segments[i].Length, len);
+    len -= n;
+
+    if (carry && n)
     {
-      recv_len = Obj->fops.IO_Receive(pdata, 0, Obj->Timeout);
-      if (recv_len > 0)
+      pair[1] = *data++;
+      n--;
+      carry = 0;
+      if (Obj->fops.IO_Send(pair, 2, Obj->Timeout) != 2)
       {
-        *(pdata+recv_len) = 0;
-        if(strstr((char *)pdata, AT_OK_STRING))
-        {
-          UNLOCK_WIFI();
-          return ES_WIFI_STATUS_OK;
-        }
-        else if(strstr((char *)pdata, AT_ERROR_STRING))
-        {
-          UNLOCK_WIFI();
-          return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
-        }
-        else
-        {
-          UNLOCK_WIFI();
-          return ES_WIFI_STATUS_ERROR;
-        }
+        UNLOCK_WIFI();
+        return ES_WIFI_STATUS_ERROR;
       }
+    }
+
+    even = n & ~1;
+    if (even && (Obj->fops.IO_Send(data, even, Obj->Timeout) != even))
+    {
       UNLOCK_WIFI();
-      if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER )
-      {
-        return ES_WIFI_STATUS_MODULE_CRASH;
-      }
       return ES_WIFI_STATUS_ERROR;
     }
+
+    if (n & 1)
+    {
+      pair[0] = data[even];
+      carry = 1;
+    }
+  }
+
+  /* the IO layer pads the last odd byte */
+  if (carry && (Obj->fops.IO_Send(pair, 1, Obj->Timeout) != 1))
+  {
+    UNLOCK_WIFI();
+    return ES_WIFI_STATUS_ERROR;
+  }
+
+  recv_len = Obj->fops.IO_Receive(pdata, 0, Obj->Timeout);
+  if (recv_len > 0)
+  {
+    *(pdata+recv_len) = 0;
+    if(strstr((char *)pdata, AT_OK_STRING))
+    {
+      UNLOCK_WIFI();
+      return ES_WIFI_STATUS_OK;
+    }
+    else if(strstr((char *)pdata, AT_ERROR_STRING))
+    {
+      UNLOCK_WIFI();
+      return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
+    }
     else
     {
+      UNLOCK_WIFI();
       return ES_WIFI_STATUS_ERROR;
     }
   }
-  return ES_WIFI_STATUS_IO_ERROR;
+  UNLOCK_WIFI();
+  if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER )
+  {
+    return ES_WIFI_STATUS_MODULE_CRASH;
+  }
+  return ES_WIFI_STATUS_ERROR;
+}
+
+/**
+  * @brief  Execute AT command with data.
+  * @param  Obj: pointer to module handle
+  * @param  cmd: pointer to command string
+  * @param  pcmd_data: pointer to binary data
+  * @param  len: binary data length
+  * @param  pdata: pointer to returned data
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pcmd_data, uint16_t len, uint8_t *pdata)
+{
+  ES_WIFI_Segment_t segment;
+
+  segment.Data = pcmd_data;
+  segment.Length = len;
+  return AT_RequestSendSegments(Obj, cmd, &segment, 1, len, pdata);
 }
 
 
@@ -903,6 +975,60 @@ static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t* cmd
 }
 
 
+/**
+  * @brief  Select the socket the following commands apply to, skipped if already selected.
+  * @param  Obj: pointer to module handle
+  * @param  Socket: number of the socket
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SelectSocket(ES_WIFIObject_t *Obj, uint8_t Socket)
+{
+  ES_WIFI_Status_t ret;
+
+  if ((Obj->CacheValid & ES_WIFI_CACHE_SOCKET) && (Obj->ActiveSocket == Socket))
+  {
+    return ES_WIFI_STATUS_OK;
+  }
+
+  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    /* the tracked settings belonged to the previous socket */
+    Obj->ActiveSocket = Socket;
+    Obj->CacheValid = ES_WIFI_CACHE_SOCKET;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Set a setting of the selected socket, skipped if it already holds the value.
+  * @param  Obj: pointer to module handle
+  * @param  cmd: command name, S2, R1 or R2
+  * @param  flag: ES_WIFI_CACHE_xxx bit tracking the setting
+  * @param  cached: last value set
+  * @param  value: value to set
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SetSocketSetting(ES_WIFIObject_t *Obj, const char *cmd, uint8_t flag, uint32_t *cached, uint32_t value)
+{
+  ES_WIFI_Status_t ret;
+
+  if ((Obj->CacheValid & flag) && (*cached == value))
+  {
+    return ES_WIFI_STATUS_OK;
+  }
+
+  sprintf((char*)Obj->CmdData,"%s=%lu\r", cmd, (unsigned long)value);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    *cached = value;
+    Obj->CacheValid |= flag;
+  }
+  return ret;
+}
+
 /**
   * @brief  Initialize WIFI module.
   * @param  Obj: pointer to module handle
@@ -915,6 +1041,7 @@ ES_WIFI_Status_t  ES_WIFI_Init(ES_WIFIObject_t *Obj)
   LOCK_WIFI();
 
   Obj->Timeout = ES_WIFI_TIMEOUT;
+  Obj->CacheValid = 0;
 
   if (Obj->fops.IO_Init(ES_WIFI_INIT) == 0)
   {
@@ -1423,6 +1550,7 @@ ES_WIFI_Status_t ES_WIFI_ResetModule(ES_WIFIObject_t *Obj)
   int ret;
   LOCK_WIFI();
 
+  Obj->CacheValid = 0;
   sprintf((char*)Obj->CmdData,"ZR\r");
   ret = Obj->fops.IO_Send(Obj->CmdData, strlen((char*)Obj->CmdData), Obj->Timeout);
 #if (ES_WIFI_USE_UART == 0)
@@ -1446,6 +1574,7 @@ ES_WIFI_Status_t ES_WIFI_HardResetModule(ES_WIFIObject_t *Obj)
 {
   int ret;
   LOCK_WIFI();
+  Obj->CacheValid = 0;
   ret = Obj->fops.IO_Init(ES_WIFI_RESET);
   UNLOCK_WIFI();
   return (ret > 0) ? ES_WIFI_STATUS_OK : ES_WIFI_STATUS_ERROR;
@@ -1640,8 +1769,9 @@ ES_WIFI_Status_t ES_WIFI_StartClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  /* a new connection starts from the module defaults */
+  Obj->CacheValid &= ~ES_WIFI_CACHE_SOCKET_SETTINGS;
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -1703,8 +1833,7 @@ ES_WIFI_Status_t ES_WIFI_StopClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -1728,8 +1857,9 @@ ES_WIFI_Status_t ES_WIFI_StartAWSClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  /* a new connection starts from the module defaults */
+  Obj->CacheValid &= ~ES_WIFI_CACHE_SOCKET_SETTINGS;
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1791,8 +1921,9 @@ ES_WIFI_Status_t ES_WIFI_StartServerSingleConn(ES_WIFIObject_t *Obj, ES_WIFI_Con
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  /* a new connection starts from the module defaults */
+  Obj->CacheValid &= ~ES_WIFI_CACHE_SOCKET_SETTINGS;
+  ret = AT_SelectSocket(Obj, conn->Number);
   if(ret != ES_WIFI_STATUS_OK)
   {
     UNLOCK_WIFI();
@@ -1944,8 +2075,7 @@ ES_WIFI_Status_t ES_WIFI_CloseServerConnection(ES_WIFIObject_t *Obj, int socket)
 {
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
-  sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, (uint8_t)socket);
   if(ret != ES_WIFI_STATUS_OK)
   {
     DEBUG(" Can not select socket %s\r\n", Obj->CmdData);
@@ -1975,8 +2105,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, int socket)
 {
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
-  sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, (uint8_t)socket);
   if(ret != ES_WIFI_STATUS_OK)
   {
     DEBUG("Selecting socket failed: %s\r\n", Obj->CmdData);
@@ -2009,12 +2138,13 @@ ES_WIFI_Status_t ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
   LOCK_WIFI();
 
+  /* a new connection starts from the module defaults */
+  Obj->CacheValid &= ~ES_WIFI_CACHE_SOCKET_SETTINGS;
   sprintf((char*)Obj->CmdData,"PK=1,3000\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, conn->Number);
     if(ret == ES_WIFI_STATUS_OK)
     {
       sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
@@ -2070,8 +2200,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, conn->Number);
   if(ret != ES_WIFI_STATUS_OK)
   {
     UNLOCK_WIFI();
@@ -2134,11 +2263,36 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
   * @retval Operation Status.
   */
 ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen , uint16_t *SentLen , uint32_t Timeout)
+{
+  ES_WIFI_Segment_t segment;
+
+  segment.Data = pdata;
+  segment.Length = Reqlen;
+  return ES_WIFI_SendDataSegments(Obj, Socket, &segment, 1, SentLen, Timeout);
+}
+
+/**
+  * @brief  Send data gathered from several buffers over WIFI in one transfer.
+  * @param  Obj: pointer to module handle
+  * @param  Socket: number of the socket
+  * @param  Segments: buffers holding the data, sent in order
+  * @param  Count: number of segments
+  * @param  SentLen : length of the data sent, at most ES_WIFI_PAYLOAD_SIZE
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_SendDataSegments(ES_WIFIObject_t *Obj, uint8_t Socket, ES_WIFI_Segment_t *Segments, uint8_t Count, uint16_t *SentLen, uint32_t Timeout)
 {
   uint32_t wkgTimeOut;
+  uint32_t Reqlen = 0;
+  uint8_t i;
 
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
 
+  for (i = 0; i < Count; i++)
+  {
+    Reqlen += Segments[i].Length;
+  }
+
   if (Timeout == 0)
   {
     wkgTimeOut = NET_DEFAULT_NOBLOCKING_WRITE_TIMEOUT;
@@ -2152,17 +2306,15 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t
   if(Reqlen >= ES_WIFI_PAYLOAD_SIZE ) Reqlen= ES_WIFI_PAYLOAD_SIZE;
 
   *SentLen = Reqlen;
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, Socket);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"S2=%lu\r",wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketSetting(Obj, "S2", ES_WIFI_CACHE_SEND_TIMEOUT, &Obj->SendTimeout, wkgTimeOut);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char *)Obj->CmdData,"S3=%04d\r",Reqlen);
-      ret = AT_RequestSendData(Obj, Obj->CmdData, pdata, Reqlen, Obj->CmdData);
+      sprintf((char *)Obj->CmdData,"S3=%04lu\r",(unsigned long)Reqlen);
+      ret = AT_RequestSendSegments(Obj, Obj->CmdData, Segments, Count, Reqlen, Obj->CmdData);
 
       if(ret == ES_WIFI_STATUS_OK)
       {
@@ -2191,6 +2343,11 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t
   {
     *SentLen = 0;
   }
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    /* a failed S3 leaves the module state unknown as well */
+    Obj->CacheValid = 0;
+  }
   UNLOCK_WIFI();
   return ret;
 }
@@ -2212,8 +2369,7 @@ ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, Socket);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -2244,8 +2400,7 @@ ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData, "S2=%lu\r", wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketSetting(Obj, "S2", ES_WIFI_CACHE_SEND_TIMEOUT, &Obj->SendTimeout, wkgTimeOut);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
@@ -2280,6 +2435,11 @@ ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
     *SentLen = 0;
   }
 
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    /* a failed S3 leaves the module state unknown as well */
+    Obj->CacheValid = 0;
+  }
   UNLOCK_WIFI();
   return ret;
 }
@@ -2312,17 +2472,14 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if(Reqlen <= ES_WIFI_PAYLOAD_SIZE )
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
-      ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+      ret = AT_SetSocketSetting(Obj, "R1", ES_WIFI_CACHE_RECV_LENGTH, &Obj->RecvLength, Reqlen);
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
-        ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+        ret = AT_SetSocketSetting(Obj, "R2", ES_WIFI_CACHE_RECV_TIMEOUT, &Obj->RecvTimeout, wkgTimeOut);
         if(ret == ES_WIFI_STATUS_OK)
         {
           sprintf((char*)Obj->CmdData,"R0\r");
@@ -2349,6 +2506,11 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
       issue15++;
     }
   }
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    /* a failed R0 leaves the module state unknown as well */
+    Obj->CacheValid = 0;
+  }
   UNLOCK_WIFI();
   return ret;
 }
@@ -2375,14 +2537,12 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE )
   {
-    sprintf((char*)Obj->CmdData, "P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketSetting(Obj, "R1", ES_WIFI_CACHE_RECV_LENGTH, &Obj->RecvLength, Reqlen);
   }
   else
   {
@@ -2391,8 +2551,7 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketSetting(Obj, "R2", ES_WIFI_CACHE_RECV_TIMEOUT, &Obj->RecvTimeout, wkgTimeOut);
   }
   else
   {
@@ -2440,6 +2599,7 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
   {
     DEBUG("Read error:\n%s\r\n", Obj->CmdData);
     *Receivedlen = 0;
+    Obj->CacheValid = 0;
   }
   UNLOCK_WIFI();
   return ret;
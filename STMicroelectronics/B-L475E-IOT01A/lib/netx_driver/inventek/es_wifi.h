@@ -249,6 +249,11 @@ typedef struct {
   uint8_t            Backlog;
 } ES_WIFI_Conn_t;
 
+typedef struct {
+  uint8_t            *Data;
+  uint16_t           Length;
+} ES_WIFI_Segment_t;
+
 typedef struct {
   IO_Init_Func       IO_Init;
   IO_DeInit_Func     IO_DeInit;
@@ -272,6 +277,12 @@ typedef struct {
   uint8_t            CmdData[ES_WIFI_DATA_SIZE];
   uint32_t           Timeout;
   uint32_t           BufferSize;  
+  /* Settings the module is known to hold, lets repeated sends and receives skip the AT round trips */
+  uint8_t            CacheValid;
+  uint8_t            ActiveSocket;
+  uint32_t           SendTimeout;
+  uint32_t           RecvLength;
+  uint32_t           RecvTimeout;
 } ES_WIFIObject_t;
 
 
@@ -317,6 +328,7 @@ ES_WIFI_Status_t  ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, int socket)
 ES_WIFI_Status_t  ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_t *conn);
 ES_WIFI_Status_t  ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj,ES_WIFI_Conn_t *conn);
 ES_WIFI_Status_t  ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen , uint16_t *SentLen, uint32_t Timeout);
+ES_WIFI_Status_t  ES_WIFI_SendDataSegments(ES_WIFIObject_t *Obj, uint8_t Socket, ES_WIFI_Segment_t *Segments, uint8_t Count, uint16_t *SentLen, uint32_t Timeout);
 ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen , uint16_t *SentLen, uint32_t Timeout, uint8_t *IPaddr, uint16_t Port);
 ES_WIFI_Status_t  ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *Receivedlen, uint32_t Timeout);
 ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *Receivedlen, uint32_t Timeout, uint8_t *IPaddr, uint16_t *pPort);
@@ -74,6 +74,13 @@ extern osMutexId es_wifi_mutex;
                                                     
 #define ES_WIFI_USE_SPI                             1  
 #define ES_WIFI_USE_UART                            (!ES_WIFI_USE_SPI)
+
+/* Send SPI data with one DMA transfer and wait for completion on a ThreadX
+   semaphore. Receives always take one interrupt per 16-bit word, CMD/DATA_READY
+   is checked before each. 0 sends with interrupts as well */
+#ifndef ES_WIFI_USE_SPI_DMA
+#define ES_WIFI_USE_SPI_DMA                         1
+#endif /* ES_WIFI_USE_SPI_DMA  */
    
 
 
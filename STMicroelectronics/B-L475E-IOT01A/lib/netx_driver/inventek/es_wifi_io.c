@@ -25,6 +25,9 @@
 #include <string.h>
 #include "es_wifi_conf.h"
 #include <core_cm4.h>
+#if (ES_WIFI_USE_SPI_DMA == 1)
+#include "tx_api.h"
+#endif
 
 /* Private define ------------------------------------------------------------*/
 #define MIN(a, b)  ((a) < (b) ? (a) : (b))
@@ -36,6 +39,13 @@ static  int volatile spi_rx_event = 0;
 static  int volatile spi_tx_event = 0;
 static  int volatile cmddata_rdy_rising_event = 0;
 
+#if (ES_WIFI_USE_SPI_DMA == 1)
+DMA_HandleTypeDef hdma_spi_tx;
+static TX_SEMAPHORE spi_dma_sem;
+static int volatile spi_dma_event = 0;
+static int volatile spi_dma_error = 0;
+#endif
+
 #ifdef WIFI_USE_CMSIS_OS
 osMutexId es_wifi_mutex;
 osMutexDef(es_wifi_mutex);
@@ -60,6 +70,10 @@ static  int wait_cmddata_rdy_high(int timeout);
 static  int wait_cmddata_rdy_rising_event(int timeout);
 static  int wait_spi_tx_event(int timeout);
 static  int wait_spi_rx_event(int timeout);
+#if (ES_WIFI_USE_SPI_DMA == 1)
+static  void arm_spi_dma_event(void);
+static  int wait_spi_dma_event(uint32_t timeout);
+#endif
 static  void SPI_WIFI_DelayUs(uint32_t);
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
@@ -135,6 +149,24 @@ void SPI_WIFI_MspInit(SPI_HandleTypeDef* _hspi)
   GPIO_Init.Speed     = GPIO_SPEED_FREQ_MEDIUM;
   GPIO_Init.Alternate = GPIO_AF6_SPI3;
   HAL_GPIO_Init( GPIOC,&GPIO_Init );
+
+#if (ES_WIFI_USE_SPI_DMA == 1)
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  /* SPI3 TX is DMA2 channel 2 on request 3. Receives stay on the interrupt path, the module gives no length up
+     front and CMD/DATA_READY has to be checked before every 16-bit word. */
+  hdma_spi_tx.Instance                 = DMA2_Channel2;
+  hdma_spi_tx.Init.Request             = DMA_REQUEST_3;
+  hdma_spi_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_spi_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_spi_tx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_spi_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_spi_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+  hdma_spi_tx.Init.Mode                = DMA_NORMAL;
+  hdma_spi_tx.Init.Priority            = DMA_PRIORITY_MEDIUM;
+  HAL_DMA_Init(&hdma_spi_tx);
+  __HAL_LINKDMA(_hspi, hdmatx, hdma_spi_tx);
+#endif
 }
 
 /**
@@ -176,6 +208,20 @@ int8_t SPI_WIFI_Init(uint16_t mode)
      HAL_NVIC_SetPriority((IRQn_Type)SPI3_IRQn, SPI_INTERFACE_PRIO, 0);
      HAL_NVIC_EnableIRQ((IRQn_Type)SPI3_IRQn);
 
+#if (ES_WIFI_USE_SPI_DMA == 1)
+     /* Enable Interrupt for DMA transfer complete */
+     HAL_NVIC_SetPriority((IRQn_Type)DMA2_Channel2_IRQn, SPI_INTERFACE_PRIO, 0);
+     HAL_NVIC_EnableIRQ((IRQn_Type)DMA2_Channel2_IRQn);
+
+     if (spi_dma_sem.tx_semaphore_id != TX_SEMAPHORE_ID)
+     {
+       if (tx_semaphore_create(&spi_dma_sem, "WiFi SPI DMA", 0) != TX_SUCCESS)
+       {
+         return -1;
+       }
+     }
+#endif
+
 #ifdef WIFI_USE_CMSIS_OS
     cmddata_rdy_rising_event=0;
     es_wifi_mutex = osMutexCreate(osMutex(es_wifi_mutex));
@@ -330,6 +376,41 @@ int wait_spi_tx_event(int timeout)
 
 
 
+#if (ES_WIFI_USE_SPI_DMA == 1)
+/**
+  * @brief  Arm the DMA completion before starting a transfer
+  * @note   A completion that raced with a timeout is dropped, it would end the next transfer before its data arrived
+  */
+static void arm_spi_dma_event(void)
+{
+  while (tx_semaphore_get(&spi_dma_sem, TX_NO_WAIT) == TX_SUCCESS)
+  {
+  }
+  spi_dma_error = 0;
+  spi_dma_event = 1;
+}
+
+/**
+  * @brief  Wait for the DMA transfer started last, abort it on timeout
+  * @param  timeout : timeout in mS
+  * @retval 0 when the transfer completed without error, -1 otherwise
+  */
+static int wait_spi_dma_event(uint32_t timeout)
+{
+  ULONG ticks = (timeout * TX_TIMER_TICKS_PER_SECOND + 999) / 1000;
+
+  if (tx_semaphore_get(&spi_dma_sem, ticks) != TX_SUCCESS)
+  {
+    spi_dma_event = 0;
+    HAL_SPI_Abort(&hspi);
+    /* The transfer may have completed between the timeout and the abort */
+    tx_semaphore_get(&spi_dma_sem, TX_NO_WAIT);
+    return -1;
+  }
+  return spi_dma_error ? -1 : 0;
+}
+#endif
+
 int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
 {
   int16_t length = 0;
@@ -403,6 +484,20 @@ int16_t SPI_WIFI_SendData( uint8_t *pdata,  uint16_t len, uint32_t timeout)
   LOCK_SPI();
   WIFI_ENABLE_NSS();
   SPI_WIFI_DelayUs(15);
+#if (ES_WIFI_USE_SPI_DMA == 1)
+  if ((len > 1) && (((uint32_t)pdata & 1) == 0))
+  {
+    arm_spi_dma_event();
+    if ((HAL_SPI_Transmit_DMA(&hspi, (uint8_t *)pdata, len/2) != HAL_OK) ||
+        (wait_spi_dma_event(timeout) < 0))
+    {
+      WIFI_DISABLE_NSS();
+      UNLOCK_SPI();
+      return ES_WIFI_ERROR_SPI_FAILED;
+    }
+  }
+  else
+#endif
   if (len > 1)
   {
     spi_tx_event=1;
@@ -497,6 +592,13 @@ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *_hspi)
   */
 void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *_hspi)
 {
+#if (ES_WIFI_USE_SPI_DMA == 1)
+  if (spi_dma_event)
+  {
+    spi_dma_event = 0;
+    tx_semaphore_put(&spi_dma_sem);
+  }
+#endif
   if (spi_tx_event)
   {
     SEM_SIGNAL(spi_tx_sem);
@@ -504,6 +606,24 @@ void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *_hspi)
   }
 }
 
+#if (ES_WIFI_USE_SPI_DMA == 1)
+/**
+  * @brief SPI error callback.
+  * @param  hspi: pointer to a SPI_HandleTypeDef structure that contains
+  *               the configuration information for SPI module.
+  * @retval None
+  */
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *_hspi)
+{
+  if (spi_dma_event)
+  {
+    spi_dma_event = 0;
+    spi_dma_error = 1;
+    tx_semaphore_put(&spi_dma_sem);
+  }
+}
+#endif
+
 
 /**
   * @brief  Interrupt handler for  Data RDY signal
@@ -466,6 +466,26 @@ WIFI_Status_t WIFI_SendData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uin
   return ret;
 }
 
+/**
+  * @brief  Send Data gathered from several buffers on a socket
+  * @param  segments : buffers holding the data to be sent
+  * @param  count : number of segments
+  * @param  SentDatalen : (OUT) length actually sent
+  * @param  Timeout : Socket write timeout (ms)
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_SendDataSegments(uint8_t socket, ES_WIFI_Segment_t *segments, uint8_t count, uint16_t *SentDatalen, uint32_t Timeout)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_SendDataSegments(&EsWifiObj, socket, segments, count, SentDatalen, Timeout) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+
+  return ret;
+}
+
 /**
   * @brief  Send Data on a socket
   * @param  pdata : pointer to data to be sent
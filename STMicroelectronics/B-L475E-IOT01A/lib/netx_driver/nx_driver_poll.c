@@ -0,0 +1,64 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "nx_driver_poll.h"
+
+void nx_driver_poll_init(
+    NX_DRIVER_POLL* poll, uint32_t interval, uint32_t fast_interval, uint16_t fast_count, uint32_t now)
+{
+    poll->interval      = interval;
+    poll->fast_interval = fast_interval;
+    poll->fast_count    = fast_count;
+    poll->last_poll_all = now - interval;
+}
+
+int nx_driver_poll_all(NX_DRIVER_POLL* poll, uint32_t now)
+{
+    /* All sockets are polled as fallback in case data arrives without a send before it.  */
+    if ((uint32_t)(now - poll->last_poll_all) < poll->interval)
+    {
+        return 0;
+    }
+
+    poll->last_poll_all = now;
+    return 1;
+}
+
+int nx_driver_poll_socket(const NX_DRIVER_POLL* poll, uint16_t* fast_polls, int woken, int poll_all)
+{
+    if (woken)
+    {
+        /* Socket sent or connected, data is likely to follow.  */
+        *fast_polls = poll->fast_count;
+        return 1;
+    }
+
+    /* Idle sockets wait for the next full poll.  */
+    return poll_all || *fast_polls;
+}
+
+void nx_driver_poll_done(const NX_DRIVER_POLL* poll, uint16_t* fast_polls, int received)
+{
+    /* More data tends to follow data, keep polling fast until the socket is quiet.  */
+    if (received)
+    {
+        *fast_polls = poll->fast_count;
+    }
+    else if (*fast_polls)
+    {
+        (*fast_polls)--;
+    }
+}
+
+uint32_t nx_driver_poll_wait(const NX_DRIVER_POLL* poll, uint32_t now, int fast)
+{
+    uint32_t elapsed = now - poll->last_poll_all;
+    uint32_t wait    = (elapsed < poll->interval) ? (poll->interval - elapsed) : 0;
+
+    if (fast && (wait > poll->fast_interval))
+    {
+        wait = poll->fast_interval;
+    }
+
+    return wait;
+}
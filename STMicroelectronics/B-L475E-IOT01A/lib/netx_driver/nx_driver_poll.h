@@ -0,0 +1,55 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _NX_DRIVER_POLL_H
+#define _NX_DRIVER_POLL_H
+
+#include <stdint.h>
+
+/* Decides when the offload driver thread polls its sockets. It has no ThreadX or NetX dependency, the driver thread
+   passes in tx_time_get() and the socket events and waits for the returned number of ticks.  */
+
+typedef struct NX_DRIVER_POLL_STRUCT
+{
+    uint32_t interval;      /* Ticks between polls of every socket  */
+    uint32_t fast_interval; /* Ticks between polls of a socket expecting data  */
+    uint16_t fast_count;    /* Fast polls without data before a socket falls back to interval  */
+    uint32_t last_poll_all;
+} NX_DRIVER_POLL;
+
+/**
+ * @brief Start the schedule, the first loop polls every socket
+ * @param now Current tick
+ */
+void nx_driver_poll_init(
+    NX_DRIVER_POLL* poll, uint32_t interval, uint32_t fast_interval, uint16_t fast_count, uint32_t now);
+
+/**
+ * @brief Start a loop of the driver thread
+ * @return Non-zero if every socket is polled in this loop
+ */
+int nx_driver_poll_all(NX_DRIVER_POLL* poll, uint32_t now);
+
+/**
+ * @brief Decide whether a socket is polled in this loop
+ * @param fast_polls The socket's remaining fast polls
+ * @param woken Non-zero if the socket sent or connected since the last loop
+ * @param poll_all Result of nx_driver_poll_all for this loop
+ * @return Non-zero if the socket is polled
+ */
+int nx_driver_poll_socket(const NX_DRIVER_POLL* poll, uint16_t* fast_polls, int woken, int poll_all);
+
+/**
+ * @brief Account a poll of a socket, data keeps it on the fast schedule and a quiet poll uses one fast poll up
+ * @param received Non-zero if the poll returned data
+ */
+void nx_driver_poll_done(const NX_DRIVER_POLL* poll, uint16_t* fast_polls, int received);
+
+/**
+ * @brief Get the ticks to wait for a socket event before the next loop
+ * @param fast Non-zero if any open socket has fast polls left
+ * @return Ticks to wait, 0 if the next loop is due now
+ */
+uint32_t nx_driver_poll_wait(const NX_DRIVER_POLL* poll, uint32_t now, int fast);
+
+#endif /* _NX_DRIVER_POLL_H */
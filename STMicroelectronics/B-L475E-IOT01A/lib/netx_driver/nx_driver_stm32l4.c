@@ -23,6 +23,7 @@
 /* Indicate that driver source is being compiled.  */
 
 #include "nx_driver_stm32l4.h"
+#include "nx_driver_poll.h"
 
 #ifndef NX_ENABLE_TCPIP_OFFLOAD
 #error "NX_ENABLE_TCPIP_OFFLOAD must be defined to use this driver"
@@ -40,11 +41,21 @@
 #define NX_DRIVER_STACK_SIZE                    1024
 #endif /* NX_DRIVER_STACK_SIZE  */
 
-/* Interval to receive packets when there is no packet. The default value is 100 ticks which is 1s.  */
+/* Interval to poll all sockets for packets when there is no activity. The default value is 100 ticks which is 1s.  */
 #ifndef NX_DRIVER_THREAD_INTERVAL
 #define NX_DRIVER_THREAD_INTERVAL               NX_IP_PERIODIC_RATE
 #endif /* NX_DRIVER_THREAD_INTERVAL */
 
+/* Interval to poll a socket that expects data after sending or receiving. The default value is 2 ticks which is 20ms.  */
+#ifndef NX_DRIVER_FAST_POLL_INTERVAL
+#define NX_DRIVER_FAST_POLL_INTERVAL            2
+#endif /* NX_DRIVER_FAST_POLL_INTERVAL */
+
+/* Number of fast polls without data before a socket falls back to NX_DRIVER_THREAD_INTERVAL.  */
+#ifndef NX_DRIVER_FAST_POLL_COUNT
+#define NX_DRIVER_FAST_POLL_COUNT               25
+#endif /* NX_DRIVER_FAST_POLL_COUNT */
+
 /* Define the maximum sockets at the same time. This is limited by hardware TCP/IP on STM32L4.  */
 #define NX_DRIVER_SOCKETS_MAXIMUM               4
 
@@ -56,8 +67,23 @@
 /* Define the maximum wait timeout in ms for socket send. This is limited by hardware TCP/IP on STM32L4.  */
 #define NX_DRIVER_SOCKET_SEND_TIMEOUT_MAXIMUM   3000
 
+/* Define the maximum packets in a chain gathered into one send.  */
+#ifndef NX_DRIVER_SEND_SEGMENTS_MAXIMUM
+#define NX_DRIVER_SEND_SEGMENTS_MAXIMUM         8
+#endif /* NX_DRIVER_SEND_SEGMENTS_MAXIMUM */
+
+#ifndef NX_DISABLE_PACKET_CHAIN
+#define NX_DRIVER_PACKET_NEXT(packet_ptr)       ((packet_ptr) -> nx_packet_next)
+#else
+#define NX_DRIVER_PACKET_NEXT(packet_ptr)       NX_NULL
+#endif /* NX_DISABLE_PACKET_CHAIN */
+
 #define NX_DRIVER_CAPABILITY                    (NX_INTERFACE_CAPABILITY_TCPIP_OFFLOAD)
 
+/* Define the driver thread events, one per socket expecting data.  */
+#define NX_DRIVER_EVENT_SOCKET(i)               ((ULONG)1 << (i))
+#define NX_DRIVER_EVENT_ALL                     (NX_DRIVER_EVENT_SOCKET(NX_DRIVER_SOCKETS_MAXIMUM) - 1)
+
 
 /* Define basic netword driver information typedef.  */
 
@@ -90,13 +116,15 @@ typedef struct NX_DRIVER_SOCKET_STRUCT
     USHORT               remote_port;
     UCHAR                tcp_connected;
     UCHAR                is_client;
-    USHORT               reseverd;
+    USHORT               fast_polls;
 } NX_DRIVER_SOCKET;
 
 static NX_DRIVER_INFORMATION nx_driver_information;
 static NX_DRIVER_SOCKET nx_driver_sockets[NX_DRIVER_SOCKETS_MAXIMUM];
 static TX_THREAD nx_driver_thread;
 static UCHAR nx_driver_thread_stack[NX_DRIVER_STACK_SIZE];
+static TX_EVENT_FLAGS_GROUP nx_driver_events;
+static NX_DRIVER_POLL nx_driver_poll;
 
 /* Define the routines for processing each driver entry request.  The contents of these routines will change with
    each driver. However, the main driver entry function will not change, except for the entry function name.  */
@@ -967,7 +995,9 @@ static VOID  _nx_driver_deferred_processing(NX_IP_DRIVER *driver_req_ptr)
 /*                                                                        */ 
 /*    This function is the driver thread entry. In this thread, it        */ 
 /*    performs checking for incoming TCP and UDP packets. On new packet,  */ 
-/*    it will be passed to NetX.                                          */
+/*    it will be passed to NetX. Sockets that sent or received recently   */
+/*    are checked every NX_DRIVER_FAST_POLL_INTERVAL, all sockets every   */
+/*    NX_DRIVER_THREAD_INTERVAL.                                          */
 /*                                                                        */ 
 /*  INPUT                                                                 */ 
 /*                                                                        */ 
@@ -982,6 +1012,12 @@ static VOID  _nx_driver_deferred_processing(NX_IP_DRIVER *driver_req_ptr)
 /*    tx_mutex_get                          Obtain protection mutex       */
 /*    tx_mutex_put                          Release protection mutex      */
 /*    tx_thread_sleep                       Sleep driver thread           */
+/*    tx_event_flags_get                    Wait for socket activity      */
+/*    nx_driver_poll_all                    Check for a poll of all       */
+/*                                            sockets                     */
+/*    nx_driver_poll_socket                 Check for a poll of a socket  */
+/*    nx_driver_poll_done                   Account a socket poll         */
+/*    nx_driver_poll_wait                   Get ticks to next loop        */
 /*    nx_packet_allocate                    Allocate a packet for incoming*/
 /*                                            TCP and UDP data            */
 /*    _nx_tcp_socket_driver_packet_receive  Receive TCP packet            */
@@ -1008,14 +1044,26 @@ UINT status;
 NXD_ADDRESS local_ip;
 NXD_ADDRESS remote_ip;
 uint16_t data_length;
+UINT poll_all;
+UINT received;
+UINT fast;
+ULONG events = 0;
+ULONG wait_ticks;
 NX_IP *ip_ptr = nx_driver_information.nx_driver_information_ip_ptr;
 NX_INTERFACE *interface_ptr = nx_driver_information.nx_driver_information_interface;
 NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_pool_ptr;
 
     NX_PARAMETER_NOT_USED(thread_input);
 
+    /* Poll all sockets on the first loop.  */
+    nx_driver_poll_init(&nx_driver_poll, NX_DRIVER_THREAD_INTERVAL, NX_DRIVER_FAST_POLL_INTERVAL,
+                        NX_DRIVER_FAST_POLL_COUNT, tx_time_get());
+
     for (;;)
     {
+
+        /* All sockets are polled as fallback in case data arrives without a send before it.  */
+        poll_all = (UINT)nx_driver_poll_all(&nx_driver_poll, tx_time_get());
         
         /* Obtain the IP internal mutex before processing the IP event.  */
         tx_mutex_get(&(ip_ptr -> nx_ip_protection), TX_WAIT_FOREVER);
@@ -1038,6 +1086,14 @@ NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_po
                 continue;
             }
 
+            if (!nx_driver_poll_socket(&nx_driver_poll, &nx_driver_sockets[i].fast_polls,
+                                       (events & NX_DRIVER_EVENT_SOCKET(i)) != 0, (int)poll_all))
+            {
+
+                /* Skip idle sockets until the next full poll.  */
+                continue;
+            }
+
             /* Set packet type.  */
             if (nx_driver_sockets[i].protocol == NX_PROTOCOL_TCP)
             {
@@ -1062,6 +1118,7 @@ NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_po
             } 
 
             /* Loop to receive all data on current socket.  */
+            received = NX_FALSE;
             for (;;)
             {
                 if (nx_packet_allocate(pool_ptr, &packet_ptr, packet_type, NX_NO_WAIT))
@@ -1099,6 +1156,7 @@ NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_po
                                                              NX_NULL, NX_NULL, 0);
                     }
                     nx_packet_release(packet_ptr);
+                    nx_driver_sockets[i].fast_polls = 0;
                     break;
                 }
 
@@ -1110,6 +1168,8 @@ NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_po
                     break;
                 }
 
+                received = NX_TRUE;
+
                 /* Set packet length.  */
                 packet_ptr -> nx_packet_length = (ULONG)data_length;
                 packet_ptr -> nx_packet_append_ptr = packet_ptr -> nx_packet_prepend_ptr + data_length;
@@ -1134,13 +1194,27 @@ NX_PACKET_POOL *pool_ptr = nx_driver_information.nx_driver_information_packet_po
                                                          nx_driver_sockets[i].remote_port);
                 }
             }
+
+            nx_driver_poll_done(&nx_driver_poll, &nx_driver_sockets[i].fast_polls, (int)received);
+        }
+
+        /* Calculate ticks to next loop.  */
+        fast = NX_FALSE;
+        for (i = 0; i < NX_DRIVER_SOCKETS_MAXIMUM; i++)
+        {
+            if ((nx_driver_sockets[i].socket_ptr != NX_NULL) && nx_driver_sockets[i].fast_polls)
+            {
+                fast = NX_TRUE;
+            }
         }
+        wait_ticks = nx_driver_poll_wait(&nx_driver_poll, tx_time_get(), (int)fast);
         
         /* Release the IP internal mutex before processing the IP event.  */
         tx_mutex_put(&(ip_ptr -> nx_ip_protection));
         
-        /* Sleep some ticks to next loop.  */
-        tx_thread_sleep(NX_DRIVER_THREAD_INTERVAL);
+        /* Wait for a socket to send or the next poll.  */
+        events = 0;
+        tx_event_flags_get(&nx_driver_events, NX_DRIVER_EVENT_ALL, TX_OR_CLEAR, &events, wait_ticks);
     }
 }
 
@@ -1200,8 +1274,13 @@ static UINT _nx_driver_tcpip_handler(struct NX_IP_STRUCT *ip_ptr,
 UINT status = NX_NOT_SUCCESSFUL;
 UCHAR remote_ip_bytes[4];
 NX_PACKET *current_packet;
+NX_PACKET *gather_packet;
 ULONG packet_size;
 ULONG offset;
+ULONG gather_offset;
+ULONG gather_size;
+ES_WIFI_Segment_t segments[NX_DRIVER_SEND_SEGMENTS_MAXIMUM];
+UINT segment_count;
 uint16_t sent_size;
 UINT i;
 
@@ -1289,6 +1368,9 @@ UINT i;
         nx_driver_sockets[i].remote_port = *remote_port;
         nx_driver_sockets[i].protocol = NX_PROTOCOL_TCP;
         nx_driver_sockets[i].is_client = NX_TRUE;
+
+        /* Wake driver thread to poll the new connection.  */
+        tx_event_flags_set(&nx_driver_events, NX_DRIVER_EVENT_SOCKET(i), TX_OR);
         break;
 
     case NX_TCPIP_OFFLOAD_TCP_SERVER_SOCKET_LISTEN:
@@ -1341,6 +1423,9 @@ UINT i;
         nx_driver_sockets[i].remote_ip = remote_ip -> nxd_ip_address.v4;
         *remote_port = (UINT)nx_driver_sockets[i].remote_port;
         nx_driver_sockets[i].tcp_connected = NX_TRUE;
+
+        /* Wake driver thread to poll the new connection.  */
+        tx_event_flags_set(&nx_driver_events, NX_DRIVER_EVENT_SOCKET(i), TX_OR);
         break;
 
     case NX_TCPIP_OFFLOAD_TCP_SERVER_SOCKET_UNLISTEN:
@@ -1498,6 +1583,9 @@ UINT i;
 
         /* Release the packet.  */
         nx_packet_transmit_release(packet_ptr);
+
+        /* Wake driver thread to poll for the response.  */
+        tx_event_flags_set(&nx_driver_events, NX_DRIVER_EVENT_SOCKET(i), TX_OR);
         break;
 
     case NX_TCPIP_OFFLOAD_TCP_SOCKET_SEND:
@@ -1521,55 +1609,79 @@ UINT i;
         while(current_packet)
         {
 
-            /* Calculate current packet size. */
-            packet_size = (ULONG)(current_packet -> nx_packet_append_ptr - current_packet -> nx_packet_prepend_ptr);
-            packet_size -= offset;
+            /* Gather the chain from the current position, up to ES_WIFI_PAYLOAD_SIZE per send.  */
+            segment_count = 0;
+            gather_size = 0;
+            gather_packet = current_packet;
+            gather_offset = offset;
+            while (gather_packet && (segment_count < NX_DRIVER_SEND_SEGMENTS_MAXIMUM) &&
+                   (gather_size < ES_WIFI_PAYLOAD_SIZE))
+            {
+
+                /* Calculate remaining size in this packet, limited by the room left in the send.  */
+                packet_size = (ULONG)(gather_packet -> nx_packet_append_ptr - gather_packet -> nx_packet_prepend_ptr);
+                packet_size -= gather_offset;
+                if (packet_size > (ES_WIFI_PAYLOAD_SIZE - gather_size))
+                {
+                    packet_size = ES_WIFI_PAYLOAD_SIZE - gather_size;
+                }
+
+                if (packet_size)
+                {
+                    segments[segment_count].Data = gather_packet -> nx_packet_prepend_ptr + gather_offset;
+                    segments[segment_count].Length = (uint16_t)packet_size;
+                    segment_count++;
+                    gather_size += packet_size;
+                }
+
+                gather_packet = NX_DRIVER_PACKET_NEXT(gather_packet);
+                gather_offset = 0;
+            }
 
-            /* Limit the data size to ES_WIFI_PAYLOAD_SIZE due to underlayer limitation.  */
-            if (packet_size > ES_WIFI_PAYLOAD_SIZE)
+            if (gather_size == 0)
             {
-                packet_size = ES_WIFI_PAYLOAD_SIZE;
+
+                /* Only empty packets left.  */
+                break;
             }
 
-            /* Send data.  */
-            status = WIFI_SendData((uint8_t)i,
-                                   current_packet -> nx_packet_prepend_ptr + offset,
-                                   (uint16_t)packet_size, &sent_size,
-                                   wait_option); 
-            
+            /* Send data straight from the packet payloads.  */
+            status = WIFI_SendDataSegments((uint8_t)i, segments, (uint8_t)segment_count, &sent_size,
+                                           wait_option);
+
             /* Check status.  */
-            if ((status != WIFI_STATUS_OK) || (sent_size != packet_size))
+            if ((status != WIFI_STATUS_OK) || (sent_size == 0))
             {
                 return (NX_NOT_SUCCESSFUL);
             }
 
-            /* Calculate current packet size. */
-            packet_size = (ULONG)(current_packet -> nx_packet_append_ptr - current_packet -> nx_packet_prepend_ptr);
-
-            if ((sent_size + offset) < packet_size)
+            /* Move past the data sent, a partial send resumes in the middle of a packet.  */
+            while (sent_size)
             {
+                packet_size = (ULONG)(current_packet -> nx_packet_append_ptr - current_packet -> nx_packet_prepend_ptr);
+                packet_size -= offset;
 
-                /* Partial data sent. Increase the offset.  */
-                offset += sent_size;
-            }
-            else
-            {
+                if (sent_size < packet_size)
+                {
+                    offset += sent_size;
+                    sent_size = 0;
+                }
+                else
+                {
 
-                /* Data in current packet are all sent.  */
-                offset = 0;
-            
-#ifndef NX_DISABLE_PACKET_CHAIN
-                /* We have crossed the packet boundary.  Move to the next packet structure.  */
-                current_packet =  current_packet -> nx_packet_next;
-#else
-                /* End of the loop.  */
-                current_packet = NX_NULL;
-#endif /* NX_DISABLE_PACKET_CHAIN */
+                    /* Data in current packet are all sent.  */
+                    sent_size -= (uint16_t)packet_size;
+                    offset = 0;
+                    current_packet = NX_DRIVER_PACKET_NEXT(current_packet);
+                }
             }
         }
 
         /* Release the packet.  */
         nx_packet_transmit_release(packet_ptr);
+
+        /* Wake driver thread to poll for the response.  */
+        tx_event_flags_set(&nx_driver_events, NX_DRIVER_EVENT_SOCKET(i), TX_OR);
         break;
 
     default:
@@ -1608,6 +1720,7 @@ UINT i;
 /*  CALLS                                                                 */ 
 /*                                                                        */ 
 /*    tx_thread_info_get                    Get thread information        */ 
+/*    tx_event_flags_create                 Create driver thread events   */
 /*    tx_thread_create                      Create driver thread          */ 
 /*                                                                        */
 /*  CALLED BY                                                             */ 
@@ -1630,6 +1743,13 @@ UINT priority = 0;
     tx_thread_info_get(tx_thread_identify(), NX_NULL, NX_NULL, NX_NULL, &priority,
                        NX_NULL, NX_NULL, NX_NULL, NX_NULL);
 
+    /* Create the events that wake driver thread.  */
+    status = tx_event_flags_create(&nx_driver_events, "Driver Events");
+    if (status)
+    {
+        return(status);
+    }
+
     /* Create the driver thread.  */
     /* The priority of network thread is lower than IP thread.  */
     status = tx_thread_create(&nx_driver_thread, "Driver Thread", _nx_driver_thread_entry, 0,  
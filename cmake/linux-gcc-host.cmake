@@ -0,0 +1,34 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License.
+
+# Host build against the ThreadX Linux port. NetX Duo expects 32-bit longs, so everything is built with -m32.
+set(THREADX_ARCH "linux")
+set(THREADX_TOOLCHAIN "gnu")
+
+set(CMAKE_SYSTEM_NAME Linux)
+
+# default to Debug build
+if(NOT CMAKE_BUILD_TYPE)
+    set(CMAKE_BUILD_TYPE "Debug" CACHE STRING "Choose the type of build, options are: Debug Release." FORCE)
+endif()
+
+set(CMAKE_C_COMPILER    gcc)
+set(CMAKE_CXX_COMPILER  g++)
+set(CMAKE_ASM_COMPILER  gcc)
+
+# Compiler and linker flags, the middleware is not warning free under host compilers so warnings stay warnings
+set(CMAKE_COMMON_FLAGS "-m32 -g3 -D_GNU_SOURCE -fno-strict-aliasing -fno-common -Wall -Wshadow -Wno-unused-parameter")
+set(CMAKE_C_FLAGS   "${CMAKE_COMMON_FLAGS}")
+set(CMAKE_CXX_FLAGS "${CMAKE_COMMON_FLAGS}")
+set(CMAKE_ASM_FLAGS "${CMAKE_COMMON_FLAGS}")
+set(CMAKE_EXE_LINKER_FLAGS "-m32 -pthread")
+
+set(CMAKE_C_FLAGS_DEBUG "-O0")
+set(CMAKE_CXX_FLAGS_DEBUG "-O0")
+set(CMAKE_ASM_FLAGS_DEBUG "")
+set(CMAKE_EXE_LINKER_FLAGS_DEBUG "")
+
+set(CMAKE_C_FLAGS_RELEASE "-O2")
+set(CMAKE_CXX_FLAGS_RELEASE "-O2")
+set(CMAKE_ASM_FLAGS_RELEASE "")
+set(CMAKE_EXE_LINKER_FLAGS_RELEASE "")
@@ -0,0 +1,315 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License.
+
+# Summarize a GNU ld map file per component and check it against a budget, run in script mode:
+#
+#   cmake -DMAP_FILE=<target>.map -DAPP_NAME=<target> -DREPORT=<report.txt>
+#         [-DBASELINE=<baseline.txt>] [-DUPDATE_BASELINE=ON]
+#         [-DRAM_BUDGET=<bytes>] [-DFLASH_BUDGET=<bytes>] [-DGROWTH_LIMIT=<bytes>] [-DTOP_SYMBOLS=<count>]
+#         -P memory_report.cmake
+#
+# With GROWTH_LIMIT the check also fails when the .text, .data or .bss of a component grew by more than that many
+# bytes over the baseline, a component missing from the baseline counts as grown from zero.
+#
+# Components are taken from the static library an object came from (libthreadx.a -> threadx), objects of
+# app_common and of the target itself are reported as app_common and app, the toolchain runtime as toolchain.
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT MAP_FILE OR NOT EXISTS ${MAP_FILE})
+    message(FATAL_ERROR "Map file '${MAP_FILE}' not found")
+endif()
+
+if(NOT TOP_SYMBOLS)
+    set(TOP_SYMBOLS 15)
+endif()
+
+set(TOOLCHAIN_LIBS c c_nano g g_nano gcc m nosys rdimon stdc++ stdc++_nano supc++ supc++_nano)
+
+function(pad_left OUT WIDTH VALUE)
+    string(LENGTH "${VALUE}" length)
+    while(length LESS WIDTH)
+        set(VALUE " ${VALUE}")
+        math(EXPR length "${length} + 1")
+    endwhile()
+    set(${OUT} "${VALUE}" PARENT_SCOPE)
+endfunction()
+
+function(pad_right OUT WIDTH VALUE)
+    string(LENGTH "${VALUE}" length)
+    while(length LESS WIDTH)
+        set(VALUE "${VALUE} ")
+        math(EXPR length "${length} + 1")
+    endwhile()
+    set(${OUT} "${VALUE}" PARENT_SCOPE)
+endfunction()
+
+function(signed OUT VALUE)
+    if(VALUE GREATER 0)
+        set(VALUE "+${VALUE}")
+    endif()
+    set(${OUT} "${VALUE}" PARENT_SCOPE)
+endfunction()
+
+# Only keep the lines the parser looks at, this also keeps brackets in linker script lines out of the list
+file(STRINGS ${MAP_FILE} lines REGEX "^(Linker script and memory map|\\.|[ \t]+0x| [.A-Za-z_])")
+
+set(in_map OFF)
+set(kind "")
+set(pending "")
+set(components "")
+set(symbols "")
+
+foreach(line IN LISTS lines)
+    set(name "")
+
+    if(line MATCHES "^Linker script and memory map")
+        set(in_map ON)
+        continue()
+    elseif(NOT in_map)
+        continue()
+    endif()
+
+    # Output section, work out which region its input sections count against
+    if(line MATCHES "^(\\.[^ \t]+)")
+        set(output ${CMAKE_MATCH_1})
+        set(pending "")
+        if(output MATCHES "^\\.(isr_vector|text|rodata|ARM\\.extab|ARM|ARM\\.exidx|preinit_array|init_array|fini_array)$")
+            set(kind text)
+        elseif(output MATCHES "^\\.data$")
+            set(kind data)
+        elseif(output MATCHES "^\\.(bss|noinit)$")
+            set(kind bss)
+        else()
+            set(kind "")
+        endif()
+        continue()
+    endif()
+
+    if(kind STREQUAL "")
+        continue()
+    endif()
+
+    # Input section on one line, or split over two when the section name is long
+    if(line MATCHES "^ ([.A-Za-z_][^ \t]*)[ \t]+0x([0-9a-fA-F]+)[ \t]+0x([0-9a-fA-F]+)[ \t]+(.+)$")
+        set(name ${CMAKE_MATCH_1})
+        set(address ${CMAKE_MATCH_2})
+        set(size ${CMAKE_MATCH_3})
+        set(object ${CMAKE_MATCH_4})
+    elseif(line MATCHES "^ ([.A-Za-z_][^ \t]*)$")
+        set(pending ${CMAKE_MATCH_1})
+    elseif(pending AND line MATCHES "^[ \t]+0x([0-9a-fA-F]+)[ \t]+0x([0-9a-fA-F]+)[ \t]+(.+)$")
+        set(name ${pending})
+        set(address ${CMAKE_MATCH_1})
+        set(size ${CMAKE_MATCH_2})
+        set(object ${CMAKE_MATCH_3})
+        set(pending "")
+    else()
+        set(pending "")
+    endif()
+
+    if(name STREQUAL "")
+        continue()
+    endif()
+
+    math(EXPR size "0x${size}")
+    if(size EQUAL 0 OR address MATCHES "^0+$")
+        continue()
+    endif()
+
+    if(object MATCHES "lib([A-Za-z0-9_+-]+)\\.a\\(")
+        set(component ${CMAKE_MATCH_1})
+        if(component IN_LIST TOOLCHAIN_LIBS)
+            set(component toolchain)
+        endif()
+    elseif(object MATCHES "app_common\\.dir")
+        set(component app_common)
+    elseif(APP_NAME AND object MATCHES "${APP_NAME}\\.dir")
+        set(component app)
+    elseif(object MATCHES "crt[^/\\\\]*\\.o$")
+        set(component toolchain)
+    else()
+        set(component other)
+    endif()
+
+    if(NOT component IN_LIST components)
+        list(APPEND components ${component})
+        set(${component}_text 0)
+        set(${component}_data 0)
+        set(${component}_bss 0)
+    endif()
+    math(EXPR ${component}_${kind} "${${component}_${kind}} + ${size}")
+
+    # With -ffunction-sections and -fdata-sections every input section is a single symbol
+    string(REGEX REPLACE "^\\.(text|rodata|data|bss|noinit)\\." "" symbol "${name}")
+    pad_left(sort_key 10 ${size})
+    string(REPLACE " " "0" sort_key "${sort_key}")
+    list(APPEND symbols "${sort_key}|${kind}|${component}|${symbol}")
+endforeach()
+
+if(NOT components)
+    message(FATAL_ERROR "No allocated sections found in '${MAP_FILE}'")
+endif()
+
+list(SORT components)
+
+# Baseline lines are "component text data bss"
+set(baseline_components "")
+if(BASELINE AND EXISTS ${BASELINE} AND NOT UPDATE_BASELINE)
+    file(STRINGS ${BASELINE} baseline_lines REGEX "^[A-Za-z0-9_+-]+ [0-9]+ [0-9]+ [0-9]+$")
+    foreach(line IN LISTS baseline_lines)
+        string(REPLACE " " ";" fields "${line}")
+        list(GET fields 0 component)
+        list(GET fields 1 base_${component}_text)
+        list(GET fields 2 base_${component}_data)
+        list(GET fields 3 base_${component}_bss)
+        list(APPEND baseline_components ${component})
+    endforeach()
+endif()
+
+set(total_text 0)
+set(total_data 0)
+set(total_bss 0)
+set(base_flash 0)
+set(base_ram 0)
+set(baseline_out "# ${APP_NAME} bytes per component: name .text .data .bss\n")
+string(APPEND baseline_out "# Refresh with a release build of the ${APP_NAME}.memory_baseline target\n")
+set(grown "")
+
+pad_right(report 14 "Component")
+foreach(column .text .data .bss Flash RAM)
+    pad_left(cell 10 ${column})
+    string(APPEND report "${cell}")
+endforeach()
+if(baseline_components)
+    pad_left(cell 12 "Flash diff")
+    string(APPEND report "${cell}")
+    pad_left(cell 12 "RAM diff")
+    string(APPEND report "${cell}")
+endif()
+string(APPEND report "\n")
+
+foreach(component IN LISTS components)
+    math(EXPR flash "${${component}_text} + ${${component}_data}")
+    math(EXPR ram "${${component}_data} + ${${component}_bss}")
+    math(EXPR total_text "${total_text} + ${${component}_text}")
+    math(EXPR total_data "${total_data} + ${${component}_data}")
+    math(EXPR total_bss "${total_bss} + ${${component}_bss}")
+    string(APPEND baseline_out "${component} ${${component}_text} ${${component}_data} ${${component}_bss}\n")
+
+    pad_right(row 14 ${component})
+    foreach(value ${${component}_text} ${${component}_data} ${${component}_bss} ${flash} ${ram})
+        pad_left(cell 10 ${value})
+        string(APPEND row "${cell}")
+    endforeach()
+
+    if(baseline_components)
+        if(component IN_LIST baseline_components)
+            math(EXPR flash_diff "${flash} - ${base_${component}_text} - ${base_${component}_data}")
+            math(EXPR ram_diff "${ram} - ${base_${component}_data} - ${base_${component}_bss}")
+        else()
+            set(flash_diff ${flash})
+            set(ram_diff ${ram})
+            foreach(kind text data bss)
+                set(base_${component}_${kind} 0)
+            endforeach()
+        endif()
+
+        if(GROWTH_LIMIT)
+            foreach(kind text data bss)
+                math(EXPR growth "${${component}_${kind}} - ${base_${component}_${kind}}")
+                if(growth GREATER GROWTH_LIMIT)
+                    list(APPEND grown "${component} .${kind} grew by ${growth} bytes")
+                endif()
+            endforeach()
+        endif()
+        signed(flash_diff ${flash_diff})
+        signed(ram_diff ${ram_diff})
+        pad_left(cell 12 ${flash_diff})
+        string(APPEND row "${cell}")
+        pad_left(cell 12 ${ram_diff})
+        string(APPEND row "${cell}")
+    endif()
+
+    string(APPEND report "${row}\n")
+endforeach()
+
+foreach(component IN LISTS baseline_components)
+    math(EXPR base_flash "${base_flash} + ${base_${component}_text} + ${base_${component}_data}")
+    math(EXPR base_ram "${base_ram} + ${base_${component}_data} + ${base_${component}_bss}")
+endforeach()
+
+math(EXPR total_flash "${total_text} + ${total_data}")
+math(EXPR total_ram "${total_data} + ${total_bss}")
+
+pad_right(row 14 "total")
+foreach(value ${total_text} ${total_data} ${total_bss} ${total_flash} ${total_ram})
+    pad_left(cell 10 ${value})
+    string(APPEND row "${cell}")
+endforeach()
+if(baseline_components)
+    math(EXPR flash_diff "${total_flash} - ${base_flash}")
+    math(EXPR ram_diff "${total_ram} - ${base_ram}")
+    signed(flash_diff ${flash_diff})
+    signed(ram_diff ${ram_diff})
+    pad_left(cell 12 ${flash_diff})
+    string(APPEND row "${cell}")
+    pad_left(cell 12 ${ram_diff})
+    string(APPEND row "${cell}")
+endif()
+string(APPEND report "${row}\n\nLargest symbols\n")
+
+list(SORT symbols ORDER DESCENDING)
+set(count 0)
+foreach(entry IN LISTS symbols)
+    if(NOT count LESS TOP_SYMBOLS)
+        break()
+    endif()
+    string(REPLACE "|" ";" fields "${entry}")
+    list(GET fields 0 size)
+    list(GET fields 1 kind)
+    list(GET fields 2 component)
+    list(GET fields 3 symbol)
+    string(REGEX REPLACE "^0+" "" size "${size}")
+    pad_left(size 10 ${size})
+    pad_right(kind 6 ${kind})
+    pad_right(component 14 ${component})
+    string(APPEND report "${size}  ${kind}${component}${symbol}\n")
+    math(EXPR count "${count} + 1")
+endforeach()
+
+set(failed "")
+if(FLASH_BUDGET)
+    string(APPEND report "\nFlash ${total_flash} of ${FLASH_BUDGET} bytes budgeted\n")
+    if(total_flash GREATER FLASH_BUDGET)
+        list(APPEND failed "flash use of ${total_flash} bytes exceeds the budget of ${FLASH_BUDGET}")
+    endif()
+endif()
+if(RAM_BUDGET)
+    string(APPEND report "RAM ${total_ram} of ${RAM_BUDGET} bytes budgeted\n")
+    if(total_ram GREATER RAM_BUDGET)
+        list(APPEND failed "RAM use of ${total_ram} bytes exceeds the budget of ${RAM_BUDGET}")
+    endif()
+endif()
+
+if(grown)
+    string(REPLACE ";" ", " grown "${grown}")
+    list(APPEND failed "${grown}, the limit is ${GROWTH_LIMIT} bytes per section")
+endif()
+
+if(REPORT)
+    file(WRITE ${REPORT} "${report}")
+endif()
+message("${report}")
+
+if(UPDATE_BASELINE)
+    file(WRITE ${BASELINE} "${baseline_out}")
+    message(STATUS "Baseline written to ${BASELINE}")
+elseif(BASELINE AND NOT baseline_components)
+    message(STATUS "No entries in baseline ${BASELINE}, build the ${APP_NAME}.memory_baseline target to fill it")
+endif()
+
+if(failed)
+    string(REPLACE ";" "; " failed "${failed}")
+    message(FATAL_ERROR "Memory budget exceeded: ${failed}")
+endif()
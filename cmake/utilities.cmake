@@ -1,6 +1,8 @@
 # Copyright (c) Microsoft Corporation.
 # Licensed under the MIT License.
 
+set(UTILITIES_DIR ${CMAKE_CURRENT_LIST_DIR})
+
 function(post_build TARGET)
     if(CMAKE_C_COMPILER_ID STREQUAL "IAR")
         add_custom_target(${TARGET}.bin ALL 
@@ -16,6 +18,43 @@ function(post_build TARGET)
     endif()
 endfunction()
 
+# Per-component .text/.data/.bss report from the linker map, built after every link.
+# The build fails when RAM_BUDGET or FLASH_BUDGET (bytes, 0 to skip) is exceeded.
+# With a BASELINE file the report is diffed against it, build ${TARGET}.memory_baseline to refresh it.
+# GROWTH_LIMIT (bytes, 0 to skip) also fails the build when a section of a component grew more than that over it.
+function(memory_budget TARGET)
+    cmake_parse_arguments(MEMORY "" "BASELINE;RAM_BUDGET;FLASH_BUDGET;GROWTH_LIMIT" "" ${ARGN})
+
+    if(CMAKE_C_COMPILER_ID STREQUAL "GNU")
+        set(MEMORY_REPORT_ARGS
+            -DMAP_FILE=${CMAKE_CURRENT_BINARY_DIR}/${TARGET}.map
+            -DAPP_NAME=${TARGET}
+            -DREPORT=${CMAKE_CURRENT_BINARY_DIR}/${TARGET}.memory.txt)
+
+        if(MEMORY_BASELINE)
+            list(APPEND MEMORY_REPORT_ARGS -DBASELINE=${MEMORY_BASELINE})
+        endif()
+
+        add_custom_target(${TARGET}.memory ALL
+            DEPENDS ${TARGET}
+            COMMAND ${CMAKE_COMMAND} ${MEMORY_REPORT_ARGS}
+                -DRAM_BUDGET=${MEMORY_RAM_BUDGET}
+                -DFLASH_BUDGET=${MEMORY_FLASH_BUDGET}
+                -DGROWTH_LIMIT=${MEMORY_GROWTH_LIMIT}
+                -P ${UTILITIES_DIR}/memory_report.cmake)
+
+        if(MEMORY_BASELINE)
+            add_custom_target(${TARGET}.memory_baseline
+                DEPENDS ${TARGET}
+                COMMAND ${CMAKE_COMMAND} ${MEMORY_REPORT_ARGS}
+                    -DUPDATE_BASELINE=ON
+                    -P ${UTILITIES_DIR}/memory_report.cmake)
+        endif()
+    else()
+        message(STATUS "Memory budget report is only implemented for GNU, skipping ${TARGET}")
+    endif()
+endfunction()
+
 function(set_target_linker TARGET LINKER_SCRIPT)
     if(CMAKE_C_COMPILER_ID STREQUAL "IAR")
         target_link_options(${TARGET} PRIVATE --config ${LINKER_SCRIPT})
@@ -0,0 +1,360 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_command.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const CHAR timeout_body[] = "{\"error\":\"timeout\"}";
+
+static ULONG request_id_make(AZURE_IOT_COMMAND_SERVICE* service, AZURE_IOT_COMMAND_REQUEST* request)
+{
+    return ((ULONG)request->generation << 8) | (ULONG)(request - service->requests + 1);
+}
+
+static ULONG request_timeout(AZURE_IOT_COMMAND_REQUEST* request)
+{
+    return request->entry->timeout ? request->entry->timeout : AZURE_IOT_COMMAND_TIMEOUT_DEFAULT;
+}
+
+// Interrupts must be disabled
+static VOID request_free(AZURE_IOT_COMMAND_REQUEST* request)
+{
+    request->state     = AZURE_IOT_COMMAND_FREE;
+    request->responded = false;
+    request->generation++;
+}
+
+// Interrupts must be disabled, the latency is counted when the response is decided rather than when it is sent
+static VOID request_latency(AZURE_IOT_COMMAND_SERVICE* service, AZURE_IOT_COMMAND_REQUEST* request)
+{
+    ULONG latency = tx_time_get() - request->received_time;
+
+    service->stats.latency_total += latency;
+    if (latency > service->stats.latency_max)
+    {
+        service->stats.latency_max = latency;
+    }
+}
+
+static VOID request_respond(AZURE_IOT_COMMAND_SERVICE* service,
+    UINT status,
+    const UCHAR* context,
+    USHORT context_length,
+    const CHAR* body,
+    UINT body_length)
+{
+    UINT result;
+
+    if ((result = nx_azure_iot_hub_client_command_message_response(service->hub_client,
+             status,
+             (VOID*)context,
+             context_length,
+             (const UCHAR*)body,
+             body_length,
+             NX_WAIT_FOREVER)))
+    {
+        printf("ERROR: command response failed (0x%08x)\r\n", result);
+    }
+}
+
+static VOID request_timer_entry(ULONG context)
+{
+    AZURE_IOT_COMMAND_SERVICE* service = (AZURE_IOT_COMMAND_SERVICE*)context;
+    tx_event_flags_set(service->events, service->timeout_event, TX_OR);
+}
+
+static VOID worker_entry(ULONG context)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    AZURE_IOT_COMMAND_SERVICE* service = (AZURE_IOT_COMMAND_SERVICE*)context;
+    AZURE_IOT_COMMAND_REQUEST* request;
+    ULONG slot;
+    bool run;
+    UINT status;
+
+    while (true)
+    {
+        if (tx_queue_receive(&service->queue, &slot, TX_WAIT_FOREVER))
+        {
+            continue;
+        }
+
+        request = &service->requests[slot];
+
+        TX_DISABLE
+        service->stats.queue_depth--;
+        request->state = AZURE_IOT_COMMAND_RUNNING;
+        run            = !request->responded;
+        TX_RESTORE
+
+        // A request that timed out while queued is dropped without running
+        if (run)
+        {
+            status = request->entry->handler(&request->arg, request->entry->context);
+            if (status != DISPATCH_STATUS_PENDING)
+            {
+                azure_iot_command_complete(service, request->arg.request_id, status);
+            }
+        }
+
+        TX_DISABLE
+        if (request->responded)
+        {
+            request_free(request);
+        }
+        else
+        {
+            request->state = AZURE_IOT_COMMAND_PENDING;
+        }
+        TX_RESTORE
+    }
+}
+
+UINT azure_iot_command_start(AZURE_IOT_COMMAND_SERVICE* service,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    TX_EVENT_FLAGS_GROUP* events,
+    ULONG timeout_event)
+{
+    UINT status;
+
+    if (service->started)
+    {
+        return TX_SUCCESS;
+    }
+
+    memset(service, 0, sizeof(*service));
+    service->hub_client    = hub_client;
+    service->events        = events;
+    service->timeout_event = timeout_event;
+
+    if ((status = tx_queue_create(
+             &service->queue, "Command queue", TX_1_ULONG, service->queue_storage, sizeof(service->queue_storage))))
+    {
+        printf("ERROR: tx_queue_create (0x%08x)\r\n", status);
+        return status;
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_COMMAND_SLOTS; i++)
+    {
+        if ((status = tx_timer_create(&service->requests[i].timer,
+                 "Command timer",
+                 request_timer_entry,
+                 (ULONG)service,
+                 AZURE_IOT_COMMAND_TIMEOUT_DEFAULT,
+                 0,
+                 TX_NO_ACTIVATE)))
+        {
+            printf("ERROR: tx_timer_create (0x%08x)\r\n", status);
+            return status;
+        }
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_COMMAND_WORKERS; i++)
+    {
+        if ((status = tx_thread_create(&service->workers[i],
+                 "Command worker",
+                 worker_entry,
+                 (ULONG)service,
+                 service->worker_stacks[i],
+                 AZURE_IOT_COMMAND_STACK_SIZE,
+                 AZURE_IOT_COMMAND_PRIORITY,
+                 AZURE_IOT_COMMAND_PRIORITY,
+                 TX_NO_TIME_SLICE,
+                 TX_AUTO_START)))
+        {
+            printf("ERROR: tx_thread_create (0x%08x)\r\n", status);
+            return status;
+        }
+    }
+
+    service->started = true;
+
+    return TX_SUCCESS;
+}
+
+UINT azure_iot_command_submit(AZURE_IOT_COMMAND_SERVICE* service,
+    const dispatch_entry_t* entry,
+    const UCHAR* payload,
+    USHORT payload_length,
+    const VOID* context,
+    USHORT context_length)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    AZURE_IOT_COMMAND_REQUEST* request = NX_NULL;
+    ULONG slot;
+    UINT status;
+
+    if (payload_length > AZURE_IOT_COMMAND_PAYLOAD_SIZE)
+    {
+        return DISPATCH_STATUS_BAD_REQUEST;
+    }
+
+    if (context_length > AZURE_IOT_COMMAND_CONTEXT_SIZE)
+    {
+        return DISPATCH_STATUS_ERROR;
+    }
+
+    // Only the client thread submits, a slot found free stays free until it is marked queued here
+    for (slot = 0; slot < AZURE_IOT_COMMAND_SLOTS; slot++)
+    {
+        if (service->requests[slot].state == AZURE_IOT_COMMAND_FREE)
+        {
+            request = &service->requests[slot];
+            break;
+        }
+    }
+
+    if (request == NX_NULL)
+    {
+        TX_DISABLE
+        service->stats.rejected++;
+        TX_RESTORE
+        return DISPATCH_STATUS_UNAVAILABLE;
+    }
+
+    // The argument points into the copy, the packet is released once this returns
+    memcpy(request->payload, payload, payload_length);
+    memcpy(request->context, context, context_length);
+    request->context_length = context_length;
+    request->entry          = entry;
+    request->received_time  = tx_time_get();
+
+    if ((status = dispatch_parse(entry, (const CHAR*)request->payload, payload_length, &request->arg)) !=
+        DISPATCH_STATUS_OK)
+    {
+        return status;
+    }
+    request->arg.request_id = request_id_make(service, request);
+
+    tx_timer_deactivate(&request->timer);
+    tx_timer_change(&request->timer, request_timeout(request), 0);
+
+    // Counted before the send, a worker may pick the request up straight away
+    TX_DISABLE
+    request->state = AZURE_IOT_COMMAND_QUEUED;
+    service->stats.queue_depth++;
+    TX_RESTORE
+
+    // The slots outnumber the queue entries, a burst can fill the queue before a worker picks anything up
+    if (tx_queue_send(&service->queue, &slot, TX_NO_WAIT))
+    {
+        TX_DISABLE
+        service->stats.queue_depth--;
+        service->stats.rejected++;
+        request_free(request);
+        TX_RESTORE
+        return DISPATCH_STATUS_UNAVAILABLE;
+    }
+
+    TX_DISABLE
+    service->stats.submitted++;
+    if (service->stats.queue_depth > service->stats.queue_depth_max)
+    {
+        service->stats.queue_depth_max = service->stats.queue_depth;
+    }
+    TX_RESTORE
+
+    tx_timer_activate(&request->timer);
+
+    return DISPATCH_STATUS_PENDING;
+}
+
+UINT azure_iot_command_complete(AZURE_IOT_COMMAND_SERVICE* service, ULONG request_id, UINT status)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    ULONG slot = (request_id & 0xFF) - 1;
+    AZURE_IOT_COMMAND_REQUEST* request;
+    UCHAR context[AZURE_IOT_COMMAND_CONTEXT_SIZE];
+    USHORT context_length;
+
+    if (request_id == 0 || slot >= AZURE_IOT_COMMAND_SLOTS)
+    {
+        return NX_INVALID_PARAMETERS;
+    }
+
+    request = &service->requests[slot];
+
+    // The response goes out from a copy of the context, the slot can be reused as soon as it is marked
+    TX_DISABLE
+    if (request->state == AZURE_IOT_COMMAND_FREE || request->responded || request->arg.request_id != request_id)
+    {
+        service->stats.late++;
+        TX_RESTORE
+        return NX_NOT_FOUND;
+    }
+
+    request->responded = true;
+    service->stats.completed++;
+    request_latency(service, request);
+    context_length = request->context_length;
+    memcpy(context, request->context, context_length);
+
+    // Stopped before the slot can be freed, a request submitted into it re-arms the timer for itself
+    tx_timer_deactivate(&request->timer);
+
+    if (request->state == AZURE_IOT_COMMAND_PENDING)
+    {
+        request_free(request);
+    }
+    TX_RESTORE
+
+    request_respond(service, status, context, context_length, NX_NULL, 0);
+
+    return NX_SUCCESS;
+}
+
+VOID azure_iot_command_timeouts(AZURE_IOT_COMMAND_SERVICE* service)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    ULONG now = tx_time_get();
+    UCHAR context[AZURE_IOT_COMMAND_CONTEXT_SIZE];
+    USHORT context_length;
+
+    for (UINT i = 0; i < AZURE_IOT_COMMAND_SLOTS; i++)
+    {
+        AZURE_IOT_COMMAND_REQUEST* request = &service->requests[i];
+        bool expired;
+
+        TX_DISABLE
+        expired = request->state != AZURE_IOT_COMMAND_FREE && !request->responded &&
+                  now - request->received_time >= request_timeout(request);
+
+        if (expired)
+        {
+            // A queued request is dropped by the worker that picks it up, a running one is freed when it returns
+            request->responded = true;
+            service->stats.timeouts++;
+            request_latency(service, request);
+            context_length = request->context_length;
+            memcpy(context, request->context, context_length);
+
+            if (request->state == AZURE_IOT_COMMAND_PENDING)
+            {
+                request_free(request);
+            }
+        }
+        TX_RESTORE
+
+        if (expired)
+        {
+            printf("Command %s timed out\r\n", request->entry->name);
+            request_respond(
+                service, DISPATCH_STATUS_TIMEOUT, context, context_length, timeout_body, sizeof(timeout_body) - 1);
+        }
+    }
+}
+
+VOID azure_iot_command_stats(AZURE_IOT_COMMAND_SERVICE* service, AZURE_IOT_COMMAND_STATS* stats)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *stats = service->stats;
+    TX_RESTORE
+}
@@ -0,0 +1,122 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_COMMAND_H
+#define _AZURE_IOT_COMMAND_H
+
+#include <stdbool.h>
+
+#include "nx_api.h"
+#include "nx_azure_iot_hub_client.h"
+
+#include "dispatch.h"
+
+// Long running commands are copied out of the received packet, queued and run by a pool of worker threads, so the
+// client thread keeps serving telemetry, properties and reconnects. The response is sent from whichever thread
+// finishes the request, or from the client thread with 504 once the request timeout expires.
+// The service holds the worker stacks and request slots, so only apps with long running commands allocate one.
+
+#define AZURE_IOT_COMMAND_WORKERS         2
+#define AZURE_IOT_COMMAND_QUEUE_SIZE      4
+#define AZURE_IOT_COMMAND_SLOTS           (AZURE_IOT_COMMAND_WORKERS + AZURE_IOT_COMMAND_QUEUE_SIZE)
+#define AZURE_IOT_COMMAND_STACK_SIZE      2048
+#define AZURE_IOT_COMMAND_PRIORITY        8
+#define AZURE_IOT_COMMAND_PAYLOAD_SIZE    128
+#define AZURE_IOT_COMMAND_CONTEXT_SIZE    32
+#define AZURE_IOT_COMMAND_TIMEOUT_DEFAULT (30 * TX_TIMER_TICKS_PER_SECOND)
+
+typedef enum
+{
+    AZURE_IOT_COMMAND_FREE,
+    AZURE_IOT_COMMAND_QUEUED,
+    AZURE_IOT_COMMAND_RUNNING, // A worker is in the handler
+    AZURE_IOT_COMMAND_PENDING  // The handler returned, waiting for azure_iot_command_complete
+} AZURE_IOT_COMMAND_STATE;
+
+// A request from receive to response, the payload and the hub request context are copied out of the packet
+typedef struct AZURE_IOT_COMMAND_REQUEST_STRUCT
+{
+    AZURE_IOT_COMMAND_STATE state;
+    bool responded;
+    UCHAR generation; // Bumped on every reuse so a stale request id is ignored
+    const dispatch_entry_t* entry;
+    dispatch_arg_t arg;
+    ULONG received_time;
+    TX_TIMER timer;
+    UCHAR payload[AZURE_IOT_COMMAND_PAYLOAD_SIZE];
+    UCHAR context[AZURE_IOT_COMMAND_CONTEXT_SIZE];
+    USHORT context_length;
+} AZURE_IOT_COMMAND_REQUEST;
+
+typedef struct AZURE_IOT_COMMAND_STATS_STRUCT
+{
+    ULONG submitted;
+    ULONG completed;
+    ULONG timeouts;
+    ULONG rejected;      // Queue full, answered with 503
+    ULONG late;          // Completions after the 504 went out
+    UINT queue_depth;    // Requests waiting for a worker
+    UINT queue_depth_max;
+    ULONG latency_total; // Ticks from receive to response, over completed and timed out requests
+    ULONG latency_max;
+} AZURE_IOT_COMMAND_STATS;
+
+typedef struct AZURE_IOT_COMMAND_SERVICE_STRUCT
+{
+    NX_AZURE_IOT_HUB_CLIENT* hub_client;
+    TX_EVENT_FLAGS_GROUP* events; // Client thread events, timeout_event is set when a request timer expires
+    ULONG timeout_event;
+    bool started;
+
+    TX_QUEUE queue;
+    ULONG queue_storage[AZURE_IOT_COMMAND_QUEUE_SIZE];
+    TX_THREAD workers[AZURE_IOT_COMMAND_WORKERS];
+    ULONG worker_stacks[AZURE_IOT_COMMAND_WORKERS][AZURE_IOT_COMMAND_STACK_SIZE / sizeof(ULONG)];
+
+    AZURE_IOT_COMMAND_REQUEST requests[AZURE_IOT_COMMAND_SLOTS];
+    AZURE_IOT_COMMAND_STATS stats;
+} AZURE_IOT_COMMAND_SERVICE;
+
+/**
+ * @brief Create the queue, request timers and worker threads
+ * @param service Service to create
+ * @param hub_client Hub client the responses are sent on
+ * @param events Client thread event flags
+ * @param timeout_event Event set when a request times out, the client thread then calls azure_iot_command_timeouts
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT azure_iot_command_start(AZURE_IOT_COMMAND_SERVICE* service,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    TX_EVENT_FLAGS_GROUP* events,
+    ULONG timeout_event);
+
+/**
+ * @brief Validate and queue a long running command, called from the client thread before the packet is released
+ * @return DISPATCH_STATUS_PENDING once queued, otherwise the status to answer with straight away
+ */
+UINT azure_iot_command_submit(AZURE_IOT_COMMAND_SERVICE* service,
+    const dispatch_entry_t* entry,
+    const UCHAR* payload,
+    USHORT payload_length,
+    const VOID* context,
+    USHORT context_length);
+
+/**
+ * @brief Answer a request whose handler returned DISPATCH_STATUS_PENDING, from any thread but a timer or an ISR
+ * @param request_id The request_id of the handler argument
+ * @param status HTTP status to answer with
+ * @return NX_SUCCESS, or NX_NOT_FOUND if the request already timed out
+ */
+UINT azure_iot_command_complete(AZURE_IOT_COMMAND_SERVICE* service, ULONG request_id, UINT status);
+
+/**
+ * @brief Answer the expired requests with 504, called from the client thread on the timeout event
+ */
+VOID azure_iot_command_timeouts(AZURE_IOT_COMMAND_SERVICE* service);
+
+/**
+ * @brief Get the queue depth, completion and latency counters
+ */
+VOID azure_iot_command_stats(AZURE_IOT_COMMAND_SERVICE* service, AZURE_IOT_COMMAND_STATS* stats);
+
+#endif // _AZURE_IOT_COMMAND_H
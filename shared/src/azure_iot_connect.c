@@ -1,6 +1,7 @@
 /* Copyright (c) Microsoft Corporation.
    Licensed under the MIT License. */
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "nx_azure_iot_hub_client.h"
@@ -11,6 +12,8 @@
 #define MAX_EXPONENTIAL_BACKOFF_IN_SEC         (10 * 60)
 #define MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT (60)
 
+#define NETWORK_RETRY_TICKS (5 * TX_TIMER_TICKS_PER_SECOND)
+
 static UINT exponential_retry_count;
 
 static VOID exponential_backoff_reset()
@@ -18,7 +21,8 @@ static VOID exponential_backoff_reset()
     exponential_retry_count = 0;
 }
 
-static VOID exponential_backoff_with_jitter()
+// Returns the ticks to wait before the next connection attempt, zero for the first one
+static ULONG exponential_backoff_with_jitter()
 {
     double jitter_percent = (MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT / 100.0) * (rand() / ((double)RAND_MAX));
     UINT base_delay       = MAX_EXPONENTIAL_BACKOFF_IN_SEC;
@@ -28,7 +32,7 @@ static VOID exponential_backoff_with_jitter()
     // If the retry is 0, then we don't need to delay the first time
     if (exponential_retry_count++ == 0)
     {
-        return;
+        return 0;
     }
 
     if (exponential_retry_count < (sizeof(UINT) * 8))
@@ -52,7 +56,31 @@ static VOID exponential_backoff_with_jitter()
     backoff_seconds = (UINT)(base_delay * (1 + jitter_percent));
 
     printf("\r\nIoT connection backoff for %d seconds\r\n", backoff_seconds);
-    tx_thread_sleep(backoff_seconds * NX_IP_PERIODIC_RATE);
+    return backoff_seconds * NX_IP_PERIODIC_RATE;
+}
+
+// Arm the one-shot connection timer, the client thread gets HUB_CONNECTION_TIMER_EVENT when it expires
+static VOID connection_timer_start(AZURE_IOT_NX_CONTEXT* nx_context, ULONG ticks)
+{
+    UINT status;
+
+    if ((status = tx_timer_change(&nx_context->connection_timer, ticks, 0)))
+    {
+        printf("ERROR: tx_timer_change (0x%08x)\r\n", status);
+    }
+    else if ((status = tx_timer_activate(&nx_context->connection_timer)))
+    {
+        printf("ERROR: tx_timer_activate (0x%08x)\r\n", status);
+    }
+}
+
+static bool connection_timer_active(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    UINT active = TX_FALSE;
+
+    tx_timer_info_get(&nx_context->connection_timer, NULL, &active, NULL, NULL, NULL);
+
+    return active == TX_TRUE;
 }
 
 static void iothub_connect(AZURE_IOT_NX_CONTEXT* nx_context)
@@ -84,6 +112,68 @@ VOID connection_status_set(AZURE_IOT_NX_CONTEXT* nx_context, UINT connection_sta
     }
 }
 
+// Make one connection attempt, on failure schedule the next one and return to the event loop
+static VOID connection_attempt(
+    AZURE_IOT_NX_CONTEXT* nx_context, UINT (*iot_initialize)(AZURE_IOT_NX_CONTEXT* nx_context), UINT (*network_connect)())
+{
+    switch (nx_context->azure_iot_connection_status)
+    {
+        // Something bad has happened with client state, we need to re-initialize it
+        case NX_DNS_QUERY_FAILED:
+        case NXD_MQTT_COMMUNICATION_FAILURE:
+        case NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD:
+        case NXD_MQTT_ERROR_NOT_AUTHORIZED:
+        {
+            // Deinitialize iot hub client
+            nx_azure_iot_hub_client_deinitialize(&nx_context->iothub_client);
+
+            // The cached hub rejected the device, provision again. An unreachable hub keeps the cache.
+            if (nx_context->azure_iot_hub_from_cache && dps_cache_rejected(nx_context->azure_iot_connection_status))
+            {
+                printf("Cached DPS assignment is stale, provisioning again\r\n");
+                dps_cache_invalidate();
+                nx_context->azure_iot_hub_from_cache = false;
+            }
+        }
+
+        // Fallthrough
+        case NX_AZURE_IOT_NOT_INITIALIZED:
+        {
+            // Set the state to not initialized
+            nx_context->azure_iot_connection_status = NX_AZURE_IOT_NOT_INITIALIZED;
+
+            // Connect the network
+            if (network_connect() != NX_SUCCESS)
+            {
+                // Failed, try again when the timer fires
+                connection_timer_start(nx_context, NETWORK_RETRY_TICKS);
+                return;
+            }
+
+            // Initialize IoT Hub
+            if (iot_initialize(nx_context) == NX_SUCCESS)
+            {
+                // Connect IoT Hub
+                iothub_connect(nx_context);
+            }
+        }
+        break;
+
+        case NX_AZURE_IOT_SAS_TOKEN_EXPIRED:
+        {
+            printf("SAS token has expired\r\n");
+        }
+
+        // Fallthrough
+        default:
+        {
+            // Connect IoT Hub
+            iothub_connect(nx_context);
+        }
+        break;
+    }
+}
+
 //---------------------------------------------------------------------------------
 //
 //   +-------------+              +-------------+              +-------------+
@@ -95,10 +185,16 @@ VOID connection_status_set(AZURE_IOT_NX_CONTEXT* nx_context, UINT connection_sta
 //          |                         |     |                         |
 //          +-------------------------+     +-------------------------+
 //
+// Each transition runs from the client thread on an event. A failed attempt arms
+// the connection timer with the backoff, and its expiry drives the next attempt.
 //---------------------------------------------------------------------------------
-VOID connection_monitor(
-    AZURE_IOT_NX_CONTEXT* nx_context, UINT (*iot_initialize)(AZURE_IOT_NX_CONTEXT* nx_context), UINT (*network_connect)())
+VOID connection_monitor(AZURE_IOT_NX_CONTEXT* nx_context,
+    UINT (*iot_initialize)(AZURE_IOT_NX_CONTEXT* nx_context),
+    UINT (*network_connect)(),
+    bool timer_expired)
 {
+    ULONG backoff_ticks;
+
     // Check parameters
     if ((nx_context == NX_NULL) || (iot_initialize == NX_NULL))
     {
@@ -113,71 +209,40 @@ VOID connection_monitor(
         return;
     }
 
-    // Disconnect
-    if (nx_context->azure_iot_connection_status != NX_AZURE_IOT_NOT_INITIALIZED)
+    // A retry is already scheduled, the disconnect came from the attempt that scheduled it
+    if (!timer_expired && connection_timer_active(nx_context))
+    {
+        return;
+    }
+
+    // Disconnect, only on the way out of the connected state
+    if (!timer_expired && nx_context->azure_iot_connection_status != NX_AZURE_IOT_NOT_INITIALIZED)
     {
         nx_azure_iot_hub_client_disconnect(&nx_context->iothub_client);
     }
 
-    // Recover
-    while (true)
+    // Recover, attempts without a backoff run straight away
+    while (nx_context->azure_iot_connection_status != NX_SUCCESS)
     {
-        switch (nx_context->azure_iot_connection_status)
+        if (!timer_expired)
         {
-            // Something bad has happened with client state, we need to re-initialize it
-            case NX_DNS_QUERY_FAILED:
-            case NXD_MQTT_COMMUNICATION_FAILURE:
-            case NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD:
-            case NXD_MQTT_ERROR_NOT_AUTHORIZED:
-            {
-                // Deinitialize iot hub client
-                nx_azure_iot_hub_client_deinitialize(&nx_context->iothub_client);
-            }
-
-            // Fallthrough
-            case NX_AZURE_IOT_NOT_INITIALIZED:
-            {
-                // Set the state to not initialized
-                nx_context->azure_iot_connection_status = NX_AZURE_IOT_NOT_INITIALIZED;
-
-                // Connect the network
-                if (network_connect() != NX_SUCCESS)
-                {
-                    // Failed, sleep and break out to try again next time
-                    tx_thread_sleep(5 * TX_TIMER_TICKS_PER_SECOND);
-                    break;
-                }
-
-                // Initialize IoT Hub
-                exponential_backoff_with_jitter();
-                if (iot_initialize(nx_context) == NX_SUCCESS)
-                {
-                    // Connect IoT Hub
-                    iothub_connect(nx_context);
-                }
-            }
-            break;
-
-            case NX_AZURE_IOT_SAS_TOKEN_EXPIRED:
+            if ((backoff_ticks = exponential_backoff_with_jitter()) > 0)
             {
-                printf("SAS token has expired\r\n");
+                connection_timer_start(nx_context, backoff_ticks);
+                return;
             }
-
-            // Fallthrough
-            default:
-            {
-                // Connect IoT Hub
-                exponential_backoff_with_jitter();
-                iothub_connect(nx_context);
-            }
-            break;
         }
+        timer_expired = false;
+
+        connection_attempt(nx_context, iot_initialize, network_connect);
 
-        // Check status
-        if (nx_context->azure_iot_connection_status == NX_SUCCESS)
+        // The network is down, the timer is already armed
+        if (connection_timer_active(nx_context))
         {
-            // Success!
             return;
         }
     }
+
+    // Connected, the next outage starts a fresh backoff
+    exponential_backoff_reset();
 }
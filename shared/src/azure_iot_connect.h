@@ -4,13 +4,18 @@
 #ifndef _AZURE_IOT_CONNECT_H
 #define _AZURE_IOT_CONNECT_H
 
+#include <stdbool.h>
+
 #include "nx_api.h"
 
 #include "azure_iot_nx_client.h"
 
 VOID connection_status_set(AZURE_IOT_NX_CONTEXT* nx_context, UINT connection_status);
 
-VOID connection_monitor(
-    AZURE_IOT_NX_CONTEXT* nx_context, UINT (*iothub_init)(AZURE_IOT_NX_CONTEXT* nx_context), UINT (*network_connect)());
+// Run the connect workflow, from a connection event or the expiry of the connection timer
+VOID connection_monitor(AZURE_IOT_NX_CONTEXT* nx_context,
+    UINT (*iothub_init)(AZURE_IOT_NX_CONTEXT* nx_context),
+    UINT (*network_connect)(),
+    bool timer_expired);
 
 #endif
\ No newline at end of file
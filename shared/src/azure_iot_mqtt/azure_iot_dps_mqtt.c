@@ -3,19 +3,19 @@
 
 // https://docs.microsoft.com/azure/iot-dps/iot-dps-mqtt-support
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "azure_iot_cert.h"
 #include "azure_iot_dps_mqtt.h"
 
+#include "azure_iot_mqtt/dps_response.h"
 #include "azure_iot_mqtt/sas_token.h"
 
-#include "json_utils.h"
-
 #define AZURE_IOT_DPS_ENDPOINT "global.azure-devices-provisioning.net"
 
 #define USERNAME               "%s/registrations/%s/api-version=2019-03-31"
-#define DPS_REGISTER_BASE      "$dps/registrations/res"
 #define DPS_REGISTER_SUBSCRIBE "$dps/registrations/res/#"
 #define DPS_REGISTER_TOPIC     "$dps/registrations/PUT/iotdps-register/?$rid=1"
 #define DPS_STATUS_TOPIC       "$dps/registrations/GET/iotdps-get-operationstatus/?$rid=1&operationId="
@@ -24,89 +24,123 @@
 #define MQTT_TIMEOUT    (10 * TX_TIMER_TICKS_PER_SECOND)
 #define MQTT_KEEP_ALIVE 240
 
+#define DPS_REGISTER_TIMEOUT (60 * TX_TIMER_TICKS_PER_SECOND)
+
+// Responses parse into tokens on the stack, larger ones into a borrowed message buffer, anything bigger is rejected
+#define DPS_TOKENS_INLINE 16
+#define DPS_TOKENS_MAX    (MSG_POOL_MEDIUM_SIZE / sizeof(jsmntok_t))
+
 #define EVENT_FLAGS_SUCCESS 1
+#define EVENT_FLAGS_FAILED  2
+#define EVENT_FLAGS_RETRY   4
+#define EVENT_FLAGS_ALL     (EVENT_FLAGS_SUCCESS | EVENT_FLAGS_FAILED | EVENT_FLAGS_RETRY)
 
 extern CHAR* azure_iot_x509_hostname;
 
-static VOID process_retry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+static VOID dps_retry_timer_entry(ULONG context)
 {
-    UINT status;
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_RETRY, TX_OR);
+}
 
-    jsmn_parser parser;
-    jsmntok_t tokens[12];
-    INT token_count;
+static VOID dps_failed(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    azure_iot_mqtt->dps_state = AZURE_IOT_DPS_FAILED;
+    tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_FAILED, TX_OR);
+}
+
+// Arm the retry timer, the registering thread sends the next request when it fires
+static VOID dps_retry_schedule(AZURE_IOT_MQTT* azure_iot_mqtt, UINT retry_after)
+{
+    azure_iot_mqtt->dps_retry_after = retry_after;
+    azure_iot_mqtt->dps_state       = AZURE_IOT_DPS_RETRY_WAIT;
 
-    INT retry_interval;
-    CHAR mqtt_publish_topic[256];
+    tx_timer_deactivate(&azure_iot_mqtt->dps_retry_timer);
+    tx_timer_change(&azure_iot_mqtt->dps_retry_timer, retry_after * TX_TIMER_TICKS_PER_SECOND, 0);
+    tx_timer_activate(&azure_iot_mqtt->dps_retry_timer);
+}
 
-    CHAR* find = strstr(topic, "retry-after=");
-    if (find == 0)
+static VOID dps_response_dispatch(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+{
+    jsmn_parser parser;
+    jsmntok_t inline_tokens[DPS_TOKENS_INLINE];
+    jsmntok_t* tokens         = inline_tokens;
+    msg_medium_t* token_store = NX_NULL;
+    INT token_count;
+    dps_response_t response = {
+        .hostname          = azure_iot_mqtt->mqtt_hub_hostname,
+        .hostname_size     = AZURE_IOT_MQTT_HOSTNAME_SIZE,
+        .device_id         = azure_iot_mqtt->mqtt_device_id,
+        .device_id_size    = AZURE_IOT_MQTT_DEVICE_ID_SIZE,
+        .operation_id      = azure_iot_mqtt->dps_operation_id,
+        .operation_id_size = AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE,
+    };
+
+    if (azure_iot_mqtt->dps_state != AZURE_IOT_DPS_REGISTERING && azure_iot_mqtt->dps_state != AZURE_IOT_DPS_POLLING)
     {
-        printf("Error: Unknown retry-after\r\n");
+        printf("WARNING: Ignoring unexpected DPS response %d\r\n", dps_response_status(topic));
         return;
     }
 
-    // extract retry interval
-    retry_interval = atoi(find + 12);
-
+    // Count first, so the token storage fits the response
     jsmn_init(&parser);
-
-    token_count = jsmn_parse(&parser,
-        azure_iot_mqtt->mqtt_receive_message_buffer,
-        strlen(azure_iot_mqtt->mqtt_receive_message_buffer),
-        tokens,
-        12);
-
-    strncpy(mqtt_publish_topic, DPS_STATUS_TOPIC, sizeof(mqtt_publish_topic));
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
-            tokens,
-            token_count,
-            "operationId",
-            mqtt_publish_topic + sizeof(DPS_STATUS_TOPIC) - 1))
+    token_count = jsmn_parse(&parser, message, strlen(message), NX_NULL, 0);
+    if (token_count > DPS_TOKENS_INLINE)
     {
-        printf("ERROR: Failed to parse DPS operationId\r\n");
+        if (token_count > (INT)DPS_TOKENS_MAX || (token_store = msg_medium_acquire(TX_NO_WAIT)) == NX_NULL)
+        {
+            printf("ERROR: No room for %d DPS response tokens\r\n", token_count);
+            dps_failed(azure_iot_mqtt);
+            return;
+        }
+        tokens = (jsmntok_t*)token_store->data;
     }
 
-    tx_thread_sleep(retry_interval * TX_TIMER_TICKS_PER_SECOND);
-
-    status = mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
-    if (status != NX_SUCCESS)
+    switch (dps_response_process(
+        topic, message, tokens, token_count > DPS_TOKENS_INLINE ? token_count : DPS_TOKENS_INLINE, &response))
     {
-        printf("ERROR: Failed to poll for DPS status (0x%04x)\r\n", status);
+        case DPS_RESPONSE_ASSIGNED:
+            azure_iot_mqtt->dps_state = AZURE_IOT_DPS_ASSIGNED;
+            tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR);
+            break;
+
+        case DPS_RESPONSE_RETRY:
+            dps_retry_schedule(azure_iot_mqtt, response.retry_after);
+            break;
+
+        case DPS_RESPONSE_FAILED:
+            dps_failed(azure_iot_mqtt);
+            break;
     }
+
+    msg_medium_release(token_store);
 }
 
-static VOID process_success(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+// Send the registration, or poll its status once DPS has handed out an operation id
+static UINT dps_request_send(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
-    jsmn_parser parser;
-    jsmntok_t tokens[64];
-    INT token_count;
-
-    jsmn_init(&parser);
+    CHAR mqtt_publish_topic[sizeof(DPS_STATUS_TOPIC) + AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE];
+    CHAR mqtt_publish_payload[100];
 
-    token_count = jsmn_parse(&parser,
-        azure_iot_mqtt->mqtt_receive_message_buffer,
-        strlen(azure_iot_mqtt->mqtt_receive_message_buffer),
-        tokens,
-        64);
-
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
-            tokens,
-            token_count,
-            "assignedHub",
-            azure_iot_mqtt->mqtt_hub_hostname))
+    if (azure_iot_mqtt->dps_operation_id[0] != 0)
     {
-        printf("ERROR: DPS failed to parse hub hostname\r\n");
-    }
+        snprintf(mqtt_publish_topic,
+            sizeof(mqtt_publish_topic),
+            DPS_STATUS_TOPIC "%s",
+            azure_iot_mqtt->dps_operation_id);
 
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
-            tokens,
-            token_count,
-            "deviceId",
-            azure_iot_mqtt->mqtt_device_id))
-    {
-        printf("ERROR: DPS failed to parse device id\r\n");
+        azure_iot_mqtt->dps_state = AZURE_IOT_DPS_POLLING;
+        return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
     }
+
+    snprintf(mqtt_publish_payload,
+        sizeof(mqtt_publish_payload),
+        "{\"registrationId\":\"%s\",\"payload\":{\"modelId\":\"%s\"}}",
+        azure_iot_mqtt->mqtt_dps_registration_id,
+        azure_iot_mqtt->mqtt_model_id);
+
+    azure_iot_mqtt->dps_state = AZURE_IOT_DPS_REGISTERING;
+    return mqtt_publish(azure_iot_mqtt, DPS_REGISTER_TOPIC, mqtt_publish_payload);
 }
 
 static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
@@ -116,16 +150,24 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
     UINT status;
 
     AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr->nxd_mqtt_packet_receive_context;
+    CHAR* topic                    = azure_iot_mqtt->session->receive_topic;
+    msg_medium_t* message;
+
+    if ((message = msg_medium_acquire(AZURE_IOT_MQTT_RECEIVE_BUFFER_WAIT)) == NX_NULL)
+    {
+        printf("ERROR: No buffer for %u received DPS messages\r\n", number_of_messages);
+        return;
+    }
 
     for (UINT count = 0; count < number_of_messages; ++count)
     {
         // Get the mqtt client message
         status = nxd_mqtt_client_message_get(client_ptr,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer,
-            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH,
+            (UCHAR*)topic,
+            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH - 1,
             &actual_topic_length,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_message_buffer,
-            AZURE_IOT_MQTT_MESSAGE_LENGTH,
+            (UCHAR*)message->data,
+            sizeof(message->data) - 1,
             &actual_message_length);
         if (status != NXD_MQTT_SUCCESS)
         {
@@ -134,47 +176,32 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
         }
 
         // Append null string terminators
-        azure_iot_mqtt->mqtt_receive_topic_buffer[actual_topic_length]     = 0;
-        azure_iot_mqtt->mqtt_receive_message_buffer[actual_message_length] = 0;
+        topic[actual_topic_length]           = 0;
+        message->data[actual_message_length] = 0;
 
-        if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DPS_REGISTER_BASE) == 0)
+        if (dps_response_status(topic) == 0)
         {
-            printf("ERROR: Unknown incoming DPS topic %s\r\n", (CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer);
+            printf("ERROR: Unknown incoming DPS topic %s\r\n", topic);
             continue;
         }
 
-        // Parse the response status
-        CHAR* location = azure_iot_mqtt->mqtt_receive_topic_buffer + sizeof(DPS_REGISTER_BASE);
-        INT msg_status = atoi(location);
-
-        switch (msg_status)
-        {
-            case 202:
-                process_retry(azure_iot_mqtt,
-                    azure_iot_mqtt->mqtt_receive_topic_buffer,
-                    azure_iot_mqtt->mqtt_receive_message_buffer);
-                break;
-
-            case 200:
-                process_success(azure_iot_mqtt,
-                    azure_iot_mqtt->mqtt_receive_topic_buffer,
-                    azure_iot_mqtt->mqtt_receive_message_buffer);
-                tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR);
-                break;
-
-            default:
-                printf("ERROR: Unknown incoming DPS topic status %d\r\n", msg_status);
-                break;
-        }
+        dps_response_dispatch(azure_iot_mqtt, topic, message->data);
     }
 
-    return;
+    msg_medium_release(message);
 }
 
 UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
 {
     UINT status;
 
+    status = msg_pool_init();
+    if (status != TX_SUCCESS)
+    {
+        printf("FAIL: Unable to create message pools (0x%02x)\r\n", status);
+        return status;
+    }
+
     status = tx_event_flags_create(&azure_iot_mqtt->mqtt_event_flags, "DPS event flags");
     if (status != TX_SUCCESS)
     {
@@ -182,6 +209,20 @@ UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKE
         return false;
     }
 
+    status = tx_timer_create(&azure_iot_mqtt->dps_retry_timer,
+        "DPS retry timer",
+        dps_retry_timer_entry,
+        (ULONG)azure_iot_mqtt,
+        DPS_RESPONSE_RETRY_DEFAULT * TX_TIMER_TICKS_PER_SECOND,
+        0,
+        TX_NO_ACTIVATE);
+    if (status != TX_SUCCESS)
+    {
+        printf("FAIL: Unable to create DPS retry timer (0x%02x)\r\n", status);
+        tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
+        return status;
+    }
+
     status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
         "MQTT DPS client",
         azure_iot_mqtt->mqtt_dps_registration_id,
@@ -196,6 +237,7 @@ UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKE
     if (status)
     {
         printf("Failed to create MQTT Client (0x%02x)\r\n", status);
+        tx_timer_delete(&azure_iot_mqtt->dps_retry_timer);
         tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
         return status;
     }
@@ -204,6 +246,7 @@ UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKE
     if (status)
     {
         printf("Error in setting receive notify (0x%02x)\r\n", status);
+        tx_timer_delete(&azure_iot_mqtt->dps_retry_timer);
         tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
         nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
         return status;
@@ -223,9 +266,15 @@ UINT azure_iot_dps_delete(AZURE_IOT_MQTT* azure_iot_mqtt)
         return NX_PTR_ERROR;
     }
 
-    tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
+    // Disconnect first so no response callback can touch the timer or the flags
     nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
     nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+    tx_timer_deactivate(&azure_iot_mqtt->dps_retry_timer);
+    tx_timer_delete(&azure_iot_mqtt->dps_retry_timer);
+    tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
+
+    // The hub client takes the session next
+    azure_iot_mqtt_session_release(azure_iot_mqtt);
 
     return NX_SUCCESS;
 }
@@ -234,14 +283,22 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
 {
     UINT status;
     NXD_ADDRESS server_ip;
-    CHAR mqtt_publish_payload[100];
+    ULONG timeout = (wait == NX_WAIT_FOREVER) ? DPS_REGISTER_TIMEOUT : wait;
+    ULONG start;
+    ULONG elapsed;
+    ULONG events;
 
     printf("\tEndpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
     printf("\tId scope: %s\r\n", azure_iot_mqtt->mqtt_dps_id_scope);
     printf("\tRegistration id: %s\r\n", azure_iot_mqtt->mqtt_dps_registration_id);
 
+    if ((status = azure_iot_mqtt_session_acquire(azure_iot_mqtt)))
+    {
+        return status;
+    }
+
     // Create the nxd_mqtt_client_secure_connect & password
-    snprintf(azure_iot_mqtt->mqtt_username,
+    snprintf(azure_iot_mqtt->session->username,
         AZURE_IOT_MQTT_USERNAME_SIZE,
         USERNAME,
         azure_iot_mqtt->mqtt_dps_id_scope,
@@ -252,7 +309,7 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
             azure_iot_mqtt->mqtt_dps_id_scope,
             azure_iot_mqtt->mqtt_dps_registration_id,
             azure_iot_mqtt->unix_time_get(),
-            azure_iot_mqtt->mqtt_password,
+            azure_iot_mqtt->session->password,
             AZURE_IOT_MQTT_PASSWORD_SIZE))
     {
         printf("ERROR: Unable to generate DPS SAS token\r\n");
@@ -260,10 +317,10 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
     }
 
     status = nxd_mqtt_client_login_set(&azure_iot_mqtt->nxd_mqtt_client,
-        azure_iot_mqtt->mqtt_username,
-        strlen(azure_iot_mqtt->mqtt_username),
-        azure_iot_mqtt->mqtt_password,
-        strlen(azure_iot_mqtt->mqtt_password));
+        azure_iot_mqtt->session->username,
+        strlen(azure_iot_mqtt->session->username),
+        azure_iot_mqtt->session->password,
+        strlen(azure_iot_mqtt->session->password));
     if (status != NXD_MQTT_SUCCESS)
     {
         printf("Could not set client login (0x%04x)\r\n", status);
@@ -313,30 +370,49 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
         return status;
     }
 
-    // Create the payload
-    snprintf(mqtt_publish_payload,
-        sizeof(mqtt_publish_payload),
-        "{\"registrationId\":\"%s\",\"payload\":{\"modelId\":\"%s\"}}",
-        azure_iot_mqtt->mqtt_dps_registration_id,
-        azure_iot_mqtt->mqtt_model_id);
+    azure_iot_mqtt->dps_operation_id[0] = 0;
+    tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, ~EVENT_FLAGS_ALL, TX_AND);
 
     // Register the device
-    status = mqtt_publish(azure_iot_mqtt, DPS_REGISTER_TOPIC, mqtt_publish_payload);
+    status = dps_request_send(azure_iot_mqtt);
     if (status != NX_SUCCESS)
     {
         printf("ERROR: Failed to publish DPS registration (0x%04x)\r\n", status);
+        return status;
     }
 
-    // Wait for an event
-    ULONG events = 0;
-    tx_event_flags_get(
-        &azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR_CLEAR, &events, 30 * NX_IP_PERIODIC_RATE);
-
-    if (events != EVENT_FLAGS_SUCCESS)
+    // Responses arm the retry timer or finish the registration, each retry sends the next request from this thread
+    start = tx_time_get();
+    while ((elapsed = tx_time_get() - start) < timeout)
     {
-        printf("ERROR: Failed to resolve device from DPS\r\n");
-        return NX_NOT_SUCCESSFUL;
+        events = 0;
+        tx_event_flags_get(
+            &azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_ALL, TX_OR_CLEAR, &events, timeout - elapsed);
+
+        if (events & EVENT_FLAGS_SUCCESS)
+        {
+            return NXD_MQTT_SUCCESS;
+        }
+
+        if (events & EVENT_FLAGS_FAILED)
+        {
+            break;
+        }
+
+        if (events & EVENT_FLAGS_RETRY)
+        {
+            status = dps_request_send(azure_iot_mqtt);
+            if (status != NX_SUCCESS)
+            {
+                printf("ERROR: Failed to poll for DPS status (0x%04x)\r\n", status);
+                break;
+            }
+        }
     }
 
-    return NXD_MQTT_SUCCESS;
+    tx_timer_deactivate(&azure_iot_mqtt->dps_retry_timer);
+    azure_iot_mqtt->dps_state = AZURE_IOT_DPS_FAILED;
+
+    printf("ERROR: Failed to resolve device from DPS\r\n");
+    return NX_NOT_SUCCESSFUL;
 }
@@ -11,6 +11,8 @@
 
 UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool);
 UINT azure_iot_dps_delete(AZURE_IOT_MQTT* azure_iot_mqtt);
+// Register and wait for the assignment, responses and retry timers never block the MQTT client thread.
+// wait bounds the whole registration, NX_WAIT_FOREVER uses the default timeout.
 UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait);
 
 #endif
\ No newline at end of file
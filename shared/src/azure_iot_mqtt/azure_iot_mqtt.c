@@ -12,6 +12,7 @@
 #include "nxd_mqtt_client.h"
 
 #include "azure_iot_cert.h"
+#include "dps_cache.h"
 #include "azure_iot_mqtt/azure_iot_dps_mqtt.h"
 #include "azure_iot_mqtt/sas_token.h"
 
@@ -36,6 +37,10 @@
 #define MQTT_TIMEOUT         (10 * TX_TIMER_TICKS_PER_SECOND)
 #define MQTT_KEEP_ALIVE      240
 
+// Build time size checks, the array size goes negative when a check fails
+typedef CHAR azure_iot_mqtt_footprint_check[sizeof(AZURE_IOT_MQTT) <= AZURE_IOT_MQTT_FOOTPRINT_MAX ? 1 : -1];
+typedef CHAR azure_iot_mqtt_session_check[sizeof(AZURE_IOT_MQTT_SESSION) <= MSG_POOL_SESSION_SIZE ? 1 : -1];
+
 CHAR* azure_iot_x509_hostname;
 
 static ULONG azure_iot_certificate_verify(NX_SECURE_TLS_SESSION* session, NX_SECURE_X509_CERT* certificate)
@@ -101,6 +106,54 @@ UINT azure_iot_mqtt_register_device_twin_prop_callback(
     return NX_SUCCESS;
 }
 
+UINT azure_iot_mqtt_session_acquire(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    AZURE_IOT_MQTT_SESSION* session;
+
+    // Reconnects keep the session they have
+    if (azure_iot_mqtt->session != NX_NULL)
+    {
+        return NX_SUCCESS;
+    }
+
+    // Boards enable one session block, so a second client is refused while the first holds it
+    if ((session = (AZURE_IOT_MQTT_SESSION*)msg_pool_acquire(MSG_POOL_SESSION, TX_NO_WAIT)) == NX_NULL)
+    {
+        printf("ERROR: No MQTT session available\r\n");
+        return NX_NO_MEMORY;
+    }
+
+    if ((session->tls_packet_buffer = msg_large_acquire(TX_NO_WAIT)) == NX_NULL)
+    {
+        printf("ERROR: No TLS packet buffer available\r\n");
+        msg_pool_release(MSG_POOL_SESSION, session);
+        return NX_NO_MEMORY;
+    }
+
+    azure_iot_mqtt->session = session;
+
+    return NX_SUCCESS;
+}
+
+VOID azure_iot_mqtt_session_release(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    AZURE_IOT_MQTT_SESSION* session = azure_iot_mqtt->session;
+
+    if (session == NX_NULL)
+    {
+        return;
+    }
+
+    msg_large_release(session->tls_packet_buffer);
+    session->tls_packet_buffer = NX_NULL;
+
+    // Credentials don't outlive the connection
+    memset(session->password, 0, sizeof(session->password));
+
+    azure_iot_mqtt->session = NX_NULL;
+    msg_pool_release(MSG_POOL_SESSION, session);
+}
+
 UINT tls_setup(NXD_MQTT_CLIENT* client,
     NX_SECURE_TLS_SESSION* tls_session,
     NX_SECURE_X509_CERT* cert,
@@ -108,7 +161,8 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
 {
     UINT status;
 
-    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client->nxd_mqtt_packet_receive_context;
+    AZURE_IOT_MQTT* azure_iot_mqtt   = (AZURE_IOT_MQTT*)client->nxd_mqtt_packet_receive_context;
+    AZURE_IOT_MQTT_SESSION* session = azure_iot_mqtt->session;
 
     // Create TLS session.
     status = _nx_secure_tls_session_create_ext(tls_session,
@@ -116,8 +170,8 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         _nx_azure_iot_tls_supported_crypto_size,
         _nx_azure_iot_tls_ciphersuite_map,
         _nx_azure_iot_tls_ciphersuite_map_size,
-        azure_iot_mqtt->tls_metadata_buffer,
-        sizeof(azure_iot_mqtt->tls_metadata_buffer));
+        session->tls_metadata_buffer,
+        sizeof(session->tls_metadata_buffer));
     if (status != NX_SUCCESS)
     {
         printf("Failed to create TLS session status (0x%04x)\r\n", status);
@@ -125,9 +179,9 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
     }
 
     status = nx_secure_tls_remote_certificate_allocate(tls_session,
-        &azure_iot_mqtt->mqtt_remote_certificate,
-        azure_iot_mqtt->mqtt_remote_cert_buffer,
-        sizeof(azure_iot_mqtt->mqtt_remote_cert_buffer));
+        &session->remote_certificate,
+        session->remote_cert_buffer,
+        sizeof(session->remote_cert_buffer));
     if (status != NX_SUCCESS)
     {
         printf("Failed to create remote certificate buffer (0x%04x)\r\n", status);
@@ -156,8 +210,9 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         return status;
     }
 
-    status = nx_secure_tls_session_packet_buffer_set(
-        tls_session, azure_iot_mqtt->tls_packet_buffer, sizeof(azure_iot_mqtt->tls_packet_buffer));
+    status = nx_secure_tls_session_packet_buffer_set(tls_session,
+        session->tls_packet_buffer->data,
+        sizeof(session->tls_packet_buffer->data));
     if (status != NX_SUCCESS)
     {
         printf("Could not set TLS session packet buffer (0x%02x)\r\n", status);
@@ -357,16 +412,24 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
     UINT status;
 
     AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr->nxd_mqtt_packet_receive_context;
+    CHAR* topic                    = azure_iot_mqtt->session->receive_topic;
+    msg_medium_t* message;
+
+    if ((message = msg_medium_acquire(AZURE_IOT_MQTT_RECEIVE_BUFFER_WAIT)) == NX_NULL)
+    {
+        printf("ERROR: No buffer for %u received messages\r\n", number_of_messages);
+        return;
+    }
 
     for (UINT count = 0; count < number_of_messages; ++count)
     {
         // Get the mqtt client message
         status = nxd_mqtt_client_message_get(client_ptr,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer,
-            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH,
+            (UCHAR*)topic,
+            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH - 1,
             &actual_topic_length,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_message_buffer,
-            AZURE_IOT_MQTT_MESSAGE_LENGTH,
+            (UCHAR*)message->data,
+            sizeof(message->data) - 1,
             &actual_message_length);
         if (status != NXD_MQTT_SUCCESS)
         {
@@ -375,34 +438,36 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
         }
 
         // Append null string terminators
-        azure_iot_mqtt->mqtt_receive_topic_buffer[actual_topic_length]     = 0;
-        azure_iot_mqtt->mqtt_receive_message_buffer[actual_message_length] = 0;
+        topic[actual_topic_length]           = 0;
+        message->data[actual_message_length] = 0;
 
-        if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DIRECT_METHOD_RECEIVE))
+        if (strstr(topic, DIRECT_METHOD_RECEIVE))
         {
             process_direct_method(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
+                azure_iot_mqtt, topic, message->data);
         }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_MESSAGE_BASE))
+        else if (strstr(topic, DEVICE_MESSAGE_BASE))
         {
             process_c2d_message(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
+                azure_iot_mqtt, topic, message->data);
         }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_TWIN_RES_BASE))
+        else if (strstr(topic, DEVICE_TWIN_RES_BASE))
         {
             process_device_twin_response(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
+                azure_iot_mqtt, topic, message->data);
         }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_TWIN_DESIRED_PROP_RES_BASE))
+        else if (strstr(topic, DEVICE_TWIN_DESIRED_PROP_RES_BASE))
         {
             process_device_twin_desired_prop_update(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
+                azure_iot_mqtt, topic, message->data);
         }
         else
         {
             printf("Unknown topic received, no custom processing specified\r\n");
         }
     }
+
+    msg_medium_release(message);
 }
 
 static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
@@ -411,6 +476,13 @@ static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP*
 
     printf("\r\nInitializing MQTT Hub client\r\n");
 
+    status = msg_pool_init();
+    if (status != TX_SUCCESS)
+    {
+        printf("Failed to create message pools (0x%02x)\r\n", status);
+        return status;
+    }
+
     status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
         "MQTT client",
         azure_iot_mqtt->mqtt_device_id,
@@ -570,6 +642,17 @@ UINT azure_iot_mqtt_device_twin_request(AZURE_IOT_MQTT* azure_iot_mqtt)
     return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
 }
 
+// The cached hub rejected the device, the next create provisions again. An unreachable hub keeps the cache.
+static VOID dps_cache_check(AZURE_IOT_MQTT* azure_iot_mqtt, UINT status)
+{
+    if (azure_iot_mqtt->mqtt_hub_from_cache && dps_cache_rejected(status))
+    {
+        printf("Cached DPS assignment is stale, provisioning again on the next start\r\n");
+        dps_cache_invalidate();
+        azure_iot_mqtt->mqtt_hub_from_cache = false;
+    }
+}
+
 UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
     NX_IP* nx_ip,
     NX_PACKET_POOL* nx_pool,
@@ -617,6 +700,9 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     CHAR* iot_model_id)
 {
     UINT status;
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE];
+    UINT hostname_length;
+    UINT device_id_length;
 
     printf("\r\nInitializing MQTT DPS client\r\n");
 
@@ -642,6 +728,27 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     azure_iot_mqtt->mqtt_sas_key             = iot_sas_key;
     azure_iot_mqtt->mqtt_model_id            = iot_model_id;
 
+    // Skip the registration when the last assignment is still valid
+    dps_cache_fingerprint(iot_dps_id_scope,
+        strlen(iot_dps_id_scope),
+        iot_registration_id,
+        strlen(iot_registration_id),
+        (UCHAR*)iot_sas_key,
+        strlen(iot_sas_key),
+        fingerprint);
+    if (dps_cache_load(fingerprint,
+            azure_iot_mqtt->mqtt_hub_hostname,
+            AZURE_IOT_MQTT_HOSTNAME_SIZE,
+            &hostname_length,
+            azure_iot_mqtt->mqtt_device_id,
+            AZURE_IOT_MQTT_DEVICE_ID_SIZE,
+            &device_id_length) == NX_SUCCESS)
+    {
+        printf("SUCCESS: Using cached DPS assignment\r\n");
+        azure_iot_mqtt->mqtt_hub_from_cache = true;
+        return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
+    }
+
     // Setup DPS
     status = azure_iot_dps_create(azure_iot_mqtt, nx_ip, nx_pool);
     if (status != NX_SUCCESS)
@@ -667,6 +774,17 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
 
     printf("SUCCESS: MQTT DPS client initialized\r\n");
 
+    // A failed store only costs a registration on the next start
+    if ((status = dps_cache_store(fingerprint,
+             azure_iot_mqtt->mqtt_hub_hostname,
+             strlen(azure_iot_mqtt->mqtt_hub_hostname),
+             azure_iot_mqtt->mqtt_device_id,
+             strlen(azure_iot_mqtt->mqtt_device_id))) &&
+        status != NX_NOT_IMPLEMENTED)
+    {
+        printf("WARNING: Failed to cache the DPS assignment (0x%04x)\r\n", status);
+    }
+
     // call into common code
     return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
 }
@@ -676,6 +794,8 @@ UINT azure_iot_mqtt_delete(AZURE_IOT_MQTT* azure_iot_mqtt)
     nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
     nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
 
+    azure_iot_mqtt_session_release(azure_iot_mqtt);
+
     return NXD_MQTT_SUCCESS;
 }
 
@@ -689,8 +809,13 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
     printf("\tDevice id: %s\r\n", azure_iot_mqtt->mqtt_device_id);
     printf("\tModel id: %s\r\n", azure_iot_mqtt->mqtt_model_id);
 
+    if ((status = azure_iot_mqtt_session_acquire(azure_iot_mqtt)))
+    {
+        return status;
+    }
+
     // Create the username & password
-    snprintf(azure_iot_mqtt->mqtt_username,
+    snprintf(azure_iot_mqtt->session->username,
         AZURE_IOT_MQTT_USERNAME_SIZE,
         USERNAME,
         azure_iot_mqtt->mqtt_hub_hostname,
@@ -702,7 +827,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
             azure_iot_mqtt->mqtt_hub_hostname,
             azure_iot_mqtt->mqtt_device_id,
             azure_iot_mqtt->unix_time_get(),
-            azure_iot_mqtt->mqtt_password,
+            azure_iot_mqtt->session->password,
             AZURE_IOT_MQTT_PASSWORD_SIZE))
     {
         printf("ERROR: Unable to generate SAS token\r\n");
@@ -710,10 +835,10 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
     }
 
     status = nxd_mqtt_client_login_set(&azure_iot_mqtt->nxd_mqtt_client,
-        azure_iot_mqtt->mqtt_username,
-        strlen(azure_iot_mqtt->mqtt_username),
-        azure_iot_mqtt->mqtt_password,
-        strlen(azure_iot_mqtt->mqtt_password));
+        azure_iot_mqtt->session->username,
+        strlen(azure_iot_mqtt->session->username),
+        azure_iot_mqtt->session->password,
+        strlen(azure_iot_mqtt->session->password));
     if (status != NXD_MQTT_SUCCESS)
     {
         printf("Could not create Login Set (0x%02x)\r\n", status);
@@ -748,6 +873,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
     {
         printf("Could not connect to MQTT server (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
+        dps_cache_check(azure_iot_mqtt, status);
         return status;
     }
 
@@ -13,19 +13,24 @@
 #include "nxd_mqtt_client.h"
 
 #include "azure_iot_ciphersuites.h"
+#include "msg_pool.h"
 
 #define AZURE_IOT_MQTT_HOSTNAME_SIZE           100
 #define AZURE_IOT_MQTT_DEVICE_ID_SIZE          64
 #define AZURE_IOT_MQTT_USERNAME_SIZE           256
 #define AZURE_IOT_MQTT_PASSWORD_SIZE           256
 #define AZURE_IOT_MQTT_TOPIC_NAME_LENGTH       256
-#define AZURE_IOT_MQTT_MESSAGE_LENGTH          1024
 #define AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE 6
+#define AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE   64
 
 #define AZURE_IOT_MQTT_CLIENT_STACK_SIZE 4096
 #define AZURE_IOT_MQTT_CERT_BUFFER_SIZE 4096
 
-#define TLS_PACKET_BUFFER 4096
+// Upper bound of sizeof(AZURE_IOT_MQTT), checked at build time so connection buffers don't creep back into the client
+#define AZURE_IOT_MQTT_FOOTPRINT_MAX (sizeof(NXD_MQTT_CLIENT) + AZURE_IOT_MQTT_CLIENT_STACK_SIZE + 768)
+
+// How long a receive callback waits for a message buffer before dropping the batch
+#define AZURE_IOT_MQTT_RECEIVE_BUFFER_WAIT (5 * TX_TIMER_TICKS_PER_SECOND)
 
 #define MQTT_QOS_0 0 // QoS 0 - Deliver at most once
 #define MQTT_QOS_1 1 // QoS 1 - Deliver at least once
@@ -33,6 +38,32 @@
 
 typedef struct AZURE_IOT_MQTT_STRUCT AZURE_IOT_MQTT;
 
+// Buffers only needed while a client has a connection, borrowed from the MSG_POOL_SESSION class from the first
+// connect until the client is deleted. With one session block the DPS client and the hub client take it in turn.
+typedef struct AZURE_IOT_MQTT_SESSION_STRUCT
+{
+    CHAR username[AZURE_IOT_MQTT_USERNAME_SIZE];
+    CHAR password[AZURE_IOT_MQTT_PASSWORD_SIZE];
+    CHAR receive_topic[AZURE_IOT_MQTT_TOPIC_NAME_LENGTH];
+
+    ULONG tls_metadata_buffer[NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE / sizeof(ULONG)];
+    msg_large_t* tls_packet_buffer; // Taken from the message pool with the session
+
+    NX_SECURE_X509_CERT remote_certificate;
+    UCHAR remote_cert_buffer[AZURE_IOT_MQTT_CERT_BUFFER_SIZE];
+} AZURE_IOT_MQTT_SESSION;
+
+// DPS registration steps, see azure_iot_dps_register
+typedef enum
+{
+    AZURE_IOT_DPS_IDLE,
+    AZURE_IOT_DPS_REGISTERING, // Registration sent, waiting for the response
+    AZURE_IOT_DPS_RETRY_WAIT,  // Retry timer armed, the next request goes out when it fires
+    AZURE_IOT_DPS_POLLING,     // Operation status requested, waiting for the response
+    AZURE_IOT_DPS_ASSIGNED,
+    AZURE_IOT_DPS_FAILED
+} AZURE_IOT_DPS_STATE;
+
 typedef void (*func_ptr_direct_method)(AZURE_IOT_MQTT*, CHAR*, CHAR*);
 typedef void (*func_ptr_c2d_message)(AZURE_IOT_MQTT*, CHAR*, CHAR*);
 typedef void (*func_ptr_device_twin_desired_prop)(AZURE_IOT_MQTT*, CHAR*);
@@ -46,7 +77,6 @@ struct AZURE_IOT_MQTT_STRUCT
 
     // TX_MUTEX mqtt_mutex;
     TX_EVENT_FLAGS_GROUP mqtt_event_flags;
-    UINT mqtt_dps_status;
 
     // Hub config
     CHAR mqtt_hub_hostname[AZURE_IOT_MQTT_HOSTNAME_SIZE];
@@ -54,31 +84,26 @@ struct AZURE_IOT_MQTT_STRUCT
     // DPS config
     CHAR* mqtt_dps_id_scope;
     CHAR* mqtt_dps_registration_id;
+    bool mqtt_hub_from_cache; // The hub config came from the DPS cache rather than a registration
 
     // Device config
     CHAR mqtt_device_id[AZURE_IOT_MQTT_DEVICE_ID_SIZE];
     CHAR* mqtt_sas_key;
     CHAR* mqtt_model_id;
 
-    UINT dps_retry_interval;
+    // DPS registration, advanced by the response callback and the retry timer
+    AZURE_IOT_DPS_STATE dps_state;
+    TX_TIMER dps_retry_timer;
+    UINT dps_retry_after; // Seconds, from the last response
+    CHAR dps_operation_id[AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE];
 
     UINT reported_property_version;
     UINT desired_property_version;
     CHAR direct_command_request_id[AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE];
 
-    CHAR mqtt_username[AZURE_IOT_MQTT_USERNAME_SIZE];
-    CHAR mqtt_password[AZURE_IOT_MQTT_PASSWORD_SIZE];
-
-    CHAR mqtt_receive_topic_buffer[AZURE_IOT_MQTT_TOPIC_NAME_LENGTH];
-    CHAR mqtt_receive_message_buffer[AZURE_IOT_MQTT_MESSAGE_LENGTH];
-
     ULONG mqtt_client_stack[AZURE_IOT_MQTT_CLIENT_STACK_SIZE / sizeof(ULONG)];
 
-    ULONG tls_metadata_buffer[NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE / sizeof(ULONG)];
-    UCHAR tls_packet_buffer[TLS_PACKET_BUFFER];
-
-    NX_SECURE_X509_CERT mqtt_remote_certificate;	
-    UCHAR mqtt_remote_cert_buffer[AZURE_IOT_MQTT_CERT_BUFFER_SIZE];
+    AZURE_IOT_MQTT_SESSION* session; // NULL until the first connect
 
     func_ptr_direct_method cb_ptr_mqtt_invoke_direct_method;
     func_ptr_c2d_message cb_ptr_mqtt_c2d_message;
@@ -102,6 +127,10 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
     NX_SECURE_X509_CERT* cert,
     NX_SECURE_X509_CERT* trusted_cert);
 
+// Borrow a session from the message pools, NX_NO_MEMORY while another client holds the last one
+UINT azure_iot_mqtt_session_acquire(AZURE_IOT_MQTT* azure_iot_mqtt);
+VOID azure_iot_mqtt_session_release(AZURE_IOT_MQTT* azure_iot_mqtt);
+
 UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message);
 
 UINT azure_iot_mqtt_publish_float_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value);
@@ -0,0 +1,120 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "dps_response.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_utils.h"
+
+int dps_response_status(const char* topic)
+{
+    if (strncmp(topic, DPS_RESPONSE_BASE "/", sizeof(DPS_RESPONSE_BASE)) != 0)
+    {
+        return 0;
+    }
+
+    return atoi(topic + sizeof(DPS_RESPONSE_BASE));
+}
+
+unsigned int dps_response_retry_after(const char* topic)
+{
+    const char* find = strstr(topic, "retry-after=");
+    int retry_after  = find ? atoi(find + 12) : DPS_RESPONSE_RETRY_DEFAULT;
+
+    if (retry_after <= 0)
+    {
+        return 1;
+    }
+
+    if (retry_after > DPS_RESPONSE_RETRY_MAX)
+    {
+        return DPS_RESPONSE_RETRY_MAX;
+    }
+
+    return retry_after;
+}
+
+// A registration or operation status body, 200 and 202 both carry the operation status
+static dps_response_action_t dps_operation_process(
+    const char* topic, const char* message, jsmntok_t* tokens, int token_size, dps_response_t* response)
+{
+    jsmn_parser parser;
+    int token_count;
+    char status[16];
+
+    jsmn_init(&parser);
+    token_count = jsmn_parse(&parser, message, strlen(message), tokens, token_size);
+    if (token_count <= 0)
+    {
+        printf("ERROR: Failed to parse DPS response\r\n");
+        return DPS_RESPONSE_FAILED;
+    }
+
+    if (!findJsonString(message, tokens, token_count, "status", status, sizeof(status)))
+    {
+        printf("ERROR: DPS response has no status\r\n");
+        return DPS_RESPONSE_FAILED;
+    }
+
+    if (strcmp(status, "assigned") == 0)
+    {
+        if (!findJsonString(message, tokens, token_count, "assignedHub", response->hostname, response->hostname_size))
+        {
+            printf("ERROR: DPS failed to parse hub hostname\r\n");
+            return DPS_RESPONSE_FAILED;
+        }
+
+        if (!findJsonString(message, tokens, token_count, "deviceId", response->device_id, response->device_id_size))
+        {
+            printf("ERROR: DPS failed to parse device id\r\n");
+            return DPS_RESPONSE_FAILED;
+        }
+
+        return DPS_RESPONSE_ASSIGNED;
+    }
+
+    if (strcmp(status, "assigning") == 0 || strcmp(status, "unassigned") == 0)
+    {
+        if (!findJsonString(
+                message, tokens, token_count, "operationId", response->operation_id, response->operation_id_size))
+        {
+            printf("ERROR: Failed to parse DPS operationId\r\n");
+            return DPS_RESPONSE_FAILED;
+        }
+
+        response->retry_after = dps_response_retry_after(topic);
+        return DPS_RESPONSE_RETRY;
+    }
+
+    // failed or disabled, retrying won't change the outcome
+    printf("ERROR: DPS registration %s\r\n", status);
+    return DPS_RESPONSE_FAILED;
+}
+
+dps_response_action_t dps_response_process(
+    const char* topic, const char* message, jsmntok_t* tokens, int token_size, dps_response_t* response)
+{
+    int status = dps_response_status(topic);
+
+    switch (status)
+    {
+        case 200:
+        case 202:
+            return dps_operation_process(topic, message, tokens, token_size, response);
+
+        // Throttled or a transient service error, send the same request again later
+        case 429:
+        case 500:
+        case 503:
+            printf("WARNING: DPS responded %d, retrying\r\n", status);
+            response->retry_after = dps_response_retry_after(topic);
+            return DPS_RESPONSE_RETRY;
+
+        default:
+            printf("ERROR: DPS responded %d %s\r\n", status, message);
+            return DPS_RESPONSE_FAILED;
+    }
+}
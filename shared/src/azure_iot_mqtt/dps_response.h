@@ -0,0 +1,60 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _DPS_RESPONSE_H
+#define _DPS_RESPONSE_H
+
+#include <stdbool.h>
+
+#include "jsmn.h"
+
+// Decides what a DPS registration response means for the registration. It has no ThreadX or NetX dependency, the
+// MQTT client arms the retry timer and raises the events from the result.
+
+#define DPS_RESPONSE_BASE          "$dps/registrations/res"
+#define DPS_RESPONSE_RETRY_DEFAULT 3 // Seconds, when a response carries no retry-after
+#define DPS_RESPONSE_RETRY_MAX     60
+
+typedef enum
+{
+    DPS_RESPONSE_ASSIGNED, // hostname and device_id are set
+    DPS_RESPONSE_RETRY,    // Send the next request after retry_after seconds, polling operation_id if it is set
+    DPS_RESPONSE_FAILED    // Retrying won't change the outcome
+} dps_response_action_t;
+
+// Caller owned buffers the response is copied into, each is left untouched unless its field is found
+typedef struct
+{
+    char* hostname;
+    int hostname_size;
+    char* device_id;
+    int device_id_size;
+    char* operation_id;
+    int operation_id_size;
+    unsigned int retry_after; // Seconds, set for DPS_RESPONSE_RETRY
+} dps_response_t;
+
+/**
+ * @brief Get the status code from a response topic
+ * @return The status code, 0 if the topic is not a registration response
+ */
+int dps_response_status(const char* topic);
+
+/**
+ * @brief Get the retry interval from a response topic, bounded to 1 to DPS_RESPONSE_RETRY_MAX seconds
+ */
+unsigned int dps_response_retry_after(const char* topic);
+
+/**
+ * @brief Decide the next step of the registration from a response
+ * @param topic Response topic, null terminated
+ * @param message Response body, null terminated
+ * @param tokens Token storage for the body
+ * @param token_size Number of tokens that fit, a body needing more fails the registration
+ * @param response Receives the assignment, operation id and retry interval
+ * @return The next step
+ */
+dps_response_action_t dps_response_process(
+    const char* topic, const char* message, jsmntok_t* tokens, int token_size, dps_response_t* response);
+
+#endif // _DPS_RESPONSE_H
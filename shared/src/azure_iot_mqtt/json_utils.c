@@ -26,7 +26,8 @@ bool findJsonInt(const char* json, jsmntok_t* tokens, int tokens_count, const ch
     return false;
 }
 
-bool findJsonString(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value)
+bool findJsonString(
+    const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value, int value_size)
 {
     int key_len;
     int value_len;
@@ -38,6 +39,11 @@ bool findJsonString(const char* json, jsmntok_t* tokens, int tokens_count, const
             if (((int)strlen(s) == key_len) && (strncmp(json + tokens[i].start, s, key_len) == 0))
             {
                 value_len = tokens[i + 1].end - tokens[i + 1].start;
+                if (value_len >= value_size)
+                {
+                    return false;
+                }
+
                 strncpy(value, json + tokens[i + 1].start, value_len);
                 value[value_len] = 0;
 
@@ -9,6 +9,8 @@
 #include "jsmn.h"
 
 bool findJsonInt(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, int* value);
-bool findJsonString(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value);
+// Copies the value null terminated, false if it is missing or doesn't fit value_size
+bool findJsonString(
+    const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value, int value_size);
 
 #endif
\ No newline at end of file
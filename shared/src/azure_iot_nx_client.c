@@ -11,11 +11,13 @@
 #include "azure_iot_cert.h"
 #include "azure_iot_ciphersuites.h"
 #include "azure_iot_connect.h"
+#include "msg_pool.h"
+#include "profiler.h"
 
 #define NX_AZURE_IOT_THREAD_PRIORITY 4
 
 // Incoming events from the middleware
-#define HUB_ALL_EVENTS                        0xFF
+#define HUB_ALL_EVENTS                        0x3FF
 #define HUB_CONNECT_EVENT                     0x01
 #define HUB_DISCONNECT_EVENT                  0x02
 #define HUB_COMMAND_RECEIVE_EVENT             0x04
@@ -23,6 +25,9 @@
 #define HUB_WRITABLE_PROPERTIES_RECEIVE_EVENT 0x10
 #define HUB_PROPERTIES_COMPLETE_EVENT         0x20
 #define HUB_PERIODIC_TIMER_EVENT              0x40
+#define HUB_CONNECTION_TIMER_EVENT            0x80
+#define HUB_PROPERTIES_FLUSH_EVENT            0x100
+#define HUB_COMMAND_TIMEOUT_EVENT             0x200
 
 #define AZURE_IOT_DPS_ENDPOINT "global.azure-devices-provisioning.net"
 
@@ -34,8 +39,6 @@
 #define DPS_REGISTER_TIMEOUT_TICKS (30 * TX_TIMER_TICKS_PER_SECOND)
 
 #define DPS_PAYLOAD_SIZE       (15 + 128)
-#define TELEMETRY_BUFFER_SIZE  256
-#define PROPERTIES_BUFFER_SIZE 128
 
 // define static strings for content type and -encoding on message property bag
 static const UCHAR content_type_property[]     = "$.ct";
@@ -43,9 +46,6 @@ static const UCHAR content_encoding_property[] = "$.ce";
 static const UCHAR content_type_json[]         = "application%2Fjson";
 static const UCHAR content_encoding_utf8[]     = "utf-8";
 
-static UCHAR telemetry_buffer[TELEMETRY_BUFFER_SIZE];
-static UCHAR properties_buffer[PROPERTIES_BUFFER_SIZE];
-
 static VOID printf_packet(CHAR* prepend, NX_PACKET* packet_ptr)
 {
     printf("%s", prepend);
@@ -101,6 +101,52 @@ static VOID periodic_timer_entry(ULONG context)
     tx_event_flags_set(&nx_context->events, HUB_PERIODIC_TIMER_EVENT, TX_OR);
 }
 
+static VOID connection_timer_entry(ULONG context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    tx_event_flags_set(&nx_context->events, HUB_CONNECTION_TIMER_EVENT, TX_OR);
+}
+
+static VOID reported_properties_response_callback(
+    NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, UINT request_id, UINT response_status, ULONG version, VOID* args)
+{
+    TX_INTERRUPT_SAVE_AREA
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)args;
+    UINT property_count              = 0;
+    ULONG sent_time                  = 0;
+
+    TX_DISABLE
+    for (UINT i = 0; i < AZURE_IOT_PROPERTY_PENDING_SIZE; i++)
+    {
+        AZURE_IOT_PROPERTY_REQUEST* request = &nx_context->property_requests[i];
+        if (request->sent_time != 0 && request->request_id == request_id)
+        {
+            property_count     = request->property_count;
+            sent_time          = request->sent_time;
+            request->sent_time = 0;
+            break;
+        }
+    }
+    if ((response_status < 200) || (response_status >= 300))
+    {
+        nx_context->property_failures++;
+    }
+    TX_RESTORE
+
+    if ((response_status < 200) || (response_status >= 300))
+    {
+        printf("Error: Property request %u response status failed (%u)\r\n", request_id, response_status);
+    }
+    else if (sent_time != 0)
+    {
+        printf("Properties acknowledged: request %u, %u properties, version %lu, %lu ticks\r\n",
+            request_id,
+            property_count,
+            version,
+            tx_time_get() - sent_time);
+    }
+}
+
 static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
@@ -179,6 +225,13 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
         printf("Error: failed on connection_status_callback (0x%08x)\r\n", status);
     }
 
+    // Reported property responses complete asynchronously
+    else if ((status = nx_azure_iot_hub_client_reported_properties_response_callback_set(
+                  &nx_context->iothub_client, reported_properties_response_callback, (VOID*)nx_context)))
+    {
+        printf("Error: reported properties response callback set (0x%08x)\r\n", status);
+    }
+
     // Enable commands
     else if ((status = nx_azure_iot_hub_client_command_enable(&nx_context->iothub_client)))
     {
@@ -236,10 +289,32 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
     return status;
 }
 
+// The cached assignment is only valid for the scope, registration id and credential it was provisioned with
+static VOID dps_fingerprint(AZURE_IOT_NX_CONTEXT* nx_context, UCHAR* fingerprint)
+{
+    const UCHAR* credential = (const UCHAR*)nx_context->azure_iot_device_sas_key;
+    UINT credential_length  = nx_context->azure_iot_device_sas_key_len;
+
+    if (nx_context->azure_iot_auth_mode == AZURE_IOT_AUTH_MODE_CERT)
+    {
+        credential        = nx_context->device_certificate.nx_secure_x509_certificate_raw_data;
+        credential_length = nx_context->device_certificate.nx_secure_x509_certificate_raw_data_length;
+    }
+
+    dps_cache_fingerprint(nx_context->azure_iot_dps_id_scope,
+        nx_context->azure_iot_dps_id_scope_len,
+        nx_context->azure_iot_dps_registration_id,
+        nx_context->azure_iot_dps_registration_id_len,
+        credential,
+        credential_length,
+        fingerprint);
+}
+
 static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
     CHAR payload[DPS_PAYLOAD_SIZE];
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE];
 
     if (nx_context == NULL)
     {
@@ -254,6 +329,23 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
         return NX_PTR_ERROR;
     }
 
+    // Skip the registration when the last assignment is still valid
+    dps_fingerprint(nx_context, fingerprint);
+    if (dps_cache_load(fingerprint,
+            nx_context->azure_iot_hub_hostname,
+            sizeof(nx_context->azure_iot_hub_hostname),
+            &nx_context->azure_iot_hub_hostname_len,
+            nx_context->azure_iot_hub_device_id,
+            sizeof(nx_context->azure_iot_hub_device_id),
+            &nx_context->azure_iot_hub_device_id_len) == NX_SUCCESS)
+    {
+        printf("\r\nUsing cached DPS assignment\r\n");
+        nx_context->azure_iot_hub_from_cache = true;
+        return iot_hub_initialize(nx_context);
+    }
+
+    nx_context->azure_iot_hub_from_cache = false;
+
     printf("\r\nInitializing Azure IoT DPS client\r\n");
     printf("\tDPS endpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
     printf("\tDPS ID scope: %.*s\r\n", nx_context->azure_iot_dps_id_scope_len, nx_context->azure_iot_dps_id_scope);
@@ -366,6 +458,17 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 
     printf("SUCCESS: Azure IoT DPS client initialized\r\n");
 
+    // A failed store only costs a registration on the next start
+    if ((status = dps_cache_store(fingerprint,
+             nx_context->azure_iot_hub_hostname,
+             nx_context->azure_iot_hub_hostname_len,
+             nx_context->azure_iot_hub_device_id,
+             nx_context->azure_iot_hub_device_id_len)) &&
+        status != NX_NOT_IMPLEMENTED)
+    {
+        printf("WARNING: failed to cache the DPS assignment (0x%08x)\r\n", status);
+    }
+
     return iot_hub_initialize(nx_context);
 }
 
@@ -384,14 +487,27 @@ static VOID process_connect(AZURE_IOT_NX_CONTEXT* nx_context)
     {
         printf("ERROR: tx_timer_activate (0x%08x)\r\n", status);
     }
+
+    // Send what was staged while disconnected
+    if (nx_context->property_stage.count > 0)
+    {
+        tx_event_flags_set(&nx_context->events, HUB_PROPERTIES_FLUSH_EVENT, TX_OR);
+    }
 }
 
 static VOID process_disconnect(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
 
+    TX_INTERRUPT_SAVE_AREA
+
     printf("Disconnected from IoT Hub\r\n");
 
+    // Responses to in flight requests will not arrive, staged properties are kept for the next connection
+    TX_DISABLE
+    memset(nx_context->property_requests, 0, sizeof(nx_context->property_requests));
+    TX_RESTORE
+
     // Stop the periodic timer
     if ((status = tx_timer_deactivate(&nx_context->periodic_timer)))
     {
@@ -407,6 +523,46 @@ static VOID process_properties_complete(AZURE_IOT_NX_CONTEXT* nx_context)
     }
 }
 
+// Answer a declared or unknown command, errors carry a short reason
+static VOID command_respond(
+    AZURE_IOT_NX_CONTEXT* nx_context, UINT command_status, VOID* context_ptr, USHORT context_length)
+{
+    static const CHAR bad_request[] = "{\"error\":\"invalid payload\"}";
+    static const CHAR not_found[]   = "{\"error\":\"unknown command\"}";
+    static const CHAR unavailable[] = "{\"error\":\"busy\"}";
+    const CHAR* payload             = NX_NULL;
+    UINT payload_length             = 0;
+    UINT status;
+
+    if (command_status == DISPATCH_STATUS_BAD_REQUEST)
+    {
+        payload        = bad_request;
+        payload_length = sizeof(bad_request) - 1;
+    }
+    else if (command_status == DISPATCH_STATUS_NOT_FOUND)
+    {
+        printf("Command is not declared for this device\r\n");
+        payload        = not_found;
+        payload_length = sizeof(not_found) - 1;
+    }
+    else if (command_status == DISPATCH_STATUS_UNAVAILABLE)
+    {
+        payload        = unavailable;
+        payload_length = sizeof(unavailable) - 1;
+    }
+
+    if ((status = nx_azure_iot_hub_client_command_message_response(&nx_context->iothub_client,
+             command_status,
+             context_ptr,
+             context_length,
+             (const UCHAR*)payload,
+             payload_length,
+             NX_WAIT_FOREVER)))
+    {
+        printf("ERROR: command response failed (0x%08x)\r\n", status);
+    }
+}
+
 static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
@@ -419,6 +575,8 @@ static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
     UCHAR* payload_ptr;
     USHORT payload_length;
     NX_PACKET* packet_ptr;
+    const dispatch_entry_t* entry;
+    UINT command_status;
 
     while ((status = nx_azure_iot_hub_client_command_message_receive(&nx_context->iothub_client,
                 &component_name_ptr,
@@ -436,7 +594,37 @@ static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
         payload_ptr    = packet_ptr->nx_packet_prepend_ptr;
         payload_length = packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr;
 
-        if (nx_context->command_received_cb)
+        entry = dispatch_find(&nx_context->commands,
+            (const CHAR*)component_name_ptr,
+            component_name_length,
+            (const CHAR*)command_name_ptr,
+            command_name_length);
+
+        if (entry != NULL && entry->long_running && nx_context->command_service != NULL)
+        {
+            // Copied and queued, a worker answers once the handler is done
+            command_status = azure_iot_command_submit(
+                nx_context->command_service, entry, payload_ptr, payload_length, context_ptr, context_length);
+
+            if (command_status != DISPATCH_STATUS_PENDING)
+            {
+                command_respond(nx_context, command_status, context_ptr, context_length);
+            }
+        }
+        else if (entry != NULL || nx_context->command_received_cb == NULL)
+        {
+            command_status = entry ? dispatch_run(entry, (const CHAR*)payload_ptr, payload_length)
+                                   : DISPATCH_STATUS_NOT_FOUND;
+
+            // Only a queued request can be completed later
+            if (command_status == DISPATCH_STATUS_PENDING)
+            {
+                command_status = DISPATCH_STATUS_ERROR;
+            }
+
+            command_respond(nx_context, command_status, context_ptr, context_length);
+        }
+        else
         {
             nx_context->command_received_cb(nx_context,
                 component_name_ptr,
@@ -461,6 +649,59 @@ static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
     }
 }
 
+// Run a declared writable property and acknowledge it, a rejected value is acknowledged with its error status
+static VOID property_dispatch(AZURE_IOT_NX_CONTEXT* nx_context,
+    const dispatch_entry_t* entry,
+    NX_AZURE_IOT_JSON_READER* json_reader,
+    ULONG version)
+{
+    dispatch_arg_t arg = {.type = entry->type};
+    AZURE_IOT_PROPERTY ack = {
+        .component_name = (CHAR*)entry->component,
+        .property_name  = (CHAR*)entry->name,
+        .version        = version,
+    };
+    UINT boolean;
+    int32_t value;
+    UINT status = DISPATCH_STATUS_BAD_REQUEST;
+
+    if (entry->type == DISPATCH_ARG_BOOL)
+    {
+        if (nx_azure_iot_json_reader_token_bool_get(json_reader, &boolean) == NX_AZURE_IOT_SUCCESS)
+        {
+            arg.boolean = boolean;
+            status      = dispatch_check(entry, &arg);
+        }
+
+        ack.type  = AZURE_IOT_PROPERTY_WRITABLE_BOOL;
+        ack.value = arg.boolean;
+    }
+    else if (entry->type == DISPATCH_ARG_INT)
+    {
+        if (nx_azure_iot_json_reader_token_int32_get(json_reader, &value) == NX_AZURE_IOT_SUCCESS)
+        {
+            arg.integer = value;
+            status      = dispatch_check(entry, &arg);
+        }
+
+        ack.type  = AZURE_IOT_PROPERTY_WRITABLE_INT;
+        ack.value = arg.integer;
+    }
+    else
+    {
+        printf("ERROR: writable property %s must be bool or int\r\n", entry->name);
+        return;
+    }
+
+    if (status == DISPATCH_STATUS_OK)
+    {
+        status = entry->handler(&arg, entry->context);
+    }
+
+    ack.http_status = status;
+    property_stage_put(&nx_context->property_stage, &ack);
+}
+
 static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
     NX_PACKET* packet_ptr,
     UINT message_type,
@@ -475,6 +716,7 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
     UINT property_name_length;
     ULONG properties_version;
     NX_AZURE_IOT_JSON_READER json_reader;
+    const dispatch_entry_t* entry;
 
     if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
     {
@@ -516,13 +758,26 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
 
         nx_azure_iot_json_reader_next_token(&json_reader);
 
-        property_received_cb(nx_context,
-            component_name_ptr,
+        entry = dispatch_find(&nx_context->writable_properties,
+            (const CHAR*)component_name_ptr,
             component_name_length,
-            scratch_buffer,
-            property_name_length,
-            &json_reader,
-            properties_version);
+            (const CHAR*)scratch_buffer,
+            property_name_length);
+
+        if (entry != NULL)
+        {
+            property_dispatch(nx_context, entry, &json_reader, properties_version);
+        }
+        else if (property_received_cb != NULL)
+        {
+            property_received_cb(nx_context,
+                component_name_ptr,
+                component_name_length,
+                scratch_buffer,
+                property_name_length,
+                &json_reader,
+                properties_version);
+        }
 
         // If we are still looking at the value, then skip over it (including if it has children)
         if (nx_azure_iot_json_reader_token_type(&json_reader) == NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT)
@@ -549,19 +804,23 @@ static VOID process_properties(AZURE_IOT_NX_CONTEXT* nx_context)
 
     printf_packet("Receive properties: ", packet_ptr);
 
-    if (nx_context->property_received_cb)
+    if (nx_context->property_received_cb || nx_context->writable_properties.count > 0)
     {
+        msg_small_t* properties_buffer = msg_small_acquire(NX_WAIT_FOREVER);
+
         // Parse the writable properties from the device twin receive receive message
         if ((status = process_properties_shared(nx_context,
                  packet_ptr,
                  NX_AZURE_IOT_HUB_PROPERTIES,
                  NX_AZURE_IOT_HUB_CLIENT_PROPERTY_WRITABLE,
-                 properties_buffer,
-                 sizeof(properties_buffer),
+                 (UCHAR*)properties_buffer->data,
+                 sizeof(properties_buffer->data),
                  nx_context->property_received_cb)))
         {
             printf("Error: failed to parse properties (0x%08x)\r\n", status);
         }
+
+        msg_small_release(properties_buffer);
     }
 
     // Release the received packet, as ownership was passed to the application from the middleware
@@ -585,19 +844,23 @@ static VOID process_writable_properties(AZURE_IOT_NX_CONTEXT* nx_context)
 
     printf_packet("Receive properties: ", packet_ptr);
 
-    if (nx_context->writable_property_received_cb)
+    if (nx_context->writable_property_received_cb || nx_context->writable_properties.count > 0)
     {
+        msg_small_t* properties_buffer = msg_small_acquire(NX_WAIT_FOREVER);
+
         // Parse the writable properties from the writable receive message
         if ((status = process_properties_shared(nx_context,
                  packet_ptr,
                  NX_AZURE_IOT_HUB_WRITABLE_PROPERTIES,
                  NX_AZURE_IOT_HUB_CLIENT_PROPERTY_WRITABLE,
-                 properties_buffer,
-                 sizeof(properties_buffer),
+                 (UCHAR*)properties_buffer->data,
+                 sizeof(properties_buffer->data),
                  nx_context->writable_property_received_cb)))
         {
             printf("ERROR: failed to parse properties (0x%08x)\r\n", status);
         }
+
+        msg_small_release(properties_buffer);
     }
 
     // Release the received packet, as ownership was passed to the application from the middleware
@@ -642,6 +905,22 @@ UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT
     return status;
 }
 
+static UINT build_telemetry(
+    NX_AZURE_IOT_JSON_WRITER* json_writer, UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr))
+{
+    UINT status;
+    PROF_BEGIN(PROF_HUB_TELEMETRY_JSON);
+
+    if ((status = nx_azure_iot_json_writer_append_begin_object(json_writer)) == NX_AZURE_IOT_SUCCESS &&
+        (status = append_properties(json_writer)) == NX_AZURE_IOT_SUCCESS)
+    {
+        status = nx_azure_iot_json_writer_append_end_object(json_writer);
+    }
+
+    PROF_END(PROF_HUB_TELEMETRY_JSON);
+    return status;
+}
+
 UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
     CHAR* component_name_ptr,
     UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr))
@@ -650,6 +929,7 @@ UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
     UINT telemetry_length;
     NX_PACKET* packet_ptr;
     NX_AZURE_IOT_JSON_WRITER json_writer;
+    msg_small_t* telemetry_buffer;
 
     if ((status = nx_azure_iot_hub_client_telemetry_message_create(
              &context_ptr->iothub_client, &packet_ptr, NX_WAIT_FOREVER)))
@@ -669,58 +949,74 @@ UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
         }
     }
 
-    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_writer, telemetry_buffer, sizeof(telemetry_buffer))))
+    if ((telemetry_buffer = msg_small_acquire(NX_WAIT_FOREVER)) == NX_NULL)
     {
-        printf("Error: Failed to initialize json writer (0x%08x)\r\n", status);
+        printf("Error: No telemetry buffer available\r\n");
         nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
+        return NX_NO_MEMORY;
     }
 
-    if ((status = nx_azure_iot_json_writer_append_begin_object(&json_writer)) ||
-        (status = append_properties(&json_writer)) ||
-        (status = nx_azure_iot_json_writer_append_end_object(&json_writer)))
+    if ((status = nx_azure_iot_json_writer_with_buffer_init(
+             &json_writer, (UCHAR*)telemetry_buffer->data, sizeof(telemetry_buffer->data))))
+    {
+        printf("Error: Failed to initialize json writer (0x%08x)\r\n", status);
+    }
+
+    else if ((status = build_telemetry(&json_writer, append_properties)))
     {
         printf("Error: Failed to build telemetry (0x%08x)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
     }
 
     // set the ContentType property on the message to "application/json" (url-encoded)
-    if ((status = nx_azure_iot_hub_client_telemetry_property_add(packet_ptr,
-             content_type_property,
-             sizeof(content_type_property) - 1,
-             content_type_json,
-             sizeof(content_type_json) - 1,
-             NX_WAIT_FOREVER)))
+    else if ((status = nx_azure_iot_hub_client_telemetry_property_add(packet_ptr,
+                  content_type_property,
+                  sizeof(content_type_property) - 1,
+                  content_type_json,
+                  sizeof(content_type_json) - 1,
+                  NX_WAIT_FOREVER)))
     {
         printf("Error: Cant set ContentType message property (0x%08X)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
     }
 
     // set the ContentEncoding property on the message to "utf-8"
-    if ((status = nx_azure_iot_hub_client_telemetry_property_add(packet_ptr,
-             content_encoding_property,
-             sizeof(content_encoding_property) - 1,
-             content_encoding_utf8,
-             sizeof(content_encoding_utf8) - 1,
-             NX_WAIT_FOREVER)))
+    else if ((status = nx_azure_iot_hub_client_telemetry_property_add(packet_ptr,
+                  content_encoding_property,
+                  sizeof(content_encoding_property) - 1,
+                  content_encoding_utf8,
+                  sizeof(content_encoding_utf8) - 1,
+                  NX_WAIT_FOREVER)))
     {
         printf("Error: Cant set ContentEncoding message property (0x%08X)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
     }
 
-    telemetry_length = nx_azure_iot_json_writer_get_bytes_used(&json_writer);
-    if ((status = nx_azure_iot_hub_client_telemetry_send(
-             &context_ptr->iothub_client, packet_ptr, telemetry_buffer, telemetry_length, NX_WAIT_FOREVER)))
+    else
     {
-        printf("Error: Telemetry message send failed (0x%08x)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
+        PROF_BEGIN(PROF_HUB_TELEMETRY_SEND);
+        telemetry_length = nx_azure_iot_json_writer_get_bytes_used(&json_writer);
+        status           = nx_azure_iot_hub_client_telemetry_send(&context_ptr->iothub_client,
+            packet_ptr,
+            (UCHAR*)telemetry_buffer->data,
+            telemetry_length,
+            NX_WAIT_FOREVER);
+        PROF_END(PROF_HUB_TELEMETRY_SEND);
+
+        if (status)
+        {
+            printf("Error: Telemetry message send failed (0x%08x)\r\n", status);
+        }
+        else
+        {
+            printf("Telemetry message sent: %.*s.\r\n", telemetry_length, telemetry_buffer->data);
+        }
     }
 
-    printf("Telemetry message sent: %.*s.\r\n", telemetry_length, telemetry_buffer);
+    // The packet owns a copy of the payload once sent
+    msg_small_release(telemetry_buffer);
+
+    if (status)
+    {
+        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+    }
 
     return status;
 }
@@ -758,13 +1054,56 @@ static UINT reported_properties_begin(AZURE_IOT_NX_CONTEXT* context_ptr,
     return status;
 }
 
+// Remember a sent PATCH until its response arrives, the oldest request is given up when the table is full
+static VOID reported_properties_track(AZURE_IOT_NX_CONTEXT* nx_context, UINT request_id, UINT property_count)
+{
+    TX_INTERRUPT_SAVE_AREA
+    AZURE_IOT_PROPERTY_REQUEST* slot = &nx_context->property_requests[0];
+    ULONG now                        = tx_time_get();
+    UINT lost_id                     = 0;
+    bool lost                        = false;
+
+    TX_DISABLE
+    for (UINT i = 0; i < AZURE_IOT_PROPERTY_PENDING_SIZE; i++)
+    {
+        AZURE_IOT_PROPERTY_REQUEST* request = &nx_context->property_requests[i];
+        if (request->sent_time == 0)
+        {
+            slot = request;
+            break;
+        }
+        if (now - request->sent_time > now - slot->sent_time)
+        {
+            slot = request;
+        }
+    }
+
+    if (slot->sent_time != 0)
+    {
+        lost    = true;
+        lost_id = slot->request_id;
+        nx_context->property_failures++;
+    }
+
+    slot->request_id     = request_id;
+    slot->property_count = property_count;
+    slot->sent_time      = now == 0 ? 1 : now;
+    TX_RESTORE
+
+    if (lost)
+    {
+        printf("Error: No response to property request %u\r\n", lost_id);
+    }
+}
+
 static UINT reported_properties_end(AZURE_IOT_NX_CONTEXT* nx_context,
     NX_AZURE_IOT_JSON_WRITER* json_writer,
     NX_PACKET** packet_ptr,
-    CHAR* component_name_ptr)
+    CHAR* component_name_ptr,
+    UINT property_count)
 {
     UINT status;
-    UINT response_status = 0;
+    UINT request_id = 0;
 
     if ((component_name_ptr != NX_NULL && (status = nx_azure_iot_hub_client_reported_properties_component_end(
                                                &nx_context->iothub_client, json_writer))))
@@ -781,99 +1120,212 @@ static UINT reported_properties_end(AZURE_IOT_NX_CONTEXT* nx_context,
 
     printf_packet("Sending property: ", *packet_ptr);
 
-    if ((status = nx_azure_iot_hub_client_reported_properties_send(
-             &nx_context->iothub_client, *packet_ptr, NX_NULL, &response_status, NX_NULL, 5 * NX_IP_PERIODIC_RATE)))
+    // The response comes back through reported_properties_response_callback, the client thread does not wait for it
+    PROF_BEGIN(PROF_HUB_PROPERTY_SEND);
+    status = nx_azure_iot_hub_client_reported_properties_send(
+        &nx_context->iothub_client, *packet_ptr, &request_id, NX_NULL, NX_NULL, NX_WAIT_FOREVER);
+    PROF_END(PROF_HUB_PROPERTY_SEND);
+
+    if (status)
     {
         printf("Error: nx_azure_iot_hub_client_reported_properties_send failed (0x%08x)\r\n", status);
         return status;
     }
 
-    else if ((response_status < 200) || (response_status >= 300))
-    {
-        printf("Error: Property sent response status failed (%d)\r\n", response_status);
-        return NX_NOT_SUCCESSFUL;
-    }
+    reported_properties_track(nx_context, request_id, property_count);
 
     return NX_SUCCESS;
 }
 
-UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* nx_context,
-    CHAR* component_name_ptr,
-    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr))
+static UINT reported_property_append(
+    AZURE_IOT_NX_CONTEXT* nx_context, NX_AZURE_IOT_JSON_WRITER* json_writer, AZURE_IOT_PROPERTY* property)
 {
     UINT status;
-    NX_PACKET* packet_ptr;
-    NX_AZURE_IOT_JSON_WRITER json_writer;
 
-    if ((status = reported_properties_begin(nx_context, &json_writer, &packet_ptr, component_name_ptr)) ||
+    switch (property->type)
+    {
+        case AZURE_IOT_PROPERTY_BOOL:
+            status = nx_azure_iot_json_writer_append_property_with_bool_value(json_writer,
+                (const UCHAR*)property->property_name,
+                strlen(property->property_name),
+                property->value);
+            break;
 
-        (status = append_properties(&json_writer)) ||
+        case AZURE_IOT_PROPERTY_INT:
+            status = nx_azure_iot_json_writer_append_property_with_int32_value(json_writer,
+                (const UCHAR*)property->property_name,
+                strlen(property->property_name),
+                property->value);
+            break;
 
-        (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
-    {
-        printf("ERROR: azure_iot_nx_client_publish_properties (0x%08x)", status);
-        nx_packet_release(packet_ptr);
+        case AZURE_IOT_PROPERTY_WRITABLE_INT:
+        case AZURE_IOT_PROPERTY_WRITABLE_BOOL:
+            if ((status = nx_azure_iot_hub_client_reported_properties_status_begin(&nx_context->iothub_client,
+                     json_writer,
+                     (const UCHAR*)property->property_name,
+                     strlen(property->property_name),
+                     property->http_status,
+                     property->version,
+                     NULL,
+                     0)) == NX_AZURE_IOT_SUCCESS &&
+                (status = property->type == AZURE_IOT_PROPERTY_WRITABLE_BOOL
+                              ? nx_azure_iot_json_writer_append_bool(json_writer, property->value)
+                              : nx_azure_iot_json_writer_append_int32(json_writer, property->value)) ==
+                    NX_AZURE_IOT_SUCCESS)
+            {
+                status =
+                    nx_azure_iot_hub_client_reported_properties_status_end(&nx_context->iothub_client, json_writer);
+            }
+            break;
+
+        default:
+            status = NX_INVALID_PARAMETERS;
+            break;
     }
 
     return status;
 }
 
-UINT azure_iot_nx_client_publish_bool_property(
-    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, CHAR* property_ptr, bool value)
+static bool same_component(CHAR* a, CHAR* b)
+{
+    return a == b || (a != NX_NULL && b != NX_NULL && strcmp(a, b) == 0);
+}
+
+// Send the staged properties as one PATCH, grouped by component. Nothing goes out while disconnected, the stage is
+// flushed again on connect.
+static UINT reported_properties_flush(AZURE_IOT_PROPERTY* properties, UINT count, VOID* context)
 {
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
     UINT status;
+    NX_PACKET* packet_ptr = NX_NULL;
     NX_AZURE_IOT_JSON_WRITER json_writer;
-    NX_PACKET* packet_ptr;
+    bool written[PROPERTY_STAGE_SIZE] = {false};
 
-    if ((status = reported_properties_begin(nx_context, &json_writer, &packet_ptr, component_name_ptr)) ||
+    if (nx_context->azure_iot_connection_status != NX_SUCCESS)
+    {
+        return NX_NOT_CONNECTED;
+    }
+
+    if ((status = reported_properties_begin(nx_context, &json_writer, &packet_ptr, NX_NULL)))
+    {
+        if (packet_ptr != NX_NULL)
+        {
+            nx_packet_release(packet_ptr);
+        }
+        return status;
+    }
+
+    for (UINT i = 0; i < count && status == NX_AZURE_IOT_SUCCESS; i++)
+    {
+        CHAR* component_name_ptr = properties[i].component_name;
+
+        if (written[i])
+        {
+            continue;
+        }
+
+        if (component_name_ptr != NX_NULL &&
+            (status = nx_azure_iot_hub_client_reported_properties_component_begin(&nx_context->iothub_client,
+                 &json_writer,
+                 (UCHAR*)component_name_ptr,
+                 strlen(component_name_ptr))))
+        {
+            printf("Error: Failed to append component begin (0x%08x)\r\n", status);
+            break;
+        }
 
-        (status = nx_azure_iot_json_writer_append_property_with_bool_value(
-             &json_writer, (const UCHAR*)property_ptr, strlen(property_ptr), value)) ||
+        for (UINT j = i; j < count && status == NX_AZURE_IOT_SUCCESS; j++)
+        {
+            if (!written[j] && same_component(properties[j].component_name, component_name_ptr))
+            {
+                status     = reported_property_append(nx_context, &json_writer, &properties[j]);
+                written[j] = true;
+            }
+        }
+
+        if (status == NX_AZURE_IOT_SUCCESS && component_name_ptr != NX_NULL)
+        {
+            status =
+                nx_azure_iot_hub_client_reported_properties_component_end(&nx_context->iothub_client, &json_writer);
+        }
+    }
 
-        (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
+    if (status || (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, NX_NULL, count)))
     {
-        printf("ERROR: azure_iot_nx_client_publish_bool_property (0x%08x)", status);
+        printf("ERROR: failed to flush %u reported properties (0x%08x)\r\n", count, status);
         nx_packet_release(packet_ptr);
     }
 
     return status;
 }
 
-UINT azure_nx_client_respond_int_writable_property(AZURE_IOT_NX_CONTEXT* nx_context,
+UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* nx_context,
     CHAR* component_name_ptr,
-    CHAR* property_ptr,
-    INT value,
-    INT http_status,
-    INT version)
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr))
 {
     UINT status;
-    NX_AZURE_IOT_JSON_WRITER json_writer;
     NX_PACKET* packet_ptr;
+    NX_AZURE_IOT_JSON_WRITER json_writer;
 
+    // The document is built by the caller and cannot be merged with the stage, it goes out as its own PATCH
     if ((status = reported_properties_begin(nx_context, &json_writer, &packet_ptr, component_name_ptr)) ||
 
-        (status = nx_azure_iot_hub_client_reported_properties_status_begin(&nx_context->iothub_client,
-             &json_writer,
-             (const UCHAR*)property_ptr,
-             strlen(property_ptr),
-             http_status,
-             version,
-             NULL,
-             0)) ||
-
-        (status = nx_azure_iot_json_writer_append_int32(&json_writer, value)) ||
-
-        (status = nx_azure_iot_hub_client_reported_properties_status_end(&nx_context->iothub_client, &json_writer)) ||
+        (status = append_properties(&json_writer)) ||
 
-        (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
+        (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr, 1)))
     {
-        printf("ERROR: azure_nx_client_respond_int_writable_property (0x%08x)", status);
+        printf("ERROR: azure_iot_nx_client_publish_properties (0x%08x)", status);
         nx_packet_release(packet_ptr);
     }
 
     return status;
 }
 
+UINT azure_iot_nx_client_publish_bool_property(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, CHAR* property_ptr, bool value)
+{
+    AZURE_IOT_PROPERTY property = {
+        .component_name = component_name_ptr,
+        .property_name  = property_ptr,
+        .type           = AZURE_IOT_PROPERTY_BOOL,
+        .value          = value,
+    };
+
+    return property_stage_put(&nx_context->property_stage, &property);
+}
+
+UINT azure_iot_nx_client_publish_int_property(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, CHAR* property_ptr, INT value)
+{
+    AZURE_IOT_PROPERTY property = {
+        .component_name = component_name_ptr,
+        .property_name  = property_ptr,
+        .type           = AZURE_IOT_PROPERTY_INT,
+        .value          = value,
+    };
+
+    return property_stage_put(&nx_context->property_stage, &property);
+}
+
+UINT azure_nx_client_respond_int_writable_property(AZURE_IOT_NX_CONTEXT* nx_context,
+    CHAR* component_name_ptr,
+    CHAR* property_ptr,
+    INT value,
+    INT http_status,
+    INT version)
+{
+    AZURE_IOT_PROPERTY property = {
+        .component_name = component_name_ptr,
+        .property_name  = property_ptr,
+        .type           = AZURE_IOT_PROPERTY_WRITABLE_INT,
+        .value          = value,
+        .http_status    = http_status,
+        .version        = version,
+    };
+
+    return property_stage_put(&nx_context->property_stage, &property);
+}
+
 UINT azure_iot_nx_client_publish_int_writable_property(
     AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_ptr, CHAR* property_ptr, UINT value)
 {
@@ -916,6 +1368,77 @@ UINT azure_iot_nx_client_register_property_callback(
     return NX_SUCCESS;
 }
 
+UINT azure_iot_nx_client_register_commands(
+    AZURE_IOT_NX_CONTEXT* nx_context, const dispatch_entry_t* commands, UINT count)
+{
+    if (nx_context == NULL || nx_context->commands.count != 0)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return dispatch_table_init(&nx_context->commands, commands, count);
+}
+
+UINT azure_iot_nx_client_register_command_service(AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_COMMAND_SERVICE* service)
+{
+    UINT status;
+
+    if (nx_context == NULL || service == NULL || nx_context->command_service != NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((status = azure_iot_command_start(
+             service, &nx_context->iothub_client, &nx_context->events, HUB_COMMAND_TIMEOUT_EVENT)))
+    {
+        return status;
+    }
+
+    nx_context->command_service = service;
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_command_complete(AZURE_IOT_NX_CONTEXT* nx_context, ULONG request_id, UINT status)
+{
+    if (nx_context->command_service == NULL)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    return azure_iot_command_complete(nx_context->command_service, request_id, status);
+}
+
+VOID azure_iot_nx_client_command_stats(AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_COMMAND_STATS* stats)
+{
+    if (nx_context->command_service == NULL)
+    {
+        memset(stats, 0, sizeof(AZURE_IOT_COMMAND_STATS));
+        return;
+    }
+
+    azure_iot_command_stats(nx_context->command_service, stats);
+}
+
+UINT azure_iot_nx_client_register_writable_properties(
+    AZURE_IOT_NX_CONTEXT* nx_context, const dispatch_entry_t* properties, UINT count)
+{
+    if (nx_context == NULL || nx_context->writable_properties.count != 0)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    for (UINT i = 0; i < count; i++)
+    {
+        if (properties[i].type != DISPATCH_ARG_BOOL && properties[i].type != DISPATCH_ARG_INT)
+        {
+            return NX_INVALID_PARAMETERS;
+        }
+    }
+
+    return dispatch_table_init(&nx_context->writable_properties, properties, count);
+}
+
 UINT azure_iot_nx_client_register_properties_complete_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_properties_complete callback)
 {
@@ -1032,15 +1555,20 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
     nx_context->azure_iot_model_id          = iot_model_id;
     nx_context->azure_iot_model_id_len      = iot_model_id_len;
 
+    if ((status = msg_pool_init()))
+    {
+        printf("ERROR: msg_pool_init (0x%08x)\r\n", status);
+    }
+
     // Initialize CA root certificates
-    if ((status = nx_secure_x509_certificate_initialize(&nx_context->root_ca_cert,
-             (UCHAR*)azure_iot_root_cert,
-             (USHORT)azure_iot_root_cert_size,
-             NX_NULL,
-             0,
-             NULL,
-             0,
-             NX_SECURE_X509_KEY_TYPE_NONE)))
+    else if ((status = nx_secure_x509_certificate_initialize(&nx_context->root_ca_cert,
+                  (UCHAR*)azure_iot_root_cert,
+                  (USHORT)azure_iot_root_cert_size,
+                  NX_NULL,
+                  0,
+                  NULL,
+                  0,
+                  NX_SECURE_X509_KEY_TYPE_NONE)))
     {
         printf("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
     }
@@ -1086,6 +1614,34 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
         tx_event_flags_delete(&nx_context->events);
     }
 
+    // One-shot, armed by the connect workflow with the backoff
+    else if ((status = tx_timer_create(&nx_context->connection_timer,
+                  "connection_timer",
+                  connection_timer_entry,
+                  (ULONG)nx_context,
+                  1,
+                  0,
+                  TX_NO_ACTIVATE)))
+    {
+        printf("ERROR: tx_timer_create (0x%08x)\r\n", status);
+        tx_event_flags_delete(&nx_context->events);
+        tx_timer_delete(&nx_context->periodic_timer);
+    }
+
+    // Armed when a property is staged, and again after a flush that failed
+    else if ((status = property_stage_create(&nx_context->property_stage,
+                  &nx_context->events,
+                  HUB_PROPERTIES_FLUSH_EVENT,
+                  AZURE_IOT_PROPERTY_FLUSH_TICKS,
+                  reported_properties_flush,
+                  nx_context)))
+    {
+        printf("ERROR: tx_timer_create (0x%08x)\r\n", status);
+        tx_event_flags_delete(&nx_context->events);
+        tx_timer_delete(&nx_context->periodic_timer);
+        tx_timer_delete(&nx_context->connection_timer);
+    }
+
     // Create Azure IoT handler
     else if ((status = nx_azure_iot_create(&nx_context->nx_azure_iot,
                   (UCHAR*)"Azure IoT",
@@ -1100,6 +1656,8 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
         printf("ERROR: failed on nx_azure_iot_create (0x%08x)\r\n", status);
         tx_event_flags_delete(&nx_context->events);
         tx_timer_delete(&nx_context->periodic_timer);
+        tx_timer_delete(&nx_context->connection_timer);
+        property_stage_delete(&nx_context->property_stage);
     }
 
     return status;
@@ -1110,14 +1668,27 @@ static UINT client_run(
 {
     ULONG app_events;
 
+    // Start the connect workflow, from here on it only runs on connection events
+    connection_monitor(nx_context, iot_initialize, network_connect, false);
+
     while (true)
     {
         app_events = 0;
-        tx_event_flags_get(&nx_context->events, HUB_ALL_EVENTS, TX_OR_CLEAR, &app_events, NX_IP_PERIODIC_RATE);
+        tx_event_flags_get(&nx_context->events, HUB_ALL_EVENTS, TX_OR_CLEAR, &app_events, TX_WAIT_FOREVER);
+        nx_context->azure_iot_wakeups++;
 
         if (app_events & HUB_DISCONNECT_EVENT)
         {
             process_disconnect(nx_context);
+
+            // Reconnect where possible
+            connection_monitor(nx_context, iot_initialize, network_connect, false);
+        }
+
+        if (app_events & HUB_CONNECTION_TIMER_EVENT)
+        {
+            // Backoff or network retry has elapsed
+            connection_monitor(nx_context, iot_initialize, network_connect, true);
         }
 
         if (app_events & HUB_CONNECT_EVENT)
@@ -1140,6 +1711,12 @@ static UINT client_run(
             process_command(nx_context);
         }
 
+        // Only set by a command service
+        if (app_events & HUB_COMMAND_TIMEOUT_EVENT)
+        {
+            azure_iot_command_timeouts(nx_context->command_service);
+        }
+
         if (app_events & HUB_PROPERTIES_RECEIVE_EVENT)
         {
             process_properties(nx_context);
@@ -1150,8 +1727,11 @@ static UINT client_run(
             process_writable_properties(nx_context);
         }
 
-        // Monitor and reconnect where possible
-        connection_monitor(nx_context, iot_initialize, network_connect);
+        // Send the staged reported properties as one PATCH
+        if (app_events & HUB_PROPERTIES_FLUSH_EVENT)
+        {
+            property_stage_flush(&nx_context->property_stage);
+        }
     }
 
     return NX_SUCCESS;
@@ -12,12 +12,20 @@
 #include "nx_azure_iot_provisioning_client.h"
 
 #include "azure_iot_ciphersuites.h"
+#include "azure_iot_command.h"
+#include "dispatch.h"
+#include "dps_cache.h"
+#include "property_stage.h"
 
 #define NX_AZURE_IOT_STACK_SIZE  (2 * 1024)
 #define AZURE_IOT_STACK_SIZE     (3 * 1024)
 #define AZURE_IOT_HOST_NAME_SIZE 128
 #define AZURE_IOT_DEVICE_ID_SIZE 64
 
+// Reported properties are staged and sent as one PATCH, a short while after the first change or once the stage is full
+#define AZURE_IOT_PROPERTY_FLUSH_TICKS  (TX_TIMER_TICKS_PER_SECOND / 5)
+#define AZURE_IOT_PROPERTY_PENDING_SIZE 4
+
 #define AZURE_IOT_AUTH_MODE_UNKNOWN 0
 #define AZURE_IOT_AUTH_MODE_SAS     1
 #define AZURE_IOT_AUTH_MODE_CERT    2
@@ -35,6 +43,14 @@ typedef void (*func_ptr_timer)(AZURE_IOT_NX_CONTEXT*);
 
 typedef ULONG (*func_ptr_unix_time_get)(VOID);
 
+// A PATCH waiting for its response from the twin
+typedef struct AZURE_IOT_PROPERTY_REQUEST_STRUCT
+{
+    UINT request_id;
+    UINT property_count;
+    ULONG sent_time; // tx_time_get when sent, zero for a free slot
+} AZURE_IOT_PROPERTY_REQUEST;
+
 struct AZURE_IOT_NX_CONTEXT_STRUCT
 {
     NX_SECURE_X509_CERT root_ca_cert;
@@ -73,10 +89,15 @@ struct AZURE_IOT_NX_CONTEXT_STRUCT
     UINT azure_iot_hub_hostname_len;
     CHAR azure_iot_hub_device_id[AZURE_IOT_DEVICE_ID_SIZE];
     UINT azure_iot_hub_device_id_len;
+    bool azure_iot_hub_from_cache; // The hub config came from the DPS cache rather than a registration
 
     TX_THREAD azure_iot_thread;
     TX_EVENT_FLAGS_GROUP events;
     TX_TIMER periodic_timer;
+    TX_TIMER connection_timer;
+
+    // Times the client thread has woken on an event, for idle power accounting
+    ULONG azure_iot_wakeups;
 
     NX_AZURE_IOT nx_azure_iot;
 
@@ -96,6 +117,20 @@ struct AZURE_IOT_NX_CONTEXT_STRUCT
     func_ptr_property_received property_received_cb;
     func_ptr_properties_complete properties_complete_cb;
     func_ptr_timer timer_cb;
+
+    // declared commands and writable properties, checked before the callbacks
+    dispatch_table_t commands;
+    dispatch_table_t writable_properties;
+
+    // worker pool for long running commands, provided by the app, NULL runs every command inline
+    AZURE_IOT_COMMAND_SERVICE* command_service;
+
+    // reported properties, only touched from the client thread
+    property_stage_t property_stage;
+
+    // in flight PATCH requests, completed from the middleware thread
+    AZURE_IOT_PROPERTY_REQUEST property_requests[AZURE_IOT_PROPERTY_PENDING_SIZE];
+    ULONG property_failures;
 };
 
 UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT interval);
@@ -107,8 +142,12 @@ UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* nx_context,
 UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* nx_context,
     CHAR* component_name_ptr,
     UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr));
+
+// Staged reported properties, the latest value of each property goes out in the next PATCH
 UINT azure_iot_nx_client_publish_bool_property(
     AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, CHAR* property_ptr, bool value);
+UINT azure_iot_nx_client_publish_int_property(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, CHAR* property_ptr, INT value);
 
 UINT azure_nx_client_respond_int_writable_property(AZURE_IOT_NX_CONTEXT* nx_context,
     CHAR* component_name_ptr,
@@ -125,6 +164,20 @@ UINT azure_iot_nx_client_register_writable_property_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_writable_property_received callback);
 UINT azure_iot_nx_client_register_property_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_property_received callback);
+
+// Declared commands are answered with the handler status, unknown commands with 404 when there is no command callback.
+UINT azure_iot_nx_client_register_commands(
+    AZURE_IOT_NX_CONTEXT* nx_context, const dispatch_entry_t* commands, UINT count);
+// Start a worker pool for long running commands, the service is owned by the app and must stay allocated. Long running
+// commands are then queued and answered with 503 when the pool is full, 504 when they time out. Without a service
+// they run inline on the client thread.
+UINT azure_iot_nx_client_register_command_service(AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_COMMAND_SERVICE* service);
+// Answer a long running command whose handler returned DISPATCH_STATUS_PENDING, from any thread
+UINT azure_iot_nx_client_command_complete(AZURE_IOT_NX_CONTEXT* nx_context, ULONG request_id, UINT status);
+VOID azure_iot_nx_client_command_stats(AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_COMMAND_STATS* stats);
+// Declared writable properties, bool or int only, are acknowledged with the handler status and the desired version
+UINT azure_iot_nx_client_register_writable_properties(
+    AZURE_IOT_NX_CONTEXT* nx_context, const dispatch_entry_t* properties, UINT count);
 UINT azure_iot_nx_client_register_properties_complete_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_properties_complete callback);
 UINT azure_iot_nx_client_register_timer_callback(
@@ -0,0 +1,28 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320) as used by zlib and Ethernet.
+// Start with a crc of 0 and feed the previous result back in to checksum data in pieces.
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length);
+
+// Software only slice-by-8 implementation, never uses the hardware backend
+uint32_t crc32_update_sw(uint32_t crc, const void* data, size_t length);
+
+static inline uint32_t crc32_compute(const void* data, size_t length)
+{
+    return crc32_update(0, data, length);
+}
+
+// Hardware backend hook, boards with a CRC unit override this weak symbol.
+// Advances the raw (non-inverted) CRC register over word aligned data, returns false to fall back to software.
+bool crc32_hw_update(uint32_t* state, const uint32_t* words, size_t count);
+
+#endif
@@ -0,0 +1,226 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "dispatch.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsmn.h"
+
+// FNV-1a over the component, a separator and the name
+static ULONG dispatch_hash(const CHAR* component, UINT component_length, const CHAR* name, UINT name_length)
+{
+    ULONG hash = 2166136261UL;
+
+    for (UINT i = 0; i < component_length; i++)
+    {
+        hash = (hash ^ (UCHAR)component[i]) * 16777619UL;
+    }
+
+    hash = (hash ^ '/') * 16777619UL;
+
+    for (UINT i = 0; i < name_length; i++)
+    {
+        hash = (hash ^ (UCHAR)name[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+static bool dispatch_match(const CHAR* expected, const CHAR* text, UINT length)
+{
+    if (expected == NULL)
+    {
+        return length == 0;
+    }
+
+    return strlen(expected) == length && strncmp(expected, text, length) == 0;
+}
+
+UINT dispatch_table_init(dispatch_table_t* table, const dispatch_entry_t* entries, UINT count)
+{
+    memset(table, 0, sizeof(*table));
+
+    if (count > DISPATCH_MAX_ENTRIES)
+    {
+        return TX_SIZE_ERROR;
+    }
+
+    table->entries = entries;
+
+    for (UINT i = 0; i < count; i++)
+    {
+        const dispatch_entry_t* entry = &entries[i];
+        UINT component_length         = entry->component ? strlen(entry->component) : 0;
+        UINT name_length              = strlen(entry->name);
+        ULONG slot;
+
+        if (dispatch_find(table, entry->component, component_length, entry->name, name_length) != NULL)
+        {
+            return TX_PTR_ERROR;
+        }
+
+        // Linear probing, the index is never more than half full
+        slot = dispatch_hash(entry->component, component_length, entry->name, name_length);
+        while (table->index[slot & (DISPATCH_INDEX_SIZE - 1)] != 0)
+        {
+            slot++;
+        }
+
+        table->index[slot & (DISPATCH_INDEX_SIZE - 1)] = (UCHAR)(i + 1);
+        table->count++;
+    }
+
+    return TX_SUCCESS;
+}
+
+const dispatch_entry_t* dispatch_find(const dispatch_table_t* table,
+    const CHAR* component,
+    UINT component_length,
+    const CHAR* name,
+    UINT name_length)
+{
+    ULONG slot = dispatch_hash(component, component_length, name, name_length);
+    UCHAR entry_number;
+
+    while ((entry_number = table->index[slot & (DISPATCH_INDEX_SIZE - 1)]) != 0)
+    {
+        const dispatch_entry_t* entry = &table->entries[entry_number - 1];
+
+        if (dispatch_match(entry->component, component, component_length) &&
+            dispatch_match(entry->name, name, name_length))
+        {
+            return entry;
+        }
+
+        slot++;
+    }
+
+    return NULL;
+}
+
+UINT dispatch_check(const dispatch_entry_t* entry, const dispatch_arg_t* arg)
+{
+    if (arg->type != entry->type)
+    {
+        return DISPATCH_STATUS_BAD_REQUEST;
+    }
+
+    switch (entry->type)
+    {
+        case DISPATCH_ARG_INT:
+            if (arg->integer < entry->min || arg->integer > entry->max)
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            break;
+
+        case DISPATCH_ARG_STRING:
+            if (arg->string_length > (UINT)entry->max)
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return DISPATCH_STATUS_OK;
+}
+
+UINT dispatch_parse(const dispatch_entry_t* entry, const CHAR* payload, UINT length, dispatch_arg_t* arg)
+{
+    jsmn_parser parser;
+    jsmntok_t token;
+    const CHAR* value;
+    UINT value_length;
+
+    memset(arg, 0, sizeof(*arg));
+    arg->type = entry->type;
+
+    if (entry->type == DISPATCH_ARG_NONE)
+    {
+        return DISPATCH_STATUS_OK;
+    }
+
+    // A single value, anything with children is rejected by the one token limit
+    jsmn_init(&parser);
+    if (jsmn_parse(&parser, payload, length, &token, 1) != 1)
+    {
+        return DISPATCH_STATUS_BAD_REQUEST;
+    }
+
+    value        = payload + token.start;
+    value_length = token.end - token.start;
+
+    switch (entry->type)
+    {
+        case DISPATCH_ARG_BOOL:
+            if (token.type != JSMN_PRIMITIVE)
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            else if (value_length == 4 && strncmp(value, "true", 4) == 0)
+            {
+                arg->boolean = true;
+            }
+            else if (!(value_length == 5 && strncmp(value, "false", 5) == 0))
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            break;
+
+        case DISPATCH_ARG_INT:
+        {
+            CHAR digits[12];
+            CHAR* end;
+            long number;
+
+            if (token.type != JSMN_PRIMITIVE || value_length == 0 || value_length >= sizeof(digits))
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+
+            memcpy(digits, value, value_length);
+            digits[value_length] = 0;
+
+            number = strtol(digits, &end, 10);
+            if (*end != 0 || number < INT_MIN || number > INT_MAX)
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            arg->integer = (INT)number;
+        }
+        break;
+
+        case DISPATCH_ARG_STRING:
+            if (token.type != JSMN_STRING)
+            {
+                return DISPATCH_STATUS_BAD_REQUEST;
+            }
+            arg->string        = value;
+            arg->string_length = value_length;
+            break;
+
+        default:
+            return DISPATCH_STATUS_BAD_REQUEST;
+    }
+
+    return dispatch_check(entry, arg);
+}
+
+UINT dispatch_run(const dispatch_entry_t* entry, const CHAR* payload, UINT length)
+{
+    dispatch_arg_t arg;
+    UINT status;
+
+    if ((status = dispatch_parse(entry, payload, length, &arg)) != DISPATCH_STATUS_OK)
+    {
+        return status;
+    }
+
+    return entry->handler(&arg, entry->context);
+}
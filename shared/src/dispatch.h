@@ -0,0 +1,112 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _DISPATCH_H
+#define _DISPATCH_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+// Static tables of commands and writable properties, shared by the Azure IoT client and the legacy MQTT client.
+// Apps declare name, component, argument schema and handler, the clients look entries up through a hash index,
+// validate the payload and send the standard responses.
+
+#define DISPATCH_MAX_ENTRIES 16
+#define DISPATCH_INDEX_SIZE  32 // Power of two, at least twice DISPATCH_MAX_ENTRIES
+
+// Status codes follow HTTP, both clients report them that way
+#define DISPATCH_STATUS_OK          200
+#define DISPATCH_STATUS_PENDING     202 // Long running handler will complete the request later
+#define DISPATCH_STATUS_BAD_REQUEST 400
+#define DISPATCH_STATUS_NOT_FOUND   404
+#define DISPATCH_STATUS_ERROR       500
+#define DISPATCH_STATUS_UNAVAILABLE 503 // No room to queue a long running request
+#define DISPATCH_STATUS_TIMEOUT     504
+
+typedef enum
+{
+    DISPATCH_ARG_NONE,  // Payload ignored
+    DISPATCH_ARG_BOOL,  // true or false
+    DISPATCH_ARG_INT,   // Integer within min and max
+    DISPATCH_ARG_STRING // JSON string of at most max characters, escapes are left in place
+} dispatch_arg_type_t;
+
+// A validated argument, strings point into the received payload
+typedef struct
+{
+    dispatch_arg_type_t type;
+    bool boolean;
+    INT integer;
+    const CHAR* string;
+    UINT string_length;
+    ULONG request_id; // Handle to complete a long running request later, zero when run inline
+} dispatch_arg_t;
+
+/**
+ * @brief Handle a command or a writable property update
+ * @param arg Validated argument
+ * @param context Entry context
+ * @return A DISPATCH_STATUS_ code, sent back as the command status or the property acknowledgement
+ */
+typedef UINT (*dispatch_handler_t)(const dispatch_arg_t* arg, VOID* context);
+
+typedef struct
+{
+    const CHAR* component; // NULL for the default component
+    const CHAR* name;
+    dispatch_arg_type_t type;
+    INT min; // Bounds of an integer, maximum length of a string
+    INT max;
+    dispatch_handler_t handler;
+    bool long_running; // Run on a worker thread, the handler may block or return DISPATCH_STATUS_PENDING
+    ULONG timeout;     // Ticks a long running request may take before it is answered with 504, 0 for the default
+    VOID* context;
+} dispatch_entry_t;
+
+typedef struct
+{
+    const dispatch_entry_t* entries;
+    UINT count;
+    UCHAR index[DISPATCH_INDEX_SIZE]; // Entry number plus one by hash slot, zero when free
+} dispatch_table_t;
+
+/**
+ * @brief Index a static table, the entries are not copied
+ * @return TX_SUCCESS, TX_SIZE_ERROR if there are more than DISPATCH_MAX_ENTRIES, TX_PTR_ERROR for a duplicate
+ */
+UINT dispatch_table_init(dispatch_table_t* table, const dispatch_entry_t* entries, UINT count);
+
+/**
+ * @brief Find an entry, names are not necessarily null terminated
+ * @return The entry or NULL
+ */
+const dispatch_entry_t* dispatch_find(const dispatch_table_t* table,
+    const CHAR* component,
+    UINT component_length,
+    const CHAR* name,
+    UINT name_length);
+
+/**
+ * @brief Parse a JSON payload against the schema of an entry
+ * @param entry Entry the payload is for
+ * @param payload JSON value, not necessarily null terminated
+ * @param length Length of the payload
+ * @param arg Receives the argument
+ * @return DISPATCH_STATUS_OK or DISPATCH_STATUS_BAD_REQUEST
+ */
+UINT dispatch_parse(const dispatch_entry_t* entry, const CHAR* payload, UINT length, dispatch_arg_t* arg);
+
+/**
+ * @brief Check an argument read by other means, such as a JSON reader, against the schema of an entry
+ * @return DISPATCH_STATUS_OK or DISPATCH_STATUS_BAD_REQUEST
+ */
+UINT dispatch_check(const dispatch_entry_t* entry, const dispatch_arg_t* arg);
+
+/**
+ * @brief Parse the payload and run the handler
+ * @return The handler status, or DISPATCH_STATUS_BAD_REQUEST if the payload does not match the schema
+ */
+UINT dispatch_run(const dispatch_entry_t* entry, const CHAR* payload, UINT length);
+
+#endif // _DISPATCH_H
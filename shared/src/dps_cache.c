@@ -0,0 +1,138 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "dps_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nxd_mqtt_client.h"
+
+#include "crc32.h"
+#include "sha256.h"
+
+static const UCHAR separator = 0;
+
+static uint32_t record_crc(const dps_cache_record_t* record)
+{
+    return crc32_compute(record, offsetof(dps_cache_record_t, crc));
+}
+
+__attribute__((weak)) UINT dps_cache_storage_read(VOID* record, UINT length)
+{
+    return NX_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) UINT dps_cache_storage_write(const VOID* record, UINT length)
+{
+    return NX_NOT_IMPLEMENTED;
+}
+
+VOID dps_cache_fingerprint(const CHAR* id_scope,
+    UINT id_scope_length,
+    const CHAR* registration_id,
+    UINT registration_id_length,
+    const UCHAR* credential,
+    UINT credential_length,
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE])
+{
+    sha256_t sha;
+
+    // Separated so moving bytes between the fields changes the hash
+    sha256_init(&sha);
+    sha256_update(&sha, (const UCHAR*)id_scope, id_scope_length);
+    sha256_update(&sha, &separator, 1);
+    sha256_update(&sha, (const UCHAR*)registration_id, registration_id_length);
+    sha256_update(&sha, &separator, 1);
+    sha256_update(&sha, credential, credential_length);
+    sha256_final(&sha, fingerprint);
+}
+
+UINT dps_cache_load(const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE],
+    CHAR* hostname,
+    UINT hostname_size,
+    UINT* hostname_length,
+    CHAR* device_id,
+    UINT device_id_size,
+    UINT* device_id_length)
+{
+    dps_cache_record_t record;
+    UINT host_length;
+    UINT id_length;
+
+    if (dps_cache_storage_read(&record, sizeof(record)))
+    {
+        return NX_NOT_FOUND;
+    }
+
+    // Erased storage, a different layout or a torn write all read as a miss
+    if (record.magic != DPS_CACHE_MAGIC || record.version != DPS_CACHE_VERSION || record.size != sizeof(record) ||
+        record.crc != record_crc(&record))
+    {
+        return NX_NOT_FOUND;
+    }
+
+    if (memcmp(record.fingerprint, fingerprint, DPS_CACHE_FINGERPRINT_SIZE) != 0)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    host_length = strnlen(record.hostname, sizeof(record.hostname));
+    id_length   = strnlen(record.device_id, sizeof(record.device_id));
+    if (host_length == 0 || host_length == sizeof(record.hostname) || id_length == 0 ||
+        id_length == sizeof(record.device_id))
+    {
+        return NX_NOT_FOUND;
+    }
+
+    if (host_length >= hostname_size || id_length >= device_id_size)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    memcpy(hostname, record.hostname, host_length + 1);
+    memcpy(device_id, record.device_id, id_length + 1);
+    *hostname_length  = host_length;
+    *device_id_length = id_length;
+
+    return NX_SUCCESS;
+}
+
+UINT dps_cache_store(const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE],
+    const CHAR* hostname,
+    UINT hostname_length,
+    const CHAR* device_id,
+    UINT device_id_length)
+{
+    dps_cache_record_t record;
+
+    if (hostname_length >= sizeof(record.hostname) || device_id_length >= sizeof(record.device_id))
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.magic   = DPS_CACHE_MAGIC;
+    record.version = DPS_CACHE_VERSION;
+    record.size    = sizeof(record);
+    memcpy(record.fingerprint, fingerprint, DPS_CACHE_FINGERPRINT_SIZE);
+    memcpy(record.hostname, hostname, hostname_length);
+    memcpy(record.device_id, device_id, device_id_length);
+    record.crc = record_crc(&record);
+
+    return dps_cache_storage_write(&record, sizeof(record));
+}
+
+bool dps_cache_rejected(UINT status)
+{
+    return status == NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD || status == NXD_MQTT_ERROR_NOT_AUTHORIZED;
+}
+
+UINT dps_cache_invalidate(VOID)
+{
+    dps_cache_record_t record;
+
+    memset(&record, 0, sizeof(record));
+
+    return dps_cache_storage_write(&record, sizeof(record));
+}
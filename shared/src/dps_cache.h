@@ -0,0 +1,86 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _DPS_CACHE_H
+#define _DPS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nx_api.h"
+
+// The hub assignment from the Device Provisioning Service, kept across reboots so startup can connect straight to the
+// hub. A record is only used when its fingerprint matches the ID scope, registration ID and credential it was
+// provisioned with, and the clients invalidate it only when the cached hub rejects the device. A DNS or network
+// failure keeps it, the hub is most likely just out of reach.
+
+#define DPS_CACHE_MAGIC            0x43535044 // "DPSC"
+#define DPS_CACHE_VERSION          1
+#define DPS_CACHE_FINGERPRINT_SIZE 32 // SHA-256
+#define DPS_CACHE_HOSTNAME_SIZE    128
+#define DPS_CACHE_DEVICE_ID_SIZE   64
+
+// Stored as is, the CRC covers everything before it
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE];
+    CHAR hostname[DPS_CACHE_HOSTNAME_SIZE];
+    CHAR device_id[DPS_CACHE_DEVICE_ID_SIZE];
+    uint32_t crc;
+} dps_cache_record_t;
+
+/**
+ * @brief Hash the provisioning inputs, a change to any of them invalidates the cached assignment
+ * @param credential SAS key or raw device certificate
+ */
+VOID dps_cache_fingerprint(const CHAR* id_scope,
+    UINT id_scope_length,
+    const CHAR* registration_id,
+    UINT registration_id_length,
+    const UCHAR* credential,
+    UINT credential_length,
+    UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE]);
+
+/**
+ * @brief Read the cached assignment, the hostname and device id are null terminated
+ * @return NX_SUCCESS, NX_NOT_FOUND if there is no valid record for the fingerprint, NX_SIZE_ERROR if it doesn't fit
+ */
+UINT dps_cache_load(const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE],
+    CHAR* hostname,
+    UINT hostname_size,
+    UINT* hostname_length,
+    CHAR* device_id,
+    UINT device_id_size,
+    UINT* device_id_length);
+
+/**
+ * @brief Persist a fresh assignment
+ * @return NX_SUCCESS, NX_SIZE_ERROR if it doesn't fit a record, or the storage error
+ */
+UINT dps_cache_store(const UCHAR fingerprint[DPS_CACHE_FINGERPRINT_SIZE],
+    const CHAR* hostname,
+    UINT hostname_length,
+    const CHAR* device_id,
+    UINT device_id_length);
+
+/**
+ * @brief Decide whether a failed connection to the cached hub means the assignment is stale
+ * @param status Connection status reported by the MQTT client
+ * @return true if the hub rejected the device, false for DNS, network and other failures
+ */
+bool dps_cache_rejected(UINT status);
+
+/**
+ * @brief Erase the record so the next start provisions again
+ */
+UINT dps_cache_invalidate(VOID);
+
+// Storage hooks, boards with non volatile storage override these weak symbols.
+// The defaults return NX_NOT_IMPLEMENTED, which leaves every start provisioning as before.
+UINT dps_cache_storage_read(VOID* record, UINT length);
+UINT dps_cache_storage_write(const VOID* record, UINT length);
+
+#endif // _DPS_CACHE_H
@@ -0,0 +1,517 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "heap.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define BLOCK_FREE      0x1
+#define BLOCK_PREV_FREE 0x2
+#define BLOCK_FLAGS     (BLOCK_FREE | BLOCK_PREV_FREE)
+
+// Every block starts with a header, the free list links overlay the payload of free blocks
+struct heap_block
+{
+    heap_block_t* prev_phys; // Physically previous block, NULL for the first one
+    size_t size;             // Payload size | flags
+    heap_block_t* next_free;
+    heap_block_t* prev_free;
+};
+
+#define BLOCK_HEADER     (offsetof(heap_block_t, next_free))
+#define BLOCK_SIZE_MIN   (sizeof(heap_block_t) - BLOCK_HEADER)
+#define BLOCK_SIZE_MAX   (((size_t)1 << HEAP_FL_MAX) - HEAP_ALIGN)
+#define SMALL_BLOCK_SIZE ((size_t)1 << HEAP_FL_SHIFT)
+
+static int fls_size(size_t value)
+{
+    return 31 - __builtin_clz((unsigned int)value);
+}
+
+static int ffs_bits(uint32_t value)
+{
+    return __builtin_ctz(value);
+}
+
+static size_t block_size(const heap_block_t* block)
+{
+    return block->size & ~(size_t)BLOCK_FLAGS;
+}
+
+static void block_set_size(heap_block_t* block, size_t size)
+{
+    block->size = size | (block->size & BLOCK_FLAGS);
+}
+
+static void* block_to_ptr(heap_block_t* block)
+{
+    return (unsigned char*)block + BLOCK_HEADER;
+}
+
+static heap_block_t* block_from_ptr(void* ptr)
+{
+    return (heap_block_t*)((unsigned char*)ptr - BLOCK_HEADER);
+}
+
+static heap_block_t* block_next(heap_block_t* block)
+{
+    return (heap_block_t*)((unsigned char*)block_to_ptr(block) + block_size(block));
+}
+
+// Point the next block back at this one and return it
+static heap_block_t* block_link_next(heap_block_t* block)
+{
+    heap_block_t* next = block_next(block);
+    next->prev_phys    = block;
+    return next;
+}
+
+static void block_mark_free(heap_block_t* block)
+{
+    block_link_next(block)->size |= BLOCK_PREV_FREE;
+    block->size |= BLOCK_FREE;
+}
+
+static void block_mark_used(heap_block_t* block)
+{
+    block_next(block)->size &= ~(size_t)BLOCK_PREV_FREE;
+    block->size &= ~(size_t)BLOCK_FREE;
+}
+
+static void mapping_insert(size_t size, int* fl, int* sl)
+{
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / HEAP_SL_COUNT));
+    }
+    else
+    {
+        int bit = fls_size(size);
+        *sl     = (int)(size >> (bit - HEAP_SL_COUNT_LOG2)) ^ HEAP_SL_COUNT;
+        *fl     = bit - (HEAP_FL_SHIFT - 1);
+    }
+}
+
+// Round the request up to the next list so any block found there is large enough
+static void mapping_search(size_t size, int* fl, int* sl)
+{
+    if (size >= SMALL_BLOCK_SIZE)
+    {
+        size += ((size_t)1 << (fls_size(size) - HEAP_SL_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static heap_block_t* search_suitable_block(heap_t* heap, int* fl, int* sl)
+{
+    uint32_t sl_map = heap->sl_bitmap[*fl] & (~0U << *sl);
+
+    if (sl_map == 0)
+    {
+        uint32_t fl_map = (*fl + 1 < HEAP_FL_COUNT) ? heap->fl_bitmap & (~0U << (*fl + 1)) : 0;
+        if (fl_map == 0)
+        {
+            return NULL;
+        }
+
+        *fl    = ffs_bits(fl_map);
+        sl_map = heap->sl_bitmap[*fl];
+    }
+
+    *sl = ffs_bits(sl_map);
+    return heap->blocks[*fl][*sl];
+}
+
+static void remove_free_block(heap_t* heap, heap_block_t* block, int fl, int sl)
+{
+    heap_block_t* prev = block->prev_free;
+    heap_block_t* next = block->next_free;
+
+    if (next)
+    {
+        next->prev_free = prev;
+    }
+    if (prev)
+    {
+        prev->next_free = next;
+    }
+
+    if (heap->blocks[fl][sl] == block)
+    {
+        heap->blocks[fl][sl] = next;
+        if (next == NULL)
+        {
+            heap->sl_bitmap[fl] &= ~(1U << sl);
+            if (heap->sl_bitmap[fl] == 0)
+            {
+                heap->fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+}
+
+static void insert_free_block(heap_t* heap, heap_block_t* block)
+{
+    int fl;
+    int sl;
+
+    mapping_insert(block_size(block), &fl, &sl);
+
+    block->prev_free = NULL;
+    block->next_free = heap->blocks[fl][sl];
+    if (block->next_free)
+    {
+        block->next_free->prev_free = block;
+    }
+
+    heap->blocks[fl][sl] = block;
+    heap->fl_bitmap |= 1U << fl;
+    heap->sl_bitmap[fl] |= 1U << sl;
+}
+
+static void block_remove(heap_t* heap, heap_block_t* block)
+{
+    int fl;
+    int sl;
+
+    mapping_insert(block_size(block), &fl, &sl);
+    remove_free_block(heap, block, fl, sl);
+}
+
+// Split off the tail of a block as a new free block if it is big enough to hold one
+static void block_trim(heap_t* heap, heap_block_t* block, size_t size)
+{
+    size_t total = block_size(block);
+
+    if (total >= size + sizeof(heap_block_t))
+    {
+        heap_block_t* remaining = (heap_block_t*)((unsigned char*)block_to_ptr(block) + size);
+
+        remaining->size = total - size - BLOCK_HEADER;
+        block_set_size(block, size);
+        block_link_next(block);
+        block_mark_free(remaining);
+
+        // Coalesce with a free block behind it, e.g. after shrinking a realloc
+        heap_block_t* next = block_next(remaining);
+        if (next->size & BLOCK_FREE)
+        {
+            block_remove(heap, next);
+            remaining->size += BLOCK_HEADER + block_size(next);
+            block_link_next(remaining);
+        }
+
+        insert_free_block(heap, remaining);
+    }
+}
+
+static size_t adjust_request(size_t size)
+{
+    if (size == 0 || size > BLOCK_SIZE_MAX)
+    {
+        return 0;
+    }
+
+    size = (size + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+    return size < BLOCK_SIZE_MIN ? BLOCK_SIZE_MIN : size;
+}
+
+int heap_init(heap_t* heap, void* memory, size_t size)
+{
+    uintptr_t start = ((uintptr_t)memory + HEAP_ALIGN - 1) & ~(uintptr_t)(HEAP_ALIGN - 1);
+    uintptr_t end   = ((uintptr_t)memory + size) & ~(uintptr_t)(HEAP_ALIGN - 1);
+    heap_block_t* block;
+    heap_block_t* sentinel;
+    size_t pool_size;
+
+    memset(heap, 0, sizeof(heap_t));
+
+    // Room is needed for one free block plus the zero sized sentinel that ends the pool
+    if (end <= start || end - start < sizeof(heap_block_t) + BLOCK_HEADER)
+    {
+        return -1;
+    }
+
+    pool_size = end - start - 2 * BLOCK_HEADER;
+    if (pool_size > BLOCK_SIZE_MAX)
+    {
+        return -1;
+    }
+
+    block            = (heap_block_t*)start;
+    block->prev_phys = NULL;
+    block->size      = pool_size;
+    block_mark_free(block);
+    insert_free_block(heap, block);
+
+    sentinel       = block_next(block);
+    sentinel->size = BLOCK_PREV_FREE;
+
+    heap->first = block;
+    heap->size  = end - start;
+    return 0;
+}
+
+void* heap_alloc(heap_t* heap, size_t size)
+{
+    size_t adjusted = adjust_request(size);
+    heap_block_t* block;
+    int fl;
+    int sl;
+
+    if (adjusted == 0)
+    {
+        if (size)
+        {
+            heap->failures++;
+        }
+        return NULL;
+    }
+
+    mapping_search(adjusted, &fl, &sl);
+    block = fl < HEAP_FL_COUNT ? search_suitable_block(heap, &fl, &sl) : NULL;
+    if (block == NULL)
+    {
+        heap->failures++;
+        return NULL;
+    }
+
+    remove_free_block(heap, block, fl, sl);
+    block_trim(heap, block, adjusted);
+    block_mark_used(block);
+
+    heap->used += block_size(block) + BLOCK_HEADER;
+    if (heap->used > heap->peak)
+    {
+        heap->peak = heap->used;
+    }
+    heap->allocs++;
+
+    return block_to_ptr(block);
+}
+
+void heap_free(heap_t* heap, void* ptr)
+{
+    heap_block_t* block;
+    heap_block_t* next;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    block = block_from_ptr(ptr);
+    heap->used -= block_size(block) + BLOCK_HEADER;
+
+    if (block->size & BLOCK_PREV_FREE)
+    {
+        heap_block_t* prev = block->prev_phys;
+        block_remove(heap, prev);
+        prev->size += BLOCK_HEADER + block_size(block);
+        block = prev;
+    }
+
+    next = block_next(block);
+    if (next->size & BLOCK_FREE)
+    {
+        block_remove(heap, next);
+        block->size += BLOCK_HEADER + block_size(next);
+    }
+
+    block_mark_free(block);
+    insert_free_block(heap, block);
+}
+
+void* heap_resize(heap_t* heap, void* ptr, size_t size)
+{
+    size_t adjusted = adjust_request(size);
+    heap_block_t* block;
+    heap_block_t* next;
+    size_t current;
+
+    if (ptr == NULL || adjusted == 0)
+    {
+        return NULL;
+    }
+
+    block   = block_from_ptr(ptr);
+    current = block_size(block);
+    next    = block_next(block);
+
+    // Grow into the following free block when it is large enough
+    if (adjusted > current && (next->size & BLOCK_FREE) && current + BLOCK_HEADER + block_size(next) >= adjusted)
+    {
+        block_remove(heap, next);
+        block_set_size(block, current + BLOCK_HEADER + block_size(next));
+        block_mark_used(block);
+    }
+
+    if (adjusted > block_size(block))
+    {
+        return NULL;
+    }
+
+    block_trim(heap, block, adjusted);
+    heap->used = heap->used - current + block_size(block);
+    if (heap->used > heap->peak)
+    {
+        heap->peak = heap->used;
+    }
+
+    return ptr;
+}
+
+void* heap_realloc(heap_t* heap, void* ptr, size_t size)
+{
+    void* moved;
+
+    if (ptr == NULL)
+    {
+        return heap_alloc(heap, size);
+    }
+
+    if (size == 0)
+    {
+        heap_free(heap, ptr);
+        return NULL;
+    }
+
+    if (heap_resize(heap, ptr, size))
+    {
+        return ptr;
+    }
+
+    moved = heap_alloc(heap, size);
+    if (moved)
+    {
+        memcpy(moved, ptr, heap_usable_size(ptr));
+        heap_free(heap, ptr);
+    }
+
+    return moved;
+}
+
+size_t heap_usable_size(void* ptr)
+{
+    return ptr ? block_size(block_from_ptr(ptr)) : 0;
+}
+
+void heap_get_stats(heap_t* heap, heap_stats_t* stats)
+{
+    stats->used     = heap->used;
+    stats->peak     = heap->peak;
+    stats->free     = heap->size - BLOCK_HEADER - heap->used;
+    stats->allocs   = heap->allocs;
+    stats->failures = heap->failures;
+    stats->largest  = 0;
+
+    // Only the highest non-empty list can hold the largest block
+    if (heap->fl_bitmap)
+    {
+        int fl = fls_size(heap->fl_bitmap);
+        int sl = fls_size(heap->sl_bitmap[fl]);
+
+        for (heap_block_t* block = heap->blocks[fl][sl]; block; block = block->next_free)
+        {
+            if (block_size(block) > stats->largest)
+            {
+                stats->largest = block_size(block);
+            }
+        }
+    }
+}
+
+int heap_check(heap_t* heap)
+{
+    heap_block_t* prev = NULL;
+    heap_block_t* block;
+    heap_stats_t stats;
+    size_t used      = 0;
+    size_t free      = 0;
+    size_t largest   = 0;
+    size_t free_walk = 0;
+    size_t free_list = 0;
+
+    if (heap->first == NULL)
+    {
+        return -1;
+    }
+
+    // Physical order, the free flags on both sides agree and no two free blocks touch. The link back is only kept
+    // up to date, and only read, when the previous block is free.
+    for (block = heap->first; block_size(block) != 0; prev = block, block = block_next(block))
+    {
+        size_t size  = block_size(block);
+        bool is_free = (block->size & BLOCK_FREE) != 0;
+
+        if (((block->size & BLOCK_PREV_FREE) && block->prev_phys != prev) || size < BLOCK_SIZE_MIN || (size & (HEAP_ALIGN - 1)) ||
+            ((block->size & BLOCK_PREV_FREE) != 0) != (prev != NULL && (prev->size & BLOCK_FREE)) ||
+            (is_free && prev != NULL && (prev->size & BLOCK_FREE)))
+        {
+            return -1;
+        }
+
+        if (is_free)
+        {
+            free += size + BLOCK_HEADER;
+            largest = size > largest ? size : largest;
+            free_walk++;
+        }
+        else
+        {
+            used += size + BLOCK_HEADER;
+        }
+    }
+
+    // The sentinel ends the pool exactly
+    if (((block->size & BLOCK_PREV_FREE) && block->prev_phys != prev) ||
+        (unsigned char*)block + BLOCK_HEADER != (unsigned char*)heap->first + heap->size)
+    {
+        return -1;
+    }
+
+    // Every listed block is free and filed under its size, the bitmaps match the lists
+    for (int fl = 0; fl < HEAP_FL_COUNT; fl++)
+    {
+        if (((heap->fl_bitmap >> fl) & 1) != (heap->sl_bitmap[fl] != 0))
+        {
+            return -1;
+        }
+
+        for (int sl = 0; sl < HEAP_SL_COUNT; sl++)
+        {
+            heap_block_t* listed = heap->blocks[fl][sl];
+
+            if (((heap->sl_bitmap[fl] >> sl) & 1) != (listed != NULL) || (listed && listed->prev_free != NULL))
+            {
+                return -1;
+            }
+
+            for (; listed; listed = listed->next_free)
+            {
+                int block_fl;
+                int block_sl;
+
+                mapping_insert(block_size(listed), &block_fl, &block_sl);
+                if (!(listed->size & BLOCK_FREE) || block_fl != fl || block_sl != sl ||
+                    (listed->next_free && listed->next_free->prev_free != listed))
+                {
+                    return -1;
+                }
+                free_list++;
+            }
+        }
+    }
+
+    heap_get_stats(heap, &stats);
+
+    return free_list == free_walk && used == heap->used && stats.free == free && stats.largest == largest ? 0 : -1;
+}
+
+// Boards that route malloc through a pool override this weak symbol
+__attribute__((weak)) void heap_system_stats(heap_stats_t* stats)
+{
+    memset(stats, 0, sizeof(heap_stats_t));
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Two-level segregated fit allocator (TLSF), allocation and free are O(1) and the pool never grows.
+// The core has no RTOS dependency, callers serialize access to a pool themselves.
+
+#define HEAP_ALIGN_LOG2      3
+#define HEAP_ALIGN           (1 << HEAP_ALIGN_LOG2)
+#define HEAP_SL_COUNT_LOG2   4
+#define HEAP_SL_COUNT        (1 << HEAP_SL_COUNT_LOG2)
+#define HEAP_FL_SHIFT        (HEAP_SL_COUNT_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_FL_MAX          20 // Largest block is just under 1 MB
+#define HEAP_FL_COUNT        (HEAP_FL_MAX - HEAP_FL_SHIFT + 1)
+
+typedef struct heap_block heap_block_t;
+
+typedef struct
+{
+    size_t used;        // Bytes handed out, block overhead included
+    size_t peak;        // Highest value of used
+    size_t free;        // Bytes available, block overhead included
+    size_t largest;     // Largest free block
+    uint32_t allocs;    // Successful allocations
+    uint32_t failures;  // Allocations refused for lack of memory
+} heap_stats_t;
+
+typedef struct
+{
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[HEAP_FL_COUNT];
+    heap_block_t* blocks[HEAP_FL_COUNT][HEAP_SL_COUNT];
+    heap_block_t* first;
+    size_t size;
+    size_t used;
+    size_t peak;
+    uint32_t allocs;
+    uint32_t failures;
+} heap_t;
+
+/**
+ * @brief Initialize a pool over a memory region
+ * @param heap Pool to initialize
+ * @param memory Start of the region
+ * @param size Size of the region in bytes
+ * @return 0 on success, -1 if the region is too small or too large
+ */
+int heap_init(heap_t* heap, void* memory, size_t size);
+
+/**
+ * @brief Allocate memory aligned to HEAP_ALIGN
+ * @return Pointer to the memory, or NULL if the request cannot be satisfied
+ */
+void* heap_alloc(heap_t* heap, size_t size);
+
+/**
+ * @brief Return memory to the pool, NULL is ignored
+ */
+void heap_free(heap_t* heap, void* ptr);
+
+/**
+ * @brief Resize an allocation without moving it
+ * @return ptr if the block now holds size bytes, NULL if it has to move and is left untouched
+ */
+void* heap_resize(heap_t* heap, void* ptr, size_t size);
+
+/**
+ * @brief Resize an allocation in place when possible, the semantics match realloc
+ */
+void* heap_realloc(heap_t* heap, void* ptr, size_t size);
+
+/**
+ * @brief Get the usable size of an allocation
+ */
+size_t heap_usable_size(void* ptr);
+
+/**
+ * @brief Get the pool statistics
+ * @param heap Pool to inspect
+ * @param stats Receives the statistics
+ */
+void heap_get_stats(heap_t* heap, heap_stats_t* stats);
+
+/**
+ * @brief Walk the pool and verify the block links, the free lists and the statistics
+ * @param heap Pool to verify
+ * @return 0 if the pool is consistent, -1 otherwise
+ */
+int heap_check(heap_t* heap);
+
+/**
+ * @brief Get the statistics of the system heap behind malloc, zeroed if it is not in use
+ * @param stats Receives the statistics
+ */
+void heap_system_stats(heap_stats_t* stats);
+
+#endif // _HEAP_H
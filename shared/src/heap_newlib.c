@@ -0,0 +1,149 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifdef __GNUC__
+
+#include <errno.h>
+#include <reent.h>
+#include <string.h>
+
+#include "tx_api.h"
+
+#include "heap.h"
+
+// Replaces the newlib allocator with a TLSF pool spanning the RAM between the end of .bss and _heap_limit,
+// which the linker script places below the main stack. The pool never grows past it, exhaustion returns NULL.
+
+extern int _end;
+extern int _heap_limit;
+
+static heap_t system_heap;
+static int system_heap_ready;
+
+// Called with interrupts disabled, printf may allocate before the kernel starts so initialize on first use
+static heap_t* system_heap_get(void)
+{
+    if (!system_heap_ready)
+    {
+        heap_init(&system_heap, &_end, (size_t)((unsigned char*)&_heap_limit - (unsigned char*)&_end));
+        system_heap_ready = 1;
+    }
+
+    return &system_heap;
+}
+
+void* _malloc_r(struct _reent* reent, size_t size)
+{
+    TX_INTERRUPT_SAVE_AREA
+    void* ptr;
+
+    TX_DISABLE
+    ptr = heap_alloc(system_heap_get(), size);
+    TX_RESTORE
+
+    if (ptr == NULL && size)
+    {
+        reent->_errno = ENOMEM;
+    }
+
+    return ptr;
+}
+
+void _free_r(struct _reent* reent, void* ptr)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    heap_free(system_heap_get(), ptr);
+    TX_RESTORE
+}
+
+void* _realloc_r(struct _reent* reent, void* ptr, size_t size)
+{
+    TX_INTERRUPT_SAVE_AREA
+    void* resized;
+
+    if (ptr == NULL)
+    {
+        return _malloc_r(reent, size);
+    }
+
+    if (size == 0)
+    {
+        _free_r(reent, ptr);
+        return NULL;
+    }
+
+    TX_DISABLE
+    resized = heap_resize(system_heap_get(), ptr, size);
+    TX_RESTORE
+
+    // Copy with interrupts enabled when the block has to move
+    if (resized == NULL && (resized = _malloc_r(reent, size)))
+    {
+        memcpy(resized, ptr, heap_usable_size(ptr));
+        _free_r(reent, ptr);
+    }
+
+    return resized;
+}
+
+void* _calloc_r(struct _reent* reent, size_t count, size_t size)
+{
+    size_t total = count * size;
+    void* ptr;
+
+    if (size && total / size != count)
+    {
+        reent->_errno = ENOMEM;
+        return NULL;
+    }
+
+    if ((ptr = _malloc_r(reent, total)))
+    {
+        memset(ptr, 0, total);
+    }
+
+    return ptr;
+}
+
+size_t _malloc_usable_size_r(struct _reent* reent, void* ptr)
+{
+    return heap_usable_size(ptr);
+}
+
+void* malloc(size_t size)
+{
+    return _malloc_r(_REENT, size);
+}
+
+void free(void* ptr)
+{
+    _free_r(_REENT, ptr);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    return _realloc_r(_REENT, ptr, size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    return _calloc_r(_REENT, count, size);
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+    return heap_usable_size(ptr);
+}
+
+void heap_system_stats(heap_stats_t* stats)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    heap_get_stats(system_heap_get(), stats);
+    TX_RESTORE
+}
+
+#endif
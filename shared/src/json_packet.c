@@ -0,0 +1,265 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "json_packet.h"
+
+#include <string.h>
+
+static json_packet_stats_t json_packet_totals;
+
+static VOID json_packet_append(json_packet_t* writer, const VOID* data, ULONG length)
+{
+    UINT status;
+
+    if (writer->status != NX_SUCCESS || length == 0)
+    {
+        return;
+    }
+
+    // Fills the tail of the last packet, then chains new packets from the pool
+    if ((status = nx_packet_data_append(writer->packet, (VOID*)data, length, writer->pool, writer->wait_option)))
+    {
+        writer->status = status;
+        return;
+    }
+
+    writer->length += length;
+}
+
+static VOID json_packet_name(json_packet_t* writer, const CHAR* name)
+{
+    UINT bit = 1U << writer->depth;
+
+    if (writer->has_member & bit)
+    {
+        json_packet_append(writer, ",", 1);
+    }
+    writer->has_member |= bit;
+
+    if (name != NULL)
+    {
+        json_packet_append(writer, "\"", 1);
+        json_packet_append(writer, name, strlen(name));
+        json_packet_append(writer, "\":", 2);
+    }
+}
+
+// Format an unsigned value right aligned in a local buffer, return the first digit
+static CHAR* json_packet_digits(CHAR* end, ULONG value, UINT min_digits)
+{
+    CHAR* digit = end;
+
+    do
+    {
+        *--digit = (CHAR)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 || (UINT)(end - digit) < min_digits);
+
+    return digit;
+}
+
+// Get the escape for a character of a string value, 0 if it is written as is. Quotes, backslashes and control
+// characters must be escaped, bytes of multibyte UTF-8 sequences pass through.
+static UINT json_packet_escape(UCHAR c, CHAR* escape)
+{
+    static const CHAR hex[] = "0123456789abcdef";
+
+    escape[0] = '\\';
+    switch (c)
+    {
+        case '"':
+        case '\\':
+            escape[1] = (CHAR)c;
+            return 2;
+        case '\b':
+            escape[1] = 'b';
+            return 2;
+        case '\f':
+            escape[1] = 'f';
+            return 2;
+        case '\n':
+            escape[1] = 'n';
+            return 2;
+        case '\r':
+            escape[1] = 'r';
+            return 2;
+        case '\t':
+            escape[1] = 't';
+            return 2;
+        default:
+            break;
+    }
+
+    if (c >= 0x20)
+    {
+        return 0;
+    }
+
+    escape[1] = 'u';
+    escape[2] = '0';
+    escape[3] = '0';
+    escape[4] = hex[c >> 4];
+    escape[5] = hex[c & 0xf];
+    return 6;
+}
+
+VOID json_packet_init(json_packet_t* writer, NX_PACKET* packet, NX_PACKET_POOL* pool, ULONG wait_option)
+{
+    memset(writer, 0, sizeof(*writer));
+
+    writer->packet      = packet;
+    writer->start       = packet->nx_packet_append_ptr;
+    writer->pool        = pool;
+    writer->wait_option = wait_option;
+
+    // The head is already full, the document will start in the next packet
+    if (packet->nx_packet_next != NX_NULL || packet->nx_packet_append_ptr == packet->nx_packet_data_end)
+    {
+        writer->start = NX_NULL;
+    }
+}
+
+VOID json_packet_object_begin(json_packet_t* writer, const CHAR* name)
+{
+    if (writer->depth + 1 >= JSON_PACKET_MAX_DEPTH)
+    {
+        writer->status = NX_OVERFLOW;
+        return;
+    }
+
+    if (writer->depth > 0 || name != NULL)
+    {
+        json_packet_name(writer, name);
+    }
+    json_packet_append(writer, "{", 1);
+
+    writer->depth++;
+    writer->has_member &= ~(1U << writer->depth);
+}
+
+VOID json_packet_object_end(json_packet_t* writer)
+{
+    if (writer->depth == 0)
+    {
+        writer->status = NX_INVALID_PARAMETERS;
+        return;
+    }
+
+    json_packet_append(writer, "}", 1);
+    writer->depth--;
+}
+
+VOID json_packet_string(json_packet_t* writer, const CHAR* name, const CHAR* value)
+{
+    const CHAR* run = value;
+    CHAR escape[6];
+    UINT length;
+
+    json_packet_name(writer, name);
+    json_packet_append(writer, "\"", 1);
+
+    // Append unescaped runs in one go, only the characters JSON reserves are written as an escape
+    while (*value != 0)
+    {
+        if ((length = json_packet_escape((UCHAR)*value, escape)) != 0)
+        {
+            json_packet_append(writer, run, value - run);
+            json_packet_append(writer, escape, length);
+            writer->staged += length;
+            run = value + 1;
+        }
+        value++;
+    }
+    json_packet_append(writer, run, value - run);
+
+    json_packet_append(writer, "\"", 1);
+}
+
+VOID json_packet_string_raw(json_packet_t* writer, const CHAR* name, const CHAR* value, UINT length)
+{
+    json_packet_name(writer, name);
+    json_packet_append(writer, "\"", 1);
+    json_packet_append(writer, value, length);
+    json_packet_append(writer, "\"", 1);
+}
+
+VOID json_packet_bool(json_packet_t* writer, const CHAR* name, bool value)
+{
+    json_packet_name(writer, name);
+    json_packet_append(writer, value ? "true" : "false", value ? 4 : 5);
+}
+
+VOID json_packet_int(json_packet_t* writer, const CHAR* name, INT value)
+{
+    CHAR buffer[12];
+    CHAR* end   = buffer + sizeof(buffer);
+    CHAR* digit = json_packet_digits(end, value < 0 ? 0UL - (ULONG)value : (ULONG)value, 1);
+
+    if (value < 0)
+    {
+        *--digit = '-';
+    }
+
+    json_packet_name(writer, name);
+    json_packet_append(writer, digit, end - digit);
+    writer->staged += end - digit;
+}
+
+VOID json_packet_fixed(json_packet_t* writer, const CHAR* name, INT hundredths)
+{
+    CHAR buffer[14];
+    CHAR* end      = buffer + sizeof(buffer);
+    ULONG absolute = hundredths < 0 ? 0UL - (ULONG)hundredths : (ULONG)hundredths;
+    CHAR* digit;
+
+    digit    = json_packet_digits(end, absolute % 100, 2);
+    *--digit = '.';
+    digit    = json_packet_digits(digit, absolute / 100, 1);
+
+    if (hundredths < 0)
+    {
+        *--digit = '-';
+    }
+
+    json_packet_name(writer, name);
+    json_packet_append(writer, digit, end - digit);
+    writer->staged += end - digit;
+}
+
+UINT json_packet_end(json_packet_t* writer)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (writer->status == NX_SUCCESS && writer->depth != 0)
+    {
+        writer->status = NX_INVALID_PARAMETERS;
+    }
+
+    TX_DISABLE
+    if (writer->status == NX_SUCCESS)
+    {
+        json_packet_totals.documents++;
+        json_packet_totals.bytes += writer->length;
+        json_packet_totals.staged += writer->staged;
+        if (writer->start == NX_NULL || writer->packet->nx_packet_next != NX_NULL)
+        {
+            json_packet_totals.chained++;
+        }
+    }
+    else
+    {
+        json_packet_totals.failures++;
+    }
+    TX_RESTORE
+
+    return writer->status;
+}
+
+VOID json_packet_stats(json_packet_stats_t* stats)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *stats = json_packet_totals;
+    TX_RESTORE
+}
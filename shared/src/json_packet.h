@@ -0,0 +1,100 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _JSON_PACKET_H
+#define _JSON_PACKET_H
+
+#include <stdbool.h>
+
+#include "nx_api.h"
+
+// Streaming JSON writer appending straight into an NX_PACKET chain. The document grows into packets
+// chained from the pool instead of being formatted into a buffer and copied. Errors are sticky, the
+// first one is kept and every later call does nothing, so a document is built without checking each
+// step and the status is read once from json_packet_end.
+
+#define JSON_PACKET_MAX_DEPTH 8
+
+typedef struct
+{
+    NX_PACKET* packet;    // Head of the chain
+    UCHAR* start;         // First byte of the document in the head packet
+    NX_PACKET_POOL* pool; // Chained packets come from here
+    ULONG wait_option;
+    UINT status;          // First error
+    ULONG length;         // Document bytes written so far
+    ULONG staged;         // Bytes formatted in a local buffer before being appended
+    UINT depth;
+    UINT has_member;      // Bit n is set once the object at depth n has a member
+} json_packet_t;
+
+// Totals over every finished document
+typedef struct
+{
+    ULONG documents;
+    ULONG bytes;
+    ULONG staged;
+    ULONG chained; // Documents that spilled into a second packet
+    ULONG failures;
+} json_packet_stats_t;
+
+/**
+ * @brief Start a document at the end of a packet's current data
+ * @param writer Writer to initialize
+ * @param packet Packet the document is appended to, usually holding a protocol header already
+ * @param pool Pool to chain more packets from
+ * @param wait_option ThreadX wait option for packet allocation
+ */
+VOID json_packet_init(json_packet_t* writer, NX_PACKET* packet, NX_PACKET_POOL* pool, ULONG wait_option);
+
+/**
+ * @brief Open an object
+ * @param name Member name, NULL for the root object
+ */
+VOID json_packet_object_begin(json_packet_t* writer, const CHAR* name);
+
+/**
+ * @brief Close the innermost object
+ */
+VOID json_packet_object_end(json_packet_t* writer);
+
+/**
+ * @brief Append a string member, quotes, backslashes and control characters in the value are escaped
+ */
+VOID json_packet_string(json_packet_t* writer, const CHAR* name, const CHAR* value);
+
+/**
+ * @brief Append a string member whose value is already JSON string text, such as the body of a jsmn string token
+ * @param value Escaped text without the quotes, written as is
+ * @param length Length of the text
+ */
+VOID json_packet_string_raw(json_packet_t* writer, const CHAR* name, const CHAR* value, UINT length);
+
+/**
+ * @brief Append a boolean member
+ */
+VOID json_packet_bool(json_packet_t* writer, const CHAR* name, bool value);
+
+/**
+ * @brief Append an integer member
+ */
+VOID json_packet_int(json_packet_t* writer, const CHAR* name, INT value);
+
+/**
+ * @brief Append a number with two decimals, for targets where printf has no floating point
+ * @param hundredths The value multiplied by 100
+ */
+VOID json_packet_fixed(json_packet_t* writer, const CHAR* name, INT hundredths);
+
+/**
+ * @brief Finish the document and add it to the totals
+ * @return NX_SUCCESS, or the first error hit while writing
+ */
+UINT json_packet_end(json_packet_t* writer);
+
+/**
+ * @brief Get the totals over every finished document
+ */
+VOID json_packet_stats(json_packet_stats_t* stats);
+
+#endif // _JSON_PACKET_H
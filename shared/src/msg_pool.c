@@ -0,0 +1,130 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "msg_pool.h"
+
+#include <stdio.h>
+
+// Each block carries a pointer back to its pool
+#define MSG_POOL_AREA(size, count) ((count) * ((size) + sizeof(VOID*)) / sizeof(ULONG))
+
+static ULONG msg_pool_small_area[MSG_POOL_AREA(MSG_POOL_SMALL_SIZE, MSG_POOL_SMALL_COUNT) + 1];
+static ULONG msg_pool_medium_area[MSG_POOL_AREA(MSG_POOL_MEDIUM_SIZE, MSG_POOL_MEDIUM_COUNT) + 1];
+static ULONG msg_pool_large_area[MSG_POOL_AREA(MSG_POOL_LARGE_SIZE, MSG_POOL_LARGE_COUNT) + 1];
+static ULONG msg_pool_session_area[MSG_POOL_AREA(MSG_POOL_SESSION_SIZE, MSG_POOL_SESSION_COUNT) + 1];
+
+typedef struct
+{
+    const CHAR* name;
+    ULONG* area;
+    ULONG area_size;
+    ULONG block_size;
+    ULONG block_count;
+    TX_BLOCK_POOL pool;
+    msg_pool_stats_t stats;
+} msg_pool_t;
+
+static msg_pool_t msg_pools[MSG_POOL_CLASS_COUNT] = {
+    {"Message Small", msg_pool_small_area, sizeof(msg_pool_small_area), MSG_POOL_SMALL_SIZE, MSG_POOL_SMALL_COUNT},
+    {"Message Medium", msg_pool_medium_area, sizeof(msg_pool_medium_area), MSG_POOL_MEDIUM_SIZE, MSG_POOL_MEDIUM_COUNT},
+    {"Message Large", msg_pool_large_area, sizeof(msg_pool_large_area), MSG_POOL_LARGE_SIZE, MSG_POOL_LARGE_COUNT},
+    {"Message Session",
+        msg_pool_session_area,
+        sizeof(msg_pool_session_area),
+        MSG_POOL_SESSION_SIZE,
+        MSG_POOL_SESSION_COUNT}};
+
+static UINT msg_pool_ready;
+
+UINT msg_pool_init(void)
+{
+    UINT status = TX_SUCCESS;
+
+    if (msg_pool_ready)
+    {
+        return TX_SUCCESS;
+    }
+
+    for (UINT i = 0; i < MSG_POOL_CLASS_COUNT; i++)
+    {
+        msg_pool_t* entry = &msg_pools[i];
+
+        entry->stats.block_size  = entry->block_size;
+        entry->stats.block_count = entry->block_count;
+
+        if (entry->block_count == 0)
+        {
+            continue;
+        }
+
+        if ((status = tx_block_pool_create(
+                 &entry->pool, (CHAR*)entry->name, entry->block_size, entry->area, entry->area_size)))
+        {
+            printf("ERROR: Failed to create block pool '%s' (0x%08x)\r\n", entry->name, status);
+            return status;
+        }
+    }
+
+    msg_pool_ready = 1;
+
+    return status;
+}
+
+VOID* msg_pool_acquire(msg_pool_class_t pool_class, ULONG wait_option)
+{
+    TX_INTERRUPT_SAVE_AREA
+    msg_pool_t* entry = &msg_pools[pool_class];
+    VOID* buffer      = NULL;
+
+    if (!msg_pool_ready || entry->block_count == 0 || tx_block_allocate(&entry->pool, &buffer, wait_option))
+    {
+        buffer = NULL;
+    }
+
+    TX_DISABLE
+    if (buffer)
+    {
+        entry->stats.acquired++;
+        if (++entry->stats.in_use > entry->stats.peak)
+        {
+            entry->stats.peak = entry->stats.in_use;
+        }
+    }
+    else
+    {
+        entry->stats.failures++;
+    }
+    TX_RESTORE
+
+    return buffer;
+}
+
+VOID msg_pool_release(msg_pool_class_t pool_class, VOID* buffer)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    tx_block_release(buffer);
+
+    TX_DISABLE
+    msg_pools[pool_class].stats.in_use--;
+    TX_RESTORE
+}
+
+ULONG msg_pool_size(msg_pool_class_t pool_class)
+{
+    return msg_pools[pool_class].block_size;
+}
+
+VOID msg_pool_stats(msg_pool_class_t pool_class, msg_pool_stats_t* stats)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *stats = msg_pools[pool_class].stats;
+    TX_RESTORE
+}
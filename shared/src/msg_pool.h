@@ -0,0 +1,135 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _MSG_POOL_H
+#define _MSG_POOL_H
+
+#include "tx_api.h"
+
+// Shared fixed size buffers for messages, one ThreadX block pool per message class.
+// Only the small class is on by default, boards whose apps take medium, large or session buffers opt in with a count.
+
+#ifndef MSG_POOL_SMALL_SIZE
+#define MSG_POOL_SMALL_SIZE 256 // Outgoing telemetry and property documents
+#endif
+#ifndef MSG_POOL_SMALL_COUNT
+#define MSG_POOL_SMALL_COUNT 4
+#endif
+
+#ifndef MSG_POOL_MEDIUM_SIZE
+#define MSG_POOL_MEDIUM_SIZE 1536 // Received MQTT payloads and health reports
+#endif
+#ifndef MSG_POOL_MEDIUM_COUNT
+#define MSG_POOL_MEDIUM_COUNT 0
+#endif
+
+#ifndef MSG_POOL_LARGE_SIZE
+#define MSG_POOL_LARGE_SIZE 4096 // TLS record buffer, held for the life of a connection
+#endif
+#ifndef MSG_POOL_LARGE_COUNT
+#define MSG_POOL_LARGE_COUNT 0
+#endif
+
+#ifndef MSG_POOL_SESSION_SIZE
+#define MSG_POOL_SESSION_SIZE (15 * 1024) // AZURE_IOT_MQTT connection session, held from connect until delete
+#endif
+#ifndef MSG_POOL_SESSION_COUNT
+#define MSG_POOL_SESSION_COUNT 0
+#endif
+
+typedef enum
+{
+    MSG_POOL_SMALL,
+    MSG_POOL_MEDIUM,
+    MSG_POOL_LARGE,
+    MSG_POOL_SESSION,
+    MSG_POOL_CLASS_COUNT
+} msg_pool_class_t;
+
+// Usage counters of one class
+typedef struct
+{
+    ULONG block_size;
+    ULONG block_count;
+    ULONG in_use;   // Acquired and not yet released, non-zero when idle means a leak
+    ULONG peak;     // Highest value of in_use
+    ULONG acquired;
+    ULONG failures; // Acquires that timed out or hit a disabled class
+} msg_pool_stats_t;
+
+/**
+ * @brief Create the block pools, safe to call more than once
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT msg_pool_init(void);
+
+/**
+ * @brief Take a buffer of the given class
+ * @param pool_class Message class
+ * @param wait_option ThreadX wait option
+ * @return Buffer of msg_pool_size(pool_class) bytes, or NULL
+ */
+VOID* msg_pool_acquire(msg_pool_class_t pool_class, ULONG wait_option);
+
+/**
+ * @brief Return a buffer to the class it was taken from, NULL is ignored
+ */
+VOID msg_pool_release(msg_pool_class_t pool_class, VOID* buffer);
+
+/**
+ * @brief Get the block size of a class
+ */
+ULONG msg_pool_size(msg_pool_class_t pool_class);
+
+/**
+ * @brief Get the usage counters of a class
+ */
+VOID msg_pool_stats(msg_pool_class_t pool_class, msg_pool_stats_t* stats);
+
+// Typed helpers, the class travels with the type so acquire and release cannot be mismatched
+typedef struct
+{
+    CHAR data[MSG_POOL_SMALL_SIZE];
+} msg_small_t;
+
+typedef struct
+{
+    CHAR data[MSG_POOL_MEDIUM_SIZE];
+} msg_medium_t;
+
+typedef struct
+{
+    UCHAR data[MSG_POOL_LARGE_SIZE];
+} msg_large_t;
+
+static inline msg_small_t* msg_small_acquire(ULONG wait_option)
+{
+    return (msg_small_t*)msg_pool_acquire(MSG_POOL_SMALL, wait_option);
+}
+
+static inline VOID msg_small_release(msg_small_t* buffer)
+{
+    msg_pool_release(MSG_POOL_SMALL, buffer);
+}
+
+static inline msg_medium_t* msg_medium_acquire(ULONG wait_option)
+{
+    return (msg_medium_t*)msg_pool_acquire(MSG_POOL_MEDIUM, wait_option);
+}
+
+static inline VOID msg_medium_release(msg_medium_t* buffer)
+{
+    msg_pool_release(MSG_POOL_MEDIUM, buffer);
+}
+
+static inline msg_large_t* msg_large_acquire(ULONG wait_option)
+{
+    return (msg_large_t*)msg_pool_acquire(MSG_POOL_LARGE, wait_option);
+}
+
+static inline VOID msg_large_release(msg_large_t* buffer)
+{
+    msg_pool_release(MSG_POOL_LARGE, buffer);
+}
+
+#endif // _MSG_POOL_H
@@ -13,6 +13,9 @@
 extern int errno;
 extern int _end;
 
+// Upper bound of the heap, provided by linker scripts that reserve the main stack above it
+extern int _heap_limit __attribute__((weak));
+
 void* _sbrk(int incr)
 {
     static unsigned char* heap = NULL;
@@ -24,6 +27,12 @@ void* _sbrk(int incr)
     }
     prev_heap = heap;
 
+    if (&_heap_limit != NULL && incr > (unsigned char*)&_heap_limit - heap)
+    {
+        errno = ENOMEM;
+        return (void*)-1;
+    }
+
     heap += incr;
 
     return prev_heap;
@@ -0,0 +1,215 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "profiler.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tx_api.h"
+
+#if defined(__arm__)
+#define PROF_DEMCR           (*(volatile uint32_t*)0xE000EDFC)
+#define PROF_DEMCR_TRCENA    (1UL << 24)
+#define PROF_DWT_CTRL        (*(volatile uint32_t*)0xE0001000)
+#define PROF_DWT_CTRL_CYCCNT (1UL << 0)
+
+extern uint32_t SystemCoreClock;
+#endif
+
+static const char* const prof_names[PROF_COUNT] = {
+    [PROF_PUBLISH_CYCLE]      = "publish_cycle",
+    [PROF_JSON_BUILD]         = "json_build",
+    [PROF_MQTT_PUBLISH]       = "mqtt_publish",
+    [PROF_CONSOLE_WRITE]      = "console_write",
+    [PROF_SENSOR_HTS221]      = "hts221_read",
+    [PROF_SENSOR_LPS22HB]     = "lps22hb_read",
+    [PROF_SENSOR_LSM6DSL]     = "lsm6dsl_read",
+    [PROF_SENSOR_LIS2MDL]     = "lis2mdl_read",
+    [PROF_SCREEN_UPDATE]      = "ssd1306_update",
+    [PROF_HUB_TELEMETRY_JSON] = "hub_telemetry_json",
+    [PROF_HUB_TELEMETRY_SEND] = "hub_telemetry_send",
+    [PROF_HUB_PROPERTY_SEND]  = "hub_property_send",
+};
+
+static prof_probe_t prof_probes[PROF_COUNT];
+
+static int prof_bucket(uint32_t cycles)
+{
+    return cycles ? 31 - __builtin_clz(cycles) : 0;
+}
+
+static uint32_t prof_to_us(uint64_t cycles)
+{
+    return (uint32_t)((cycles * 1000000) / prof_cycles_per_second());
+}
+
+void prof_init(void)
+{
+#if defined(__arm__)
+    // Also started by the system monitor, enabling twice is harmless
+    PROF_DEMCR |= PROF_DEMCR_TRCENA;
+    PROF_DWT_CTRL |= PROF_DWT_CTRL_CYCCNT;
+#endif
+
+    prof_reset();
+}
+
+void prof_reset(void)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    memset(prof_probes, 0, sizeof(prof_probes));
+    TX_RESTORE
+}
+
+void prof_record(prof_id_t id, uint32_t cycles)
+{
+    TX_INTERRUPT_SAVE_AREA
+    prof_probe_t* probe = &prof_probes[id];
+    int bucket          = prof_bucket(cycles);
+
+    TX_DISABLE
+    if (probe->count == 0 || cycles < probe->min)
+    {
+        probe->min = cycles;
+    }
+    if (cycles > probe->max)
+    {
+        probe->max = cycles;
+    }
+    probe->count++;
+    probe->total += cycles;
+    if (probe->histogram[bucket] != UINT16_MAX)
+    {
+        probe->histogram[bucket]++;
+    }
+    TX_RESTORE
+
+    prof_sample(id, cycles);
+}
+
+__attribute__((weak)) void prof_sample(prof_id_t id, uint32_t cycles)
+{
+}
+
+void prof_get(prof_id_t id, prof_probe_t* probe)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *probe = prof_probes[id];
+    TX_RESTORE
+}
+
+const char* prof_name(prof_id_t id)
+{
+    return id < PROF_COUNT ? prof_names[id] : "unknown";
+}
+
+uint32_t prof_cycles_per_second(void)
+{
+#if defined(__arm__)
+    return SystemCoreClock;
+#else
+    return 1000000000;
+#endif
+}
+
+void prof_print(void)
+{
+    printf("\r\n%-20s %8s %9s %9s %9s  %s\r\n", "Probe", "Count", "Min us", "Mean us", "Max us", "log2(cycles):count");
+
+    for (UINT i = 0; i < PROF_COUNT; i++)
+    {
+        prof_probe_t probe;
+
+        prof_get((prof_id_t)i, &probe);
+        if (probe.count == 0)
+        {
+            continue;
+        }
+
+        printf("%-20s %8lu %9lu %9lu %9lu ",
+            prof_names[i],
+            (unsigned long)probe.count,
+            (unsigned long)prof_to_us(probe.min),
+            (unsigned long)prof_to_us(probe.total / probe.count),
+            (unsigned long)prof_to_us(probe.max));
+
+        for (UINT bucket = 0; bucket < PROF_HISTOGRAM_BUCKETS; bucket++)
+        {
+            if (probe.histogram[bucket])
+            {
+                printf(" %u:%u", bucket, (UINT)probe.histogram[bucket]);
+            }
+        }
+        printf("\r\n");
+    }
+}
+
+unsigned int prof_format_json(char* buffer, size_t size)
+{
+    size_t length;
+    int written;
+    bool first = true;
+
+    // Compact keys: hz=counter rate, n=name, c=count, lo/avg/hi=cycles, h=histogram as {"log2 cycles":count}
+    written = snprintf(buffer, size, "{\"hz\":%lu,\"probes\":[", (unsigned long)prof_cycles_per_second());
+    length  = written > 0 ? (size_t)written : size;
+
+    for (UINT i = 0; i < PROF_COUNT && length < size; i++)
+    {
+        prof_probe_t probe;
+        bool first_bucket = true;
+
+        prof_get((prof_id_t)i, &probe);
+        if (probe.count == 0)
+        {
+            continue;
+        }
+
+        written = snprintf(buffer + length,
+            size - length,
+            "%s{\"n\":\"%s\",\"c\":%lu,\"lo\":%lu,\"avg\":%lu,\"hi\":%lu,\"h\":{",
+            first ? "" : ",",
+            prof_names[i],
+            (unsigned long)probe.count,
+            (unsigned long)probe.min,
+            (unsigned long)(probe.total / probe.count),
+            (unsigned long)probe.max);
+        length += written > 0 ? (size_t)written : size;
+        first = false;
+
+        for (UINT bucket = 0; bucket < PROF_HISTOGRAM_BUCKETS && length < size; bucket++)
+        {
+            if (probe.histogram[bucket])
+            {
+                written = snprintf(buffer + length,
+                    size - length,
+                    "%s\"%u\":%u",
+                    first_bucket ? "" : ",",
+                    bucket,
+                    (UINT)probe.histogram[bucket]);
+                length += written > 0 ? (size_t)written : size;
+                first_bucket = false;
+            }
+        }
+
+        if (length < size)
+        {
+            written = snprintf(buffer + length, size - length, "}}");
+            length += written > 0 ? (size_t)written : size;
+        }
+    }
+
+    if (length < size)
+    {
+        written = snprintf(buffer + length, size - length, "]}");
+        length += written > 0 ? (size_t)written : size;
+    }
+
+    return length < size ? (unsigned int)length : 0;
+}
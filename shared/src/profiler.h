@@ -0,0 +1,117 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(__arm__)
+#include <time.h>
+#endif
+
+// Named probes timing hot paths with the DWT cycle counter on target and CLOCK_MONOTONIC (ns) on the host.
+// Probes compile to nothing unless PROFILER_ENABLE is defined. PROF_BEGIN and PROF_END must be used in the
+// same scope, the start time lives in a local so a probe can be hit by several threads at once.
+
+#define PROF_HISTOGRAM_BUCKETS 32
+
+// Probe ids, keep in step with prof_names in profiler.c
+typedef enum
+{
+    PROF_PUBLISH_CYCLE,      // One pass of a telemetry loop
+    PROF_JSON_BUILD,         // Formatting a telemetry payload
+    PROF_MQTT_PUBLISH,       // nxd_mqtt_client_publish of a telemetry message
+    PROF_CONSOLE_WRITE,      // printf output reaching the UART
+    PROF_SENSOR_HTS221,      // Sensor driver reads
+    PROF_SENSOR_LPS22HB,
+    PROF_SENSOR_LSM6DSL,
+    PROF_SENSOR_LIS2MDL,
+    PROF_SCREEN_UPDATE,      // ssd1306 frame buffer transfer
+    PROF_HUB_TELEMETRY_JSON, // Azure IoT Hub telemetry payload build
+    PROF_HUB_TELEMETRY_SEND, // Azure IoT Hub telemetry send
+    PROF_HUB_PROPERTY_SEND,  // Azure IoT Hub reported property round trip
+    PROF_COUNT
+} prof_id_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint16_t histogram[PROF_HISTOGRAM_BUCKETS]; // Bucket n counts samples of [2^n, 2^(n+1)) cycles, saturating
+} prof_probe_t;
+
+#ifdef PROFILER_ENABLE
+#define PROF_BEGIN(id) uint32_t prof_start_##id = prof_cycles()
+#define PROF_END(id)   prof_record((id), prof_cycles() - prof_start_##id)
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+static inline uint32_t prof_cycles(void)
+{
+#if defined(__arm__)
+    return *(volatile uint32_t*)0xE0001004; // DWT->CYCCNT
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000000U + (uint32_t)now.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Start the cycle counter and clear all probes
+ */
+void prof_init(void);
+
+/**
+ * @brief Clear all probes
+ */
+void prof_reset(void);
+
+/**
+ * @brief Add one sample to a probe, normally called through PROF_END
+ * @param id Probe to update
+ * @param cycles Duration of the sample
+ */
+void prof_record(prof_id_t id, uint32_t cycles);
+
+// Raw sample hook, called by prof_record outside the lock. The host build overrides this weak symbol to keep
+// every sample for percentiles.
+void prof_sample(prof_id_t id, uint32_t cycles);
+
+/**
+ * @brief Get a copy of a probe
+ * @param id Probe to read
+ * @param probe Receives the probe
+ */
+void prof_get(prof_id_t id, prof_probe_t* probe);
+
+/**
+ * @brief Get the name of a probe
+ */
+const char* prof_name(prof_id_t id);
+
+/**
+ * @brief Get the rate of the cycle counter
+ */
+uint32_t prof_cycles_per_second(void);
+
+/**
+ * @brief Print every probe that has samples to the console
+ */
+void prof_print(void);
+
+/**
+ * @brief Format every probe that has samples as compact JSON
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ * @return Length written, or 0 if the buffer is too small
+ */
+unsigned int prof_format_json(char* buffer, size_t size);
+
+#endif // _PROFILER_H
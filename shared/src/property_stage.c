@@ -0,0 +1,164 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "property_stage.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static VOID property_stage_timer_entry(ULONG context)
+{
+    property_stage_t* stage = (property_stage_t*)context;
+    tx_event_flags_set(stage->events, stage->flush_event, TX_OR);
+}
+
+static bool property_writable(AZURE_IOT_PROPERTY_TYPE type)
+{
+    return type == AZURE_IOT_PROPERTY_WRITABLE_INT || type == AZURE_IOT_PROPERTY_WRITABLE_BOOL;
+}
+
+static bool property_boolean(AZURE_IOT_PROPERTY_TYPE type)
+{
+    return type == AZURE_IOT_PROPERTY_BOOL || type == AZURE_IOT_PROPERTY_WRITABLE_BOOL;
+}
+
+static bool same_component(CHAR* a, CHAR* b)
+{
+    return a == b || (a != NX_NULL && b != NX_NULL && strcmp(a, b) == 0);
+}
+
+static AZURE_IOT_PROPERTY* property_find(property_stage_t* stage, const AZURE_IOT_PROPERTY* property)
+{
+    for (UINT i = 0; i < stage->count; i++)
+    {
+        AZURE_IOT_PROPERTY* staged = &stage->properties[i];
+        if (same_component(staged->component_name, property->component_name) &&
+            strcmp(staged->property_name, property->property_name) == 0)
+        {
+            return staged;
+        }
+    }
+
+    return NX_NULL;
+}
+
+// Start the flush delay unless it is already running. An expired one-shot timer has no ticks left, so reload it.
+static VOID property_stage_arm(property_stage_t* stage)
+{
+    UINT active = TX_FALSE;
+    UINT status;
+
+    if (stage->count == 0 || tx_timer_info_get(&stage->timer, TX_NULL, &active, TX_NULL, TX_NULL, TX_NULL) ||
+        active)
+    {
+        return;
+    }
+
+    if ((status = tx_timer_change(&stage->timer, stage->flush_ticks, 0)) ||
+        (status = tx_timer_activate(&stage->timer)))
+    {
+        printf("ERROR: property stage timer (0x%08x)\r\n", status);
+    }
+}
+
+UINT property_stage_create(property_stage_t* stage,
+    TX_EVENT_FLAGS_GROUP* events,
+    ULONG flush_event,
+    ULONG flush_ticks,
+    property_stage_flush_t flush,
+    VOID* context)
+{
+    memset(stage, 0, sizeof(property_stage_t));
+
+    stage->events      = events;
+    stage->flush_event = flush_event;
+    stage->flush_ticks = flush_ticks;
+    stage->flush       = flush;
+    stage->context     = context;
+
+    return tx_timer_create(
+        &stage->timer, "property_stage", property_stage_timer_entry, (ULONG)stage, flush_ticks, 0, TX_NO_ACTIVATE);
+}
+
+UINT property_stage_delete(property_stage_t* stage)
+{
+    return tx_timer_delete(&stage->timer);
+}
+
+UINT property_stage_put(property_stage_t* stage, const AZURE_IOT_PROPERTY* property)
+{
+    AZURE_IOT_PROPERTY* staged = property_find(stage, property);
+
+    // A plain report, or the acknowledgement of an older version, must not hide a pending acknowledgement. The new
+    // value goes out with the pending acknowledgement when both are the same kind, otherwise that is sent first.
+    if (staged != NX_NULL && property_writable(staged->type) &&
+        (!property_writable(property->type) || staged->version > property->version))
+    {
+        if (property_boolean(staged->type) == property_boolean(property->type))
+        {
+            staged->value = property->value;
+            property_stage_arm(stage);
+            return NX_SUCCESS;
+        }
+
+        property_stage_flush(stage);
+
+        if ((staged = property_find(stage, property)) != NX_NULL)
+        {
+            printf("ERROR: %s is waiting for its acknowledgement, dropping the report\r\n", property->property_name);
+            return NX_NOT_SUCCESSFUL;
+        }
+    }
+
+    if (staged == NX_NULL)
+    {
+        if (stage->count == PROPERTY_STAGE_SIZE && property_stage_flush(stage) != NX_SUCCESS)
+        {
+            // Full, and the flush could not make room
+            printf("ERROR: reported property stage full, dropping %s\r\n", property->property_name);
+            return NX_NO_MEMORY;
+        }
+
+        staged = &stage->properties[stage->count++];
+    }
+
+    *staged = *property;
+
+    if (stage->count == PROPERTY_STAGE_SIZE)
+    {
+        property_stage_flush(stage);
+    }
+    else
+    {
+        property_stage_arm(stage);
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT property_stage_flush(property_stage_t* stage)
+{
+    UINT status;
+
+    tx_timer_deactivate(&stage->timer);
+
+    if (stage->count == 0)
+    {
+        return NX_SUCCESS;
+    }
+
+    if ((status = stage->flush(stage->properties, stage->count, stage->context)) == NX_SUCCESS)
+    {
+        stage->count = 0;
+    }
+
+    // No new report may come along to re-arm the timer, so a failed flush schedules its own retry
+    else if (status != NX_NOT_CONNECTED)
+    {
+        stage->retries++;
+        property_stage_arm(stage);
+    }
+
+    return status;
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _PROPERTY_STAGE_H
+#define _PROPERTY_STAGE_H
+
+#include "nx_api.h"
+
+// Reported properties waiting to go out together. The stage keeps the latest value of each property and asks its
+// owner for a flush through an event flag, a short while after a change or again after a flush that failed.
+// Only the owning thread may put and flush.
+
+#define PROPERTY_STAGE_SIZE 8
+
+typedef enum
+{
+    AZURE_IOT_PROPERTY_BOOL,
+    AZURE_IOT_PROPERTY_INT,
+    AZURE_IOT_PROPERTY_WRITABLE_INT, // Response to a writable property, with status and version
+    AZURE_IOT_PROPERTY_WRITABLE_BOOL
+} AZURE_IOT_PROPERTY_TYPE;
+
+// A reported property waiting for the next flush, names are not copied and must outlive the flush
+typedef struct AZURE_IOT_PROPERTY_STRUCT
+{
+    CHAR* component_name; // NULL for the default component
+    CHAR* property_name;
+    AZURE_IOT_PROPERTY_TYPE type;
+    INT value;
+    INT http_status;
+    INT version;
+} AZURE_IOT_PROPERTY;
+
+/**
+ * @brief Send the staged properties
+ * @param properties Staged properties, in the order they were first staged
+ * @param count Number of properties
+ * @param context Stage context
+ * @return NX_SUCCESS to clear the stage. NX_NOT_CONNECTED keeps it until the owner flushes again, any other error
+ *         keeps it and retries after the flush delay.
+ */
+typedef UINT (*property_stage_flush_t)(AZURE_IOT_PROPERTY* properties, UINT count, VOID* context);
+
+typedef struct
+{
+    AZURE_IOT_PROPERTY properties[PROPERTY_STAGE_SIZE];
+    UINT count;
+
+    TX_TIMER timer; // One-shot, sets flush_event on expiry
+    TX_EVENT_FLAGS_GROUP* events;
+    ULONG flush_event;
+    ULONG flush_ticks;
+
+    property_stage_flush_t flush;
+    VOID* context;
+
+    ULONG retries; // Failed flushes that were scheduled again
+} property_stage_t;
+
+/**
+ * @brief Create an empty stage
+ * @param events Event flags of the owning thread
+ * @param flush_event Flag set when the owner should call property_stage_flush
+ * @param flush_ticks Delay from a change, or a failed flush, to the flush event
+ * @return TX_SUCCESS on success, error code otherwise
+ */
+UINT property_stage_create(property_stage_t* stage,
+    TX_EVENT_FLAGS_GROUP* events,
+    ULONG flush_event,
+    ULONG flush_ticks,
+    property_stage_flush_t flush,
+    VOID* context);
+
+UINT property_stage_delete(property_stage_t* stage);
+
+/**
+ * @brief Stage a property, replacing a pending value of the same property. Filling the stage flushes straight away.
+ * @return NX_SUCCESS, NX_NO_MEMORY when the stage is full and could not be flushed, NX_NOT_SUCCESSFUL when the
+ *         report would hide a pending acknowledgement that could not be sent first
+ */
+UINT property_stage_put(property_stage_t* stage, const AZURE_IOT_PROPERTY* property);
+
+/**
+ * @brief Send the staged properties now, on failure they are kept
+ * @return Status of the flush callback, NX_SUCCESS when the stage was empty
+ */
+UINT property_stage_flush(property_stage_t* stage);
+
+#endif // _PROPERTY_STAGE_H